@@ -182,6 +182,12 @@ typedef unsigned char   u_char;
 #define KRB5_CONF_ADMIN_SERVER                 "admin_server"
 #define KRB5_CONF_ALLOW_WEAK_CRYPTO            "allow_weak_crypto"
 #define KRB5_CONF_AP_REQ_CHECKSUM_TYPE         "ap_req_checksum_type"
+#define KRB5_CONF_ASYNC                        "async"
+#define KRB5_CONF_ASYNC_BUFFER_SIZE            "async_buffer_size"
+#define KRB5_CONF_ASYNC_OVERFLOW               "async_overflow"
+#define KRB5_CONF_AUDIT_BINARY_BUFFER_SIZE     "audit_binary_buffer_size"
+#define KRB5_CONF_AUDIT_BINARY_FLUSH_INTERVAL  "audit_binary_flush_interval"
+#define KRB5_CONF_AUDIT_BINARY_OUTPUT          "audit_binary_output"
 #define KRB5_CONF_AUTH_TO_LOCAL                "auth_to_local"
 #define KRB5_CONF_AUTH_TO_LOCAL_NAMES          "auth_to_local_names"
 #define KRB5_CONF_CANONICALIZE                 "canonicalize"
@@ -218,6 +224,7 @@ typedef unsigned char   u_char;
 #define KRB5_CONF_HOST_BASED_SERVICES          "host_based_services"
 #define KRB5_CONF_HTTP_ANCHORS                 "http_anchors"
 #define KRB5_CONF_IGNORE_ACCEPTOR_HOSTNAME     "ignore_acceptor_hostname"
+#define KRB5_CONF_IPROP_COMMIT_DELAY           "iprop_commit_delay"
 #define KRB5_CONF_IPROP_ENABLE                 "iprop_enable"
 #define KRB5_CONF_IPROP_LISTEN                 "iprop_listen"
 #define KRB5_CONF_IPROP_LOGFILE                "iprop_logfile"
@@ -225,28 +232,39 @@ typedef unsigned char   u_char;
 #define KRB5_CONF_IPROP_PORT                   "iprop_port"
 #define KRB5_CONF_IPROP_RESYNC_TIMEOUT         "iprop_resync_timeout"
 #define KRB5_CONF_IPROP_SLAVE_POLL             "iprop_slave_poll"
+#define KRB5_CONF_IPROP_SLAVE_WAIT             "iprop_slave_wait"
 #define KRB5_CONF_K5LOGIN_AUTHORITATIVE        "k5login_authoritative"
 #define KRB5_CONF_K5LOGIN_DIRECTORY            "k5login_directory"
 #define KRB5_CONF_KADMIND_LISTEN               "kadmind_listen"
 #define KRB5_CONF_KADMIND_PORT                 "kadmind_port"
+#define KRB5_CONF_KADMIND_THREADS              "kadmind_threads"
 #define KRB5_CONF_KCM_MACH_SERVICE             "kcm_mach_service"
 #define KRB5_CONF_KCM_SOCKET                   "kcm_socket"
 #define KRB5_CONF_KDC                          "kdc"
 #define KRB5_CONF_KDCDEFAULTS                  "kdcdefaults"
 #define KRB5_CONF_KDC_DEFAULT_OPTIONS          "kdc_default_options"
+#define KRB5_CONF_KDC_HEALTH_FILE              "kdc_health_file"
 #define KRB5_CONF_KDC_LISTEN                   "kdc_listen"
+#define KRB5_CONF_KDC_LOOKASIDE_SIZE           "kdc_lookaside_size"
 #define KRB5_CONF_KDC_MAX_DGRAM_REPLY_SIZE     "kdc_max_dgram_reply_size"
+#define KRB5_CONF_KDC_METRICS_FILE             "kdc_metrics_file"
 #define KRB5_CONF_KDC_PORTS                    "kdc_ports"
+#define KRB5_CONF_KDC_RACE_COUNT               "kdc_race_count"
 #define KRB5_CONF_KDC_REQ_CHECKSUM_TYPE        "kdc_req_checksum_type"
+#define KRB5_CONF_KDC_REUSEPORT                "kdc_reuseport"
+#define KRB5_CONF_KDC_SHARED_LOOKASIDE         "kdc_shared_lookaside"
 #define KRB5_CONF_KDC_TCP_PORTS                "kdc_tcp_ports"
 #define KRB5_CONF_KDC_TCP_LISTEN               "kdc_tcp_listen"
 #define KRB5_CONF_KDC_TCP_LISTEN_BACKLOG       "kdc_tcp_listen_backlog"
 #define KRB5_CONF_KDC_TIMESYNC                 "kdc_timesync"
+#define KRB5_CONF_KEEP_OPEN                    "keep_open"
+#define KRB5_CONF_KEY_CACHE_SIZE               "key_cache_size"
 #define KRB5_CONF_KEY_STASH_FILE               "key_stash_file"
 #define KRB5_CONF_KPASSWD_LISTEN               "kpasswd_listen"
 #define KRB5_CONF_KPASSWD_PORT                 "kpasswd_port"
 #define KRB5_CONF_KPASSWD_SERVER               "kpasswd_server"
 #define KRB5_CONF_KRB524_SERVER                "krb524_server"
+#define KRB5_CONF_LAST_SUCCESS_INTERVAL        "last_success_interval"
 #define KRB5_CONF_LDAP_CONNS_PER_SERVER        "ldap_conns_per_server"
 #define KRB5_CONF_LDAP_KADMIND_DN              "ldap_kadmind_dn"
 #define KRB5_CONF_LDAP_KADMIND_SASL_AUTHCID    "ldap_kadmind_sasl_authcid"
@@ -275,7 +293,11 @@ typedef unsigned char   u_char;
 #define KRB5_CONF_PLUGINS                      "plugins"
 #define KRB5_CONF_PLUGIN_BASE_DIR              "plugin_base_dir"
 #define KRB5_CONF_PREFERRED_PREAUTH_TYPES      "preferred_preauth_types"
+#define KRB5_CONF_PRINCIPAL_CACHE_NEGATIVE     "principal_cache_negative"
+#define KRB5_CONF_PRINCIPAL_CACHE_SIZE         "principal_cache_size"
+#define KRB5_CONF_PRINCIPAL_CACHE_TTL          "principal_cache_ttl"
 #define KRB5_CONF_PROXIABLE                    "proxiable"
+#define KRB5_CONF_RCACHE_MMAP_ENTRIES          "rcache_mmap_entries"
 #define KRB5_CONF_RDNS                         "rdns"
 #define KRB5_CONF_REALMS                       "realms"
 #define KRB5_CONF_REALM_TRY_DOMAINS            "realm_try_domains"
@@ -1200,6 +1222,7 @@ struct ccselect_module_handle;
 struct localauth_module_handle;
 struct hostrealm_module_handle;
 struct k5_tls_vtable_st;
+struct k5_kdc_health;
 struct _krb5_context {
     krb5_magic      magic;
     krb5_enctype    *in_tkt_etypes;
@@ -1246,6 +1269,9 @@ struct _krb5_context {
     /* TLS module vtable (if loaded) */
     struct k5_tls_vtable_st *tls;
 
+    /* Observed KDC latency and failure state (if any KDC was contacted) */
+    struct k5_kdc_health *kdc_health;
+
     /* error detail info */
     struct errinfo err;
     char *err_fmt;
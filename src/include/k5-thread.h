@@ -201,6 +201,13 @@ typedef k5_os_nothread_mutex k5_os_mutex;
 # define k5_os_mutex_lock               k5_os_nothread_mutex_lock
 # define k5_os_mutex_unlock             k5_os_nothread_mutex_unlock
 
+typedef k5_os_nothread_mutex k5_os_rwlock;
+# define k5_os_rwlock_init              k5_os_nothread_mutex_init
+# define k5_os_rwlock_destroy           k5_os_nothread_mutex_destroy
+# define k5_os_rwlock_rdlock            k5_os_nothread_mutex_lock
+# define k5_os_rwlock_wrlock            k5_os_nothread_mutex_lock
+# define k5_os_rwlock_unlock            k5_os_nothread_mutex_unlock
+
 # define k5_once_t                      k5_os_nothread_once_t
 # define K5_ONCE_INIT                   K5_OS_NOTHREAD_ONCE_INIT
 # define k5_once                        k5_os_nothread_once
@@ -298,6 +305,26 @@ static inline int k5_os_mutex_finish_init(k5_os_mutex *m) { return 0; }
 
 #endif /* is pthreads always available? */
 
+typedef pthread_rwlock_t k5_os_rwlock;
+
+#ifdef USE_CONDITIONAL_PTHREADS
+
+int k5_os_rwlock_init(k5_os_rwlock *l);
+int k5_os_rwlock_destroy(k5_os_rwlock *l);
+int k5_os_rwlock_rdlock(k5_os_rwlock *l);
+int k5_os_rwlock_wrlock(k5_os_rwlock *l);
+int k5_os_rwlock_unlock(k5_os_rwlock *l);
+
+#else
+
+# define k5_os_rwlock_init(L)           pthread_rwlock_init((L), 0)
+# define k5_os_rwlock_destroy(L)        pthread_rwlock_destroy(L)
+# define k5_os_rwlock_rdlock(L)         pthread_rwlock_rdlock(L)
+# define k5_os_rwlock_wrlock(L)         pthread_rwlock_wrlock(L)
+# define k5_os_rwlock_unlock(L)         pthread_rwlock_unlock(L)
+
+#endif
+
 #elif defined _WIN32
 
 # define k5_once_t k5_os_nothread_once_t
@@ -341,6 +368,15 @@ static inline int k5_win_mutex_lock(k5_os_mutex *m)
      (M)->is_locked = 0,                        \
      ReleaseMutex((M)->h) ? 0 : GetLastError())
 
+/* No native reader-writer lock is used on Windows; readers and writers
+   are simply serialized.  */
+typedef k5_os_mutex k5_os_rwlock;
+# define k5_os_rwlock_init              k5_os_mutex_init
+# define k5_os_rwlock_destroy           k5_os_mutex_destroy
+# define k5_os_rwlock_rdlock            k5_os_mutex_lock
+# define k5_os_rwlock_wrlock            k5_os_mutex_lock
+# define k5_os_rwlock_unlock            k5_os_mutex_unlock
+
 #else
 
 # error "Thread support enabled, but thread system unknown"
@@ -372,6 +408,35 @@ static inline void k5_mutex_unlock(k5_mutex_t *m)
     assert(r == 0);
 }
 
+/* Reader-writer locks.  Any number of threads may hold the lock for
+   reading at once; a writer holds it exclusively.  There is no static
+   initializer, and the lock is not recursive.  */
+typedef k5_os_rwlock k5_rwlock_t;
+static inline int k5_rwlock_init(k5_rwlock_t *l)
+{
+    return k5_os_rwlock_init(l);
+}
+#define k5_rwlock_destroy(L)                    \
+    (k5_os_rwlock_destroy(L))
+
+static inline void k5_rwlock_rdlock(k5_rwlock_t *l)
+{
+    int r = k5_os_rwlock_rdlock(l);
+    assert(r == 0);
+}
+
+static inline void k5_rwlock_wrlock(k5_rwlock_t *l)
+{
+    int r = k5_os_rwlock_wrlock(l);
+    assert(r == 0);
+}
+
+static inline void k5_rwlock_unlock(k5_rwlock_t *l)
+{
+    int r = k5_os_rwlock_unlock(l);
+    assert(r == 0);
+}
+
 #define k5_mutex_assert_locked(M)       ((void)(M))
 #define k5_mutex_assert_unlocked(M)     ((void)(M))
 #define k5_assert_locked        k5_mutex_assert_locked
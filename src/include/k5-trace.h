@@ -253,6 +253,18 @@ void krb5int_trace(krb5_context context, const char *fmt, ...);
 #define TRACE_INIT_CREDS_SERVICE(c, service)                    \
     TRACE(c, "Setting initial creds service to {str}", service)
 
+#define TRACE_KDC_HEALTH_DOWN(c, host, port, failures, secs)            \
+    TRACE(c, "Marking KDC {str}:{int} down for {long} seconds after "   \
+          "{int} failure(s)", host, port, (long)secs, failures)
+#define TRACE_KDC_HEALTH_ORDER(c, host, port, srtt, race)               \
+    TRACE(c, "Trying KDC {str}:{int} first (smoothed RTT {int}ms, "     \
+          "racing {int})", host, port, srtt, race)
+#define TRACE_KDC_HEALTH_RTT(c, host, port, rtt, srtt)                  \
+    TRACE(c, "KDC {str}:{int} answered in {long}ms (smoothed RTT {int}ms)", \
+          host, port, (long)rtt, srtt)
+#define TRACE_KDC_HEALTH_SAVE_ERROR(c, path, err)                       \
+    TRACE(c, "Error saving KDC health file {str}: {errno}", path, err)
+
 #define TRACE_KT_GET_ENTRY(c, keytab, princ, vno, enctype, err)         \
     TRACE(c, "Retrieving {princ} from {keytab} (vno {int}, enctype {etype}) " \
           "with result: {kerr}", princ, keytab, (int) vno, enctype, err)
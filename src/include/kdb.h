@@ -376,6 +376,9 @@ krb5_error_code krb5_db_get_principal ( krb5_context kcontext,
                                         unsigned int flags,
                                         krb5_db_entry **entry );
 void krb5_db_free_principal ( krb5_context kcontext, krb5_db_entry *entry );
+krb5_error_code krb5_db_copy_principal ( krb5_context kcontext,
+                                         const krb5_db_entry *in,
+                                         krb5_db_entry **out );
 krb5_error_code krb5_db_put_principal ( krb5_context kcontext,
                                         krb5_db_entry *entry );
 krb5_error_code krb5_db_delete_principal ( krb5_context kcontext,
@@ -394,6 +397,39 @@ krb5_error_code krb5_db_iterate ( krb5_context kcontext,
                                   int (*func) (krb5_pointer, krb5_db_entry *),
                                   krb5_pointer func_arg, krb5_flags iterflags );
 
+/*
+ * Iterate over principals in the KDB in ascending strcmp order of unparsed
+ * name, beginning with the first principal whose name is not less than start,
+ * or with the first principal if start is NULL.  If the callback returns
+ * nonzero, stop and return that value.  Return KRB5_PLUGIN_OP_NOTSUPP if the
+ * module cannot iterate in order.
+ */
+krb5_error_code krb5_db_iterate_from ( krb5_context kcontext,
+                                       const char *start,
+                                       int (*func) (krb5_pointer,
+                                                    krb5_db_entry *),
+                                       krb5_pointer func_arg );
+
+/* Names of statistics which may be retrieved with krb5_db_get_stat(). */
+/* Entry writes saved by buffering last_success updates. */
+#define KRB5_KDB_STAT_WRITES_AVOIDED "writes_avoided"
+
+/*
+ * Set *value_out to the value of the statistic named name which the KDB
+ * module has accumulated through kcontext's database handle.  Return
+ * KRB5_PLUGIN_OP_NOTSUPP if the module does not keep that statistic.
+ */
+krb5_error_code krb5_db_get_stat ( krb5_context kcontext,
+                                   const char *name,
+                                   uint64_t *value_out );
+
+/*
+ * Write out any updates which the KDB module has buffered for longer than it
+ * is configured to.  Return KRB5_PLUGIN_OP_NOTSUPP if the module does not
+ * buffer updates.
+ */
+krb5_error_code krb5_db_flush_buffered ( krb5_context kcontext );
+
 
 krb5_error_code krb5_db_store_master_key  ( krb5_context kcontext,
                                             char *keyfile,
@@ -1393,6 +1429,41 @@ typedef struct _kdb_vftabl {
     void (*free_principal_e_data)(krb5_context kcontext, krb5_octet *e_data);
 
     /* End of minor version 1 for major version 6. */
+
+    /*
+     * Optional: Iterate over principals in ascending strcmp order of their
+     * unparsed names, starting with the first name not less than start (or at
+     * the beginning if start is NULL).  If func returns nonzero, stop
+     * iterating and return that value.  If this method is not implemented,
+     * callers which need ordered or resumable iteration must fall back to
+     * iterate.
+     */
+    krb5_error_code (*iterate_from)(krb5_context kcontext, const char *start,
+                                    krb5_error_code (*func)(krb5_pointer,
+                                                            krb5_db_entry *),
+                                    krb5_pointer func_arg);
+
+    /* End of minor version 2 for major version 6. */
+
+    /*
+     * Optional: Set *value_out to the value of the statistic named name (one
+     * of the KRB5_KDB_STAT_* names) accumulated through this database handle,
+     * or return KRB5_PLUGIN_OP_NOTSUPP if the module does not keep it.
+     */
+    krb5_error_code (*get_stat)(krb5_context kcontext, const char *name,
+                                uint64_t *value_out);
+
+    /* End of minor version 3 for major version 6. */
+
+    /*
+     * Optional: Write out any updates which the module has buffered in memory
+     * for longer than it is configured to hold them.  The KDC calls this
+     * method about once a second, so that buffered updates are written even
+     * when no further requests arrive.
+     */
+    krb5_error_code (*flush_buffered)(krb5_context kcontext);
+
+    /* End of minor version 4 for major version 6. */
 } kdb_vftabl;
 
 #endif /* !defined(_WIN32) */
@@ -48,6 +48,8 @@ extern "C" {
  */
 #define DEF_ULOGENTRIES 1000
 #define ULOG_IDLE_TIME  10              /* in seconds */
+#define IPROP_WAIT_TIME 60              /* Max time to hold a waiting
+                                         * update request, in seconds */
 /*
  * Max size of update entry + update header
  * We make this large since resizing can be costly.
@@ -77,6 +79,8 @@ update_status_t ulog_get_sno_status(krb5_context context,
                                     const kdb_last_t *last);
 krb5_error_code ulog_get_last(krb5_context context, kdb_last_t *last_out);
 krb5_error_code ulog_set_last(krb5_context context, const kdb_last_t *last);
+void ulog_set_commit_delay(krb5_context context, unsigned int delay_ms);
+krb5_error_code ulog_sync(krb5_context context);
 void ulog_fini(krb5_context context);
 
 typedef struct kdb_hlog {
@@ -105,6 +109,9 @@ typedef struct _kdb_log_context {
     kdb_hlog_t      *ulog;
     uint32_t        ulogentries;
     int             ulogfd;
+    unsigned int    commit_delay;   /* Group commit delay in ms, or 0 */
+    unsigned int    npending;       /* Updates written but not yet synced */
+    kdbe_time_t     pending_since;  /* Time of the first pending update */
 } kdb_log_context;
 
 #ifdef  __cplusplus
@@ -66,6 +66,14 @@ krb5_error_code loop_add_rpc_service(int default_port, const char *addresses,
                                      u_long prognum, u_long versnum,
                                      void (*dispatchfn)());
 
+/*
+ * Create listener sockets with SO_REUSEPORT, so that several processes can
+ * each call loop_setup_network() for the same addresses and have the kernel
+ * distribute incoming packets and connections among their sockets.  Returns
+ * ENOTSUP if enable is true and the platform lacks SO_REUSEPORT.
+ */
+krb5_error_code loop_set_reuseport(int enable);
+
 krb5_error_code loop_setup_network(verto_ctx *ctx, void *handle,
                                    const char *progname,
                                    int tcp_listen_backlog);
@@ -73,6 +81,23 @@ krb5_error_code loop_setup_signals(verto_ctx *ctx, void *handle,
                                    void (*reset)());
 void loop_free(verto_ctx *ctx);
 
+/*
+ * Network events which can be reported to an application hook, so that a
+ * server can keep statistics.  The hook is called from the loop with the
+ * number of occurrences.
+ */
+enum loop_event {
+    LOOP_EVENT_UDP_RECV,        /* UDP request packets received */
+    LOOP_EVENT_UDP_SEND_ERROR,  /* UDP replies which could not be sent */
+    LOOP_EVENT_ACCEPT,          /* TCP or RPC connections accepted */
+    LOOP_EVENT_CONN_DROP,       /* connections closed to admit new ones */
+    LOOP_EVENT_TCP_TOOLONG,     /* TCP requests over the length limit */
+    LOOP_EVENT_UDP_RXQ_DROP     /* UDP packets the kernel dropped because a
+                                 * socket's receive queue was full */
+};
+typedef void (*loop_event_fn)(enum loop_event event, unsigned int count);
+void loop_set_event_hook(loop_event_fn fn);
+
 /* to be supplied by the server application */
 
 /*
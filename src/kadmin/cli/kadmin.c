@@ -47,6 +47,9 @@
 #include <time.h>
 #include "kadmin.h"
 
+/* Number of names to request at a time when listing principals. */
+#define GETPRINCS_PAGE_SIZE 1000
+
 static krb5_boolean script_mode = FALSE;
 int exit_status = 0;
 char *def_realm = NULL;
@@ -1514,22 +1517,38 @@ void
 kadmin_getprincs(int argc, char *argv[])
 {
     krb5_error_code retval;
-    char *expr, **names;
+    char *expr, **names, *start = NULL;
     int i, count;
+    krb5_boolean more;
 
     expr = NULL;
     if (!(argc == 1 || (argc == 2 && (expr = argv[1])))) {
         error(_("usage: get_principals [expression]\n"));
         return;
     }
-    retval = kadm5_get_principals(handle, expr, &names, &count);
-    if (retval) {
-        com_err("get_principals", retval, _("while retrieving list."));
-        return;
-    }
-    for (i = 0; i < count; i++)
-        printf("%s\n", names[i]);
-    kadm5_free_name_list(handle, names, count);
+    /* Fetch the list a page at a time, printing each page as it arrives. */
+    do {
+        retval = kadm5_get_principals_page(handle, expr, start,
+                                           GETPRINCS_PAGE_SIZE, &names,
+                                           &count, &more);
+        free(start);
+        start = NULL;
+        if (retval) {
+            com_err("get_principals", retval, _("while retrieving list."));
+            return;
+        }
+        for (i = 0; i < count; i++)
+            printf("%s\n", names[i]);
+        if (more && count > 0) {
+            start = strdup(names[count - 1]);
+            if (start == NULL) {
+                com_err("get_principals", ENOMEM,
+                        _("while retrieving list."));
+                more = FALSE;
+            }
+        }
+        kadm5_free_name_list(handle, names, count);
+    } while (more && start != NULL);
 }
 
 static int
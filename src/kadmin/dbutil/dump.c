@@ -31,9 +31,12 @@
 #include <k5-int.h>
 #include <kadm5/admin.h>
 #include <kadm5/server_internal.h>
+#include <kadm5/admin_xdr.h>
 #include <kdb.h>
 #include <com_err.h>
 #include "kdb5_util.h"
+#include "workpool.h"
+#include <sys/mman.h>
 #if defined(HAVE_REGEX_H) && defined(HAVE_REGCOMP)
 #include <regex.h>
 #endif  /* HAVE_REGEX_H */
@@ -85,8 +88,46 @@ struct dump_args {
     krb5_boolean verbose;
     krb5_boolean omit_nra;      /* omit non-replicated attributes */
     dump_version *dump;
+    struct workpool *pool;      /* formats records, for a parallel dump */
+    struct dump_batch *batch;   /* entries not yet submitted to pool */
+    int nthreads;
+    struct bindump *bin;        /* writer state, for a binary dump */
 };
 
+/*
+ * A binary dump begins with the header line of binary_version, followed by a
+ * series of data blocks, an index block, and a trailer.  Integers outside of
+ * XDR encodings are big-endian.  A block is:
+ *
+ *     payload length (4 bytes), record count (4 bytes), payload,
+ *     SHA-256 checksum of the payload (32 bytes)
+ *
+ * The payload of a data block is a series of records, each a 4-byte length
+ * followed by an XDR encoding of a record type and a principal or policy.  The
+ * payload of the index block is an array of fixed-size entries sorted by
+ * principal name, followed by the names they refer to:
+ *
+ *     name offset (4 bytes), name length (4 bytes),
+ *     data block offset (8 bytes), record offset in payload (4 bytes)
+ *
+ * Name offsets are relative to the end of the entry array, and block offsets
+ * are relative to the start of the file.  The trailer is the offset of the
+ * index block (8 bytes) followed by BINDUMP_MAGIC.  Since the header is 32
+ * bytes long, every record is four-byte aligned in the file.
+ */
+#define BINDUMP_MAGIC "K5BINIDX"
+#define BINDUMP_BLOCK_BYTES 65536
+#define BINDUMP_BLOCK_HEADER 8
+#define BINDUMP_INDEX_ENTRY 20
+#define BINDUMP_TRAILER 16
+#define BINDUMP_PRINC 1
+#define BINDUMP_POLICY 2
+
+/* Parallel dump and load format and parse records in memory. */
+#if defined(HAVE_OPEN_MEMSTREAM) && defined(HAVE_FMEMOPEN)
+#define PARALLEL_DUMP
+#endif
+
 /* External data */
 extern krb5_db_entry *master_entry;
 
@@ -541,6 +582,496 @@ dump_ov_princ(krb5_context context, krb5_db_entry *entry, const char *name,
     return 0;
 }
 
+struct bindump_index {
+    char *name;
+    uint64_t block_offset;
+    uint32_t record_offset;
+};
+
+struct bindump {
+    FILE *ofile;
+    uint64_t offset;            /* bytes written, including the header */
+    struct k5buf block;         /* payload of the current data block */
+    uint32_t nrecords;
+    struct bindump_index *index;
+    size_t nindex;
+    size_t index_alloc;
+    krb5_boolean omit_nra;
+    krb5_error_code ret;        /* error from dump_binary_policy() */
+};
+
+/* Encode or decode the tagged data of a binary dump record, preserving its
+ * order. */
+static bool_t
+xdr_dump_tl_data(XDR *xdrs, krb5_int16 *n_tl_data, krb5_tl_data **tl_head)
+{
+    krb5_tl_data *tl, **tlp;
+    u_int count = 0, len, i;
+
+    if (xdrs->x_op == XDR_ENCODE) {
+        for (tl = *tl_head; tl != NULL; tl = tl->tl_data_next)
+            count++;
+    }
+    if (!xdr_u_int(xdrs, &count) || count > SHRT_MAX)
+        return FALSE;
+    tlp = tl_head;
+    for (i = 0; i < count; i++) {
+        if (xdrs->x_op == XDR_DECODE) {
+            *tlp = calloc(1, sizeof(**tlp));
+            if (*tlp == NULL)
+                return FALSE;
+            *n_tl_data = i + 1;
+        }
+        tl = *tlp;
+        len = tl->tl_data_length;
+        if (!xdr_krb5_int16(xdrs, &tl->tl_data_type) ||
+            !xdr_bytes(xdrs, (char **)&tl->tl_data_contents, &len, USHRT_MAX))
+            return FALSE;
+        tl->tl_data_length = len;
+        tlp = &tl->tl_data_next;
+    }
+    return TRUE;
+}
+
+/* Encode or decode a principal entry and its unparsed name.  When decoding,
+ * the caller must free entry and *name even on failure. */
+static bool_t
+xdr_dump_princ(XDR *xdrs, krb5_db_entry *entry, char **name)
+{
+    u_int n_key_data, e_length;
+    bool_t ok;
+
+    if (!xdr_string(xdrs, name, ~0) ||
+        !xdr_krb5_ui_2(xdrs, &entry->len) ||
+        !xdr_krb5_flags(xdrs, &entry->attributes) ||
+        !xdr_krb5_deltat(xdrs, &entry->max_life) ||
+        !xdr_krb5_deltat(xdrs, &entry->max_renewable_life) ||
+        !xdr_krb5_timestamp(xdrs, &entry->expiration) ||
+        !xdr_krb5_timestamp(xdrs, &entry->pw_expiration) ||
+        !xdr_krb5_timestamp(xdrs, &entry->last_success) ||
+        !xdr_krb5_timestamp(xdrs, &entry->last_failed) ||
+        !xdr_krb5_kvno(xdrs, &entry->fail_auth_count) ||
+        !xdr_dump_tl_data(xdrs, &entry->n_tl_data, &entry->tl_data))
+        return FALSE;
+
+    n_key_data = entry->n_key_data;
+    ok = xdr_array(xdrs, (caddr_t *)&entry->key_data, &n_key_data, SHRT_MAX,
+                   sizeof(krb5_key_data), (xdrproc_t)xdr_krb5_key_data);
+    if (entry->key_data != NULL)
+        entry->n_key_data = n_key_data;
+    if (!ok)
+        return FALSE;
+
+    e_length = entry->e_length;
+    if (!xdr_bytes(xdrs, (char **)&entry->e_data, &e_length, USHRT_MAX))
+        return FALSE;
+    entry->e_length = e_length;
+    return TRUE;
+}
+
+/* Encode or decode a policy entry. */
+static bool_t
+xdr_dump_policy(XDR *xdrs, osa_policy_ent_t pol)
+{
+    return xdr_string(xdrs, &pol->name, ~0) &&
+        xdr_krb5_ui_4(xdrs, &pol->pw_min_life) &&
+        xdr_krb5_ui_4(xdrs, &pol->pw_max_life) &&
+        xdr_krb5_ui_4(xdrs, &pol->pw_min_length) &&
+        xdr_krb5_ui_4(xdrs, &pol->pw_min_classes) &&
+        xdr_krb5_ui_4(xdrs, &pol->pw_history_num) &&
+        xdr_krb5_ui_4(xdrs, &pol->pw_max_fail) &&
+        xdr_krb5_ui_4(xdrs, &pol->pw_failcnt_interval) &&
+        xdr_krb5_ui_4(xdrs, &pol->pw_lockout_duration) &&
+        xdr_krb5_ui_4(xdrs, &pol->attributes) &&
+        xdr_krb5_ui_4(xdrs, &pol->max_life) &&
+        xdr_krb5_ui_4(xdrs, &pol->max_renewable_life) &&
+        xdr_nullstring(xdrs, &pol->allowed_keysalts) &&
+        xdr_dump_tl_data(xdrs, &pol->n_tl_data, &pol->tl_data);
+}
+
+/* Write out the data block being accumulated, if it holds any records. */
+static krb5_error_code
+bindump_flush(struct bindump *bd)
+{
+    krb5_error_code ret;
+    uint8_t hdr[BINDUMP_BLOCK_HEADER], cksum[K5_SHA256_HASHLEN];
+    krb5_data d;
+
+    if (bd->nrecords == 0)
+        return 0;
+    if (k5_buf_status(&bd->block) != 0)
+        return ENOMEM;
+    store_32_be(bd->block.len, hdr);
+    store_32_be(bd->nrecords, hdr + 4);
+    d = make_data(bd->block.data, bd->block.len);
+    ret = k5_sha256(&d, cksum);
+    if (ret)
+        return ret;
+    if (fwrite(hdr, 1, sizeof(hdr), bd->ofile) != sizeof(hdr) ||
+        fwrite(d.data, 1, d.length, bd->ofile) != d.length ||
+        fwrite(cksum, 1, sizeof(cksum), bd->ofile) != sizeof(cksum))
+        return errno;
+    bd->offset += sizeof(hdr) + d.length + sizeof(cksum);
+    k5_buf_truncate(&bd->block, 0);
+    bd->nrecords = 0;
+    return 0;
+}
+
+/* Append an XDR-encoded record of the given type to the current data block,
+ * flushing the block if it is full. */
+static krb5_error_code
+bindump_add_record(struct bindump *bd, int type, krb5_db_entry *entry,
+                   char **name, osa_policy_ent_t pol)
+{
+    XDR xdrs;
+    uint8_t lenbuf[4];
+    u_int len;
+    bool_t ok;
+
+    xdralloc_create(&xdrs, XDR_ENCODE);
+    ok = xdr_int(&xdrs, &type);
+    if (ok && entry != NULL)
+        ok = xdr_dump_princ(&xdrs, entry, name);
+    else if (ok)
+        ok = xdr_dump_policy(&xdrs, pol);
+    if (!ok) {
+        xdr_destroy(&xdrs);
+        return KADM5_XDR_FAILURE;
+    }
+    len = xdr_getpos(&xdrs);
+    store_32_be(len, lenbuf);
+    k5_buf_add_len(&bd->block, lenbuf, sizeof(lenbuf));
+    k5_buf_add_len(&bd->block, xdralloc_getdata(&xdrs), len);
+    xdr_destroy(&xdrs);
+    bd->nrecords++;
+    return (bd->block.len >= BINDUMP_BLOCK_BYTES) ? bindump_flush(bd) : 0;
+}
+
+/* Add a principal to a binary dump, taking ownership of name. */
+static krb5_error_code
+bindump_add_princ(struct bindump *bd, krb5_db_entry *entry, char *name)
+{
+    krb5_db_entry tmp;
+    struct bindump_index *ent, *newindex;
+    size_t newalloc;
+
+    if (bd->nindex == bd->index_alloc) {
+        newalloc = (bd->index_alloc == 0) ? 1024 : bd->index_alloc * 2;
+        newindex = realloc(bd->index, newalloc * sizeof(*bd->index));
+        if (newindex == NULL) {
+            free(name);
+            return ENOMEM;
+        }
+        bd->index = newindex;
+        bd->index_alloc = newalloc;
+    }
+    ent = &bd->index[bd->nindex++];
+    ent->name = name;
+    ent->block_offset = bd->offset;
+    ent->record_offset = bd->block.len;
+
+    tmp = *entry;
+    if (bd->omit_nra) {
+        tmp.last_success = 0;
+        tmp.last_failed = 0;
+        tmp.fail_auth_count = 0;
+    }
+    return bindump_add_record(bd, BINDUMP_PRINC, &tmp, &name, NULL);
+}
+
+static void
+dump_binary_policy(void *data, osa_policy_ent_t entry)
+{
+    struct dump_args *arg = data;
+
+    if (arg->bin->ret == 0) {
+        arg->bin->ret = bindump_add_record(arg->bin, BINDUMP_POLICY, NULL,
+                                           NULL, entry);
+    }
+}
+
+static int
+index_cmp(const void *a, const void *b)
+{
+    const struct bindump_index *ia = a, *ib = b;
+
+    return strcmp(ia->name, ib->name);
+}
+
+/* Write out the remaining records, the index block, and the trailer. */
+static krb5_error_code
+bindump_finish(struct bindump *bd)
+{
+    krb5_error_code ret;
+    struct k5buf buf;
+    uint8_t hdr[BINDUMP_BLOCK_HEADER], cksum[K5_SHA256_HASHLEN];
+    uint8_t ent[BINDUMP_INDEX_ENTRY], trailer[BINDUMP_TRAILER];
+    uint32_t nameoff = 0;
+    uint64_t index_offset;
+    size_t i, namelen;
+    krb5_data d;
+
+    if (bd->ret)
+        return bd->ret;
+    ret = bindump_flush(bd);
+    if (ret)
+        return ret;
+
+    qsort(bd->index, bd->nindex, sizeof(*bd->index), index_cmp);
+    k5_buf_init_dynamic(&buf);
+    for (i = 0; i < bd->nindex; i++) {
+        namelen = strlen(bd->index[i].name);
+        store_32_be(nameoff, ent);
+        store_32_be(namelen, ent + 4);
+        store_64_be(bd->index[i].block_offset, ent + 8);
+        store_32_be(bd->index[i].record_offset, ent + 16);
+        k5_buf_add_len(&buf, ent, sizeof(ent));
+        nameoff += namelen;
+    }
+    for (i = 0; i < bd->nindex; i++)
+        k5_buf_add(&buf, bd->index[i].name);
+    if (k5_buf_status(&buf) != 0)
+        return ENOMEM;
+
+    index_offset = bd->offset;
+    store_32_be(buf.len, hdr);
+    store_32_be(bd->nindex, hdr + 4);
+    d = make_data(buf.data, buf.len);
+    ret = k5_sha256(&d, cksum);
+    if (ret)
+        goto cleanup;
+    store_64_be(index_offset, trailer);
+    memcpy(trailer + 8, BINDUMP_MAGIC, 8);
+    if (fwrite(hdr, 1, sizeof(hdr), bd->ofile) != sizeof(hdr) ||
+        fwrite(d.data, 1, d.length, bd->ofile) != d.length ||
+        fwrite(cksum, 1, sizeof(cksum), bd->ofile) != sizeof(cksum) ||
+        fwrite(trailer, 1, sizeof(trailer), bd->ofile) != sizeof(trailer))
+        ret = errno;
+
+cleanup:
+    k5_buf_free(&buf);
+    return ret;
+}
+
+static void
+bindump_free(struct bindump *bd)
+{
+    size_t i;
+
+    if (bd == NULL)
+        return;
+    for (i = 0; i < bd->nindex; i++)
+        free(bd->index[i].name);
+    free(bd->index);
+    k5_buf_free(&bd->block);
+    free(bd);
+}
+
+#ifdef PARALLEL_DUMP
+
+/* Number of principal entries formatted together by a worker thread. */
+#define DUMP_BATCH_ENTRIES 256
+
+/* A sequence of principal entries to be formatted by a worker thread.  The
+ * entries are copies owned by the batch. */
+struct dump_batch {
+    struct dump_args *args;
+    krb5_db_entry *entries[DUMP_BATCH_ENTRIES];
+    char *names[DUMP_BATCH_ENTRIES];
+    int nentries;
+    char *text;                 /* formatted records */
+    size_t len;
+    krb5_error_code ret;
+};
+
+static void
+free_dump_batch(krb5_context context, struct dump_batch *batch)
+{
+    int i;
+
+    if (batch == NULL)
+        return;
+    for (i = 0; i < batch->nentries; i++) {
+        krb5_db_free_principal(context, batch->entries[i]);
+        free(batch->names[i]);
+    }
+    free(batch->text);
+    free(batch);
+}
+
+/* Worker thread function to format the entries of a dump batch. */
+static void
+format_dump_batch(krb5_context context, void *job)
+{
+    struct dump_batch *batch = job;
+    struct dump_args *args = batch->args;
+    FILE *fp;
+    int i;
+
+    if (context == NULL) {
+        batch->ret = ENOMEM;
+        return;
+    }
+    fp = open_memstream(&batch->text, &batch->len);
+    if (fp == NULL) {
+        batch->ret = errno;
+        return;
+    }
+    for (i = 0; i < batch->nentries && !batch->ret; i++) {
+        batch->ret = args->dump->dump_princ(context, batch->entries[i],
+                                            batch->names[i], fp,
+                                            args->verbose, args->omit_nra);
+    }
+    if (fclose(fp) != 0 && !batch->ret)
+        batch->ret = errno;
+}
+
+/* Wait for the oldest submitted batch to be formatted, write it out, and free
+ * it. */
+static krb5_error_code
+write_dump_batch(struct dump_args *args)
+{
+    krb5_error_code ret;
+    struct dump_batch *batch;
+
+    batch = workpool_retire(args->pool);
+    if (batch == NULL)
+        return 0;
+    ret = batch->ret;
+    if (!ret && fwrite(batch->text, 1, batch->len, args->ofile) != batch->len)
+        ret = errno;
+    free_dump_batch(args->context, batch);
+    return ret;
+}
+
+/* Submit the batch being filled, first writing out formatted batches to keep
+ * the number in flight bounded. */
+static krb5_error_code
+submit_dump_batch(struct dump_args *args)
+{
+    krb5_error_code ret;
+
+    if (args->batch == NULL)
+        return 0;
+    while (workpool_pending(args->pool) >= (size_t)args->nthreads * 2) {
+        ret = write_dump_batch(args);
+        if (ret)
+            return ret;
+    }
+    ret = workpool_submit(args->pool, args->batch);
+    if (ret)
+        return ret;
+    args->batch = NULL;
+    return 0;
+}
+
+/* Submit any partial batch and write out all batches in flight. */
+static krb5_error_code
+drain_dump_pool(struct dump_args *args)
+{
+    krb5_error_code ret;
+
+    ret = submit_dump_batch(args);
+    while (!ret && workpool_pending(args->pool) > 0)
+        ret = write_dump_batch(args);
+    return ret;
+}
+
+/* Queue a copy of entry to be formatted by the worker threads, taking
+ * ownership of name. */
+static krb5_error_code
+queue_dump_entry(struct dump_args *args, krb5_db_entry *entry, char *name)
+{
+    krb5_error_code ret;
+    krb5_db_entry *copy;
+    struct dump_batch *batch;
+
+    ret = krb5_db_copy_principal(args->context, entry, &copy);
+    if (ret == KRB5_PLUGIN_OP_NOTSUPP) {
+        /* The module can't copy this entry, so dump it here, after
+         * everything queued before it. */
+        ret = drain_dump_pool(args);
+        if (!ret) {
+            ret = args->dump->dump_princ(args->context, entry, name,
+                                         args->ofile, args->verbose,
+                                         args->omit_nra);
+        }
+        free(name);
+        return ret;
+    } else if (ret) {
+        free(name);
+        return ret;
+    }
+
+    if (args->batch == NULL) {
+        args->batch = calloc(1, sizeof(*args->batch));
+        if (args->batch == NULL) {
+            krb5_db_free_principal(args->context, copy);
+            free(name);
+            return ENOMEM;
+        }
+        args->batch->args = args;
+    }
+    batch = args->batch;
+    batch->entries[batch->nentries] = copy;
+    batch->names[batch->nentries] = name;
+    if (++batch->nentries < DUMP_BATCH_ENTRIES)
+        return 0;
+    return submit_dump_batch(args);
+}
+
+/* Discard any batches still in flight and stop the worker threads. */
+static void
+free_dump_pool(struct dump_args *args)
+{
+    struct dump_batch *batch;
+
+    if (args->pool == NULL)
+        return;
+    while ((batch = workpool_retire(args->pool)) != NULL)
+        free_dump_batch(args->context, batch);
+    free_dump_batch(args->context, args->batch);
+    workpool_free(args->pool);
+    args->pool = NULL;
+    args->batch = NULL;
+}
+
+static krb5_error_code
+start_dump_pool(struct dump_args *args, int nthreads)
+{
+    args->nthreads = nthreads;
+    return workpool_create(args->context, nthreads, format_dump_batch,
+                           &args->pool);
+}
+
+#else /* not PARALLEL_DUMP */
+
+static krb5_error_code
+drain_dump_pool(struct dump_args *args)
+{
+    return 0;
+}
+
+static krb5_error_code
+queue_dump_entry(struct dump_args *args, krb5_db_entry *entry, char *name)
+{
+    free(name);
+    return ENOTSUP;
+}
+
+static void
+free_dump_pool(struct dump_args *args)
+{
+}
+
+static krb5_error_code
+start_dump_pool(struct dump_args *args, int nthreads)
+{
+    return ENOTSUP;
+}
+
+#endif /* not PARALLEL_DUMP */
+
 static krb5_error_code
 dump_iterator(void *ptr, krb5_db_entry *entry)
 {
@@ -568,6 +1099,20 @@ dump_iterator(void *ptr, krb5_db_entry *entry)
     if (args->nnames > 0 && !name_matches(name, args))
         goto cleanup;
 
+    if (args->bin != NULL) {
+        ret = bindump_add_princ(args->bin, entry, name);
+        name = NULL;
+        goto cleanup;
+    }
+
+    /* In a parallel dump, hand the entry off to be formatted by the worker
+     * threads. */
+    if (args->pool != NULL) {
+        ret = queue_dump_entry(args, entry, name);
+        name = NULL;
+        goto cleanup;
+    }
+
     ret = args->dump->dump_princ(args->context, entry, name, args->ofile,
                                  args->verbose, args->omit_nra);
 
@@ -700,24 +1245,53 @@ process_tl_data(const char *fname, FILE *filep, int lineno,
     return 0;
 }
 
-/* Read a beta 7 entry and add it to the database.  Return -1 for end of file,
- * 0 for success and 1 for failure. */
+/* Set the mask bits of dbentry for its tagged data. */
+static void
+set_tl_data_mask(krb5_db_entry *dbentry)
+{
+    krb5_tl_data *tl;
+
+    for (tl = dbentry->tl_data; tl; tl = tl->tl_data_next) {
+        /* test to set mask fields */
+        if (tl->tl_data_type == KRB5_TL_KADM_DATA) {
+            XDR xdrs;
+            osa_princ_ent_rec osa_princ_ent;
+
+            /*
+             * Assuming aux_attributes will always be
+             * there
+             */
+            dbentry->mask |= KADM5_AUX_ATTRIBUTES;
+
+            /* test for an actual policy reference */
+            memset(&osa_princ_ent, 0, sizeof(osa_princ_ent));
+            xdrmem_create(&xdrs, (char *)tl->tl_data_contents,
+                          tl->tl_data_length, XDR_DECODE);
+            if (xdr_osa_princ_ent_rec(&xdrs, &osa_princ_ent)) {
+                if ((osa_princ_ent.aux_attributes & KADM5_POLICY) &&
+                    osa_princ_ent.policy != NULL)
+                    dbentry->mask |= KADM5_POLICY;
+                kdb_free_entry(NULL, NULL, &osa_princ_ent);
+            }
+            xdr_destroy(&xdrs);
+        }
+    }
+    dbentry->mask |= KADM5_TL_DATA;
+}
+
+/* Read a beta 7 entry into dbentry, which the caller must free even on
+ * failure.  Return -1 for end of file, 0 for success and 1 for failure. */
 static int
-process_k5beta7_princ(krb5_context context, const char *fname, FILE *filep,
-                      krb5_boolean verbose, int *linenop)
+read_k5beta7_princ(krb5_context context, const char *fname, FILE *filep,
+                   int *linenop, krb5_db_entry *dbentry)
 {
     int retval, nread, i, j;
-    krb5_db_entry *dbentry;
     int t1, t2, t3, t4, t5, t6, t7;
     unsigned int u1, u2, u3, u4, u5;
     char *name = NULL;
     krb5_key_data *kp = NULL, *kd;
-    krb5_tl_data *tl;
     krb5_error_code ret;
 
-    dbentry = calloc(1, sizeof(*dbentry));
-    if (dbentry == NULL)
-        return 1;
     (*linenop)++;
     nread = fscanf(filep, "%u\t%u\t%u\t%u\t%u\t", &u1, &u2, &u3, &u4, &u5);
     if (nread == EOF) {
@@ -787,32 +1361,7 @@ process_k5beta7_princ(krb5_context context, const char *fname, FILE *filep,
     if (dbentry->n_tl_data) {
         if (process_tl_data(fname, filep, *linenop, dbentry->tl_data))
             goto fail;
-        for (tl = dbentry->tl_data; tl; tl = tl->tl_data_next) {
-            /* test to set mask fields */
-            if (tl->tl_data_type == KRB5_TL_KADM_DATA) {
-                XDR xdrs;
-                osa_princ_ent_rec osa_princ_ent;
-
-                /*
-                 * Assuming aux_attributes will always be
-                 * there
-                 */
-                dbentry->mask |= KADM5_AUX_ATTRIBUTES;
-
-                /* test for an actual policy reference */
-                memset(&osa_princ_ent, 0, sizeof(osa_princ_ent));
-                xdrmem_create(&xdrs, (char *)tl->tl_data_contents,
-                              tl->tl_data_length, XDR_DECODE);
-                if (xdr_osa_princ_ent_rec(&xdrs, &osa_princ_ent)) {
-                    if ((osa_princ_ent.aux_attributes & KADM5_POLICY) &&
-                        osa_princ_ent.policy != NULL)
-                        dbentry->mask |= KADM5_POLICY;
-                    kdb_free_entry(NULL, NULL, &osa_princ_ent);
-                }
-                xdr_destroy(&xdrs);
-            }
-        }
-        dbentry->mask |= KADM5_TL_DATA;
+        set_tl_data_mask(dbentry);
     }
 
     /* Get the key data. */
@@ -853,21 +1402,11 @@ process_k5beta7_princ(krb5_context context, const char *fname, FILE *filep,
 
     /* Finally, find the end of the record. */
     read_record_end(filep, fname, *linenop);
-
-    ret = krb5_db_put_principal(context, dbentry);
-    if (ret) {
-        com_err(progname, ret, _("while storing %s"), name);
-        goto fail;
-    }
-
-    if (verbose)
-        fprintf(stderr, "%s\n", name);
     retval = 0;
 
 cleanup:
     free(kp);
     free(name);
-    krb5_db_free_principal(context, dbentry);
     return retval;
 
 fail:
@@ -875,6 +1414,47 @@ fail:
     goto cleanup;
 }
 
+/* Store a principal entry read from a dump.  Return 0 for success and 1 for
+ * failure. */
+static int
+store_princ(krb5_context context, krb5_db_entry *dbentry,
+            krb5_boolean verbose)
+{
+    krb5_error_code ret;
+    char *name;
+
+    ret = krb5_db_put_principal(context, dbentry);
+    if (!ret && !verbose)
+        return 0;
+    if (krb5_unparse_name(context, dbentry->princ, &name) != 0)
+        name = NULL;
+    if (ret)
+        com_err(progname, ret, _("while storing %s"), name ? name : "?");
+    else
+        fprintf(stderr, "%s\n", name ? name : "?");
+    free(name);
+    return ret ? 1 : 0;
+}
+
+/* Read a beta 7 entry and add it to the database.  Return -1 for end of file,
+ * 0 for success and 1 for failure. */
+static int
+process_k5beta7_princ(krb5_context context, const char *fname, FILE *filep,
+                      krb5_boolean verbose, int *linenop)
+{
+    int retval;
+    krb5_db_entry *dbentry;
+
+    dbentry = calloc(1, sizeof(*dbentry));
+    if (dbentry == NULL)
+        return 1;
+    retval = read_k5beta7_princ(context, fname, filep, linenop, dbentry);
+    if (retval == 0)
+        retval = store_princ(context, dbentry, verbose);
+    krb5_db_free_principal(context, dbentry);
+    return retval;
+}
+
 static int
 process_k5beta7_policy(krb5_context context, const char *fname, FILE *filep,
                        krb5_boolean verbose, int *linenop)
@@ -1143,6 +1723,16 @@ dump_version r1_11_version = {
     dump_r1_11_policy,
     process_r1_11_record,
 };
+dump_version binary_version = {
+    "Kerberos version 5 binary",
+    "kdb5_util binary_dump version 1\n",
+    0,
+    0,
+    0,
+    NULL,                       /* principals go through bindump_add_princ */
+    dump_binary_policy,
+    NULL,                       /* records are read by load_binary */
+};
 dump_version iprop_version = {
     "Kerberos iprop version",
     "iprop",
@@ -1246,7 +1836,7 @@ dump_db(int argc, char **argv)
     char *ofile = NULL, *tmpofile = NULL, *new_mkey_file = NULL;
     krb5_error_code ret, retval;
     dump_version *dump;
-    int aindex, ok_fd = -1;
+    int aindex, ok_fd = -1, nthreads = 0;
     bool_t dump_sno = FALSE;
     kdb_log_context *log_ctx;
     unsigned int ipropx_version = IPROPX_VERSION_0;
@@ -1259,6 +1849,9 @@ dump_db(int argc, char **argv)
     dump = &r1_11_version;
     args.verbose = FALSE;
     args.omit_nra = FALSE;
+    args.pool = NULL;
+    args.batch = NULL;
+    args.bin = NULL;
     mkey_convert = FALSE;
     log_ctx = util_context->kdblog_context;
 
@@ -1274,6 +1867,8 @@ dump_db(int argc, char **argv)
             dump = &r1_3_version;
         } else if (!strcmp(argv[aindex], "-r18")) {
             dump = &r1_8_version;
+        } else if (!strcmp(argv[aindex], "-binary")) {
+            dump = &binary_version;
         } else if (!strncmp(argv[aindex], "-i", 2)) {
             if (log_ctx && log_ctx->iproprole) {
                 /* ipropx_version is the maximum version acceptable. */
@@ -1305,6 +1900,9 @@ dump_db(int argc, char **argv)
             iterflags |= KRB5_DB_ITER_REV;
         } else if (!strcmp(argv[aindex], "-recurse")) {
             iterflags |= KRB5_DB_ITER_RECURSE;
+        } else if (!strcmp(argv[aindex], "-threads")) {
+            if (++aindex >= argc || (nthreads = atoi(argv[aindex])) <= 0)
+                usage();
         } else {
             break;
         }
@@ -1321,6 +1919,11 @@ dump_db(int argc, char **argv)
         }
     }
 
+    if (dump == &binary_version && nthreads > 0) {
+        com_err(progname, 0, _("-threads cannot be used with -binary"));
+        goto error;
+    }
+
     /* If a conditional ipropx dump we check if the existing dump is
      * good enough. */
     if (ofile != NULL && conditional) {
@@ -1434,7 +2037,32 @@ dump_db(int argc, char **argv)
     if (dump->header[strlen(dump->header)-1] != '\n')
         fputc('\n', args.ofile);
 
+    if (dump == &binary_version) {
+        args.bin = calloc(1, sizeof(*args.bin));
+        if (args.bin == NULL) {
+            com_err(progname, ENOMEM, _("while starting binary dump"));
+            goto error;
+        }
+        args.bin->ofile = f;
+        args.bin->offset = strlen(dump->header);
+        args.bin->omit_nra = args.omit_nra;
+        k5_buf_init_dynamic(&args.bin->block);
+    }
+
+    /* The database module iterates serially, but the records can be
+     * formatted in parallel and written out in order. */
+    if (nthreads > 0) {
+        ret = start_dump_pool(&args, nthreads);
+        if (ret) {
+            com_err(progname, ret, _("while starting dump threads"));
+            goto error;
+        }
+    }
+
     ret = krb5_db_iterate(util_context, NULL, dump_iterator, &args, iterflags);
+    if (!ret && args.pool != NULL)
+        ret = drain_dump_pool(&args);
+    free_dump_pool(&args);
     if (ret) {
         com_err(progname, ret, _("performing %s dump"), dump->name);
         goto error;
@@ -1448,6 +2076,15 @@ dump_db(int argc, char **argv)
         }
     }
 
+    if (args.bin != NULL) {
+        ret = bindump_finish(args.bin);
+        if (ret) {
+            com_err(progname, ret, _("performing %s dump"), dump->name);
+            goto error;
+        }
+        bindump_free(args.bin);
+    }
+
     if (f != stdout) {
         fclose(f);
         finish_ofile(ofile, &tmpofile);
@@ -1456,22 +2093,659 @@ dump_db(int argc, char **argv)
     return;
 
 error:
+    bindump_free(args.bin);
     if (tmpofile != NULL)
         unlink(tmpofile);
     free(tmpofile);
     exit_status++;
 }
 
-/* Restore the database from any version dump file. */
+/* Number of records stored under one database lock during a serial load. */
+#define LOAD_LOCK_BATCH 1000
+
+/* Lock the database before storing a group of records, so that the module
+ * does not have to reopen it for each one.  Set *locked to false if the module
+ * does not support locking.  Return 0 for success and 1 for failure. */
+static int
+begin_load_batch(krb5_context context, krb5_boolean *locked)
+{
+    krb5_error_code ret;
+
+    *locked = FALSE;
+    ret = krb5_db_lock(context, KRB5_DB_LOCKMODE_EXCLUSIVE);
+    if (ret == KRB5_PLUGIN_OP_NOTSUPP)
+        return 0;
+    if (ret) {
+        com_err(progname, ret, _("while locking database"));
+        return 1;
+    }
+    *locked = TRUE;
+    return 0;
+}
+
+/* Release the lock taken by begin_load_batch().  Return 0 for success and 1
+ * for failure. */
+static int
+end_load_batch(krb5_context context, krb5_boolean locked)
+{
+    krb5_error_code ret;
+
+    if (!locked)
+        return 0;
+    ret = krb5_db_unlock(context);
+    if (ret) {
+        com_err(progname, ret, _("while unlocking database"));
+        return 1;
+    }
+    return 0;
+}
+
+#ifdef PARALLEL_DUMP
+
+/* Approximate size of the chunks of dump text parsed by worker threads. */
+#define LOAD_BATCH_BYTES (256 * 1024)
+
+/* A record (one line) of a load batch.  Principal records are parsed by a
+ * worker thread; other records are left for the writer. */
+struct load_record {
+    size_t offset;
+    size_t len;
+    krb5_db_entry *entry;       /* parsed principal entry, or NULL */
+    int status;                 /* 1 if the record could not be parsed */
+};
+
+struct load_batch {
+    const char *fname;
+    char *text;
+    size_t len;
+    int lineno;                 /* line number before the first record */
+    struct load_record *recs;
+    size_t nrecs;
+};
+
+static void
+free_load_batch(krb5_context context, struct load_batch *batch)
+{
+    size_t i;
+
+    if (batch == NULL)
+        return;
+    for (i = 0; i < batch->nrecs; i++)
+        krb5_db_free_principal(context, batch->recs[i].entry);
+    free(batch->recs);
+    free(batch->text);
+    free(batch);
+}
+
+/* Worker thread function to parse the principal records of a load batch.
+ * Entries are freed by the writer, since freeing them requires the database
+ * handle. */
+static void
+parse_load_batch(krb5_context context, void *job)
+{
+    struct load_batch *batch = job;
+    struct load_record *rec;
+    char *line, *end;
+    size_t i, pos = 0;
+    int lineno;
+    FILE *fp;
+
+    for (i = 0; i < batch->nrecs; i++) {
+        rec = &batch->recs[i];
+        line = batch->text + pos;
+        end = memchr(line, '\n', batch->len - pos);
+        rec->offset = pos;
+        rec->len = (end != NULL) ? (size_t)(end - line) + 1 : batch->len - pos;
+        pos += rec->len;
+
+        if (context == NULL || rec->len < 6 ||
+            strncmp(line, "princ\t", 6) != 0)
+            continue;
+
+        /* If we run out of memory, leave the record for the writer. */
+        rec->entry = calloc(1, sizeof(*rec->entry));
+        if (rec->entry == NULL)
+            continue;
+        fp = fmemopen(line + 6, rec->len - 6, "r");
+        if (fp == NULL) {
+            free(rec->entry);
+            rec->entry = NULL;
+            continue;
+        }
+        lineno = batch->lineno + i;
+        if (read_k5beta7_princ(context, batch->fname, fp, &lineno,
+                               rec->entry) != 0)
+            rec->status = 1;
+        fclose(fp);
+    }
+}
+
+/* Read about LOAD_BATCH_BYTES of complete lines from f into a new batch,
+ * advancing *linenop past them.  *carry holds the start of a line left over
+ * from the previous read.  Set *batch_out to NULL at end of file. */
+static krb5_error_code
+read_load_batch(FILE *f, const char *fname, char **carry, size_t *carrylen,
+                int *linenop, struct load_batch **batch_out)
+{
+    krb5_error_code ret;
+    struct load_batch *batch;
+    char *buf, *newbuf;
+    size_t size, len, i, nlines;
+
+    *batch_out = NULL;
+    size = (*carrylen < LOAD_BATCH_BYTES / 2) ? LOAD_BATCH_BYTES :
+        *carrylen * 2;
+    buf = malloc(size);
+    if (buf == NULL)
+        return ENOMEM;
+    len = *carrylen;
+    if (len > 0)
+        memcpy(buf, *carry, len);
+    free(*carry);
+    *carry = NULL;
+    *carrylen = 0;
+
+    /* Fill the buffer, growing it until it holds at least one whole line. */
+    for (;;) {
+        len += fread(buf + len, 1, size - len, f);
+        if (len < size) {
+            if (ferror(f)) {
+                free(buf);
+                return EIO;
+            }
+            break;
+        }
+        for (i = len; i > 0 && buf[i - 1] != '\n'; i--);
+        if (i > 0) {
+            if (i < len) {
+                *carry = k5memdup(buf + i, len - i, &ret);
+                if (*carry == NULL) {
+                    free(buf);
+                    return ret;
+                }
+                *carrylen = len - i;
+            }
+            len = i;
+            break;
+        }
+        newbuf = realloc(buf, size * 2);
+        if (newbuf == NULL) {
+            free(buf);
+            return ENOMEM;
+        }
+        buf = newbuf;
+        size *= 2;
+    }
+    if (len == 0) {
+        free(buf);
+        return 0;
+    }
+
+    for (i = 0, nlines = 0; i < len; i++) {
+        if (buf[i] == '\n')
+            nlines++;
+    }
+    if (buf[len - 1] != '\n')
+        nlines++;
+
+    batch = calloc(1, sizeof(*batch));
+    if (batch == NULL) {
+        free(buf);
+        return ENOMEM;
+    }
+    batch->recs = calloc(nlines, sizeof(*batch->recs));
+    if (batch->recs == NULL) {
+        free(batch);
+        free(buf);
+        return ENOMEM;
+    }
+    batch->fname = fname;
+    batch->text = buf;
+    batch->len = len;
+    batch->lineno = *linenop;
+    batch->nrecs = nlines;
+    *linenop += nlines;
+    *batch_out = batch;
+    return 0;
+}
+
+/* Store the records of a parsed load batch in order, processing the ones the
+ * worker did not parse with the dump version's load function.  Return -1 for
+ * end of dump, 0 for success and 1 for failure. */
+static int
+store_load_batch(krb5_context context, dump_version *dump,
+                 krb5_boolean verbose, struct load_batch *batch, int *linenop)
+{
+    struct load_record *rec;
+    size_t i;
+    int err;
+    FILE *fp;
+
+    for (i = 0; i < batch->nrecs; i++) {
+        rec = &batch->recs[i];
+        if (rec->status) {
+            *linenop = batch->lineno + i + 1;
+            return 1;
+        }
+        if (rec->entry != NULL) {
+            (*linenop)++;
+            if (store_princ(context, rec->entry, verbose))
+                return 1;
+            continue;
+        }
+        fp = fmemopen(batch->text + rec->offset, rec->len, "r");
+        if (fp == NULL) {
+            com_err(progname, errno, _("while reading %s"), batch->fname);
+            return 1;
+        }
+        err = dump->load_record(context, batch->fname, fp, verbose, linenop);
+        fclose(fp);
+        if (err)
+            return err;
+    }
+    return 0;
+}
+
+/* Load the records of f, parsing principal records on nthreads worker threads
+ * and storing them in order on this one.  Return -1 for end of dump and 1 for
+ * failure. */
+static int
+load_parallel(krb5_context context, char *dumpfile, FILE *f,
+              krb5_boolean verbose, dump_version *dump, int nthreads,
+              int *linenop)
+{
+    krb5_error_code ret;
+    struct workpool *pool;
+    struct load_batch *batch;
+    char *carry = NULL;
+    size_t carrylen = 0;
+    int err = 0, lines_read = *linenop;
+    krb5_boolean eof = FALSE, locked;
+
+    ret = workpool_create(context, nthreads, parse_load_batch, &pool);
+    if (ret) {
+        com_err(progname, ret, _("while starting load threads"));
+        return 1;
+    }
+
+    while (!err) {
+        /* Keep the workers busy while we store the oldest batch. */
+        while (!eof && workpool_pending(pool) < (size_t)nthreads * 2) {
+            ret = read_load_batch(f, dumpfile, &carry, &carrylen, &lines_read,
+                                  &batch);
+            if (!ret && batch == NULL)
+                eof = TRUE;
+            else if (!ret)
+                ret = workpool_submit(pool, batch);
+            if (ret) {
+                free_load_batch(context, batch);
+                com_err(progname, ret, _("while reading %s"), dumpfile);
+                err = 1;
+                break;
+            }
+        }
+        if (err)
+            break;
+
+        batch = workpool_retire(pool);
+        if (batch == NULL) {
+            err = -1;
+            break;
+        }
+        err = begin_load_batch(context, &locked);
+        if (!err) {
+            err = store_load_batch(context, dump, verbose, batch, linenop);
+            if (end_load_batch(context, locked) && err != 1)
+                err = 1;
+        }
+        free_load_batch(context, batch);
+    }
+
+    /* Discard anything still in flight after a failure. */
+    while ((batch = workpool_retire(pool)) != NULL)
+        free_load_batch(context, batch);
+    workpool_free(pool);
+    free(carry);
+    return err;
+}
+
+#else /* not PARALLEL_DUMP */
+
+static int
+load_parallel(krb5_context context, char *dumpfile, FILE *f,
+              krb5_boolean verbose, dump_version *dump, int nthreads,
+              int *linenop)
+{
+    com_err(progname, ENOTSUP, _("while starting load threads"));
+    return 1;
+}
+
+#endif /* not PARALLEL_DUMP */
+
+/* Read a binary dump into memory, mapping it if it is a regular file.  The
+ * header line has already been read from f. */
+static krb5_error_code
+map_binary_dump(FILE *f, uint8_t **data_out, size_t *len_out,
+                krb5_boolean *mapped_out)
+{
+    struct stat st;
+    struct k5buf buf;
+    char tmp[BUFSIZ];
+    size_t n;
+    void *map;
+
+    *data_out = NULL;
+    *len_out = 0;
+    *mapped_out = FALSE;
+    if (fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size > 0 && (uintmax_t)st.st_size <= SIZE_MAX) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+        if (map == MAP_FAILED)
+            return errno;
+        *data_out = map;
+        *len_out = st.st_size;
+        *mapped_out = TRUE;
+        return 0;
+    }
+
+    /* Read the rest of a pipe after the header, so that offsets work the same
+     * way as for a file. */
+    k5_buf_init_dynamic(&buf);
+    k5_buf_add(&buf, binary_version.header);
+    while ((n = fread(tmp, 1, sizeof(tmp), f)) > 0)
+        k5_buf_add_len(&buf, tmp, n);
+    if (ferror(f)) {
+        k5_buf_free(&buf);
+        return EIO;
+    }
+    if (k5_buf_status(&buf) != 0)
+        return ENOMEM;
+    *data_out = buf.data;
+    *len_out = buf.len;
+    return 0;
+}
+
+/* Check the block at offset off of a binary dump, which must end by limit.
+ * Set *payload_out, *len_out, and *count_out to the block payload, its length,
+ * and its record count, and *next_out to the offset after the block. */
+static krb5_boolean
+check_binary_block(const uint8_t *data, uint64_t off, uint64_t limit,
+                   const uint8_t **payload_out, uint32_t *len_out,
+                   uint32_t *count_out, uint64_t *next_out)
+{
+    uint8_t cksum[K5_SHA256_HASHLEN];
+    uint32_t len;
+    krb5_data d;
+
+    if (off > limit || limit - off < BINDUMP_BLOCK_HEADER)
+        return FALSE;
+    len = load_32_be(data + off);
+    if (limit - off - BINDUMP_BLOCK_HEADER < (uint64_t)len + sizeof(cksum))
+        return FALSE;
+    d = make_data((uint8_t *)data + off + BINDUMP_BLOCK_HEADER, len);
+    if (k5_sha256(&d, cksum) != 0 ||
+        memcmp(d.data + len, cksum, sizeof(cksum)) != 0)
+        return FALSE;
+    *payload_out = (uint8_t *)d.data;
+    *len_out = len;
+    *count_out = load_32_be(data + off + 4);
+    *next_out = off + BINDUMP_BLOCK_HEADER + len + sizeof(cksum);
+    return TRUE;
+}
+
+/* Decode the record at *pos, which must end by end, and store it in the
+ * database.  Advance *pos past the record.  Return 0 for success and 1 for
+ * failure. */
+static int
+load_binary_record(krb5_context context, const char *fname,
+                   const uint8_t **pos, const uint8_t *end,
+                   krb5_boolean verbose)
+{
+    krb5_error_code ret;
+    krb5_db_entry *dbentry;
+    osa_policy_ent_rec pol;
+    uint32_t len;
+    char *name = NULL;
+    int type, retval = 1;
+    XDR xdrs;
+
+    if (end - *pos < 4 || (size_t)(end - *pos - 4) < load_32_be(*pos)) {
+        fprintf(stderr, _("%s: truncated record in %s\n"), progname, fname);
+        return 1;
+    }
+    len = load_32_be(*pos);
+    xdrmem_create(&xdrs, (char *)*pos + 4, len, XDR_DECODE);
+    *pos += 4 + len;
+    if (!xdr_int(&xdrs, &type)) {
+        fprintf(stderr, _("%s: truncated record in %s\n"), progname, fname);
+        goto cleanup;
+    }
+
+    if (type == BINDUMP_PRINC) {
+        dbentry = calloc(1, sizeof(*dbentry));
+        if (dbentry == NULL)
+            goto cleanup;
+        if (!xdr_dump_princ(&xdrs, dbentry, &name)) {
+            fprintf(stderr, _("%s: cannot decode principal in %s\n"),
+                    progname, fname);
+        } else if ((ret = krb5_parse_name(context, name, &dbentry->princ))) {
+            com_err(progname, ret, _("while parsing name %s"), name);
+        } else {
+            dbentry->mask = KADM5_LOAD | KADM5_PRINCIPAL | KADM5_ATTRIBUTES |
+                KADM5_MAX_LIFE | KADM5_MAX_RLIFE | KADM5_PRINC_EXPIRE_TIME |
+                KADM5_LAST_SUCCESS | KADM5_LAST_FAILED |
+                KADM5_FAIL_AUTH_COUNT;
+            if (dbentry->n_tl_data > 0)
+                set_tl_data_mask(dbentry);
+            if (dbentry->n_key_data > 0)
+                dbentry->mask |= KADM5_KEY_DATA;
+            retval = store_princ(context, dbentry, verbose);
+        }
+        free(name);
+        krb5_db_free_principal(context, dbentry);
+    } else if (type == BINDUMP_POLICY) {
+        memset(&pol, 0, sizeof(pol));
+        if (!xdr_dump_policy(&xdrs, &pol)) {
+            fprintf(stderr, _("%s: cannot decode policy in %s\n"), progname,
+                    fname);
+        } else {
+            ret = krb5_db_create_policy(context, &pol);
+            if (ret)
+                ret = krb5_db_put_policy(context, &pol);
+            if (ret)
+                com_err(progname, ret, _("while creating policy"));
+            else if (verbose)
+                fprintf(stderr, "created policy %s\n", pol.name);
+            retval = ret ? 1 : 0;
+        }
+        xdrs.x_op = XDR_FREE;
+        xdr_dump_policy(&xdrs, &pol);
+    } else {
+        fprintf(stderr, _("unknown record type %d\n"), type);
+    }
+
+cleanup:
+    xdr_destroy(&xdrs);
+    return retval;
+}
+
+/* Find name in the index of a binary dump and load its record. */
+static int
+load_binary_princ(krb5_context context, const char *fname,
+                  const uint8_t *data, uint64_t index_offset,
+                  const uint8_t *index, uint32_t index_len, uint32_t count,
+                  const char *name, krb5_boolean verbose)
+{
+    const uint8_t *ent, *names = index + (size_t)count * BINDUMP_INDEX_ENTRY;
+    const uint8_t *payload, *pos;
+    uint32_t lo = 0, hi = count, mid, nameoff, namelen, plen, nrec;
+    uint64_t block_offset, next;
+    size_t len = strlen(name), names_len = index_len - (names - index);
+    int cmp;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        ent = index + (size_t)mid * BINDUMP_INDEX_ENTRY;
+        nameoff = load_32_be(ent);
+        namelen = load_32_be(ent + 4);
+        if (nameoff > names_len || names_len - nameoff < namelen)
+            goto corrupt;
+        cmp = memcmp(name, names + nameoff, (len < namelen) ? len : namelen);
+        if (cmp == 0)
+            cmp = (len < namelen) ? -1 : (len > namelen) ? 1 : 0;
+        if (cmp == 0)
+            break;
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    if (lo >= hi) {
+        fprintf(stderr, _("%s: principal %s not found in %s\n"), progname,
+                name, fname);
+        return 1;
+    }
+
+    block_offset = load_64_be(ent + 8);
+    if (!check_binary_block(data, block_offset, index_offset, &payload, &plen,
+                            &nrec, &next) || load_32_be(ent + 16) >= plen)
+        goto corrupt;
+    pos = payload + load_32_be(ent + 16);
+    return load_binary_record(context, fname, &pos, payload + plen, verbose);
+
+corrupt:
+    fprintf(stderr, _("%s: corrupt index in %s\n"), progname, fname);
+    return 1;
+}
+
+/* Load a binary dump, or only the named principals from it if nnames is
+ * positive.  Return 0 for success and 1 for failure. */
+static int
+load_binary(krb5_context context, const char *fname, FILE *f,
+            krb5_boolean verbose, char **names, int nnames)
+{
+    krb5_error_code ret;
+    const uint8_t *payload, *pos, *index;
+    uint8_t *data;
+    uint64_t off, next, index_offset;
+    uint32_t plen, nrec, index_len, index_count, i;
+    size_t len, hdrlen = strlen(binary_version.header);
+    krb5_principal princ;
+    krb5_boolean mapped, locked;
+    char *name;
+    int err = 0;
+
+    ret = map_binary_dump(f, &data, &len, &mapped);
+    if (ret) {
+        com_err(progname, ret, _("while reading %s"), fname);
+        return 1;
+    }
+    if (len < hdrlen + BINDUMP_TRAILER ||
+        memcmp(data + len - 8, BINDUMP_MAGIC, 8) != 0) {
+        fprintf(stderr, _("%s: %s is truncated\n"), progname, fname);
+        err = 1;
+        goto cleanup;
+    }
+    index_offset = load_64_be(data + len - BINDUMP_TRAILER);
+    if (index_offset < hdrlen || index_offset > len - BINDUMP_TRAILER) {
+        fprintf(stderr, _("%s: corrupt index in %s\n"), progname, fname);
+        err = 1;
+        goto cleanup;
+    }
+
+    if (nnames > 0) {
+        if (!check_binary_block(data, index_offset, len - BINDUMP_TRAILER,
+                                &index, &index_len, &index_count, &next) ||
+            index_len / BINDUMP_INDEX_ENTRY < index_count) {
+            fprintf(stderr, _("%s: corrupt index in %s\n"), progname, fname);
+            err = 1;
+            goto cleanup;
+        }
+        for (i = 0; i < (uint32_t)nnames && !err; i++) {
+            /* Canonicalize the name the way the dump did. */
+            ret = krb5_parse_name(context, names[i], &princ);
+            if (!ret) {
+                ret = krb5_unparse_name(context, princ, &name);
+                krb5_free_principal(context, princ);
+            }
+            if (ret) {
+                com_err(progname, ret, _("while parsing name %s"), names[i]);
+                err = 1;
+                break;
+            }
+            err = begin_load_batch(context, &locked);
+            if (!err) {
+                err = load_binary_princ(context, fname, data, index_offset,
+                                        index, index_len, index_count, name,
+                                        verbose);
+                if (end_load_batch(context, locked))
+                    err = 1;
+            }
+            free(name);
+        }
+        goto cleanup;
+    }
+
+    for (off = hdrlen; off < index_offset && !err; off = next) {
+        if (!check_binary_block(data, off, index_offset, &payload, &plen,
+                                &nrec, &next)) {
+            fprintf(stderr, _("%s: corrupt block at offset %llu of %s\n"),
+                    progname, (unsigned long long)off, fname);
+            err = 1;
+            break;
+        }
+        err = begin_load_batch(context, &locked);
+        pos = payload;
+        for (i = 0; i < nrec && !err; i++)
+            err = load_binary_record(context, fname, &pos, payload + plen,
+                                     verbose);
+        if (end_load_batch(context, locked))
+            err = 1;
+    }
+
+cleanup:
+    if (mapped)
+        munmap(data, len);
+    else
+        free(data);
+    return err;
+}
+
+/* Load the records of f one at a time, holding the database lock across
+ * groups of them.  Return -1 for end of dump and 1 for failure. */
+static int
+load_serial(krb5_context context, char *dumpfile, FILE *f,
+            krb5_boolean verbose, dump_version *dump, int *linenop)
+{
+    int err = 0, i;
+    krb5_boolean locked;
+
+    while (!err) {
+        err = begin_load_batch(context, &locked);
+        for (i = 0; i < LOAD_LOCK_BATCH && !err; i++)
+            err = dump->load_record(context, dumpfile, f, verbose, linenop);
+        if (end_load_batch(context, locked) && err != 1)
+            err = 1;
+    }
+    return err;
+}
+
+/* Restore the database from any version dump file, using nthreads threads to
+ * parse principal records if nthreads is positive. */
 static int
 restore_dump(krb5_context context, char *dumpfile, FILE *f,
-             krb5_boolean verbose, dump_version *dump)
+             krb5_boolean verbose, dump_version *dump, int nthreads)
 {
     int err = 0;
     int lineno = 1;
 
-    /* Process the records. */
-    while (!(err = dump->load_record(context, dumpfile, f, verbose, &lineno)));
+    /* Process the records.  Workers only know how to parse principal records
+     * in the tagged formats. */
+    if (nthreads > 0 && dump != &ov_version)
+        err = load_parallel(context, dumpfile, f, verbose, dump, nthreads,
+                            &lineno);
+    else
+        err = load_serial(context, dumpfile, f, verbose, dump, &lineno);
     if (err != -1) {
         fprintf(stderr, _("%s: error processing line %d of %s\n"), progname,
                 lineno, dumpfile);
@@ -1480,9 +2754,32 @@ restore_dump(krb5_context context, char *dumpfile, FILE *f,
     return 0;
 }
 
+/*
+ * Read the commit message from fd, which must be "commit" followed by a
+ * newline.  A writer which dies partway through a dump closes fd without
+ * sending it, so the truncated dump is not mistaken for a complete one.
+ */
+static krb5_boolean
+read_commit(int fd)
+{
+    char buf[16];
+    size_t len = 0;
+    ssize_t n;
+
+    while (len < sizeof(buf)) {
+        n = read(fd, buf + len, sizeof(buf) - len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        len += n;
+    }
+    return len == 7 && memcmp(buf, "commit\n", 7) == 0;
+}
+
 /*
  * Usage: load_db [-ov] [-b7] [-r13] [-verbose] [-update] [-hash]
- *                filename
+ *                [-threads n] [-commit_fd fd] filename [principals...]
  */
 void
 load_db(int argc, char **argv)
@@ -1491,7 +2788,8 @@ load_db(int argc, char **argv)
     FILE *f = NULL;
     char *dumpfile = NULL, *dbname, buf[BUFSIZ];
     dump_version *load = NULL;
-    int aindex;
+    int aindex, nthreads = 0, nnames, commit_fd = -1;
+    char **names;
     kdb_log_context *log_ctx;
     kdb_last_t last;
     krb5_boolean db_locked = FALSE, temp_db_created = FALSE;
@@ -1523,6 +2821,12 @@ load_db(int argc, char **argv)
             verbose = TRUE;
         } else if (!strcmp(argv[aindex], "-update")){
             update = TRUE;
+        } else if (!strcmp(argv[aindex], "-threads")) {
+            if (++aindex >= argc || (nthreads = atoi(argv[aindex])) <= 0)
+                usage();
+        } else if (!strcmp(argv[aindex], "-commit_fd")) {
+            if (++aindex >= argc || (commit_fd = atoi(argv[aindex])) < 0)
+                usage();
         } else if (!strcmp(argv[aindex], "-hash")) {
             if (!add_db_arg("hash=true")) {
                 com_err(progname, ENOMEM, _("while parsing options"));
@@ -1532,9 +2836,13 @@ load_db(int argc, char **argv)
             break;
         }
     }
-    if (argc - aindex != 1)
+    if (argc - aindex < 1)
         usage();
     dumpfile = argv[aindex];
+    names = &argv[aindex + 1];
+    nnames = argc - aindex - 1;
+    if (strcmp(dumpfile, "-") == 0)
+        dumpfile = NULL;
 
     /* Open the dumpfile. */
     if (dumpfile != NULL) {
@@ -1571,6 +2879,8 @@ load_db(int argc, char **argv)
             load = &r1_8_version;
         } else if (strcmp(buf, r1_11_version.header) == 0) {
             load = &r1_11_version;
+        } else if (strcmp(buf, binary_version.header) == 0) {
+            load = &binary_version;
         } else if (strncmp(buf, ov_version.header,
                            strlen(ov_version.header)) == 0) {
             load = &ov_version;
@@ -1588,6 +2898,20 @@ load_db(int argc, char **argv)
         goto error;
     }
 
+    if (nnames > 0 && load != &binary_version) {
+        fprintf(stderr, _("%s: principals can only be selected from a "
+                          "binary dump\n"), progname);
+        goto error;
+    }
+
+    /* Without -update, the loaded principals would replace the whole
+     * database, including the master key principal. */
+    if (nnames > 0 && !update) {
+        fprintf(stderr, _("%s: principals can only be selected with the "
+                          "-update flag\n"), progname);
+        goto error;
+    }
+
     if (load->updateonly && !update) {
         fprintf(stderr, _("%s: dump version %s can only be loaded with the "
                           "-update flag\n"), progname, load->name);
@@ -1623,13 +2947,17 @@ load_db(int argc, char **argv)
         }
 
         /* Make sure the db is left unusable if the update fails, if the db
-         * supports locking. */
-        ret = krb5_db_lock(util_context, KRB5_DB_LOCKMODE_PERMANENT);
-        if (ret == 0) {
-            db_locked = TRUE;
-        } else if (ret != KRB5_PLUGIN_OP_NOTSUPP) {
-            com_err(progname, ret, _("while permanently locking database"));
-            goto error;
+         * supports locking.  Named principals are stored one at a time, so
+         * a failure to restore them leaves the db consistent. */
+        if (nnames == 0) {
+            ret = krb5_db_lock(util_context, KRB5_DB_LOCKMODE_PERMANENT);
+            if (ret == 0) {
+                db_locked = TRUE;
+            } else if (ret != KRB5_PLUGIN_OP_NOTSUPP) {
+                com_err(progname, ret,
+                        _("while permanently locking database"));
+                goto error;
+            }
         }
     }
 
@@ -1644,12 +2972,24 @@ load_db(int argc, char **argv)
         }
     }
 
-    if (restore_dump(util_context, dumpfile ? dumpfile : _("standard input"),
-                     f, verbose, load)) {
+    if (load == &binary_version) {
+        if (load_binary(util_context, dumpfile, f, verbose, names, nnames)) {
+            fprintf(stderr, _("%s: %s restore failed\n"), progname,
+                    load->name);
+            goto error;
+        }
+    } else if (restore_dump(util_context, dumpfile, f, verbose, load,
+                            nthreads)) {
         fprintf(stderr, _("%s: %s restore failed\n"), progname, load->name);
         goto error;
     }
 
+    if (commit_fd >= 0 && !read_commit(commit_fd)) {
+        fprintf(stderr, _("%s: no commit message received for %s\n"),
+                progname, dumpfile);
+        goto error;
+    }
+
     if (db_locked && (ret = krb5_db_unlock(util_context))) {
         com_err(progname, ret, _("while unlocking database"));
         goto error;
@@ -84,11 +84,13 @@ void usage()
               "\tcreate  [-s]\n"
               "\tdestroy [-f]\n"
               "\tstash   [-f keyfile]\n"
-              "\tdump    [-old|-ov|-b6|-b7|-r13|-r18] [-verbose]\n"
+              "\tdump    [-old|-ov|-b6|-b7|-r13|-r18|-binary] [-verbose]\n"
               "\t        [-mkey_convert] [-new_mkey_file mkey_file]\n"
-              "\t        [-rev] [-recurse] [filename [princs...]]\n"
+              "\t        [-rev] [-recurse] [-threads n]\n"
+              "\t        [filename [princs...]]\n"
               "\tload    [-old|-ov|-b6|-b7|-r13|-r18] [-verbose] [-update] "
-              "filename\n"
+              "[-threads n]\n"
+              "\t        [-commit_fd fd] filename [princs...]\n"
               "\tark     [-e etype_list] principal\n"
               "\tadd_mkey [-e etype] [-s]\n"
               "\tuse_mkey kvno [time]\n"
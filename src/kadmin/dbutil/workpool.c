@@ -0,0 +1,247 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* kadmin/dbutil/workpool.c - Ordered work queue for parallel dump and load */
+/*
+ * Copyright (C) 2026 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "k5-int.h"
+#include "k5-queue.h"
+#include "workpool.h"
+
+#ifdef ENABLE_THREADS
+
+#include <signal.h>
+
+struct workpool_job {
+    K5_TAILQ_ENTRY(workpool_job) links;
+    void *job;
+    krb5_boolean started;
+    krb5_boolean done;
+};
+
+K5_TAILQ_HEAD(job_list, workpool_job);
+
+struct workpool {
+    pthread_mutex_t lock;
+    pthread_cond_t work_cv;     /* signalled when a job is submitted */
+    pthread_cond_t done_cv;     /* signalled when a job is processed */
+    /* Submitted jobs which have not been retired, oldest first. */
+    struct job_list jobs;
+    size_t njobs;
+    krb5_boolean stopping;
+    workpool_fn fn;
+    krb5_context context;
+    int nthreads;
+    pthread_t *threads;
+};
+
+static void *
+thread_main(void *arg)
+{
+    struct workpool *pool = arg;
+    struct workpool_job *j;
+    krb5_context ctx;
+
+    /* Each thread gets its own context, since contexts are not safe for
+     * concurrent use.  If we can't make one, the job functions will have to
+     * cope with a null context. */
+    if (krb5_copy_context(pool->context, &ctx) != 0)
+        ctx = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        K5_TAILQ_FOREACH(j, &pool->jobs, links) {
+            if (!j->started)
+                break;
+        }
+        if (j == NULL) {
+            if (pool->stopping)
+                break;
+            pthread_cond_wait(&pool->work_cv, &pool->lock);
+            continue;
+        }
+        j->started = TRUE;
+        pthread_mutex_unlock(&pool->lock);
+        pool->fn(ctx, j->job);
+        pthread_mutex_lock(&pool->lock);
+        j->done = TRUE;
+        pthread_cond_broadcast(&pool->done_cv);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    krb5_free_context(ctx);
+    return NULL;
+}
+
+krb5_error_code
+workpool_create(krb5_context context, int nthreads, workpool_fn fn,
+                struct workpool **pool_out)
+{
+    struct workpool *pool;
+    sigset_t all, old;
+    int i, ret = 0;
+
+    *pool_out = NULL;
+    pool = calloc(1, sizeof(*pool));
+    if (pool == NULL)
+        return ENOMEM;
+    pool->threads = calloc(nthreads, sizeof(*pool->threads));
+    if (pool->threads == NULL) {
+        free(pool);
+        return ENOMEM;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cv, NULL);
+    pthread_cond_init(&pool->done_cv, NULL);
+    K5_TAILQ_INIT(&pool->jobs);
+    pool->fn = fn;
+    pool->context = context;
+
+    /* Leave signal handling to the main thread. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    for (i = 0; i < nthreads; i++) {
+        ret = pthread_create(&pool->threads[i], NULL, thread_main, pool);
+        if (ret)
+            break;
+        pool->nthreads++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret) {
+        workpool_free(pool);
+        return ret;
+    }
+    *pool_out = pool;
+    return 0;
+}
+
+krb5_error_code
+workpool_submit(struct workpool *pool, void *job)
+{
+    struct workpool_job *j;
+
+    j = calloc(1, sizeof(*j));
+    if (j == NULL)
+        return ENOMEM;
+    j->job = job;
+    pthread_mutex_lock(&pool->lock);
+    K5_TAILQ_INSERT_TAIL(&pool->jobs, j, links);
+    pool->njobs++;
+    pthread_cond_signal(&pool->work_cv);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+size_t
+workpool_pending(struct workpool *pool)
+{
+    size_t n;
+
+    pthread_mutex_lock(&pool->lock);
+    n = pool->njobs;
+    pthread_mutex_unlock(&pool->lock);
+    return n;
+}
+
+void *
+workpool_retire(struct workpool *pool)
+{
+    struct workpool_job *j;
+    void *job;
+
+    pthread_mutex_lock(&pool->lock);
+    j = K5_TAILQ_FIRST(&pool->jobs);
+    while (j != NULL && !j->done)
+        pthread_cond_wait(&pool->done_cv, &pool->lock);
+    if (j != NULL) {
+        K5_TAILQ_REMOVE(&pool->jobs, j, links);
+        pool->njobs--;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (j == NULL)
+        return NULL;
+    job = j->job;
+    free(j);
+    return job;
+}
+
+void
+workpool_free(struct workpool *pool)
+{
+    int i;
+
+    if (pool == NULL)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = TRUE;
+    pthread_cond_broadcast(&pool->work_cv);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 0; i < pool->nthreads; i++)
+        pthread_join(pool->threads[i], NULL);
+    assert(K5_TAILQ_EMPTY(&pool->jobs));
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cv);
+    pthread_cond_destroy(&pool->done_cv);
+    free(pool->threads);
+    free(pool);
+}
+
+#else /* not ENABLE_THREADS */
+
+krb5_error_code
+workpool_create(krb5_context context, int nthreads, workpool_fn fn,
+                struct workpool **pool_out)
+{
+    *pool_out = NULL;
+    return ENOTSUP;
+}
+
+krb5_error_code
+workpool_submit(struct workpool *pool, void *job)
+{
+    return ENOTSUP;
+}
+
+size_t
+workpool_pending(struct workpool *pool)
+{
+    return 0;
+}
+
+void *
+workpool_retire(struct workpool *pool)
+{
+    return NULL;
+}
+
+void
+workpool_free(struct workpool *pool)
+{
+}
+
+#endif /* not ENABLE_THREADS */
@@ -0,0 +1,65 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* kadmin/dbutil/workpool.h - Ordered work queue for parallel dump and load */
+/*
+ * Copyright (C) 2026 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+/*
+ * A work pool runs a function over a sequence of jobs on a set of threads,
+ * and hands the jobs back to the caller in the order they were submitted.
+ * Each thread has its own copy of the caller's krb5 context.
+ */
+
+typedef void (*workpool_fn)(krb5_context context, void *job);
+
+struct workpool;
+
+/* Start nthreads threads which will call fn on submitted jobs.  Return
+ * ENOTSUP if the build does not support threads. */
+krb5_error_code workpool_create(krb5_context context, int nthreads,
+                                workpool_fn fn, struct workpool **pool_out);
+
+/* Queue job to be processed by a worker thread. */
+krb5_error_code workpool_submit(struct workpool *pool, void *job);
+
+/* Return the number of jobs submitted but not yet retired. */
+size_t workpool_pending(struct workpool *pool);
+
+/* Wait for the oldest unretired job to be processed and return it, or return
+ * NULL if no jobs are pending. */
+void *workpool_retire(struct workpool *pool);
+
+/* Stop the worker threads and free pool.  All jobs must have been
+ * retired. */
+void workpool_free(struct workpool *pool);
+
+#endif /* WORKPOOL_H */
@@ -7,7 +7,7 @@
 /* #pragma ident	"@(#)ipropd_svc.c	1.2	04/02/20 SMI" */
 
 
-#include "k5-platform.h"
+#include "k5-int.h"
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/resource.h> /* rlimit */
@@ -129,18 +129,207 @@ buf_to_string(gss_buffer_desc *b)
     return s;
 }
 
-kdb_incr_result_t *
-iprop_get_updates_1_svc(kdb_last_t *arg, struct svc_req *rqstp)
+/*
+ * Replicas which ask to wait for updates while already up to date are parked
+ * here instead of being answered right away.  A parked request is answered by
+ * iprop_wake_waiters() as soon as the ulog moves past the replica's serial
+ * number, or with UPDATE_NIL after IPROP_WAIT_TIME seconds.  While a request
+ * is parked, the destroy method of its transport is hooked so that we forget
+ * the request if the replica disconnects.
+ */
+struct iprop_waiter {
+    SVCXPRT *transp;
+    struct xp_ops ops;
+    struct xp_ops *orig_ops;
+    kdb_last_t last;
+    time_t expire;
+    char *client_name;
+    char *service_name;
+    struct iprop_waiter *next;
+};
+
+static struct iprop_waiter *waiters;
+
+static void
+log_updates_result(char *whoami, kdb_last_t *arg, kdb_incr_result_t *ret,
+		   int kret, char *client_name, char *service_name,
+		   SVCXPRT *transp)
 {
-    static kdb_incr_result_t ret;
-    char *whoami = "iprop_get_updates_1";
+    char obuf[256] = {0};
+
+    if (ret->ret == UPDATE_OK) {
+	(void) snprintf(obuf, sizeof (obuf),
+			_("%s; Incoming SerialNo=%lu; Outgoing SerialNo=%lu"),
+			replystr(ret->ret),
+			(unsigned long)arg->last_sno,
+			(unsigned long)ret->lastentry.last_sno);
+    } else {
+	(void) snprintf(obuf, sizeof (obuf),
+			_("%s; Incoming SerialNo=%lu; Outgoing SerialNo=N/A"),
+			replystr(ret->ret),
+			(unsigned long)arg->last_sno);
+    }
+
+    DPRINT("%s: request %s %s\n\tclprinc=`%s'\n\tsvcprinc=`%s'\n",
+	   whoami, obuf,
+	   ((kret == 0) ? "success" : error_message(kret)),
+	   client_name, service_name);
+
+    krb5_klog_syslog(LOG_NOTICE,
+		     _("Request: %s, %s, %s, client=%s, service=%s, addr=%s"),
+		     whoami,
+		     obuf,
+		     ((kret == 0) ? "success" : error_message(kret)),
+		     client_name, service_name,
+		     client_addr(transp));
+}
+
+/* Remove w from the list of waiters and free it. */
+static void
+unpark(struct iprop_waiter *w)
+{
+    struct iprop_waiter **wp;
+
+    for (wp = &waiters; *wp != NULL; wp = &(*wp)->next) {
+	if (*wp == w) {
+	    *wp = w->next;
+	    break;
+	}
+    }
+    w->transp->xp_ops = w->orig_ops;
+    free(w->client_name);
+    free(w->service_name);
+    free(w);
+}
+
+static struct iprop_waiter *
+find_waiter(SVCXPRT *transp)
+{
+    struct iprop_waiter *w;
+
+    for (w = waiters; w != NULL; w = w->next) {
+	if (w->transp == transp)
+	    return w;
+    }
+    return NULL;
+}
+
+/* Destroy method for the transport of a parked request. */
+static void
+waiter_destroy(SVCXPRT *transp)
+{
+    struct iprop_waiter *w = find_waiter(transp);
+    struct xp_ops *orig_ops = w->orig_ops;
+
+    unpark(w);
+    orig_ops->xp_destroy(transp);
+}
+
+/* Fetch the updates past *last into *ret and log the result. */
+static void
+fetch_updates(kdb_last_t *last, kdb_incr_result_t *ret, char *client_name,
+	      char *service_name, SVCXPRT *transp)
+{
+    kadm5_server_handle_t handle = thread_server_handle();
+    char *whoami = "iprop_get_updates_wait_1";
     int kret;
-    kadm5_server_handle_t handle = global_server_handle;
+
+    memset(ret, 0, sizeof(*ret));
+    kret = ulog_get_entries(handle->context, last, ret);
+    log_updates_result(whoami, last, ret, kret, client_name, service_name,
+		       transp);
+    if (nofork)
+	debprret(whoami, ret->ret, ret->lastentry.last_sno);
+}
+
+static void
+send_updates(SVCXPRT *transp, kdb_incr_result_t *ret)
+{
+    if (!svc_sendreply(transp, xdr_kdb_incr_result_t, (caddr_t)ret)) {
+	krb5_klog_syslog(LOG_ERR, _("RPC svc_sendreply failed (%s)"),
+			 "iprop_get_updates_wait_1");
+    }
+}
+
+static void
+free_updates(kdb_incr_result_t *ret)
+{
+    if (ret->ret == UPDATE_OK) {
+	ulog_free_entries(ret->updates.kdb_ulog_t_val,
+			  ret->updates.kdb_ulog_t_len);
+	ret->updates.kdb_ulog_t_val = NULL;
+	ret->updates.kdb_ulog_t_len = 0;
+    }
+}
+
+/*
+ * Park the request being processed on transp until there are updates past
+ * *arg.  Takes ownership of client_name and service_name on success.
+ */
+static krb5_boolean
+park(kdb_last_t *arg, SVCXPRT *transp, char *client_name, char *service_name)
+{
+    struct iprop_waiter *w;
+
+    w = malloc(sizeof(*w));
+    if (w == NULL)
+	return FALSE;
+    w->transp = transp;
+    w->orig_ops = transp->xp_ops;
+    w->ops = *transp->xp_ops;
+    w->ops.xp_destroy = waiter_destroy;
+    w->last = *arg;
+    w->expire = time(NULL) + IPROP_WAIT_TIME;
+    w->client_name = client_name;
+    w->service_name = service_name;
+    w->next = waiters;
+    waiters = w;
+    transp->xp_ops = &w->ops;
+    return TRUE;
+}
+
+/*
+ * Park a request which found no updates, or log its result if it cannot be
+ * parked.  Takes ownership of client_name and service_name.  Return true if
+ * the request was parked.
+ */
+static krb5_boolean
+park_or_log(kdb_last_t *last, kdb_incr_result_t *ret, SVCXPRT *transp,
+	    char *client_name, char *service_name)
+{
+    char *whoami = "iprop_get_updates_wait_1";
+
+    if (park(last, transp, client_name, service_name)) {
+	DPRINT("%s: parked until updates arrive\n", whoami);
+	return TRUE;
+    }
+    log_updates_result(whoami, last, ret, 0, client_name, service_name,
+		       transp);
+    if (nofork)
+	debprret(whoami, ret->ret, ret->lastentry.last_sno);
+    free(client_name);
+    free(service_name);
+    return FALSE;
+}
+
+/*
+ * Fill in *ret with the updates past *arg, if the client is authorized.  If
+ * wait is true and there are no updates yet, return true and set *client_out
+ * and *service_out instead of logging the result, so that the caller can park
+ * the request.
+ */
+static krb5_boolean
+get_updates(kdb_last_t *arg, struct svc_req *rqstp, krb5_boolean wait,
+	    kdb_incr_result_t *ret, char **client_out, char **service_out)
+{
+    char *whoami = wait ? "iprop_get_updates_wait_1" : "iprop_get_updates_1";
+    int kret;
+    kadm5_server_handle_t handle = thread_server_handle();
     char *client_name = 0, *service_name = 0;
-    char obuf[256] = {0};
 
     /* default return code */
-    ret.ret = UPDATE_ERROR;
+    memset(ret, 0, sizeof(*ret));
+    ret->ret = UPDATE_ERROR;
 
     DPRINT("%s: start, last_sno=%lu\n", whoami,
 	    (unsigned long)arg->last_sno);
@@ -179,7 +368,7 @@ iprop_get_updates_1_svc(kdb_last_t *arg, struct svc_req *rqstp)
 			    ACL_IPROP,
 			    NULL,
 			    NULL)) {
-	ret.ret = UPDATE_PERM_DENIED;
+	ret->ret = UPDATE_PERM_DENIED;
 
 	DPRINT("%s: PERMISSION DENIED: clprinc=`%s'\n\tsvcprinc=`%s'\n",
 		whoami, client_name, service_name);
@@ -190,42 +379,188 @@ iprop_get_updates_1_svc(kdb_last_t *arg, struct svc_req *rqstp)
 	goto out;
     }
 
-    kret = ulog_get_entries(handle->context, arg, &ret);
-
-    if (ret.ret == UPDATE_OK) {
-	(void) snprintf(obuf, sizeof (obuf),
-			_("%s; Incoming SerialNo=%lu; Outgoing SerialNo=%lu"),
-			replystr(ret.ret),
-			(unsigned long)arg->last_sno,
-			(unsigned long)ret.lastentry.last_sno);
-    } else {
-	(void) snprintf(obuf, sizeof (obuf),
-			_("%s; Incoming SerialNo=%lu; Outgoing SerialNo=N/A"),
-			replystr(ret.ret),
-			(unsigned long)arg->last_sno);
+    kret = ulog_get_entries(handle->context, arg, ret);
+    if (wait && kret == 0 && ret->ret == UPDATE_NIL) {
+	*client_out = client_name;
+	*service_out = service_name;
+	return TRUE;
     }
-
-    DPRINT("%s: request %s %s\n\tclprinc=`%s'\n\tsvcprinc=`%s'\n",
-	   whoami, obuf,
-	   ((kret == 0) ? "success" : error_message(kret)),
-	   client_name, service_name);
-
-    krb5_klog_syslog(LOG_NOTICE,
-		     _("Request: %s, %s, %s, client=%s, service=%s, addr=%s"),
-		     whoami,
-		     obuf,
-		     ((kret == 0) ? "success" : error_message(kret)),
-		     client_name, service_name,
-		     client_addr(rqstp->rq_xprt));
+    log_updates_result(whoami, arg, ret, kret, client_name, service_name,
+		       rqstp->rq_xprt);
 
 out:
     if (nofork)
-	debprret(whoami, ret.ret, ret.lastentry.last_sno);
+	debprret(whoami, ret->ret, ret->lastentry.last_sno);
     free(client_name);
     free(service_name);
-    return (&ret);
+    return FALSE;
+}
+
+/*
+ * A GET_UPDATES or GET_UPDATES_WAIT request, or the answer to a parked
+ * request, being processed by the writer thread.  Running these on the writer
+ * orders them after every write submitted before them, and keeps the writer's
+ * pending group commit from being read by another context.
+ */
+struct iprop_job {
+    struct svc_req rqst;
+    kdb_last_t last;
+    krb5_boolean parked;
+    krb5_boolean park;
+    char *client_name;
+    char *service_name;
+    kdb_incr_result_t ret;
+};
+
+static void
+run_iprop_job(void *data)
+{
+    struct iprop_job *job = data;
+
+    if (job->parked) {
+	fetch_updates(&job->last, &job->ret, job->client_name,
+		      job->service_name, job->rqst.rq_xprt);
+    } else {
+	job->park = get_updates(&job->last, &job->rqst,
+				job->rqst.rq_proc == IPROP_GET_UPDATES_WAIT,
+				&job->ret, &job->client_name,
+				&job->service_name);
+    }
+}
+
+static void
+finish_iprop_job(void *data, krb5_boolean transp_alive)
+{
+    struct iprop_job *job = data;
+    SVCXPRT *transp = job->rqst.rq_xprt;
+    krb5_boolean parked = FALSE;
+
+    if (transp_alive && job->park) {
+	parked = park_or_log(&job->last, &job->ret, transp, job->client_name,
+			     job->service_name);
+	job->client_name = job->service_name = NULL;
+    }
+    if (transp_alive && !parked)
+	send_updates(transp, &job->ret);
+    free_updates(&job->ret);
+    free(job->client_name);
+    free(job->service_name);
+    free(job);
 }
 
+/* Hand job to the writer thread, or answer UPDATE_BUSY if that fails. */
+static void
+submit_iprop_job(struct iprop_job *job)
+{
+    SVCXPRT *transp = job->rqst.rq_xprt;
+
+    if (workers_submit(transp, WORKER_WRITE, run_iprop_job, finish_iprop_job,
+		       job) != 0) {
+	job->park = FALSE;
+	job->ret.ret = UPDATE_BUSY;
+	finish_iprop_job(job, TRUE);
+    }
+}
+
+/* Answer a parked request with whatever the ulog now holds. */
+static void
+answer_waiter(struct iprop_waiter *w)
+{
+    kdb_incr_result_t ret;
+    struct iprop_job *job;
+    SVCXPRT *transp = w->transp;
+
+    if (workers_active()) {
+	job = calloc(1, sizeof(*job));
+	if (job == NULL)
+	    return;
+	job->rqst.rq_xprt = transp;
+	job->last = w->last;
+	job->parked = TRUE;
+	job->client_name = w->client_name;
+	job->service_name = w->service_name;
+	w->client_name = w->service_name = NULL;
+	unpark(w);
+	submit_iprop_job(job);
+	return;
+    }
+
+    fetch_updates(&w->last, &ret, w->client_name, w->service_name, transp);
+    transp->xp_ops = w->orig_ops;
+    send_updates(transp, &ret);
+    free_updates(&ret);
+    unpark(w);
+}
+
+/*
+ * Answer any parked requests for which there are new updates, or which have
+ * waited long enough.  Updates awaiting a group commit, in this context or
+ * the writer thread's, are not announced until they are committed.
+ */
+void
+iprop_wake_waiters(void)
+{
+    kadm5_server_handle_t handle = global_server_handle;
+    kdb_log_context *log_ctx;
+    struct iprop_waiter *w, *next;
+    krb5_boolean pending;
+    time_t now;
+
+    if (waiters == NULL || handle == NULL)
+	return;
+    log_ctx = handle->context->kdblog_context;
+    pending = (log_ctx != NULL &&
+	       (log_ctx->npending > 0 ||
+		(log_ctx->ulog != NULL &&
+		 log_ctx->ulog->kdb_state != KDB_STABLE)));
+    now = time(NULL);
+    for (w = waiters; w != NULL; w = next) {
+	next = w->next;
+	if (now >= w->expire ||
+	    (!pending &&
+	     ulog_get_sno_status(handle->context, &w->last) != UPDATE_NIL))
+	    answer_waiter(w);
+    }
+}
+
+kdb_incr_result_t *
+iprop_get_updates_1_svc(kdb_last_t *arg, struct svc_req *rqstp)
+{
+    static kdb_incr_result_t ret;
+
+    (void)get_updates(arg, rqstp, FALSE, &ret, NULL, NULL);
+    return &ret;
+}
+
+kdb_incr_result_t *
+iprop_get_updates_wait_1_svc(kdb_last_t *arg, struct svc_req *rqstp)
+{
+    static kdb_incr_result_t ret;
+    char *client_name, *service_name;
+
+    if (get_updates(arg, rqstp, TRUE, &ret, &client_name, &service_name) &&
+	park_or_log(arg, &ret, rqstp->rq_xprt, client_name, service_name))
+	return NULL;
+    return &ret;
+}
+
+/* Process a GET_UPDATES or GET_UPDATES_WAIT request on the writer thread. */
+static void
+defer_get_updates(struct svc_req *rqstp, kdb_last_t *arg)
+{
+    static kdb_incr_result_t busy;
+    struct iprop_job *job;
+
+    job = calloc(1, sizeof(*job));
+    if (job == NULL) {
+	busy.ret = UPDATE_BUSY;
+	send_updates(rqstp->rq_xprt, &busy);
+	return;
+    }
+    job->rqst = *rqstp;
+    job->last = *arg;
+    submit_iprop_job(job);
+}
 
 /*
  * Given a client princ (foo/fqdn@R), copy (in arg cl) the fqdn substring.
@@ -531,11 +866,13 @@ krb5_iprop_prog_1(struct svc_req *rqstp,
 {
     union {
 	kdb_last_t iprop_get_updates_1_arg;
+	kdb_last_t iprop_get_updates_wait_1_arg;
     } argument;
     char *result;
     bool_t (*_xdr_argument)(), (*_xdr_result)();
     char *(*local)(/* union XXX *, struct svc_req * */);
     char *whoami = "krb5_iprop_prog_1";
+    struct iprop_waiter *w;
 
     if (!check_iprop_rpcsec_auth(rqstp)) {
 	krb5_klog_syslog(LOG_ERR, _("authentication attempt failed: %s, RPC "
@@ -546,6 +883,12 @@ krb5_iprop_prog_1(struct svc_req *rqstp,
 	return;
     }
 
+    /* A replica should not send another request while one is parked, but
+     * forget the parked one if it does. */
+    w = find_waiter(transp);
+    if (w != NULL)
+	unpark(w);
+
     switch (rqstp->rq_proc) {
     case NULLPROC:
 	(void) svc_sendreply(transp, xdr_void,
@@ -558,6 +901,12 @@ krb5_iprop_prog_1(struct svc_req *rqstp,
 	local = (char *(*)()) iprop_get_updates_1_svc;
 	break;
 
+    case IPROP_GET_UPDATES_WAIT:
+	_xdr_argument = xdr_kdb_last_t;
+	_xdr_result = xdr_kdb_incr_result_t;
+	local = (char *(*)()) iprop_get_updates_wait_1_svc;
+	break;
+
     case IPROP_FULL_RESYNC:
 	_xdr_argument = xdr_void;
 	_xdr_result = xdr_kdb_fullresync_result_t;
@@ -585,7 +934,12 @@ krb5_iprop_prog_1(struct svc_req *rqstp,
 	svcerr_decode(transp);
 	return;
     }
-    result = (*local)(&argument, rqstp);
+    if (workers_active() && _xdr_result == xdr_kdb_incr_result_t) {
+	defer_get_updates(rqstp, &argument.iprop_get_updates_1_arg);
+	result = NULL;
+    } else {
+	result = (*local)(&argument, rqstp);
+    }
 
     if (_xdr_result && result != NULL &&
 	!svc_sendreply(transp, _xdr_result, result)) {
@@ -602,16 +956,9 @@ krb5_iprop_prog_1(struct svc_req *rqstp,
 	exit(1);
     }
 
-    if (rqstp->rq_proc == IPROP_GET_UPDATES) {
-	/* LINTED */
-	kdb_incr_result_t *r = (kdb_incr_result_t *)result;
-
-	if (r->ret == UPDATE_OK) {
-	    ulog_free_entries(r->updates.kdb_ulog_t_val,
-			      r->updates.kdb_ulog_t_len);
-	    r->updates.kdb_ulog_t_val = NULL;
-	    r->updates.kdb_ulog_t_len = 0;
-	}
+    if ((rqstp->rq_proc == IPROP_GET_UPDATES ||
+	 rqstp->rq_proc == IPROP_GET_UPDATES_WAIT) && result != NULL) {
+	free_updates((kdb_incr_result_t *)result);
     }
 
 }
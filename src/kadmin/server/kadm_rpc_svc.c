@@ -19,6 +19,105 @@ extern void *global_server_handle;
 
 static int check_rpcsec_auth(struct svc_req *);
 
+union kadm_arg {
+     cprinc_arg create_principal_2_arg;
+     dprinc_arg delete_principal_2_arg;
+     mprinc_arg modify_principal_2_arg;
+     rprinc_arg rename_principal_2_arg;
+     gprinc_arg get_principal_2_arg;
+     chpass_arg chpass_principal_2_arg;
+     chrand_arg chrand_principal_2_arg;
+     cpol_arg create_policy_2_arg;
+     dpol_arg delete_policy_2_arg;
+     mpol_arg modify_policy_2_arg;
+     gpol_arg get_policy_2_arg;
+     setkey_arg setkey_principal_2_arg;
+     setv4key_arg setv4key_principal_2_arg;
+     cprinc3_arg create_principal3_2_arg;
+     chpass3_arg chpass_principal3_2_arg;
+     chrand3_arg chrand_principal3_2_arg;
+     setkey3_arg setkey_principal3_2_arg;
+     setkey4_arg setkey_principal4_2_arg;
+     getpkeys_arg get_principal_keys_2_arg;
+     gprincs_page_arg get_princs_page_2_arg;
+};
+
+union kadm_res {
+     generic_ret gen_ret;
+     gprinc_ret get_principal_2_ret;
+     chrand_ret chrand_principal_2_ret;
+     gpol_ret get_policy_2_ret;
+     getprivs_ret get_privs_2_ret;
+     gprincs_ret get_princs_2_ret;
+     gpols_ret get_pols_2_ret;
+     chrand_ret chrand_principal3_2_ret;
+     gstrings_ret get_string_2_ret;
+     getpkeys_ret get_principal_keys_ret;
+     gprincs_page_ret get_princs_page_2_ret;
+};
+
+/* A request being processed by a worker thread. */
+struct kadm_job {
+     struct svc_req rqst;
+     bool_t (*xdr_argument)(), (*xdr_result)();
+     bool_t (*local)();
+     union kadm_arg argument;
+     union kadm_res result;
+     bool_t retval;
+};
+
+static void
+run_job(void *data)
+{
+     struct kadm_job *job = data;
+
+     job->retval = (*job->local)(&job->argument, &job->result, &job->rqst);
+}
+
+static void
+finish_job(void *data, krb5_boolean transp_alive)
+{
+     struct kadm_job *job = data;
+     SVCXPRT *transp = job->rqst.rq_xprt;
+
+     if (transp_alive && job->retval &&
+	 !svc_sendreply(transp, job->xdr_result, (void *)&job->result)) {
+	  krb5_klog_syslog(LOG_ERR, "WARNING! Unable to send function results, "
+		 "continuing.");
+	  svcerr_systemerr(transp);
+     }
+     xdr_free(job->xdr_argument, &job->argument);
+     xdr_free(job->xdr_result, &job->result);
+     free(job);
+}
+
+/*
+ * Hand a decoded request to a worker thread, and send the reply when it is
+ * done.  Return false if the request should be processed here instead.
+ */
+static krb5_boolean
+defer_request(struct svc_req *rqstp, enum worker_mode mode,
+	      bool_t (*xdr_argument)(), union kadm_arg *argument,
+	      bool_t (*xdr_result)(), bool_t (*local)())
+{
+     struct kadm_job *job;
+
+     job = calloc(1, sizeof(*job));
+     if (job == NULL)
+	  return FALSE;
+     job->rqst = *rqstp;
+     job->xdr_argument = xdr_argument;
+     job->xdr_result = xdr_result;
+     job->local = local;
+     job->argument = *argument;
+     if (workers_submit(rqstp->rq_xprt, mode, run_job, finish_job,
+			job) != 0) {
+	  free(job);
+	  return FALSE;
+     }
+     return TRUE;
+}
+
 /*
  * Function: kadm_1
  *
@@ -40,42 +139,12 @@ void kadm_1(rqstp, transp)
    struct svc_req *rqstp;
    register SVCXPRT *transp;
 {
-     union {
-	  cprinc_arg create_principal_2_arg;
-	  dprinc_arg delete_principal_2_arg;
-	  mprinc_arg modify_principal_2_arg;
-	  rprinc_arg rename_principal_2_arg;
-	  gprinc_arg get_principal_2_arg;
-	  chpass_arg chpass_principal_2_arg;
-	  chrand_arg chrand_principal_2_arg;
-	  cpol_arg create_policy_2_arg;
-	  dpol_arg delete_policy_2_arg;
-	  mpol_arg modify_policy_2_arg;
-	  gpol_arg get_policy_2_arg;
-	  setkey_arg setkey_principal_2_arg;
-	  setv4key_arg setv4key_principal_2_arg;
-	  cprinc3_arg create_principal3_2_arg;
-	  chpass3_arg chpass_principal3_2_arg;
-	  chrand3_arg chrand_principal3_2_arg;
-	  setkey3_arg setkey_principal3_2_arg;
-	  setkey4_arg setkey_principal4_2_arg;
-	  getpkeys_arg get_principal_keys_2_arg;
-     } argument;
-     union {
-	  generic_ret gen_ret;
-	  gprinc_ret get_principal_2_ret;
-	  chrand_ret chrand_principal_2_ret;
-	  gpol_ret get_policy_2_ret;
-	  getprivs_ret get_privs_2_ret;
-	  gprincs_ret get_princs_2_ret;
-	  gpols_ret get_pols_2_ret;
-	  chrand_ret chrand_principal3_2_ret;
-	  gstrings_ret get_string_2_ret;
-	  getpkeys_ret get_principal_keys_ret;
-     } result;
+     union kadm_arg argument;
+     union kadm_res result;
      bool_t retval;
      bool_t (*xdr_argument)(), (*xdr_result)();
      bool_t (*local)();
+     enum worker_mode mode = WORKER_WRITE;
 
      if (rqstp->rq_cred.oa_flavor != AUTH_GSSAPI &&
 	 !check_rpcsec_auth(rqstp)) {
@@ -120,12 +189,14 @@ void kadm_1(rqstp, transp)
 	  xdr_argument = xdr_gprinc_arg;
 	  xdr_result = xdr_gprinc_ret;
 	  local = (bool_t (*)()) get_principal_2_svc;
+	  mode = WORKER_READ;
 	  break;
 
      case GET_PRINCS:
 	  xdr_argument = xdr_gprincs_arg;
 	  xdr_result = xdr_gprincs_ret;
 	  local = (bool_t (*)()) get_princs_2_svc;
+	  mode = WORKER_ITERATE;
 	  break;
 
      case CHPASS_PRINCIPAL:
@@ -174,24 +245,28 @@ void kadm_1(rqstp, transp)
 	  xdr_argument = xdr_gpol_arg;
 	  xdr_result = xdr_gpol_ret;
 	  local = (bool_t (*)()) get_policy_2_svc;
+	  mode = WORKER_READ;
 	  break;
 
      case GET_POLS:
 	  xdr_argument = xdr_gpols_arg;
 	  xdr_result = xdr_gpols_ret;
 	  local = (bool_t (*)()) get_pols_2_svc;
+	  mode = WORKER_ITERATE;
 	  break;
 
      case GET_PRIVS:
 	  xdr_argument = xdr_u_int32;
 	  xdr_result = xdr_getprivs_ret;
 	  local = (bool_t (*)()) get_privs_2_svc;
+	  mode = WORKER_READ;
 	  break;
 
      case INIT:
 	  xdr_argument = xdr_u_int32;
 	  xdr_result = xdr_generic_ret;
 	  local = (bool_t (*)()) init_2_svc;
+	  mode = WORKER_READ;
 	  break;
 
      case CREATE_PRINCIPAL3:
@@ -228,6 +303,7 @@ void kadm_1(rqstp, transp)
 	  xdr_argument = xdr_gstrings_arg;
 	  xdr_result = xdr_gstrings_ret;
 	  local = (bool_t (*)()) get_strings_2_svc;
+	  mode = WORKER_READ;
 	  break;
 
      case SET_STRING:
@@ -246,6 +322,14 @@ void kadm_1(rqstp, transp)
 	  xdr_argument = xdr_getpkeys_arg;
 	  xdr_result = xdr_getpkeys_ret;
 	  local = (bool_t (*)()) get_principal_keys_2_svc;
+	  mode = WORKER_READ;
+	  break;
+
+     case GET_PRINCS_PAGE:
+	  xdr_argument = xdr_gprincs_page_arg;
+	  xdr_result = xdr_gprincs_page_ret;
+	  local = (bool_t (*)()) get_princs_page_2_svc;
+	  mode = WORKER_ITERATE;
 	  break;
 
      default:
@@ -259,8 +343,18 @@ void kadm_1(rqstp, transp)
 	  svcerr_decode(transp);
 	  return;
      }
+     /*
+      * With AUTH_GSSAPI, the transport's auth state is reset when this
+      * function returns, so the reply must be sent before then.
+      */
+     if (workers_active() && rqstp->rq_cred.oa_flavor == RPCSEC_GSS &&
+	 defer_request(rqstp, mode, xdr_argument, &argument, xdr_result,
+		       local))
+	  return;
      memset(&result, 0, sizeof(result));
+     workers_begin(mode);
      retval = (*local)(&argument, &result, rqstp);
+     workers_end(mode);
      if (retval && !svc_sendreply(transp, xdr_result, (void *)&result)) {
 	  krb5_klog_syslog(LOG_ERR, "WARNING! Unable to send function results, "
 		 "continuing.");
@@ -274,6 +368,9 @@ void kadm_1(rqstp, transp)
 	  krb5_klog_syslog(LOG_ERR, "WARNING! Unable to free results, "
 		 "continuing.");
      }
+
+     /* Let replicas waiting for updates know about any this request made. */
+     iprop_wake_waiters();
      return;
 }
 
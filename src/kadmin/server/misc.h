@@ -55,6 +55,47 @@ void log_badauth(OM_uint32 major, OM_uint32 minor, SVCXPRT *xprt, char *data);
 
 const char *client_addr(SVCXPRT *xprt);
 
+/* workers.c */
+#define CLIENT_ADDR_BUFSIZE 128
+
+/* How a request uses the database.  Requests which iterate over the database
+ * may not run alongside a write; other reads may. */
+enum worker_mode { WORKER_READ, WORKER_ITERATE, WORKER_WRITE };
+
+typedef void (*worker_run_fn)(void *data);
+typedef void (*worker_done_fn)(void *data, krb5_boolean transp_alive);
+
+/* Start nthreads reader threads and a writer thread, each with a server handle
+ * made from params and db_args.  Do nothing if nthreads is 0; return ENOTSUP
+ * if this build cannot run workers. */
+krb5_error_code
+workers_init(verto_ctx *ctx, int nthreads, kadm5_config_params *params,
+             char **db_args);
+
+/* Return true if workers_init() started any threads. */
+krb5_boolean workers_active(void);
+
+/* Call run(data) on a worker thread, then done(data, alive) on the main
+ * thread.  WORKER_WRITE jobs run on the writer thread, in the order they were
+ * submitted.  alive is false if transp was closed meanwhile, in which case
+ * done must not use it. */
+krb5_error_code
+workers_submit(SVCXPRT *transp, enum worker_mode mode, worker_run_fn run,
+               worker_done_fn done, void *data);
+
+/* Bracket a request processed on the main thread, waiting until it may run
+ * alongside the workers. */
+void workers_begin(enum worker_mode mode);
+void workers_end(enum worker_mode mode);
+
+/* Return the server handle to use on the current thread. */
+void *thread_server_handle(void);
+
+/* Return a CLIENT_ADDR_BUFSIZE buffer belonging to the current thread. */
+char *thread_addr_buf(void);
+
+void workers_fini(void);
+
 /* network.c */
 #include "net-server.h"
 
@@ -62,6 +103,9 @@ const char *client_addr(SVCXPRT *xprt);
 void
 krb5_iprop_prog_1(struct svc_req *rqstp, SVCXPRT *transp);
 
+void
+iprop_wake_waiters(void);
+
 kadm5_ret_t
 kiprop_get_adm_host_srv_name(krb5_context,
                              const char *,
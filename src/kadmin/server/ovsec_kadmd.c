@@ -30,7 +30,7 @@
  * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
  */
 
-#include <k5-platform.h>
+#include <k5-int.h>
 #include <errno.h>
 #include <locale.h>
 #include <stdio.h>
@@ -179,6 +179,67 @@ setup_loop(int proponly, verto_ctx **ctx_out)
                               DEFAULT_TCP_LISTEN_BACKLOG);
 }
 
+static void
+sync_ulog(verto_ctx *ctx, verto_ev *ev)
+{
+    (void)ulog_sync(context);
+    iprop_wake_waiters();
+}
+
+/* Answer replicas waiting for updates made by other processes, or which have
+ * waited long enough. */
+static void
+wake_iprop_waiters(verto_ctx *ctx, verto_ev *ev)
+{
+    iprop_wake_waiters();
+}
+
+/* If a group commit delay is configured for the update log, enable it and
+ * commit pending updates from the main loop at that interval. */
+static krb5_error_code
+setup_ulog_commit(verto_ctx *ctx, const char *realm)
+{
+    int delay;
+
+    if (profile_get_integer(context->profile, KRB5_CONF_REALMS, realm,
+                            KRB5_CONF_IPROP_COMMIT_DELAY, 0, &delay) != 0 ||
+        delay <= 0)
+        return 0;
+    if (verto_add_timeout(ctx, VERTO_EV_FLAG_PERSIST, sync_ulog,
+                          delay) == NULL)
+        return ENOMEM;
+    ulog_set_commit_delay(context, delay);
+    return 0;
+}
+
+/* If the realm configures kadmind_threads, start that many worker threads
+ * for read-only requests. */
+static krb5_error_code
+setup_workers(verto_ctx *ctx, kadm5_config_params *params, char **db_args)
+{
+    krb5_error_code ret;
+    int nthreads;
+
+    ret = profile_get_integer(context->profile, KRB5_CONF_REALMS,
+                              params->realm, KRB5_CONF_KADMIND_THREADS, 0,
+                              &nthreads);
+    if (ret || nthreads <= 0)
+        return ret;
+    if (params->mkey_from_kbd) {
+        /* Each worker would prompt for the master key again. */
+        krb5_klog_syslog(LOG_WARNING, _("kadmind_threads cannot be used "
+                                        "with -m; ignoring"));
+        return 0;
+    }
+    ret = workers_init(ctx, nthreads, params, db_args);
+    if (ret == ENOTSUP) {
+        krb5_klog_syslog(LOG_WARNING, _("kadmind_threads is not supported "
+                                        "on this platform; ignoring"));
+        return 0;
+    }
+    return ret;
+}
+
 /* Point GSSAPI at the KDB keytab so we don't need an actual file keytab. */
 static krb5_error_code
 setup_kdb_keytab()
@@ -529,6 +590,14 @@ main(int argc, char *argv[])
         if (ret)
             fail_to_start(ret, _("mapping update log"));
 
+        ret = setup_ulog_commit(vctx, params.realm);
+        if (ret)
+            fail_to_start(ret, _("setting up update log group commit"));
+
+        if (verto_add_timeout(vctx, VERTO_EV_FLAG_PERSIST, wake_iprop_waiters,
+                              1000) == NULL)
+            fail_to_start(ENOMEM, _("setting up iprop wait timer"));
+
         if (nofork) {
             fprintf(stderr,
                     _("%s: create IPROP svc (PROG=%d, VERS=%d)\n"),
@@ -536,6 +605,17 @@ main(int argc, char *argv[])
         }
     }
 
+    ret = setup_workers(vctx, &params, db_args);
+    if (ret)
+        fail_to_start(ret, _("starting worker threads"));
+
+    ret = krb5_klog_start_async(context);
+    if (ret) {
+        krb5_klog_syslog(LOG_WARNING, _("Cannot start asynchronous logging "
+                                        "(%s); logging directly"),
+                         error_message(ret));
+    }
+
     if (kprop_port == NULL)
         kprop_port = getenv("KPROP_PORT");
 
@@ -547,6 +627,7 @@ main(int argc, char *argv[])
     krb5_klog_syslog(LOG_INFO, _("finished, exiting"));
 
     /* Clean up memory, etc */
+    workers_fini();
     svcauth_gssapi_unset_names();
     kadm5_destroy(global_server_handle);
     loop_free(vctx);
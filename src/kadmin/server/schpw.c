@@ -470,6 +470,7 @@ dispatch(void *handle, struct sockaddr *local_saddr,
     if (response == NULL)
         goto egress;
 
+    workers_begin(WORKER_WRITE);
     ret = process_chpw_request(server_handle->context,
                                handle,
                                server_handle->params.realm,
@@ -478,6 +479,7 @@ dispatch(void *handle, struct sockaddr *local_saddr,
                                remote_faddr,
                                request,
                                response);
+    workers_end(WORKER_WRITE);
 egress:
     if (ret)
         krb5_free_data(server_handle->context, response);
@@ -19,7 +19,6 @@
 
 extern gss_name_t                       gss_changepw_name;
 extern gss_name_t                       gss_oldchangepw_name;
-extern void *                           global_server_handle;
 
 #define CHANGEPW_SERVICE(rqstp)                                         \
     (cmp_gss_names_rel_1(acceptor_name(rqstp->rq_svccred), gss_changepw_name) | \
@@ -114,7 +113,7 @@ static kadm5_ret_t new_server_handle(krb5_ui_4 api_version,
            malloc(sizeof(*handle))))
         return ENOMEM;
 
-    *handle = *(kadm5_server_handle_t)global_server_handle;
+    *handle = *(kadm5_server_handle_t)thread_server_handle();
     handle->api_version = api_version;
 
     if (! gss_to_krb5_name(handle, rqst2name(rqstp),
@@ -143,11 +142,12 @@ static void free_server_handle(kadm5_server_handle_t handle)
     free(handle);
 }
 
-/* Result is stored in a static buffer and is invalidated by the next call. */
+/* Result is stored in a per-thread buffer and is invalidated by the next
+ * call. */
 const char *
 client_addr(SVCXPRT *xprt)
 {
-    static char abuf[128];
+    char *abuf = thread_addr_buf();
     struct sockaddr_storage ss;
     socklen_t len = sizeof(ss);
     const char *p = NULL;
@@ -155,9 +155,11 @@ client_addr(SVCXPRT *xprt)
     if (getpeername(xprt->xp_sock, ss2sa(&ss), &len) != 0)
         return "(unknown)";
     if (ss2sa(&ss)->sa_family == AF_INET)
-        p = inet_ntop(AF_INET, &ss2sin(&ss)->sin_addr, abuf, sizeof(abuf));
+        p = inet_ntop(AF_INET, &ss2sin(&ss)->sin_addr, abuf,
+                      CLIENT_ADDR_BUFSIZE);
     else if (ss2sa(&ss)->sa_family == AF_INET6)
-        p = inet_ntop(AF_INET6, &ss2sin6(&ss)->sin6_addr, abuf, sizeof(abuf));
+        p = inet_ntop(AF_INET6, &ss2sin6(&ss)->sin6_addr, abuf,
+                      CLIENT_ADDR_BUFSIZE);
     return (p == NULL) ? "(unknown)" : p;
 }
 
@@ -770,6 +772,59 @@ exit_func:
     return TRUE;
 }
 
+bool_t
+get_princs_page_2_svc(gprincs_page_arg *arg, gprincs_page_ret *ret,
+                      struct svc_req *rqstp)
+{
+    char                            *prime_arg = NULL;
+    gss_buffer_desc                 client_name = GSS_C_EMPTY_BUFFER;
+    gss_buffer_desc                 service_name = GSS_C_EMPTY_BUFFER;
+    kadm5_server_handle_t           handle;
+    krb5_boolean                    more = FALSE;
+    const char                      *errmsg = NULL;
+
+    ret->code = stub_setup(arg->api_version, rqstp, NULL, &handle,
+                           &ret->api_version, &client_name, &service_name,
+                           NULL);
+    if (ret->code)
+        goto exit_func;
+
+    prime_arg = arg->exp;
+    if (prime_arg == NULL)
+        prime_arg = "*";
+
+    if (CHANGEPW_SERVICE(rqstp) || !kadm5int_acl_check(handle->context,
+                                                       rqst2name(rqstp),
+                                                       ACL_LIST,
+                                                       NULL,
+                                                       NULL)) {
+        ret->code = KADM5_AUTH_LIST;
+        log_unauth("kadm5_get_principals", prime_arg,
+                   &client_name, &service_name, rqstp);
+    } else {
+        ret->code = kadm5_get_principals_page(handle, arg->exp, arg->start,
+                                              arg->max, &ret->princs,
+                                              &ret->count, &more);
+        ret->more = more;
+        if (ret->code != 0)
+            errmsg = krb5_get_error_message(handle->context, ret->code);
+
+        /* Log only the first page of a listing. */
+        if (arg->start == NULL || ret->code != 0) {
+            log_done("kadm5_get_principals", prime_arg, errmsg,
+                     &client_name, &service_name, rqstp);
+        }
+
+        if (errmsg != NULL)
+            krb5_free_error_message(handle->context, errmsg);
+
+    }
+
+exit_func:
+    stub_cleanup(handle, NULL, &client_name, &service_name);
+    return TRUE;
+}
+
 bool_t
 chpass_principal_2_svc(chpass_arg *arg, generic_ret *ret,
                        struct svc_req *rqstp)
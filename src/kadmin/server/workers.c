@@ -0,0 +1,582 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* kadmin/server/workers.c - Worker threads for kadmin requests */
+/*
+ * Copyright (C) 2026 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * kadmind answers most requests on its main thread, one at a time.  If the
+ * realm sets kadmind_threads, requests are instead handed to worker threads,
+ * so that a slow listing, a slow password quality check, or a busy database
+ * does not hold up every other client.  Requests which only read the database
+ * go to a pool of that many readers.  Requests which modify the database, and
+ * iprop update requests, go to a single writer thread which processes them one
+ * at a time in the order they arrive, which keeps KDB and update log writes in
+ * order and lets iprop requests see every write made before them.
+ *
+ * Each worker has its own krb5 context and server handle.  RPC decoding,
+ * authentication, and replies all happen on the main thread; the main loop
+ * learns of finished jobs through a pipe.  While a job is outstanding, the
+ * destroy method of its transport is hooked so that a client disconnecting
+ * does not free the transport out from under the worker.
+ *
+ * Workers are only used if threads are enabled and file locks are per open
+ * file description, so that the DB2 module's locks exclude other threads of
+ * this process as well as other processes.  The DB2 module drops its global
+ * mutex while holding its file lock to run iteration callbacks, so a write
+ * waiting for the file lock while holding the mutex could deadlock against a
+ * listing; db_lock keeps writes and listings apart.  Other reads run alongside
+ * writes.  Only writes made on the main thread (kpasswd requests, and kadmin
+ * requests using the old AUTH_GSSAPI flavor, whose transport state does not
+ * survive the dispatch call) make the main loop wait for db_lock.
+ *
+ * If the update log uses group commits, the writer thread's context holds the
+ * pending group, and the writer commits it once the delay has passed.  Writes
+ * made on the main thread are committed right away, since another context
+ * reading the update log would otherwise mistake the other's pending group for
+ * an interrupted update.
+ */
+
+#include <k5-int.h>
+#include <k5-queue.h>
+#include <gssrpc/rpc.h>
+#include <kadm5/admin.h>
+#include <adm_proto.h>
+#include <syslog.h>
+#include "kadm5/server_internal.h"
+#include "misc.h"
+
+extern void *global_server_handle;
+
+#if defined(ENABLE_THREADS) && defined(F_OFD_SETLKW)
+
+#include <signal.h>
+#include <kdb_log.h>
+
+struct worker {
+    pthread_t thread;
+    krb5_context context;
+    void *handle;
+    char addrbuf[CLIENT_ADDR_BUFSIZE];
+};
+
+struct worker_job {
+    K5_TAILQ_ENTRY(worker_job) links;   /* queue or finished list */
+    K5_TAILQ_ENTRY(worker_job) active;  /* outstanding list */
+    SVCXPRT *transp;
+    enum worker_mode mode;
+    struct xp_ops ops;
+    struct xp_ops *orig_ops;
+    krb5_boolean closed;
+    worker_run_fn run;
+    worker_done_fn done;
+    void *data;
+};
+
+K5_TAILQ_HEAD(job_list, worker_job);
+
+static pthread_rwlock_t db_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cv = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t write_cv = PTHREAD_COND_INITIALIZER;
+static struct job_list queue = K5_TAILQ_HEAD_INITIALIZER(queue);
+static struct job_list write_queue = K5_TAILQ_HEAD_INITIALIZER(write_queue);
+static struct job_list finished = K5_TAILQ_HEAD_INITIALIZER(finished);
+static krb5_boolean stopping;
+
+/* Jobs submitted and not yet completed.  Only used by the main thread. */
+static struct job_list outstanding = K5_TAILQ_HEAD_INITIALIZER(outstanding);
+
+static struct worker *workers;
+static int nslots, nworkers;
+static struct worker writer;
+static krb5_boolean writer_started;
+static pthread_key_t worker_key;
+static int notify_fds[2] = { -1, -1 };
+static verto_ev *notify_ev;
+static char main_addrbuf[CLIENT_ADDR_BUFSIZE];
+
+static void *
+worker_main(void *arg)
+{
+    struct worker *w = arg;
+    struct worker_job *j;
+    char c = 0;
+
+    pthread_setspecific(worker_key, w);
+    pthread_mutex_lock(&queue_lock);
+    for (;;) {
+        while (K5_TAILQ_EMPTY(&queue) && !stopping)
+            pthread_cond_wait(&queue_cv, &queue_lock);
+        j = K5_TAILQ_FIRST(&queue);
+        if (j == NULL)
+            break;
+        K5_TAILQ_REMOVE(&queue, j, links);
+        pthread_mutex_unlock(&queue_lock);
+
+        workers_begin(j->mode);
+        j->run(j->data);
+        workers_end(j->mode);
+
+        pthread_mutex_lock(&queue_lock);
+        K5_TAILQ_INSERT_TAIL(&finished, j, links);
+        /* If the pipe is full, the main loop has a wakeup pending anyway. */
+        (void)write(notify_fds[1], &c, 1);
+    }
+    pthread_mutex_unlock(&queue_lock);
+    return NULL;
+}
+
+/* If context has a group of updates awaiting commit, set *deadline to the time
+ * it should be committed and return true. */
+static krb5_boolean
+commit_deadline(krb5_context context, struct timespec *deadline)
+{
+    kdb_log_context *log_ctx = context->kdblog_context;
+    long usec;
+
+    if (log_ctx == NULL || log_ctx->commit_delay == 0 ||
+        log_ctx->npending == 0)
+        return FALSE;
+    usec = log_ctx->pending_since.useconds +
+        (long)(log_ctx->commit_delay % 1000) * 1000;
+    deadline->tv_sec = log_ctx->pending_since.seconds +
+        log_ctx->commit_delay / 1000 + usec / 1000000;
+    deadline->tv_nsec = (usec % 1000000) * 1000;
+    return TRUE;
+}
+
+static void *
+writer_main(void *arg)
+{
+    struct worker *w = arg;
+    struct worker_job *j;
+    struct timespec deadline;
+    char c = 0;
+
+    pthread_setspecific(worker_key, w);
+    pthread_mutex_lock(&queue_lock);
+    for (;;) {
+        while (K5_TAILQ_EMPTY(&write_queue) && !stopping) {
+            if (!commit_deadline(w->context, &deadline)) {
+                pthread_cond_wait(&write_cv, &queue_lock);
+            } else if (pthread_cond_timedwait(&write_cv, &queue_lock,
+                                              &deadline) == ETIMEDOUT) {
+                /* Commit the pending group, and have the main loop tell
+                 * waiting replicas about it. */
+                pthread_mutex_unlock(&queue_lock);
+                (void)ulog_sync(w->context);
+                pthread_mutex_lock(&queue_lock);
+                (void)write(notify_fds[1], &c, 1);
+            }
+        }
+        j = K5_TAILQ_FIRST(&write_queue);
+        if (j == NULL)
+            break;
+        K5_TAILQ_REMOVE(&write_queue, j, links);
+        pthread_mutex_unlock(&queue_lock);
+
+        workers_begin(WORKER_WRITE);
+        j->run(j->data);
+        workers_end(WORKER_WRITE);
+
+        pthread_mutex_lock(&queue_lock);
+        K5_TAILQ_INSERT_TAIL(&finished, j, links);
+        (void)write(notify_fds[1], &c, 1);
+    }
+    pthread_mutex_unlock(&queue_lock);
+    return NULL;
+}
+
+static struct worker_job *
+find_job(SVCXPRT *transp)
+{
+    struct worker_job *j;
+
+    K5_TAILQ_FOREACH(j, &outstanding, active) {
+        if (j->transp == transp)
+            return j;
+    }
+    return NULL;
+}
+
+/*
+ * Destroy method for the transport of an outstanding job.  Stop listening on
+ * the transport, and destroy it for real once the job has finished.
+ */
+static void
+job_destroy(SVCXPRT *transp)
+{
+    struct worker_job *j = find_job(transp);
+
+    j->closed = TRUE;
+    xprt_unregister(transp);
+}
+
+/* Hand a finished job back to its submitter on the main thread. */
+static void
+complete_job(struct worker_job *j)
+{
+    K5_TAILQ_REMOVE(&outstanding, j, active);
+    j->transp->xp_ops = j->orig_ops;
+    j->done(j->data, !j->closed);
+    if (j->closed)
+        j->orig_ops->xp_destroy(j->transp);
+    free(j);
+}
+
+static void
+complete_finished_jobs(void)
+{
+    struct job_list done;
+    struct worker_job *j;
+
+    K5_TAILQ_INIT(&done);
+    pthread_mutex_lock(&queue_lock);
+    K5_TAILQ_CONCAT(&done, &finished, links);
+    pthread_mutex_unlock(&queue_lock);
+    while ((j = K5_TAILQ_FIRST(&done)) != NULL) {
+        K5_TAILQ_REMOVE(&done, j, links);
+        complete_job(j);
+    }
+}
+
+static void
+notify_cb(verto_ctx *ctx, verto_ev *ev)
+{
+    char buf[64];
+
+    while (read(notify_fds[0], buf, sizeof(buf)) > 0);
+    complete_finished_jobs();
+
+    /* Writes or a group commit may have moved the update log along. */
+    iprop_wake_waiters();
+}
+
+/* Create a worker with its own context and server handle.  This must happen
+ * on the main thread, as kadm5_init() sets process-wide master key state. */
+static krb5_error_code
+init_worker(struct worker *w, kadm5_config_params *params, char **db_args)
+{
+    krb5_error_code ret;
+
+    ret = kadm5_init_krb5_context(&w->context);
+    if (ret)
+        return ret;
+    ret = kadm5_init(w->context, "kadmind", NULL, NULL, params,
+                     KADM5_STRUCT_VERSION, KADM5_API_VERSION_4, db_args,
+                     &w->handle);
+    if (ret) {
+        krb5_free_context(w->context);
+        w->context = NULL;
+    }
+    return ret;
+}
+
+static void
+fini_worker(struct worker *w)
+{
+    if (w->handle != NULL)
+        kadm5_destroy(w->handle);
+    krb5_free_context(w->context);
+    w->handle = NULL;
+    w->context = NULL;
+}
+
+/* Create the writer's server handle, which records its writes in the update
+ * log, and move any group commit delay from the main context to it. */
+static krb5_error_code
+init_writer(kadm5_config_params *params, char **db_args)
+{
+    krb5_error_code ret;
+    kadm5_server_handle_t main_handle = global_server_handle;
+    kdb_log_context *log_ctx = main_handle->context->kdblog_context;
+
+    ret = init_worker(&writer, params, db_args);
+    if (ret)
+        return ret;
+    ret = kadm5_init_iprop(writer.handle, db_args);
+    if (ret)
+        return ret;
+    if (log_ctx != NULL && log_ctx->commit_delay > 0) {
+        ulog_set_commit_delay(writer.context, log_ctx->commit_delay);
+        ulog_set_commit_delay(main_handle->context, 0);
+    }
+    return 0;
+}
+
+static krb5_error_code
+start_workers(int nthreads)
+{
+    sigset_t all, old;
+    int i, ret = 0;
+
+    /* Leave signal handling to the main thread. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    ret = pthread_create(&writer.thread, NULL, writer_main, &writer);
+    if (ret == 0) {
+        writer_started = TRUE;
+        for (i = 0; i < nthreads; i++) {
+            ret = pthread_create(&workers[i].thread, NULL, worker_main,
+                                 &workers[i]);
+            if (ret)
+                break;
+            nworkers++;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return ret;
+}
+
+krb5_error_code
+workers_init(verto_ctx *ctx, int nthreads, kadm5_config_params *params,
+             char **db_args)
+{
+    krb5_error_code ret;
+    int i;
+
+    if (nthreads <= 0)
+        return 0;
+    workers = calloc(nthreads, sizeof(*workers));
+    if (workers == NULL)
+        return ENOMEM;
+    nslots = nthreads;
+    for (i = 0; i < nthreads; i++) {
+        ret = init_worker(&workers[i], params, db_args);
+        if (ret)
+            goto error;
+    }
+    ret = init_writer(params, db_args);
+    if (ret)
+        goto error;
+
+    ret = pthread_key_create(&worker_key, NULL);
+    if (ret)
+        goto error;
+    if (pipe(notify_fds) != 0) {
+        ret = errno;
+        goto error;
+    }
+    set_cloexec_fd(notify_fds[0]);
+    set_cloexec_fd(notify_fds[1]);
+    if (fcntl(notify_fds[0], F_SETFL, O_NONBLOCK) != 0 ||
+        fcntl(notify_fds[1], F_SETFL, O_NONBLOCK) != 0) {
+        ret = errno;
+        goto error;
+    }
+    notify_ev = verto_add_io(ctx, VERTO_EV_FLAG_PERSIST |
+                             VERTO_EV_FLAG_IO_READ, notify_cb, notify_fds[0]);
+    if (notify_ev == NULL) {
+        ret = ENOMEM;
+        goto error;
+    }
+
+    ret = start_workers(nthreads);
+    if (ret)
+        goto error;
+    return 0;
+
+error:
+    workers_fini();
+    return ret;
+}
+
+krb5_boolean
+workers_active(void)
+{
+    return nworkers > 0;
+}
+
+krb5_error_code
+workers_submit(SVCXPRT *transp, enum worker_mode mode, worker_run_fn run,
+               worker_done_fn done, void *data)
+{
+    struct worker_job *j;
+
+    /* Clients wait for each reply, so there should only ever be one job per
+     * transport; if not, let the caller process the request itself. */
+    if (find_job(transp) != NULL)
+        return EBUSY;
+    j = calloc(1, sizeof(*j));
+    if (j == NULL)
+        return ENOMEM;
+    j->transp = transp;
+    j->mode = mode;
+    j->orig_ops = transp->xp_ops;
+    j->ops = *transp->xp_ops;
+    j->ops.xp_destroy = job_destroy;
+    j->run = run;
+    j->done = done;
+    j->data = data;
+    transp->xp_ops = &j->ops;
+    K5_TAILQ_INSERT_TAIL(&outstanding, j, active);
+
+    pthread_mutex_lock(&queue_lock);
+    if (mode == WORKER_WRITE) {
+        K5_TAILQ_INSERT_TAIL(&write_queue, j, links);
+        pthread_cond_signal(&write_cv);
+    } else {
+        K5_TAILQ_INSERT_TAIL(&queue, j, links);
+        pthread_cond_signal(&queue_cv);
+    }
+    pthread_mutex_unlock(&queue_lock);
+    return 0;
+}
+
+void
+workers_begin(enum worker_mode mode)
+{
+    if (workers == NULL || mode == WORKER_READ)
+        return;
+    if (mode == WORKER_WRITE)
+        pthread_rwlock_wrlock(&db_lock);
+    else
+        pthread_rwlock_rdlock(&db_lock);
+}
+
+void
+workers_end(enum worker_mode mode)
+{
+    if (workers != NULL && mode != WORKER_READ)
+        pthread_rwlock_unlock(&db_lock);
+}
+
+void *
+thread_server_handle(void)
+{
+    struct worker *w = NULL;
+
+    if (workers != NULL)
+        w = pthread_getspecific(worker_key);
+    return (w != NULL) ? w->handle : global_server_handle;
+}
+
+char *
+thread_addr_buf(void)
+{
+    struct worker *w = NULL;
+
+    if (workers != NULL)
+        w = pthread_getspecific(worker_key);
+    return (w != NULL) ? w->addrbuf : main_addrbuf;
+}
+
+void
+workers_fini(void)
+{
+    int i;
+
+    if (workers == NULL)
+        return;
+
+    /* Let the workers drain the queue, then complete what they finished. */
+    pthread_mutex_lock(&queue_lock);
+    stopping = TRUE;
+    pthread_cond_broadcast(&queue_cv);
+    pthread_cond_signal(&write_cv);
+    pthread_mutex_unlock(&queue_lock);
+    for (i = 0; i < nworkers; i++)
+        pthread_join(workers[i].thread, NULL);
+    nworkers = 0;
+    if (writer_started)
+        pthread_join(writer.thread, NULL);
+    writer_started = FALSE;
+    complete_finished_jobs();
+
+    for (i = 0; i < nslots; i++)
+        fini_worker(&workers[i]);
+    fini_worker(&writer);
+    free(workers);
+    workers = NULL;
+    nslots = 0;
+    if (notify_ev != NULL) {
+        verto_del(notify_ev);
+        notify_ev = NULL;
+    }
+    if (notify_fds[0] != -1) {
+        close(notify_fds[0]);
+        close(notify_fds[1]);
+        notify_fds[0] = notify_fds[1] = -1;
+    }
+}
+
+#else /* not (ENABLE_THREADS && F_OFD_SETLKW) */
+
+static char main_addrbuf[CLIENT_ADDR_BUFSIZE];
+
+krb5_error_code
+workers_init(verto_ctx *ctx, int nthreads, kadm5_config_params *params,
+             char **db_args)
+{
+    return (nthreads > 0) ? ENOTSUP : 0;
+}
+
+krb5_boolean
+workers_active(void)
+{
+    return FALSE;
+}
+
+krb5_error_code
+workers_submit(SVCXPRT *transp, enum worker_mode mode, worker_run_fn run,
+               worker_done_fn done, void *data)
+{
+    return ENOTSUP;
+}
+
+void
+workers_begin(enum worker_mode mode)
+{
+}
+
+void
+workers_end(enum worker_mode mode)
+{
+}
+
+void *
+thread_server_handle(void)
+{
+    return global_server_handle;
+}
+
+char *
+thread_addr_buf(void)
+{
+    return main_addrbuf;
+}
+
+void
+workers_fini(void)
+{
+}
+
+#endif /* not (ENABLE_THREADS && F_OFD_SETLKW) */
@@ -38,13 +38,22 @@ static krb5_int32 last_usec = 0, last_os_random = 0;
 static krb5_error_code make_too_big_error(kdc_realm_t *kdc_active_realm,
                                           krb5_data **out);
 
+/* State for a request being checked against and added to the lookaside
+ * cache. */
 struct dispatch_state {
     loop_respond_fn respond;
     void *arg;
     krb5_data *request;
+    krb5_context kdc_err_context;
+    uint64_t start;
+};
+
+/* State for a request being processed using a server handle's realms. */
+struct process_state {
+    loop_respond_fn respond;
+    void *arg;
     int is_tcp;
     kdc_realm_t *active_realm;
-    krb5_context kdc_err_context;
 };
 
 static void
@@ -53,19 +62,8 @@ finish_dispatch(struct dispatch_state *state, krb5_error_code code,
 {
     loop_respond_fn oldrespond = state->respond;
     void *oldarg = state->arg;
-    kdc_realm_t *kdc_active_realm = state->active_realm;
-
-    if (state->is_tcp == 0 && response &&
-        response->length > (unsigned int)max_dgram_reply_size) {
-        krb5_free_data(kdc_context, response);
-        response = NULL;
-        code = make_too_big_error(kdc_active_realm, &response);
-        if (code)
-            krb5_klog_syslog(LOG_ERR, "error constructing "
-                             "KRB_ERR_RESPONSE_TOO_BIG error: %s",
-                             error_message(code));
-    }
 
+    kdc_metrics_latency(KDC_HIST_DISPATCH, state->start);
     free(state);
     (*oldrespond)(oldarg, code, response);
 }
@@ -90,6 +88,30 @@ finish_dispatch_cache(void *arg, krb5_error_code code, krb5_data *response)
     finish_dispatch(state, code, response);
 }
 
+static void
+finish_process(void *arg, krb5_error_code code, krb5_data *response)
+{
+    struct process_state *state = arg;
+    loop_respond_fn oldrespond = state->respond;
+    void *oldarg = state->arg;
+    kdc_realm_t *kdc_active_realm = state->active_realm;
+
+    if (state->is_tcp == 0 && response &&
+        response->length > (unsigned int)max_dgram_reply_size) {
+        krb5_free_data(kdc_context, response);
+        response = NULL;
+        kdc_metrics_count(KDC_METRIC_REPLY_TOO_BIG);
+        code = make_too_big_error(kdc_active_realm, &response);
+        if (code)
+            krb5_klog_syslog(LOG_ERR, "error constructing "
+                             "KRB_ERR_RESPONSE_TOO_BIG error: %s",
+                             error_message(code));
+    }
+
+    free(state);
+    (*oldrespond)(oldarg, code, response);
+}
+
 static void
 reseed_random(krb5_context kdc_err_context)
 {
@@ -124,7 +146,6 @@ dispatch(void *cb, struct sockaddr *local_saddr,
          verto_ctx *vctx, loop_respond_fn respond, void *arg)
 {
     krb5_error_code retval;
-    krb5_kdc_req *as_req;
     krb5_data *response = NULL;
     struct dispatch_state *state;
     struct server_handle *handle = cb;
@@ -138,8 +159,9 @@ dispatch(void *cb, struct sockaddr *local_saddr,
     state->respond = respond;
     state->arg = arg;
     state->request = pkt;
-    state->is_tcp = is_tcp;
     state->kdc_err_context = kdc_err_context;
+    state->start = kdc_metrics_now();
+    kdc_metrics_count(is_tcp ? KDC_METRIC_TCP_REQ : KDC_METRIC_UDP_REQ);
 
     /* decode incoming packet, and dispatch */
 
@@ -150,6 +172,8 @@ dispatch(void *cb, struct sockaddr *local_saddr,
         const char *name = 0;
         char buf[46];
 
+        kdc_metrics_count(KDC_METRIC_LOOKASIDE_HIT);
+
         name = inet_ntop (ADDRTYPE2FAMILY (from->address->addrtype),
                           from->address->contents, buf, sizeof (buf));
         if (name == 0)
@@ -168,17 +192,58 @@ dispatch(void *cb, struct sockaddr *local_saddr,
         return;
     }
 
+    kdc_metrics_count(KDC_METRIC_LOOKASIDE_MISS);
+
     /* Insert a NULL entry into the lookaside to indicate that this request
      * is currently being processed. */
     kdc_insert_lookaside(kdc_err_context, pkt, NULL);
 #endif
     reseed_random(kdc_err_context);
 
+    if (kdc_threads_enabled()) {
+        /* Process the request on a worker thread; the response comes back to
+         * this loop through finish_dispatch_cache. */
+        retval = kdc_thread_dispatch(pkt, from, is_tcp, finish_dispatch_cache,
+                                     state);
+        if (retval)
+            finish_dispatch_cache(state, retval, NULL);
+        return;
+    }
+
+    kdc_process_request(handle, pkt, from, is_tcp, vctx,
+                        finish_dispatch_cache, state);
+}
+
+/*
+ * Decode and process pkt using the realms of handle, and call respond with the
+ * result.  Any asynchronous work for the request takes place in vctx.
+ */
+void
+kdc_process_request(struct server_handle *handle, krb5_data *pkt,
+                    const krb5_fulladdr *from, int is_tcp, verto_ctx *vctx,
+                    loop_respond_fn respond, void *arg)
+{
+    krb5_error_code retval;
+    krb5_kdc_req *as_req;
+    krb5_data *response = NULL;
+    struct process_state *state;
+
+    state = k5alloc(sizeof(*state), &retval);
+    if (state == NULL) {
+        (*respond)(arg, retval, NULL);
+        return;
+    }
+    state->respond = respond;
+    state->arg = arg;
+    state->is_tcp = is_tcp;
+
     /* try TGS_REQ first; they are more common! */
 
     if (krb5_is_tgs_req(pkt)) {
+        kdc_metrics_count(KDC_METRIC_TGS_REQ);
         retval = process_tgs_req(handle, pkt, from, &response);
     } else if (krb5_is_as_req(pkt)) {
+        kdc_metrics_count(KDC_METRIC_AS_REQ);
         if (!(retval = decode_krb5_as_req(pkt, &as_req))) {
             /*
              * setup_server_realm() sets up the global realm-specific data
@@ -188,17 +253,19 @@ dispatch(void *cb, struct sockaddr *local_saddr,
             state->active_realm = setup_server_realm(handle, as_req->server);
             if (state->active_realm != NULL) {
                 process_as_req(as_req, pkt, from, state->active_realm, vctx,
-                               finish_dispatch_cache, state);
+                               finish_process, state);
                 return;
             } else {
                 retval = KRB5KDC_ERR_WRONG_REALM;
-                krb5_free_kdc_req(kdc_err_context, as_req);
+                krb5_free_kdc_req(handle->kdc_err_context, as_req);
             }
         }
-    } else
+    } else {
+        kdc_metrics_count(KDC_METRIC_OTHER_REQ);
         retval = KRB5KRB_AP_ERR_MSG_TYPE;
+    }
 
-    finish_dispatch_cache(state, retval, response);
+    finish_process(state, retval, response);
 }
 
 static krb5_error_code
@@ -100,7 +100,7 @@ get_key_exp(krb5_db_entry *entry)
  * data entry.
  */
 static krb5_error_code
-select_client_key(krb5_context context, krb5_db_entry *client,
+select_client_key(kdc_realm_t *kdc_active_realm, krb5_db_entry *client,
                   krb5_enctype *req_enctypes, int n_req_enctypes,
                   krb5_keyblock *kb_out, krb5_key_data **kd_out)
 {
@@ -116,10 +116,12 @@ select_client_key(krb5_context context, krb5_db_entry *client,
         etype = req_enctypes[i];
         if (!krb5_c_valid_enctype(etype))
             continue;
-        if (krb5_dbe_find_enctype(context, client, etype, -1, 0, &kd) == 0) {
+        if (krb5_dbe_find_enctype(kdc_context, client, etype, -1, 0,
+                                  &kd) == 0) {
             /* Decrypt the client key data and set its enctype to the request
              * enctype (which may differ from the key data enctype for DES). */
-            ret = krb5_dbe_decrypt_key_data(context, NULL, kd, kb_out, NULL);
+            ret = kdc_decrypt_key_data(kdc_active_realm, client->princ, kd,
+                                       kb_out);
             if (ret)
                 return ret;
             kb_out->enctype = etype;
@@ -167,6 +169,8 @@ struct as_req_state {
 
     kdc_realm_t *active_realm;
     krb5_audit_state *au_state;
+
+    uint64_t start;             /* for request metrics */
 };
 
 static void
@@ -225,10 +229,9 @@ finish_process_as_req(struct as_req_state *state, krb5_error_code errcode)
      *
      *  server_keyblock is later used to generate auth data signatures
      */
-    if ((errcode = krb5_dbe_decrypt_key_data(kdc_context, NULL,
-                                             server_key,
-                                             &state->server_keyblock,
-                                             NULL))) {
+    if ((errcode = kdc_decrypt_key_data(kdc_active_realm, state->server->princ,
+                                        server_key,
+                                        &state->server_keyblock))) {
         state->status = "DECRYPT_SERVER_KEY";
         goto egress;
     }
@@ -368,6 +371,9 @@ egress:
     if (errcode != 0)
         assert (state->status != 0);
 
+    kdc_metrics_result(FALSE, errcode);
+    kdc_metrics_latency(KDC_HIST_AS_REQ, state->start);
+
     au_state->status = state->status;
     au_state->reply = &state->reply;
     kau_as_req(kdc_context,
@@ -387,6 +393,8 @@ egress:
                    state->status, errcode, emsg);
         did_log = 1;
     }
+    /* The KDB module has now been told of the result by log_as_req(). */
+    kdc_metrics_db_stats(kdc_context);
     if (errcode) {
         if (state->status == 0) {
             state->status = emsg;
@@ -499,6 +507,7 @@ process_as_req(krb5_kdc_req *request, krb5_data *req_pkt,
     unsigned int s_flags = 0;
     krb5_data encoded_req_body;
     krb5_enctype useenctype;
+    uint64_t lookup_start;
     struct as_req_state *state;
     krb5_audit_state *au_state = NULL;
 
@@ -513,6 +522,7 @@ process_as_req(krb5_kdc_req *request, krb5_data *req_pkt,
     state->req_pkt = req_pkt;
     state->from = from;
     state->active_realm = kdc_active_realm;
+    state->start = kdc_metrics_now();
 
     errcode = kdc_make_rstate(kdc_active_realm, &state->rstate);
     if (errcode != 0) {
@@ -536,6 +546,7 @@ process_as_req(krb5_kdc_req *request, krb5_data *req_pkt,
         errcode = KRB5_BADMSGTYPE;
         goto errout;
     }
+    kdc_metrics_padata(state->request->padata);
 
     /* Seed the audit trail with the request ID and basic information. */
     kau_as_req(kdc_context, TRUE, au_state);
@@ -611,8 +622,10 @@ process_as_req(krb5_kdc_req *request, krb5_data *req_pkt,
     if (include_pac_p(kdc_context, state->request)) {
         setflag(state->c_flags, KRB5_KDB_FLAG_INCLUDE_PAC);
     }
+    lookup_start = kdc_metrics_now();
     errcode = krb5_db_get_principal(kdc_context, state->request->client,
                                     state->c_flags, &state->client);
+    kdc_metrics_latency(KDC_HIST_DB_LOOKUP, lookup_start);
     if (errcode == KRB5_KDB_CANTLOCK_DB)
         errcode = KRB5KDC_ERR_SVC_UNAVAILABLE;
     if (errcode == KRB5_KDB_NOENTRY) {
@@ -647,8 +660,8 @@ process_as_req(krb5_kdc_req *request, krb5_data *req_pkt,
     if (isflagset(state->request->kdc_options, KDC_OPT_CANONICALIZE)) {
         setflag(s_flags, KRB5_KDB_FLAG_CANONICALIZE);
     }
-    errcode = krb5_db_get_principal(kdc_context, state->request->server,
-                                    s_flags, &state->server);
+    errcode = kdc_get_principal(kdc_active_realm, state->request->server,
+                                s_flags, &state->server);
     if (errcode == KRB5_KDB_CANTLOCK_DB)
         errcode = KRB5KDC_ERR_SVC_UNAVAILABLE;
     if (errcode == KRB5_KDB_NOENTRY) {
@@ -660,7 +673,7 @@ process_as_req(krb5_kdc_req *request, krb5_data *req_pkt,
         goto errout;
     }
 
-    errcode = get_local_tgt(kdc_context, &state->request->server->realm,
+    errcode = get_local_tgt(kdc_active_realm, &state->request->server->realm,
                             state->server, &state->local_tgt,
                             &state->local_tgt_storage);
     if (errcode) {
@@ -793,7 +806,7 @@ process_as_req(krb5_kdc_req *request, krb5_data *req_pkt,
         setflag(state->client->attributes, KRB5_KDB_REQUIRES_PRE_AUTH);
     }
 
-    errcode = select_client_key(kdc_context, state->client,
+    errcode = select_client_key(kdc_active_realm, state->client,
                                 state->request->ktype, state->request->nktypes,
                                 &state->client_keyblock, &state->client_key);
     if (errcode) {
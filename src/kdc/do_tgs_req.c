@@ -89,7 +89,7 @@ static krb5_int32
 find_referral_tgs(kdc_realm_t *, krb5_kdc_req *, krb5_principal *);
 
 static krb5_error_code
-db_get_svc_princ(krb5_context, krb5_principal, krb5_flags,
+db_get_svc_princ(kdc_realm_t *, krb5_principal, krb5_flags,
                  krb5_db_entry **, const char **);
 
 static krb5_error_code
@@ -139,6 +139,7 @@ process_tgs_req(struct server_handle *handle, krb5_data *pkt,
     kdc_realm_t *kdc_active_realm = NULL;
     krb5_audit_state *au_state = NULL;
     krb5_data **auth_indicators = NULL;
+    uint64_t start = kdc_metrics_now();
 
     memset(&reply, 0, sizeof(reply));
     memset(&reply_encpart, 0, sizeof(reply_encpart));
@@ -216,7 +217,7 @@ process_tgs_req(struct server_handle *handle, krb5_data *pkt,
         goto cleanup;
     }
 
-    errcode = get_local_tgt(kdc_context, &sprinc->realm, header_server,
+    errcode = get_local_tgt(kdc_active_realm, &sprinc->realm, header_server,
                             &local_tgt, &local_tgt_storage);
     if (errcode) {
         status = "GET_LOCAL_TGT";
@@ -555,9 +556,8 @@ process_tgs_req(struct server_handle *handle, krb5_data *pkt,
          * Convert server.key into a real key
          * (it may be encrypted in the database)
          */
-        if ((errcode = krb5_dbe_decrypt_key_data(kdc_context, NULL,
-                                                 server_key, &encrypting_key,
-                                                 NULL))) {
+        if ((errcode = kdc_decrypt_key_data(kdc_active_realm, server->princ,
+                                            server_key, &encrypting_key))) {
             status = "DECRYPT_SERVER_KEY";
             goto cleanup;
         }
@@ -842,6 +842,8 @@ cleanup:
         krb5_free_error_message (kdc_context, emsg);
         emsg = NULL;
     }
+    kdc_metrics_result(TRUE, errcode);
+    kdc_metrics_latency(KDC_HIST_TGS_REQ, start);
 
     if (errcode) {
         int got_err = 0;
@@ -985,7 +987,7 @@ decrypt_2ndtkt(kdc_realm_t *kdc_active_realm, krb5_kdc_req *req,
         return 0;
 
     stkt = req->second_ticket[0];
-    retval = kdc_get_server_key(kdc_context, stkt,
+    retval = kdc_get_server_key(kdc_active_realm, stkt,
                                 flags,
                                 TRUE, /* match_enctype */
                                 &server,
@@ -1106,7 +1108,7 @@ find_alternate_tgs(kdc_realm_t *kdc_active_realm, krb5_principal princ,
         tmp = *krb5_princ_realm(kdc_context, *pl2);
         krb5_princ_set_realm(kdc_context, *pl2,
                              krb5_princ_realm(kdc_context, princ));
-        retval = db_get_svc_princ(kdc_context, *pl2, 0, &server, status);
+        retval = db_get_svc_princ(kdc_active_realm, *pl2, 0, &server, status);
         krb5_princ_set_realm(kdc_context, *pl2, &tmp);
         if (retval == KRB5_KDB_NOENTRY)
             continue;
@@ -1239,13 +1241,13 @@ cleanup:
 }
 
 static krb5_error_code
-db_get_svc_princ(krb5_context ctx, krb5_principal princ,
+db_get_svc_princ(kdc_realm_t *kdc_active_realm, krb5_principal princ,
                  krb5_flags flags, krb5_db_entry **server,
                  const char **status)
 {
     krb5_error_code ret;
 
-    ret = krb5_db_get_principal(ctx, princ, flags, server);
+    ret = kdc_get_principal(kdc_active_realm, princ, flags, server);
     if (ret == KRB5_KDB_CANTLOCK_DB)
         ret = KRB5KDC_ERR_SVC_UNAVAILABLE;
     if (ret != 0) {
@@ -1269,7 +1271,7 @@ search_sprinc(kdc_realm_t *kdc_active_realm, krb5_kdc_req *req,
     if (!allow_referral)
         flags &= ~KRB5_KDB_FLAG_CANONICALIZE;
 
-    ret = db_get_svc_princ(kdc_context, princ, flags, server, status);
+    ret = db_get_svc_princ(kdc_active_realm, princ, flags, server, status);
     if (ret == 0 || ret != KRB5_KDB_NOENTRY || !allow_referral)
         goto cleanup;
 
@@ -1277,7 +1279,8 @@ search_sprinc(kdc_realm_t *kdc_active_realm, krb5_kdc_req *req,
         ret = find_referral_tgs(kdc_active_realm, req, &reftgs);
         if (ret != 0)
             goto cleanup;
-        ret = db_get_svc_princ(kdc_context, reftgs, flags, server, status);
+        ret = db_get_svc_princ(kdc_active_realm, reftgs, flags, server,
+                               status);
         if (ret == 0 || ret != KRB5_KDB_NOENTRY)
             goto cleanup;
 
@@ -0,0 +1,440 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* kdc/kdc_metrics.c - Shared-memory request metrics for the KDC */
+/*
+ * Copyright (C) 2026 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * When kdc_metrics_file is set in [kdcdefaults], the KDC keeps request
+ * counters and latency histograms in that file, mapped shared into every KDC
+ * process.  The file holds one slot of counters for each thread which
+ * processes requests (the main thread and each -t thread, in each -w worker
+ * process), and each slot is only written by its own thread, so counting
+ * takes no locks and no system calls.  A scraper maps or reads the file and
+ * sums each counter over the slots; it never interacts with the KDC.
+ *
+ * The file begins with a struct metrics_header in host byte order, followed
+ * by ncounters NUL-padded names of name_len bytes at names_offset, followed
+ * by nslots slots of slot_size bytes at slots_offset.  Each slot begins with
+ * ncounters 64-bit counters.  Latency histograms are HDR-style: each power
+ * of two of microseconds is split into HIST_SUB buckets, so a bucket's
+ * bounds are within 1/HIST_SUB of each other.  A histogram's counters are
+ * named NAME_usec_lt_UPPER for each bucket (with the final bucket named
+ * NAME_usec_lt_inf), NAME_count, and NAME_usec_sum.
+ *
+ * The file is replaced atomically when the KDC starts, so a scraper should
+ * reopen it if it has been replaced.
+ */
+
+#include "k5-int.h"
+#include "kdc_util.h"
+#include "extern.h"
+#include <sys/mman.h>
+
+#define METRICS_MAGIC           "KDCMETR"
+#define METRICS_VERSION         1
+#define METRICS_NAME_LEN        48
+#define SET_NAME(i, ...)        snprintf(name_field(i), METRICS_NAME_LEN, \
+                                         __VA_ARGS__)
+
+/* Counters for each request result: protocol error codes 0 (success)
+ * through KRB_ERR_MAX, and discarded requests. */
+#define NRESULTS                (KRB_ERR_MAX + 2)
+#define RESULT_DISCARD          (KRB_ERR_MAX + 1)
+
+/* Counters for padata types 0-255 seen in AS requests, and other types. */
+#define NPADATA                 257
+
+#define HIST_SUB_BITS           3
+#define HIST_SUB                (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS           27      /* last bucket starts at ~134s */
+#define HIST_BUCKETS            ((HIST_MAX_BITS - HIST_SUB_BITS + 2) * \
+                                 HIST_SUB)
+#define HIST_COUNTERS           (HIST_BUCKETS + 2)
+
+#define RESULT_BASE(tgs)        (KDC_METRIC_MAX + ((tgs) ? NRESULTS : 0))
+#define PADATA_BASE             (KDC_METRIC_MAX + 2 * NRESULTS)
+#define HIST_BASE(h)            (PADATA_BASE + NPADATA + (h) * HIST_COUNTERS)
+#define NCOUNTERS               HIST_BASE(KDC_HIST_MAX)
+
+struct metrics_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t name_len;
+    uint32_t ncounters;
+    uint32_t nslots;
+    uint32_t slots_per_process;
+    uint32_t names_offset;
+    uint32_t slots_offset;
+    uint32_t slot_size;
+};
+
+static const char *const metric_names[KDC_METRIC_MAX] = {
+    "as_requests", "tgs_requests", "other_requests", "udp_requests",
+    "tcp_requests", "lookaside_hits", "lookaside_misses", "replies_too_big",
+    "db_writes_avoided", "net_udp_packets", "net_udp_send_errors", "net_accepts",
+    "net_connection_drops", "net_tcp_too_long", "net_udp_rxq_drops"
+};
+
+static const char *const hist_names[KDC_HIST_MAX] = {
+    "dispatch", "as_req", "tgs_req", "db_lookup"
+};
+
+static unsigned char *map;
+static size_t map_len;
+static struct metrics_header *hdr;
+static int process_index;
+static uint64_t *process_slot;
+
+#ifdef ENABLE_THREADS
+static pthread_key_t slot_key;
+static krb5_boolean have_slot_key;
+#endif
+
+static uint64_t *
+get_slot(int index)
+{
+    if (index < 0 || (uint32_t)index >= hdr->nslots)
+        return NULL;
+    return (uint64_t *)(map + hdr->slots_offset + index * hdr->slot_size);
+}
+
+/* Return the counters of the calling thread. */
+static inline uint64_t *
+current_slot(void)
+{
+#ifdef ENABLE_THREADS
+    uint64_t *slot;
+
+    if (have_slot_key) {
+        slot = pthread_getspecific(slot_key);
+        if (slot != NULL)
+            return slot;
+    }
+#endif
+    return process_slot;
+}
+
+/* Return the exclusive upper bound in microseconds of histogram bucket i. */
+static uint64_t
+bucket_limit(int i)
+{
+    int row = i / HIST_SUB, col = i % HIST_SUB;
+
+    if (i < 2 * HIST_SUB)
+        return i + 1;
+    return (uint64_t)(HIST_SUB + col + 1) << (row - 1);
+}
+
+static int
+bucket_index(uint64_t usec)
+{
+    int msb;
+
+    if (usec < 2 * HIST_SUB)
+        return usec;
+    if (usec >> (HIST_MAX_BITS + 1) != 0)
+        return HIST_BUCKETS - 1;
+    for (msb = HIST_SUB_BITS + 1; usec >> (msb + 1) != 0; msb++);
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB +
+        (int)(usec >> (msb - HIST_SUB_BITS)) - HIST_SUB;
+}
+
+/* Return the name field for counter index. */
+static char *
+name_field(int index)
+{
+    return (char *)map + hdr->names_offset + index * METRICS_NAME_LEN;
+}
+
+static void
+write_names(void)
+{
+    int i, h, b, base;
+
+    for (i = 0; i < KDC_METRIC_MAX; i++)
+        SET_NAME(i, "%s", metric_names[i]);
+    for (i = 0; i < NRESULTS - 1; i++) {
+        SET_NAME(RESULT_BASE(FALSE) + i, "as_result_%d", i);
+        SET_NAME(RESULT_BASE(TRUE) + i, "tgs_result_%d", i);
+    }
+    SET_NAME(RESULT_BASE(FALSE) + RESULT_DISCARD, "as_result_discard");
+    SET_NAME(RESULT_BASE(TRUE) + RESULT_DISCARD, "tgs_result_discard");
+    for (i = 0; i < NPADATA - 1; i++)
+        SET_NAME(PADATA_BASE + i, "as_padata_%d", i);
+    SET_NAME(PADATA_BASE + NPADATA - 1, "as_padata_other");
+    for (h = 0; h < KDC_HIST_MAX; h++) {
+        base = HIST_BASE(h);
+        for (b = 0; b < HIST_BUCKETS - 1; b++) {
+            SET_NAME(base + b, "%s_usec_lt_%lu", hist_names[h],
+                     (unsigned long)bucket_limit(b));
+        }
+        SET_NAME(base + b, "%s_usec_lt_inf", hist_names[h]);
+        SET_NAME(base + HIST_BUCKETS, "%s_count", hist_names[h]);
+        SET_NAME(base + HIST_BUCKETS + 1, "%s_usec_sum", hist_names[h]);
+    }
+}
+
+/*
+ * Create the metrics file at path with slots for nprocs processes of
+ * nthreads request threads each, and map it.  Must be called before any
+ * worker processes are created.
+ */
+krb5_error_code
+kdc_metrics_init(const char *path, int nprocs, int nthreads)
+{
+    krb5_error_code ret;
+    struct metrics_header h;
+    char *tmpname = NULL;
+    size_t names_len;
+    void *addr;
+    int fd = -1;
+
+    memset(&h, 0, sizeof(h));
+    strlcpy(h.magic, METRICS_MAGIC, sizeof(h.magic));
+    h.version = METRICS_VERSION;
+    h.name_len = METRICS_NAME_LEN;
+    h.ncounters = NCOUNTERS;
+    h.slots_per_process = nthreads + 1;
+    h.nslots = (nprocs > 0 ? nprocs : 1) * h.slots_per_process;
+    /* Keep each slot on its own cache lines. */
+    h.names_offset = 64;
+    names_len = (size_t)NCOUNTERS * METRICS_NAME_LEN;
+    h.slots_offset = (h.names_offset + names_len + 63) & ~63;
+    h.slot_size = (NCOUNTERS * sizeof(uint64_t) + 63) & ~63;
+    map_len = h.slots_offset + (size_t)h.nslots * h.slot_size;
+
+    /* Build the file under a temporary name and rename it into place, so
+     * that scrapers (and a previous KDC) never see a partial file. */
+    if (asprintf(&tmpname, "%s.new", path) < 0)
+        return ENOMEM;
+    fd = open(tmpname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        ret = errno;
+        goto cleanup;
+    }
+    if (ftruncate(fd, map_len) != 0) {
+        ret = errno;
+        goto cleanup;
+    }
+    addr = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        ret = errno;
+        goto cleanup;
+    }
+    map = addr;
+    hdr = (struct metrics_header *)map;
+    *hdr = h;
+    write_names();
+    if (rename(tmpname, path) != 0) {
+        ret = errno;
+        kdc_metrics_fini();
+        goto cleanup;
+    }
+
+#ifdef ENABLE_THREADS
+    if (!have_slot_key && pthread_key_create(&slot_key, NULL) == 0)
+        have_slot_key = TRUE;
+#endif
+    kdc_metrics_set_process(0);
+    ret = 0;
+
+cleanup:
+    if (fd != -1)
+        close(fd);
+    if (ret)
+        (void)unlink(tmpname);
+    free(tmpname);
+    return ret;
+}
+
+/* Use the slots of worker process index for this process. */
+void
+kdc_metrics_set_process(int index)
+{
+    if (map == NULL)
+        return;
+    process_index = index;
+    process_slot = get_slot(index * hdr->slots_per_process);
+}
+
+/* Use the slot for request thread index for the calling thread. */
+void
+kdc_metrics_start_thread(int index)
+{
+#ifdef ENABLE_THREADS
+    if (map == NULL || !have_slot_key)
+        return;
+    (void)pthread_setspecific(slot_key,
+                              get_slot(process_index * hdr->slots_per_process +
+                                       1 + index));
+#endif
+}
+
+void
+kdc_metrics_fini(void)
+{
+    if (map == NULL)
+        return;
+    munmap(map, map_len);
+    map = NULL;
+    hdr = NULL;
+    process_slot = NULL;
+}
+
+void
+kdc_metrics_count(enum kdc_metric metric)
+{
+    uint64_t *slot;
+
+    if (map == NULL)
+        return;
+    slot = current_slot();
+    if (slot != NULL)
+        slot[metric]++;
+}
+
+/* Count network events; suitable for loop_set_event_hook(). */
+void
+kdc_metrics_loop_event(enum loop_event event, unsigned int count)
+{
+    uint64_t *slot;
+
+    if (map == NULL)
+        return;
+    slot = current_slot();
+    if (slot != NULL)
+        slot[KDC_METRIC_NET_EVENTS + event] += count;
+}
+
+/* Count the result of an AS or TGS request, as the protocol error code which
+ * will be sent for code. */
+void
+kdc_metrics_result(krb5_boolean tgs, krb5_error_code code)
+{
+    uint64_t *slot;
+    long n;
+
+    if (map == NULL)
+        return;
+    slot = current_slot();
+    if (slot == NULL)
+        return;
+    if (code == 0) {
+        n = 0;
+    } else if (code == KRB5KDC_ERR_DISCARD) {
+        n = RESULT_DISCARD;
+    } else {
+        n = (long)code - ERROR_TABLE_BASE_krb5;
+        if (n < 0 || n > KRB_ERR_MAX)
+            n = KRB_ERR_GENERIC;
+    }
+    slot[RESULT_BASE(tgs) + n]++;
+}
+
+/* Count the padata types present in an AS request. */
+void
+kdc_metrics_padata(krb5_pa_data *const *padata)
+{
+    uint64_t *slot;
+    krb5_preauthtype type;
+
+    if (map == NULL || padata == NULL)
+        return;
+    slot = current_slot();
+    if (slot == NULL)
+        return;
+    for (; *padata != NULL; padata++) {
+        type = (*padata)->pa_type;
+        slot[PADATA_BASE + ((type >= 0 && type < NPADATA - 1) ? type :
+                            NPADATA - 1)]++;
+    }
+}
+
+/*
+ * Copy the KDB module's statistics for context's database handle into the
+ * calling thread's counters.  Each request thread has its own handle, so the
+ * counters summed over the slots are the totals for all handles.
+ */
+void
+kdc_metrics_db_stats(krb5_context context)
+{
+    uint64_t *slot, val;
+
+    if (map == NULL)
+        return;
+    slot = current_slot();
+    if (slot == NULL)
+        return;
+    if (krb5_db_get_stat(context, KRB5_KDB_STAT_WRITES_AVOIDED, &val) == 0)
+        slot[KDC_METRIC_DB_WRITES_AVOIDED] = val;
+}
+
+/* Return a monotonic timestamp in microseconds, or 0 if metrics are not being
+ * kept. */
+uint64_t
+kdc_metrics_now(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+#else
+    struct timeval tv;
+#endif
+
+    if (map == NULL)
+        return 0;
+#ifdef CLOCK_MONOTONIC
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+        return 0;
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    if (gettimeofday(&tv, NULL) != 0)
+        return 0;
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+/* Record the time elapsed since start (from kdc_metrics_now()) in hist. */
+void
+kdc_metrics_latency(enum kdc_histogram hist, uint64_t start)
+{
+    uint64_t *slot, now, elapsed;
+    int base = HIST_BASE(hist);
+
+    if (map == NULL || start == 0)
+        return;
+    slot = current_slot();
+    now = kdc_metrics_now();
+    if (slot == NULL || now == 0)
+        return;
+    elapsed = (now > start) ? now - start : 0;
+    slot[base + bucket_index(elapsed)]++;
+    slot[base + HIST_BUCKETS]++;
+    slot[base + HIST_BUCKETS + 1] += elapsed;
+}
@@ -0,0 +1,425 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* kdc/kdc_threads.c - Request-processing threads for the KDC */
+/*
+ * Copyright (C) 2026 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * When krb5kdc is started with -t, the main loop continues to own the network
+ * sockets and the lookaside cache, but hands each new request to a pool of
+ * threads.  Each thread runs its own event loop (so that asynchronous preauth
+ * mechanisms have somewhere to run) and has its own server handle, so that
+ * realm contexts and KDB handles are never used from two threads at once.
+ * Completed responses are passed back to the main loop, which sends them.
+ *
+ * Requests are queued on a single list; each submission wakes one thread in
+ * round-robin order, and a woken thread keeps taking requests until the list
+ * is empty, so an idle thread can pick up work intended for a busy one.
+ */
+
+#include "k5-int.h"
+#include "k5-queue.h"
+#include "kdc_util.h"
+#include "extern.h"
+#include <syslog.h>
+
+#ifdef ENABLE_THREADS
+
+#include <signal.h>
+
+struct kdc_job {
+    K5_TAILQ_ENTRY(kdc_job) links;
+    /* The packet and address belong to net-server and remain valid until
+     * respond is called. */
+    krb5_data *pkt;
+    const krb5_fulladdr *from;
+    int is_tcp;
+    loop_respond_fn respond;
+    void *arg;
+    krb5_error_code code;
+    krb5_data *response;
+};
+
+K5_TAILQ_HEAD(job_queue, kdc_job);
+
+struct kdc_thread {
+    struct server_handle *handle;
+    verto_ctx *ctx;
+    pthread_t tid;
+    krb5_boolean running;
+    krb5_boolean hangup;
+    int wake_fds[2];
+};
+
+static struct kdc_thread *threads;
+static int nthreads;
+static int next_thread;
+
+/* pool_lock protects the job queues and the stopping and hangup flags. */
+static k5_mutex_t pool_lock = K5_MUTEX_PARTIAL_INITIALIZER;
+static struct job_queue pending_jobs = K5_TAILQ_HEAD_INITIALIZER(pending_jobs);
+static struct job_queue done_jobs = K5_TAILQ_HEAD_INITIALIZER(done_jobs);
+static krb5_boolean stopping;
+static int done_fds[2] = { -1, -1 };
+static verto_ev *done_ev;
+
+/* Write a byte to fd to wake up the loop reading from it.  If the pipe is
+ * full, the reader has wakeups pending already. */
+static void
+wake(int fd)
+{
+    char c = 0;
+
+    while (write(fd, &c, 1) < 0 && errno == EINTR);
+}
+
+/* Discard all pending wakeups on fd. */
+static void
+drain(int fd)
+{
+    char buf[64];
+
+    while (read(fd, buf, sizeof(buf)) > 0);
+}
+
+static int
+make_pipe(int fds[2])
+{
+    if (pipe(fds) != 0)
+        return errno;
+    set_cloexec_fd(fds[0]);
+    set_cloexec_fd(fds[1]);
+    if (fcntl(fds[0], F_SETFL, O_NONBLOCK) != 0 ||
+        fcntl(fds[1], F_SETFL, O_NONBLOCK) != 0)
+        return errno;
+    return 0;
+}
+
+static void
+close_pipe(int fds[2])
+{
+    if (fds[0] != -1)
+        close(fds[0]);
+    if (fds[1] != -1)
+        close(fds[1]);
+    fds[0] = fds[1] = -1;
+}
+
+/* Called in a worker thread's loop when a request has been processed.  Queue
+ * the job for the main loop. */
+static void
+finish_job(void *arg, krb5_error_code code, krb5_data *response)
+{
+    struct kdc_job *job = arg;
+    krb5_boolean was_empty;
+
+    job->code = code;
+    job->response = response;
+
+    k5_mutex_lock(&pool_lock);
+    was_empty = K5_TAILQ_EMPTY(&done_jobs);
+    K5_TAILQ_INSERT_TAIL(&done_jobs, job, links);
+    k5_mutex_unlock(&pool_lock);
+
+    if (was_empty)
+        wake(done_fds[1]);
+}
+
+/* Called in the main loop when worker threads have completed jobs.  Send the
+ * responses. */
+static void
+send_responses(verto_ctx *ctx, verto_ev *ev)
+{
+    struct job_queue jobs;
+    struct kdc_job *job, *next;
+
+    drain(done_fds[0]);
+
+    K5_TAILQ_INIT(&jobs);
+    k5_mutex_lock(&pool_lock);
+    K5_TAILQ_CONCAT(&jobs, &done_jobs, links);
+    k5_mutex_unlock(&pool_lock);
+
+    K5_TAILQ_FOREACH_SAFE(job, &jobs, links, next) {
+        (*job->respond)(job->arg, job->code, job->response);
+        free(job);
+    }
+}
+
+/* Called in a worker thread's loop when it has been woken up.  Process queued
+ * jobs until there are none left. */
+static void
+process_jobs(verto_ctx *ctx, verto_ev *ev)
+{
+    struct kdc_thread *t = verto_get_private(ev);
+    struct kdc_job *job;
+    krb5_boolean hangup;
+
+    drain(t->wake_fds[0]);
+
+    k5_mutex_lock(&pool_lock);
+    if (stopping) {
+        k5_mutex_unlock(&pool_lock);
+        verto_break(ctx);
+        return;
+    }
+    hangup = t->hangup;
+    t->hangup = FALSE;
+    k5_mutex_unlock(&pool_lock);
+
+    if (hangup)
+        reset_for_hangup(t->handle);
+
+    for (;;) {
+        k5_mutex_lock(&pool_lock);
+        job = K5_TAILQ_FIRST(&pending_jobs);
+        if (job != NULL)
+            K5_TAILQ_REMOVE(&pending_jobs, job, links);
+        k5_mutex_unlock(&pool_lock);
+        if (job == NULL)
+            break;
+
+        kdc_process_request(t->handle, job->pkt, job->from, job->is_tcp, ctx,
+                            finish_job, job);
+    }
+}
+
+static void *
+thread_main(void *arg)
+{
+    struct kdc_thread *t = arg;
+
+    kdc_metrics_start_thread(t - threads);
+    verto_run(t->ctx);
+    return NULL;
+}
+
+/*
+ * Start one request-processing thread for each of handles[0..n-1], and arrange
+ * for completed requests to be sent from ctx.  The handles must remain valid
+ * until kdc_stop_threads() is called.
+ */
+krb5_error_code
+kdc_start_threads(verto_ctx *ctx, struct server_handle *handles, int n)
+{
+    krb5_error_code ret;
+    struct kdc_thread *t;
+    verto_ev *ev;
+    sigset_t all, old;
+    int i;
+
+    ret = k5_mutex_finish_init(&pool_lock);
+    if (ret)
+        return ret;
+
+    ret = make_pipe(done_fds);
+    if (ret)
+        goto error;
+    done_ev = verto_add_io(ctx, VERTO_EV_FLAG_PERSIST | VERTO_EV_FLAG_IO_READ,
+                           send_responses, done_fds[0]);
+    if (done_ev == NULL) {
+        ret = ENOMEM;
+        goto error;
+    }
+
+    threads = calloc(n, sizeof(*threads));
+    if (threads == NULL) {
+        ret = ENOMEM;
+        goto error;
+    }
+    nthreads = n;
+    for (i = 0; i < n; i++)
+        threads[i].wake_fds[0] = threads[i].wake_fds[1] = -1;
+    for (i = 0; i < n; i++) {
+        t = &threads[i];
+        t->handle = &handles[i];
+        ret = make_pipe(t->wake_fds);
+        if (ret)
+            goto error;
+        t->ctx = verto_new(NULL, VERTO_EV_TYPE_IO | VERTO_EV_TYPE_TIMEOUT);
+        if (t->ctx == NULL) {
+            ret = ENOMEM;
+            goto error;
+        }
+        ev = verto_add_io(t->ctx, VERTO_EV_FLAG_PERSIST | VERTO_EV_FLAG_IO_READ,
+                          process_jobs, t->wake_fds[0]);
+        if (ev == NULL) {
+            ret = ENOMEM;
+            goto error;
+        }
+        verto_set_private(ev, t, NULL);
+        ev = verto_add_timeout(t->ctx, VERTO_EV_FLAG_PERSIST,
+                               kdc_flush_db_buffers, 1000);
+        if (ev == NULL) {
+            ret = ENOMEM;
+            goto error;
+        }
+        verto_set_private(ev, t->handle, NULL);
+    }
+
+    /* Leave signal handling to the main loop. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    for (i = 0; i < n; i++) {
+        ret = pthread_create(&threads[i].tid, NULL, thread_main, &threads[i]);
+        if (ret)
+            break;
+        threads[i].running = TRUE;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret)
+        goto error;
+
+    return 0;
+
+error:
+    kdc_stop_threads();
+    return ret;
+}
+
+krb5_boolean
+kdc_threads_enabled(void)
+{
+    return threads != NULL;
+}
+
+/* Queue a request for processing by a worker thread.  respond will be called
+ * from the main loop when the request is complete. */
+krb5_error_code
+kdc_thread_dispatch(krb5_data *pkt, const krb5_fulladdr *from, int is_tcp,
+                    loop_respond_fn respond, void *arg)
+{
+    struct kdc_job *job;
+
+    job = calloc(1, sizeof(*job));
+    if (job == NULL)
+        return ENOMEM;
+    job->pkt = pkt;
+    job->from = from;
+    job->is_tcp = is_tcp;
+    job->respond = respond;
+    job->arg = arg;
+
+    k5_mutex_lock(&pool_lock);
+    K5_TAILQ_INSERT_TAIL(&pending_jobs, job, links);
+    k5_mutex_unlock(&pool_lock);
+
+    wake(threads[next_thread].wake_fds[1]);
+    next_thread = (next_thread + 1) % nthreads;
+    return 0;
+}
+
+/* Arrange for each thread to reload its realms' database configuration. */
+void
+kdc_hangup_threads(void)
+{
+    int i;
+
+    k5_mutex_lock(&pool_lock);
+    for (i = 0; i < nthreads; i++)
+        threads[i].hangup = TRUE;
+    k5_mutex_unlock(&pool_lock);
+    for (i = 0; i < nthreads; i++)
+        wake(threads[i].wake_fds[1]);
+}
+
+/* Stop and join the worker threads, discarding any unfinished requests.  This
+ * must be called before the main loop is freed. */
+void
+kdc_stop_threads(void)
+{
+    struct kdc_job *job, *next;
+    struct kdc_thread *t;
+    int i;
+
+    k5_mutex_lock(&pool_lock);
+    stopping = TRUE;
+    k5_mutex_unlock(&pool_lock);
+
+    for (i = 0; i < nthreads; i++) {
+        t = &threads[i];
+        if (t->running) {
+            wake(t->wake_fds[1]);
+            pthread_join(t->tid, NULL);
+        }
+        if (t->ctx != NULL)
+            verto_free(t->ctx);
+        close_pipe(t->wake_fds);
+    }
+    free(threads);
+    threads = NULL;
+    nthreads = 0;
+    if (done_ev != NULL)
+        verto_del(done_ev);
+    done_ev = NULL;
+    close_pipe(done_fds);
+
+    K5_TAILQ_FOREACH_SAFE(job, &pending_jobs, links, next) {
+        K5_TAILQ_REMOVE(&pending_jobs, job, links);
+        free(job);
+    }
+    K5_TAILQ_FOREACH_SAFE(job, &done_jobs, links, next) {
+        K5_TAILQ_REMOVE(&done_jobs, job, links);
+        krb5_free_data(NULL, job->response);
+        free(job);
+    }
+}
+
+#else /* not ENABLE_THREADS */
+
+krb5_error_code
+kdc_start_threads(verto_ctx *ctx, struct server_handle *handles, int n)
+{
+    return ENOTSUP;
+}
+
+krb5_boolean
+kdc_threads_enabled(void)
+{
+    return FALSE;
+}
+
+krb5_error_code
+kdc_thread_dispatch(krb5_data *pkt, const krb5_fulladdr *from, int is_tcp,
+                    loop_respond_fn respond, void *arg)
+{
+    return ENOTSUP;
+}
+
+void
+kdc_hangup_threads(void)
+{
+}
+
+void
+kdc_stop_threads(void)
+{
+}
+
+#endif /* not ENABLE_THREADS */
@@ -73,7 +73,7 @@ static krb5_error_code kdc_rd_ap_req(kdc_realm_t *kdc_active_realm,
                                      krb5_auth_context auth_context,
                                      krb5_db_entry **server,
                                      krb5_keyblock **tgskey);
-static krb5_error_code find_server_key(krb5_context,
+static krb5_error_code find_server_key(kdc_realm_t *,
                                        krb5_db_entry *, krb5_enctype,
                                        krb5_kvno, krb5_keyblock **,
                                        krb5_kvno *);
@@ -396,7 +396,7 @@ kdc_rd_ap_req(kdc_realm_t *kdc_active_realm,
         match_enctype = 0;
     }
 
-    retval = kdc_get_server_key(kdc_context, apreq->ticket,
+    retval = kdc_get_server_key(kdc_active_realm, apreq->ticket,
                                 KRB5_KDB_FLAG_ALIAS_OK, match_enctype, server,
                                 NULL, NULL);
     if (retval)
@@ -406,7 +406,7 @@ kdc_rd_ap_req(kdc_realm_t *kdc_active_realm,
     kvno = apreq->ticket->enc_part.kvno;
     do {
         krb5_free_keyblock(kdc_context, *tgskey);
-        retval = find_server_key(kdc_context,
+        retval = find_server_key(kdc_active_realm,
                                  *server, search_enctype, kvno, tgskey, &kvno);
         if (retval)
             continue;
@@ -441,11 +441,12 @@ kdc_rd_ap_req(kdc_realm_t *kdc_active_realm,
  * This is also used by do_tgs_req() for u2u auth.
  */
 krb5_error_code
-kdc_get_server_key(krb5_context context,
+kdc_get_server_key(kdc_realm_t *kdc_active_realm,
                    krb5_ticket *ticket, unsigned int flags,
                    krb5_boolean match_enctype, krb5_db_entry **server_ptr,
                    krb5_keyblock **key, krb5_kvno *kvno)
 {
+    krb5_context          context = kdc_context;
     krb5_error_code       retval;
     krb5_db_entry       * server = NULL;
     krb5_enctype          search_enctype = -1;
@@ -458,8 +459,8 @@ kdc_get_server_key(krb5_context context,
 
     *server_ptr = NULL;
 
-    retval = krb5_db_get_principal(context, ticket->server, flags,
-                                   &server);
+    retval = kdc_get_principal(kdc_active_realm, ticket->server, flags,
+                               &server);
     if (retval == KRB5_KDB_NOENTRY) {
         char *sname;
         if (!krb5_unparse_name(context, ticket->server, &sname)) {
@@ -478,8 +479,8 @@ kdc_get_server_key(krb5_context context,
     }
 
     if (key) {
-        retval = find_server_key(context, server, search_enctype, search_kvno,
-                                 key, kvno);
+        retval = find_server_key(kdc_active_realm, server, search_enctype,
+                                 search_kvno, key, kvno);
         if (retval)
             goto errout;
     }
@@ -498,10 +499,11 @@ errout:
  */
 static
 krb5_error_code
-find_server_key(krb5_context context,
+find_server_key(kdc_realm_t *kdc_active_realm,
                 krb5_db_entry *server, krb5_enctype enctype, krb5_kvno kvno,
                 krb5_keyblock **key_out, krb5_kvno *kvno_out)
 {
+    krb5_context          context = kdc_context;
     krb5_error_code       retval;
     krb5_key_data       * server_key;
     krb5_keyblock       * key;
@@ -515,8 +517,8 @@ find_server_key(krb5_context context,
         return KRB5KDC_ERR_S_PRINCIPAL_UNKNOWN;
     if ((key = (krb5_keyblock *)malloc(sizeof *key)) == NULL)
         return ENOMEM;
-    retval = krb5_dbe_decrypt_key_data(context, NULL, server_key,
-                                       key, NULL);
+    retval = kdc_decrypt_key_data(kdc_active_realm, server->princ,
+                                  server_key, key);
     if (retval)
         goto errout;
     if (enctype != -1) {
@@ -545,15 +547,16 @@ errout:
  * *storage_out to NULL.  Otherwise, load the local TGT into *storage_out and
  * set *alias_out to *storage_out.
  *
- * In the future we might generalize this to a small per-request principal
- * cache.  For now, it saves a load operation in the common case where the AS
- * server or TGS header ticket server is the local TGT.
+ * This saves a load operation in the common case where the AS server or TGS
+ * header ticket server is the local TGT.  Other loads may be satisfied from
+ * the realm's principal cache.
  */
 krb5_error_code
-get_local_tgt(krb5_context context, const krb5_data *realm,
+get_local_tgt(kdc_realm_t *kdc_active_realm, const krb5_data *realm,
               krb5_db_entry *candidate, krb5_db_entry **alias_out,
               krb5_db_entry **storage_out)
 {
+    krb5_context context = kdc_context;
     krb5_error_code ret;
     krb5_principal princ;
     krb5_db_entry *tgt;
@@ -568,7 +571,7 @@ get_local_tgt(krb5_context context, const krb5_data *realm,
         return ret;
 
     if (!krb5_principal_compare(context, candidate->princ, princ)) {
-        ret = krb5_db_get_principal(context, princ, 0, &tgt);
+        ret = kdc_get_principal(kdc_active_realm, princ, 0, &tgt);
         if (!ret)
             *storage_out = *alias_out = tgt;
     } else {
@@ -1921,6 +1924,27 @@ void reset_for_hangup(void *ctx)
     int k;
     struct server_handle *h = ctx;
 
-    for (k = 0; k < h->kdc_numrealms; k++)
+    for (k = 0; k < h->kdc_numrealms; k++) {
         krb5_db_refresh_config(h->kdc_realmlist[k]->realm_context);
+        kdc_flush_principal_cache(h->kdc_realmlist[k]->realm_context,
+                                  h->kdc_realmlist[k]->realm_princ_cache);
+        kdc_flush_key_cache(h->kdc_realmlist[k]->realm_context,
+                            h->kdc_realmlist[k]->realm_key_cache);
+    }
+}
+
+/* Timeout callback: write out KDB updates which have been buffered for too
+ * long by the realms of the server handle in ev's private data. */
+void
+kdc_flush_db_buffers(verto_ctx *ctx, verto_ev *ev)
+{
+    int k;
+    struct server_handle *h = verto_get_private(ev);
+    krb5_context context;
+
+    for (k = 0; k < h->kdc_numrealms; k++) {
+        context = h->kdc_realmlist[k]->realm_context;
+        if (krb5_db_flush_buffered(context) == 0)
+            kdc_metrics_db_stats(context);
+    }
 }
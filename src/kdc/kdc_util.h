@@ -71,12 +71,12 @@ kdc_process_tgs_req (kdc_realm_t *, krb5_kdc_req *,
                      krb5_pa_data **pa_tgs_req);
 
 krb5_error_code
-kdc_get_server_key (krb5_context, krb5_ticket *, unsigned int,
+kdc_get_server_key (kdc_realm_t *, krb5_ticket *, unsigned int,
                     krb5_boolean match_enctype,
                     krb5_db_entry **, krb5_keyblock **, krb5_kvno *);
 
 krb5_error_code
-get_local_tgt(krb5_context context, const krb5_data *realm,
+get_local_tgt(kdc_realm_t *kdc_active_realm, const krb5_data *realm,
               krb5_db_entry *candidate, krb5_db_entry **alias_out,
               krb5_db_entry **storage_out);
 
@@ -159,6 +159,11 @@ dispatch (void *,
           loop_respond_fn,
           void *);
 
+void
+kdc_process_request(struct server_handle *, krb5_data *,
+                    const krb5_fulladdr *, int, verto_ctx *,
+                    loop_respond_fn, void *);
+
 void
 kdc_err(krb5_context call_context, errcode_t code, const char *fmt, ...)
 #if !defined(__cplusplus) && (__GNUC__ > 2)
@@ -257,14 +262,92 @@ handle_authdata (krb5_context context,
                  krb5_enc_tkt_part *enc_tkt_reply);
 
 /* replay.c */
-krb5_error_code kdc_init_lookaside(krb5_context context);
+#ifndef LOOKASIDE_MAX_SIZE
+#define LOOKASIDE_MAX_SIZE (10 * 1024 * 1024)
+#endif
+struct lookaside_stats {
+    unsigned long calls;
+    unsigned long hits;
+    unsigned long evictions;
+    unsigned long entries;
+    unsigned int max_hits_per_entry;
+};
+krb5_error_code kdc_init_lookaside(krb5_context context, size_t size,
+                                   krb5_boolean shared);
+void kdc_get_lookaside_stats(struct lookaside_stats *stats);
 krb5_boolean kdc_check_lookaside (krb5_context, krb5_data *, krb5_data **);
 void kdc_insert_lookaside (krb5_context, krb5_data *, krb5_data *);
 void kdc_remove_lookaside (krb5_context kcontext, krb5_data *);
 void kdc_free_lookaside(krb5_context);
 
+/* key_cache.c */
+krb5_error_code kdc_init_key_cache(krb5_context context, krb5_int32 size,
+                                   struct key_cache **kc_out);
+void kdc_flush_key_cache(krb5_context context, struct key_cache *kc);
+void kdc_free_key_cache(krb5_context context, struct key_cache *kc);
+krb5_error_code kdc_decrypt_key_data(kdc_realm_t *realm,
+                                     krb5_const_principal princ,
+                                     const krb5_key_data *kd,
+                                     krb5_keyblock *key_out);
+
+/* princ_cache.c */
+krb5_error_code kdc_init_principal_cache(krb5_context context,
+                                         const char *realm, krb5_deltat ttl,
+                                         krb5_int32 size,
+                                         krb5_boolean negative,
+                                         struct princ_cache **pc_out);
+void kdc_flush_principal_cache(krb5_context context, struct princ_cache *pc);
+void kdc_free_principal_cache(krb5_context context, struct princ_cache *pc);
+krb5_error_code kdc_get_principal(kdc_realm_t *realm,
+                                  krb5_const_principal princ,
+                                  unsigned int flags,
+                                  krb5_db_entry **entry_out);
+
+/* kdc_threads.c */
+krb5_error_code kdc_start_threads(verto_ctx *ctx, struct server_handle *handles,
+                                  int nthreads);
+krb5_boolean kdc_threads_enabled(void);
+krb5_error_code kdc_thread_dispatch(krb5_data *, const krb5_fulladdr *, int,
+                                    loop_respond_fn, void *);
+void kdc_hangup_threads(void);
+void kdc_stop_threads(void);
+
+/* kdc_metrics.c */
+enum kdc_metric {
+    KDC_METRIC_AS_REQ,
+    KDC_METRIC_TGS_REQ,
+    KDC_METRIC_OTHER_REQ,
+    KDC_METRIC_UDP_REQ,
+    KDC_METRIC_TCP_REQ,
+    KDC_METRIC_LOOKASIDE_HIT,
+    KDC_METRIC_LOOKASIDE_MISS,
+    KDC_METRIC_REPLY_TOO_BIG,
+    KDC_METRIC_DB_WRITES_AVOIDED,
+    KDC_METRIC_NET_EVENTS,      /* one counter per enum loop_event value */
+    KDC_METRIC_MAX = KDC_METRIC_NET_EVENTS + LOOP_EVENT_UDP_RXQ_DROP + 1
+};
+enum kdc_histogram {
+    KDC_HIST_DISPATCH,
+    KDC_HIST_AS_REQ,
+    KDC_HIST_TGS_REQ,
+    KDC_HIST_DB_LOOKUP,
+    KDC_HIST_MAX
+};
+krb5_error_code kdc_metrics_init(const char *path, int nprocs, int nthreads);
+void kdc_metrics_set_process(int index);
+void kdc_metrics_start_thread(int index);
+void kdc_metrics_fini(void);
+void kdc_metrics_count(enum kdc_metric metric);
+void kdc_metrics_loop_event(enum loop_event event, unsigned int count);
+void kdc_metrics_result(krb5_boolean tgs, krb5_error_code code);
+void kdc_metrics_padata(krb5_pa_data *const *padata);
+void kdc_metrics_db_stats(krb5_context context);
+uint64_t kdc_metrics_now(void);
+void kdc_metrics_latency(enum kdc_histogram hist, uint64_t start);
+
 /* kdc_util.c */
 void reset_for_hangup(void *);
+void kdc_flush_db_buffers(verto_ctx *ctx, verto_ev *ev);
 
 krb5_boolean
 include_pac_p(krb5_context context, krb5_kdc_req *request);
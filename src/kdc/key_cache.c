@@ -0,0 +1,331 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* kdc/key_cache.c - KDC cache of decrypted long-term keys */
+/*
+ * Copyright (C) 2026 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * When key_cache_size is set for a realm, the KDC remembers the results of
+ * decrypting principal keys with the master key, so that the keys used most
+ * often (such as the local krbtgt key) are not decrypted again for every
+ * request.  Entries are found by principal, kvno and enctype, and are only
+ * used if the encrypted key data still matches, so a changed key is never
+ * returned from the cache even if its kvno was reused.
+ *
+ * The cache entries, including the decrypted keys, live in a single
+ * allocation which is locked into memory if possible and is zeroed whenever
+ * an entry is discarded.  The whole cache is discarded if the master key list
+ * is reloaded, which happens when the KDC finds key data encrypted in a new
+ * master key.  As with the principal cache, each realm structure has its own
+ * key cache, so no locking is needed.
+ */
+
+#include "k5-int.h"
+#include "k5-queue.h"
+#include "kdc_util.h"
+#include "adm_proto.h"
+#include <syslog.h>
+#include <sys/mman.h>
+
+/* Keys longer than this are not cached. */
+#define MAX_CACHED_KEYLEN 64
+
+struct kc_entry {
+    K5_TAILQ_ENTRY(kc_entry) links;         /* LRU or free list */
+    K5_LIST_ENTRY(kc_entry) hash_links;
+    krb5_principal princ;
+    krb5_kvno kvno;
+    krb5_int16 data_type;
+    krb5_data enc_key;          /* Copy of the encrypted key data */
+    krb5_enctype enctype;
+    unsigned int keylen;
+    krb5_octet key[MAX_CACHED_KEYLEN];
+};
+
+K5_TAILQ_HEAD(kc_list, kc_entry);
+K5_LIST_HEAD(kc_chain, kc_entry);
+
+struct key_cache {
+    struct kc_entry *slab;
+    size_t slab_size;
+    krb5_boolean locked;
+    struct kc_list lru;         /* Least recently used first */
+    struct kc_list free;
+    struct kc_chain *buckets;
+    unsigned int nbuckets;      /* Always a power of two */
+
+    /* The master key list the cached keys were decrypted with. */
+    krb5_keylist_node *mkey_list;
+    krb5_kvno mkey_kvno;
+};
+
+static unsigned int
+hash_bytes(unsigned int h, const void *ptr, size_t len)
+{
+    const unsigned char *p = ptr;
+
+    /* FNV-1a */
+    while (len-- > 0)
+        h = (h ^ *p++) * 16777619U;
+    return h;
+}
+
+static struct kc_chain *
+get_chain(struct key_cache *kc, krb5_const_principal princ,
+          const krb5_key_data *kd)
+{
+    unsigned int h = 2166136261U;
+    int i;
+
+    h = hash_bytes(h, &kd->key_data_kvno, sizeof(kd->key_data_kvno));
+    h = hash_bytes(h, &kd->key_data_type[0], sizeof(kd->key_data_type[0]));
+    h = hash_bytes(h, princ->realm.data, princ->realm.length);
+    for (i = 0; i < princ->length; i++) {
+        h = hash_bytes(h, "/", 1);
+        h = hash_bytes(h, princ->data[i].data, princ->data[i].length);
+    }
+    return &kc->buckets[h & (kc->nbuckets - 1)];
+}
+
+/* Zero ent's key and return it to the free list. */
+static void
+discard_entry(krb5_context context, struct key_cache *kc,
+              struct kc_entry *ent)
+{
+    K5_TAILQ_REMOVE(&kc->lru, ent, links);
+    K5_LIST_REMOVE(ent, hash_links);
+    krb5_free_principal(context, ent->princ);
+    krb5_free_data_contents(context, &ent->enc_key);
+    zap(ent, sizeof(*ent));
+    K5_TAILQ_INSERT_TAIL(&kc->free, ent, links);
+}
+
+static void
+discard_all(krb5_context context, struct key_cache *kc)
+{
+    while (!K5_TAILQ_EMPTY(&kc->lru))
+        discard_entry(context, kc, K5_TAILQ_FIRST(&kc->lru));
+}
+
+/* Discard all entries if the master key list has been reloaded since we last
+ * looked. */
+static void
+check_mkey_list(krb5_context context, struct key_cache *kc)
+{
+    krb5_keylist_node *list = krb5_db_mkey_list_alias(context);
+    krb5_kvno kvno = (list != NULL) ? list->kvno : 0;
+
+    if (list == kc->mkey_list && kvno == kc->mkey_kvno)
+        return;
+    discard_all(context, kc);
+    kc->mkey_list = list;
+    kc->mkey_kvno = kvno;
+}
+
+static krb5_boolean
+enc_key_matches(const struct kc_entry *ent, const krb5_key_data *kd)
+{
+    return ent->enc_key.length == (unsigned int)kd->key_data_length[0] &&
+        memcmp(ent->enc_key.data, kd->key_data_contents[0],
+               ent->enc_key.length) == 0;
+}
+
+static struct kc_entry *
+find_entry(krb5_context context, struct kc_chain *chain,
+           krb5_const_principal princ, const krb5_key_data *kd)
+{
+    struct kc_entry *ent;
+
+    K5_LIST_FOREACH(ent, chain, hash_links) {
+        if (ent->kvno == kd->key_data_kvno &&
+            ent->data_type == kd->key_data_type[0] &&
+            krb5_principal_compare(context, ent->princ, princ))
+            return ent;
+    }
+    return NULL;
+}
+
+/* Add a decrypted key to the cache, replacing the least recently used entry
+ * if the cache is full. */
+static krb5_error_code
+add_entry(krb5_context context, struct key_cache *kc, struct kc_chain *chain,
+          krb5_const_principal princ, const krb5_key_data *kd,
+          const krb5_keyblock *key)
+{
+    krb5_error_code ret;
+    struct kc_entry *ent;
+    krb5_principal princ_copy;
+    krb5_data enc_key;
+
+    if (key->length > MAX_CACHED_KEYLEN)
+        return 0;
+
+    ret = krb5_copy_principal(context, princ, &princ_copy);
+    if (ret)
+        return ret;
+    ret = alloc_data(&enc_key, kd->key_data_length[0]);
+    if (ret) {
+        krb5_free_principal(context, princ_copy);
+        return ret;
+    }
+    if (enc_key.length > 0)
+        memcpy(enc_key.data, kd->key_data_contents[0], enc_key.length);
+
+    if (K5_TAILQ_EMPTY(&kc->free))
+        discard_entry(context, kc, K5_TAILQ_FIRST(&kc->lru));
+    ent = K5_TAILQ_FIRST(&kc->free);
+    K5_TAILQ_REMOVE(&kc->free, ent, links);
+
+    ent->princ = princ_copy;
+    ent->kvno = kd->key_data_kvno;
+    ent->data_type = kd->key_data_type[0];
+    ent->enc_key = enc_key;
+    ent->enctype = key->enctype;
+    ent->keylen = key->length;
+    memcpy(ent->key, key->contents, key->length);
+    K5_TAILQ_INSERT_TAIL(&kc->lru, ent, links);
+    K5_LIST_INSERT_HEAD(chain, ent, hash_links);
+    return 0;
+}
+
+krb5_error_code
+kdc_init_key_cache(krb5_context context, krb5_int32 size,
+                   struct key_cache **kc_out)
+{
+    krb5_error_code ret;
+    struct key_cache *kc;
+    krb5_int32 i;
+
+    *kc_out = NULL;
+    if (size <= 0)
+        return 0;
+
+    kc = k5alloc(sizeof(*kc), &ret);
+    if (kc == NULL)
+        return ret;
+    K5_TAILQ_INIT(&kc->lru);
+    K5_TAILQ_INIT(&kc->free);
+    kc->nbuckets = 16;
+    while (kc->nbuckets < (unsigned int)size)
+        kc->nbuckets *= 2;
+    kc->buckets = k5calloc(kc->nbuckets, sizeof(*kc->buckets), &ret);
+    if (kc->buckets == NULL)
+        goto error;
+    for (i = 0; (unsigned int)i < kc->nbuckets; i++)
+        K5_LIST_INIT(&kc->buckets[i]);
+
+    kc->slab_size = size * sizeof(*kc->slab);
+    kc->slab = k5calloc(size, sizeof(*kc->slab), &ret);
+    if (kc->slab == NULL)
+        goto error;
+    for (i = 0; i < size; i++)
+        K5_TAILQ_INSERT_TAIL(&kc->free, &kc->slab[i], links);
+
+    /* Keep the decrypted keys out of swap if we can.  This may fail if the
+     * KDC doesn't have the privilege or the locked memory limit is too
+     * small; the cache still works. */
+    if (mlock(kc->slab, kc->slab_size) == 0) {
+        kc->locked = TRUE;
+    } else {
+        krb5_klog_syslog(LOG_WARNING, _("Unable to lock key cache into "
+                                        "memory: %s"), strerror(errno));
+    }
+
+    kc->mkey_list = krb5_db_mkey_list_alias(context);
+    kc->mkey_kvno = (kc->mkey_list != NULL) ? kc->mkey_list->kvno : 0;
+    *kc_out = kc;
+    return 0;
+
+error:
+    kdc_free_key_cache(context, kc);
+    return ret;
+}
+
+void
+kdc_flush_key_cache(krb5_context context, struct key_cache *kc)
+{
+    if (kc != NULL)
+        discard_all(context, kc);
+}
+
+void
+kdc_free_key_cache(krb5_context context, struct key_cache *kc)
+{
+    if (kc == NULL)
+        return;
+    if (kc->slab != NULL) {
+        discard_all(context, kc);
+        if (kc->locked)
+            (void)munlock(kc->slab, kc->slab_size);
+        free(kc->slab);
+    }
+    free(kc->buckets);
+    free(kc);
+}
+
+krb5_error_code
+kdc_decrypt_key_data(kdc_realm_t *realm, krb5_const_principal princ,
+                     const krb5_key_data *kd, krb5_keyblock *key_out)
+{
+    krb5_error_code ret;
+    krb5_context context = realm->realm_context;
+    struct key_cache *kc = realm->realm_key_cache;
+    struct kc_chain *chain;
+    struct kc_entry *ent;
+    krb5_keyblock key;
+
+    memset(key_out, 0, sizeof(*key_out));
+    if (kc == NULL)
+        return krb5_dbe_decrypt_key_data(context, NULL, kd, key_out, NULL);
+
+    check_mkey_list(context, kc);
+    chain = get_chain(kc, princ, kd);
+    ent = find_entry(context, chain, princ, kd);
+    if (ent != NULL && enc_key_matches(ent, kd)) {
+        K5_TAILQ_REMOVE(&kc->lru, ent, links);
+        K5_TAILQ_INSERT_TAIL(&kc->lru, ent, links);
+        key.magic = KV5M_KEYBLOCK;
+        key.enctype = ent->enctype;
+        key.length = ent->keylen;
+        key.contents = ent->key;
+        return krb5_copy_keyblock_contents(context, &key, key_out);
+    }
+    if (ent != NULL)
+        discard_entry(context, kc, ent);
+
+    ret = krb5_dbe_decrypt_key_data(context, NULL, kd, key_out, NULL);
+    if (ret)
+        return ret;
+
+    /* Decryption may have reloaded the master key list. */
+    check_mkey_list(context, kc);
+    chain = get_chain(kc, princ, kd);
+    (void)add_entry(context, kc, chain, princ, kd, key_out);
+    return 0;
+}
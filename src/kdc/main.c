@@ -54,13 +54,19 @@ static void usage (char *);
 
 static krb5_error_code setup_sam (void);
 
-static void initialize_realms(krb5_context kcontext, int argc, char **argv,
+static void initialize_realms(struct server_handle *handle,
+                              krb5_context kcontext, int argc, char **argv,
                               int *tcp_listen_backlog_out);
 
-static void finish_realms (void);
+static void finish_realms(struct server_handle *handle);
 
 static int nofork = 0;
 static int workers = 0;
+static int threads = 0;
+static krb5_boolean reuseport = FALSE;
+static krb5_int32 lookaside_size = LOOKASIDE_MAX_SIZE;
+static krb5_boolean shared_lookaside = FALSE;
+static char *metrics_file = NULL;
 static int time_offset = 0;
 static const char *pid_file = NULL;
 static int rkey_init_done = 0;
@@ -77,6 +83,12 @@ static const char *kdc_progname;
  */
 static struct server_handle shandle;
 
+/* Server handles for request-processing threads, if -t is used. */
+static struct server_handle *thread_handles;
+
+/* Serializes use of shandle.kdc_err_context by kdc_err(). */
+static k5_mutex_t err_lock = K5_MUTEX_PARTIAL_INITIALIZER;
+
 /*
  * We use krb5_klog_init to set up a com_err callback to log error
  * messages.  The callback also pulls the error message out of the
@@ -92,11 +104,13 @@ kdc_err(krb5_context call_context, errcode_t code, const char *fmt, ...)
 {
     va_list ap;
 
+    k5_mutex_lock(&err_lock);
     if (call_context)
         krb5_copy_error_message(shandle.kdc_err_context, call_context);
     va_start(ap, fmt);
     com_err_va(kdc_progname, code, fmt, ap);
     va_end(ap);
+    k5_mutex_unlock(&err_lock);
 }
 
 /*
@@ -165,6 +179,8 @@ finish_realm(kdc_realm_t *rdp)
             memset(rdp->realm_mkey.contents, 0, rdp->realm_mkey.length);
             free(rdp->realm_mkey.contents);
         }
+        kdc_free_principal_cache(rdp->realm_context, rdp->realm_princ_cache);
+        kdc_free_key_cache(rdp->realm_context, rdp->realm_key_cache);
         krb5_db_fini(rdp->realm_context);
         if (rdp->realm_tgsprinc)
             krb5_free_principal(rdp->realm_context, rdp->realm_tgsprinc);
@@ -208,7 +224,9 @@ init_realm(kdc_realm_t * rdp, krb5_pointer aprof, char *realm,
            char *hostbased)
 {
     krb5_error_code     kret;
-    krb5_boolean        manual;
+    krb5_boolean        manual, pc_negative;
+    krb5_deltat         pc_ttl;
+    krb5_int32          pc_size, kc_size;
     int                 kdb_open_flags;
     char                *svalue = NULL;
     const char          *hierarchy[4];
@@ -314,6 +332,22 @@ init_realm(kdc_realm_t * rdp, krb5_pointer aprof, char *realm,
     if (krb5_aprof_get_deltat(aprof, hierarchy, TRUE, &rdp->realm_maxrlife))
         rdp->realm_maxrlife = KRB5_KDB_MAX_RLIFE;
 
+    /* Handle principal cache parameters */
+    hierarchy[2] = KRB5_CONF_PRINCIPAL_CACHE_TTL;
+    if (krb5_aprof_get_deltat(aprof, hierarchy, TRUE, &pc_ttl))
+        pc_ttl = 0;
+    hierarchy[2] = KRB5_CONF_PRINCIPAL_CACHE_SIZE;
+    if (krb5_aprof_get_int32(aprof, hierarchy, TRUE, &pc_size))
+        pc_size = 0;
+    hierarchy[2] = KRB5_CONF_PRINCIPAL_CACHE_NEGATIVE;
+    if (krb5_aprof_get_boolean(aprof, hierarchy, TRUE, &pc_negative))
+        pc_negative = FALSE;
+
+    /* Handle decrypted key cache size */
+    hierarchy[2] = KRB5_CONF_KEY_CACHE_SIZE;
+    if (krb5_aprof_get_int32(aprof, hierarchy, TRUE, &kc_size))
+        kc_size = 0;
+
     /* Handle KDC referrals */
     hierarchy[2] = KRB5_CONF_NO_HOST_REFERRAL;
     (void)krb5_aprof_get_string_all(aprof, hierarchy, &svalue);
@@ -381,6 +415,14 @@ init_realm(kdc_realm_t * rdp, krb5_pointer aprof, char *realm,
     }
 
 
+    kret = kdc_init_key_cache(rdp->realm_context, kc_size,
+                              &rdp->realm_key_cache);
+    if (kret) {
+        kdc_err(rdp->realm_context, kret,
+                _("while initializing key cache for realm %s"), realm);
+        goto whoops;
+    }
+
     /* Set up the keytab */
     if ((kret = krb5_ktkdb_resolve(rdp->realm_context, NULL,
                                    &rdp->realm_keytab))) {
@@ -389,6 +431,15 @@ init_realm(kdc_realm_t * rdp, krb5_pointer aprof, char *realm,
         goto whoops;
     }
 
+    kret = kdc_init_principal_cache(rdp->realm_context, realm, pc_ttl,
+                                    pc_size, pc_negative,
+                                    &rdp->realm_princ_cache);
+    if (kret) {
+        kdc_err(rdp->realm_context, kret,
+                _("while initializing principal cache for realm %s"), realm);
+        goto whoops;
+    }
+
     /* Preformat the TGS name */
     if ((kret = krb5_build_principal(rdp->realm_context, &rdp->realm_tgsprinc,
                                      strlen(realm), realm, KRB5_TGS_NAME,
@@ -520,6 +571,7 @@ create_workers(verto_ctx *ctx, int num)
         pid = fork();
         if (pid == 0) {
             free(pids);
+            kdc_metrics_set_process(i);
             if (!verto_reinitialize(ctx)) {
                 krb5_klog_syslog(LOG_ERR,
                                  _("Unable to reinitialize main loop"));
@@ -589,6 +641,84 @@ create_workers(verto_ctx *ctx, int num)
     exit(0);
 }
 
+/*
+ * Create a server handle for each of threads request-processing threads, each
+ * with its own error context and its own copy of the realm data (and therefore
+ * its own KDB handles), and start the threads.  Completed requests are sent
+ * from ctx.
+ */
+static krb5_error_code
+create_threads(verto_ctx *ctx, int argc, char **argv)
+{
+    krb5_error_code retval;
+    struct server_handle *h;
+    int i;
+
+    thread_handles = calloc(threads, sizeof(*thread_handles));
+    if (thread_handles == NULL)
+        return ENOMEM;
+    for (i = 0; i < threads; i++) {
+        h = &thread_handles[i];
+        h->kdc_realmlist = calloc(KRB5_KDC_MAX_REALMS, sizeof(kdc_realm_t *));
+        if (h->kdc_realmlist == NULL)
+            return ENOMEM;
+        retval = krb5int_init_context_kdc(&h->kdc_err_context);
+        if (retval)
+            return retval;
+        initialize_realms(h, h->kdc_err_context, argc, argv, NULL);
+    }
+
+    krb5_klog_syslog(LOG_INFO, _("creating %d request threads"), threads);
+    return kdc_start_threads(ctx, thread_handles, threads);
+}
+
+/* Stop the request-processing threads and release their server handles. */
+static void
+finish_threads(void)
+{
+    struct server_handle *h;
+    int i;
+
+    if (thread_handles == NULL)
+        return;
+    kdc_stop_threads();
+    for (i = 0; i < threads; i++) {
+        h = &thread_handles[i];
+        if (h->kdc_realmlist != NULL) {
+            finish_realms(h);
+            free(h->kdc_realmlist);
+        }
+        if (h->kdc_err_context != NULL)
+            krb5_free_context(h->kdc_err_context);
+    }
+    free(thread_handles);
+    thread_handles = NULL;
+}
+
+#ifndef NOCACHE
+/* Log lookaside cache statistics (for all workers if the cache is shared). */
+static void
+log_lookaside_stats(void)
+{
+    struct lookaside_stats st;
+
+    kdc_get_lookaside_stats(&st);
+    krb5_klog_syslog(LOG_INFO, _("lookaside cache: %lu lookups, %lu hits, "
+                                 "%lu evictions, %lu entries, max %u hits "
+                                 "per entry"), st.calls, st.hits,
+                     st.evictions, st.entries, st.max_hits_per_entry);
+}
+#endif
+
+/* Reload the database configuration for the main handle and any
+ * request-processing threads. */
+static void
+reset_all_for_hangup(void *handle)
+{
+    reset_for_hangup(handle);
+    kdc_hangup_threads();
+}
+
 static krb5_error_code
 setup_sam(void)
 {
@@ -603,7 +733,7 @@ usage(char *name)
             _("usage: %s [-x db_args]* [-d dbpathname] [-r dbrealmname]\n"
               "\t\t[-R replaycachename] [-m] [-k masterenctype]\n"
               "\t\t[-M masterkeyname] [-p port] [-P pid_file]\n"
-              "\t\t[-n] [-w numworkers] [/]\n\n"
+              "\t\t[-n] [-w numworkers] [-t numthreads] [/]\n\n"
               "where,\n"
               "\t[-x db_args]* - Any number of database specific arguments.\n"
               "\t\t\tLook at each database module documentation for "
@@ -614,8 +744,8 @@ usage(char *name)
 
 
 static void
-initialize_realms(krb5_context kcontext, int argc, char **argv,
-                  int *tcp_listen_backlog_out)
+initialize_realms(struct server_handle *handle, krb5_context kcontext,
+                  int argc, char **argv, int *tcp_listen_backlog_out)
 {
     int                 c;
     char                *db_name = (char *) NULL;
@@ -660,7 +790,20 @@ initialize_realms(krb5_context kcontext, int argc, char **argv,
             if (krb5_aprof_get_int32(aprof, hierarchy, TRUE,
                                      tcp_listen_backlog_out))
                 *tcp_listen_backlog_out = DEFAULT_TCP_LISTEN_BACKLOG;
+            hierarchy[1] = KRB5_CONF_KDC_METRICS_FILE;
+            if (krb5_aprof_get_string(aprof, hierarchy, TRUE, &metrics_file))
+                metrics_file = NULL;
         }
+        hierarchy[1] = KRB5_CONF_KDC_LOOKASIDE_SIZE;
+        if (krb5_aprof_get_int32(aprof, hierarchy, TRUE, &lookaside_size) ||
+            lookaside_size < 0)
+            lookaside_size = LOOKASIDE_MAX_SIZE;
+        hierarchy[1] = KRB5_CONF_KDC_SHARED_LOOKASIDE;
+        if (krb5_aprof_get_boolean(aprof, hierarchy, TRUE, &shared_lookaside))
+            shared_lookaside = FALSE;
+        hierarchy[1] = KRB5_CONF_KDC_REUSEPORT;
+        if (krb5_aprof_get_boolean(aprof, hierarchy, TRUE, &reuseport))
+            reuseport = FALSE;
         hierarchy[1] = KRB5_CONF_RESTRICT_ANONYMOUS_TO_TGT;
         if (krb5_aprof_get_boolean(aprof, hierarchy, TRUE, &def_restrict_anon))
             def_restrict_anon = FALSE;
@@ -690,10 +833,11 @@ initialize_realms(krb5_context kcontext, int argc, char **argv,
     /*
      * Loop through the option list.  Each time we encounter a realm name, use
      * the previously scanned options to fill in for defaults.  We do this
-     * twice if worker processes are used, so we must initialize optind.
+     * more than once if worker processes or threads are used, so we must
+     * initialize optind.
      */
     optind = 1;
-    while ((c = getopt(argc, argv, "x:r:d:mM:k:R:e:P:p:s:nw:4:T:X3")) != -1) {
+    while ((c = getopt(argc, argv, "x:r:d:mM:k:R:e:P:p:s:nw:t:4:T:X3")) != -1) {
         switch(c) {
         case 'x':
             db_args_size++;
@@ -713,7 +857,7 @@ initialize_realms(krb5_context kcontext, int argc, char **argv,
             break;
 
         case 'r':                       /* realm name for db */
-            if (!find_realm_data(&shandle, optarg, (krb5_ui_4) strlen(optarg))) {
+            if (!find_realm_data(handle, optarg, (krb5_ui_4) strlen(optarg))) {
                 if ((rdatap = (kdc_realm_t *) malloc(sizeof(kdc_realm_t)))) {
                     retval = init_realm(rdatap, aprof, optarg, mkey_name,
                                         menctype, def_udp_listen,
@@ -726,8 +870,8 @@ initialize_realms(krb5_context kcontext, int argc, char **argv,
                                 argv[0], optarg);
                         exit(1);
                     }
-                    shandle.kdc_realmlist[shandle.kdc_numrealms] = rdatap;
-                    shandle.kdc_numrealms++;
+                    handle->kdc_realmlist[handle->kdc_numrealms] = rdatap;
+                    handle->kdc_numrealms++;
                     free(db_args), db_args=NULL, db_args_size = 0;
                 }
                 else
@@ -781,6 +925,11 @@ initialize_realms(krb5_context kcontext, int argc, char **argv,
             if (workers <= 0)
                 usage(argv[0]);
             break;
+        case 't':                       /* create request-processing threads */
+            threads = atoi(optarg);
+            if (threads <= 0)
+                usage(argv[0]);
+            break;
         case 'k':                       /* enctype for master key */
             if (krb5_string_to_enctype(optarg, &menctype))
                 com_err(argv[0], 0, _("invalid enctype %s"), optarg);
@@ -822,7 +971,7 @@ initialize_realms(krb5_context kcontext, int argc, char **argv,
     /*
      * Check to see if we processed any realms.
      */
-    if (shandle.kdc_numrealms == 0) {
+    if (handle->kdc_numrealms == 0) {
         /* no realm specified, use default realm */
         if ((retval = krb5_get_default_realm(kcontext, &lrealm))) {
             com_err(argv[0], retval,
@@ -842,8 +991,8 @@ initialize_realms(krb5_context kcontext, int argc, char **argv,
                                   "file for details\n"), argv[0], lrealm);
                 exit(1);
             }
-            shandle.kdc_realmlist[0] = rdatap;
-            shandle.kdc_numrealms++;
+            handle->kdc_realmlist[0] = rdatap;
+            handle->kdc_numrealms++;
         }
         krb5_free_default_realm(kcontext, lrealm);
     }
@@ -882,15 +1031,15 @@ write_pid_file(const char *path)
 }
 
 static void
-finish_realms()
+finish_realms(struct server_handle *handle)
 {
     int i;
 
-    for (i = 0; i < shandle.kdc_numrealms; i++) {
-        finish_realm(shandle.kdc_realmlist[i]);
-        shandle.kdc_realmlist[i] = 0;
+    for (i = 0; i < handle->kdc_numrealms; i++) {
+        finish_realm(handle->kdc_realmlist[i]);
+        handle->kdc_realmlist[i] = 0;
     }
-    shandle.kdc_numrealms = 0;
+    handle->kdc_numrealms = 0;
 }
 
 /*
@@ -925,11 +1074,16 @@ int main(int argc, char **argv)
     krb5_context        kcontext;
     kdc_realm_t *realm;
     verto_ctx *ctx;
+    verto_ev *flush_ev;
     int tcp_listen_backlog;
     int errout = 0;
     int i;
 
     setlocale(LC_ALL, "");
+    if (k5_mutex_finish_init(&err_lock) != 0) {
+        fprintf(stderr, _("%s: cannot initialize mutex\n"), argv[0]);
+        exit(1);
+    }
     if (strrchr(argv[0], '/'))
         argv[0] = strrchr(argv[0], '/')+1;
 
@@ -966,21 +1120,34 @@ int main(int argc, char **argv)
     /*
      * Scan through the argument list
      */
-    initialize_realms(kcontext, argc, argv, &tcp_listen_backlog);
+    initialize_realms(&shandle, kcontext, argc, argv, &tcp_listen_backlog);
+    if (workers > 0 && threads > 0)
+        usage(argv[0]);
 
 #ifndef NOCACHE
-    retval = kdc_init_lookaside(kcontext);
+    retval = kdc_init_lookaside(kcontext, lookaside_size, shared_lookaside);
     if (retval) {
         kdc_err(kcontext, retval, _("while initializing lookaside cache"));
-        finish_realms();
+        finish_realms(&shandle);
         return 1;
     }
 #endif
 
+    if (metrics_file != NULL) {
+        retval = kdc_metrics_init(metrics_file, workers, threads);
+        if (retval) {
+            kdc_err(kcontext, retval, _("while creating metrics file %s"),
+                    metrics_file);
+            finish_realms(&shandle);
+            return 1;
+        }
+        loop_set_event_hook(kdc_metrics_loop_event);
+    }
+
     ctx = loop_init(VERTO_EV_TYPE_NONE);
     if (!ctx) {
         kdc_err(kcontext, ENOMEM, _("while creating main loop"));
-        finish_realms();
+        finish_realms(&shandle);
         return 1;
     }
 
@@ -990,7 +1157,7 @@ int main(int argc, char **argv)
     retval = setup_sam();
     if (retval) {
         kdc_err(kcontext, retval, _("while initializing SAM"));
-        finish_realms();
+        finish_realms(&shandle);
         return 1;
     }
 
@@ -1012,65 +1179,116 @@ int main(int argc, char **argv)
     }
 
     if (workers == 0) {
-        retval = loop_setup_signals(ctx, &shandle, reset_for_hangup);
+        retval = loop_setup_signals(ctx, &shandle, reset_all_for_hangup);
         if (retval) {
             kdc_err(kcontext, retval, _("while initializing signal handlers"));
-            finish_realms();
+            finish_realms(&shandle);
             return 1;
         }
     }
+    if (reuseport) {
+        retval = loop_set_reuseport(TRUE);
+        if (retval)
+            goto net_init_error;
+    }
     if ((retval = loop_setup_network(ctx, &shandle, kdc_progname,
                                      tcp_listen_backlog))) {
     net_init_error:
         kdc_err(kcontext, retval, _("while initializing network"));
-        finish_realms();
+        finish_realms(&shandle);
         return 1;
     }
     if (!nofork && daemon(0, 0)) {
         kdc_err(kcontext, errno, _("while detaching from tty"));
-        finish_realms();
+        finish_realms(&shandle);
         return 1;
     }
     if (pid_file != NULL) {
         retval = write_pid_file(pid_file);
         if (retval) {
             kdc_err(kcontext, retval, _("while creating PID file"));
-            finish_realms();
+            finish_realms(&shandle);
             return 1;
         }
     }
     if (workers > 0) {
-        finish_realms();
+        finish_realms(&shandle);
         retval = create_workers(ctx, workers);
         if (retval) {
             kdc_err(kcontext, errno, _("creating worker processes"));
             return 1;
         }
         /* We get here only in a worker child process; re-initialize realms. */
-        initialize_realms(kcontext, argc, argv, NULL);
+        initialize_realms(&shandle, kcontext, argc, argv, NULL);
+
+        /*
+         * With SO_REUSEPORT, replace the inherited listener sockets with ones
+         * owned by this worker, so that the kernel spreads requests across
+         * the workers' sockets instead of waking every worker for each one.
+         */
+        if (reuseport) {
+            retval = loop_setup_network(ctx, &shandle, kdc_progname,
+                                        tcp_listen_backlog);
+            if (retval) {
+                kdc_err(kcontext, retval, _("while initializing network"));
+                finish_realms(&shandle);
+                return 1;
+            }
+        }
     }
 
     /* Initialize audit system and audit KDC startup. */
     retval = load_audit_modules(kcontext);
     if (retval) {
         kdc_err(kcontext, retval, _("while loading audit plugin module(s)"));
-        finish_realms();
+        finish_realms(&shandle);
+        return 1;
+    }
+    /* Start buffered logging now that any worker processes exist. */
+    retval = krb5_klog_start_async(kcontext);
+    if (retval) {
+        kdc_err(kcontext, retval,
+                _("while starting asynchronous logging; logging directly"));
+    }
+    if (threads > 0) {
+        retval = create_threads(ctx, argc, argv);
+        if (retval) {
+            kdc_err(kcontext, retval, _("while creating request threads"));
+            finish_threads();
+            finish_realms(&shandle);
+            return 1;
+        }
+    }
+    /* Write out buffered KDB updates even when no requests arrive. */
+    flush_ev = verto_add_timeout(ctx, VERTO_EV_FLAG_PERSIST,
+                                 kdc_flush_db_buffers, 1000);
+    if (flush_ev == NULL) {
+        kdc_err(kcontext, ENOMEM, _("while creating database flush timer"));
+        finish_threads();
+        finish_realms(&shandle);
         return 1;
     }
+    verto_set_private(flush_ev, &shandle, NULL);
     krb5_klog_syslog(LOG_INFO, _("commencing operation"));
     if (nofork)
         fprintf(stderr, _("%s: starting...\n"), kdc_progname);
     kau_kdc_start(kcontext, TRUE);
 
     verto_run(ctx);
+    finish_threads();
     loop_free(ctx);
+    kdc_metrics_fini();
+    free(metrics_file);
     kau_kdc_stop(kcontext, TRUE);
+#ifndef NOCACHE
+    log_lookaside_stats();
+#endif
     krb5_klog_syslog(LOG_INFO, _("shutting down"));
     unload_preauth_plugins(kcontext);
     unload_authdata_plugins(kcontext);
     unload_audit_modules(kcontext);
     krb5_klog_close(kcontext);
-    finish_realms();
+    finish_realms(&shandle);
     if (shandle.kdc_realmlist)
         free(shandle.kdc_realmlist);
 #ifndef NOCACHE
@@ -0,0 +1,382 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* kdc/princ_cache.c - KDC cache of principal entries */
+/*
+ * Copyright (C) 2026 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * When principal_cache_ttl is set for a realm, the KDC keeps recently fetched
+ * server principal entries (and optionally, negative results) in memory for
+ * up to that long, so that lookups of heavily used principals such as the
+ * local krbtgt do not need to lock and decode the database each time.
+ *
+ * Each realm structure has its own cache.  Since threads and worker processes
+ * each have their own realm structures, no locking is needed.  If the realm
+ * has iprop enabled, the cache watches the update log header through a
+ * read-only mapping and discards all entries as soon as the last serial
+ * number or timestamp changes.  The database is modified before the update
+ * log, so this never leaves an out-of-date entry in the cache.  Without an
+ * update log, changes are only noticed when entries expire or on SIGHUP.
+ */
+
+#include "k5-int.h"
+#include "k5-queue.h"
+#include "kdc_util.h"
+#include <kdb_log.h>
+#include <kadm5/admin.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Default maximum number of entries per realm. */
+#define DEFAULT_CACHE_SIZE 1000
+
+struct pc_entry {
+    K5_TAILQ_ENTRY(pc_entry) lru_links;
+    K5_LIST_ENTRY(pc_entry) hash_links;
+    krb5_principal princ;
+    unsigned int flags;
+    time_t expires;
+    krb5_db_entry *entry;       /* NULL for a cached KRB5_KDB_NOENTRY */
+};
+
+K5_TAILQ_HEAD(pc_lru, pc_entry);
+K5_LIST_HEAD(pc_chain, pc_entry);
+
+struct princ_cache {
+    krb5_deltat ttl;
+    krb5_boolean negative;
+    unsigned int max_entries;
+    unsigned int num_entries;
+    struct pc_lru lru;          /* Least recently used first */
+    struct pc_chain *buckets;
+    unsigned int nbuckets;      /* Always a power of two */
+
+    /* Update log state, if the realm uses iprop. */
+    char *ulog_path;
+    kdb_hlog_t *ulog;
+    size_t ulog_maplen;
+    time_t next_map_attempt;
+    kdb_sno_t last_sno;
+    kdbe_time_t last_time;
+};
+
+static unsigned int
+hash_bytes(unsigned int h, const char *p, size_t len)
+{
+    /* FNV-1a */
+    while (len-- > 0)
+        h = (h ^ (unsigned char)*p++) * 16777619U;
+    return h;
+}
+
+static struct pc_chain *
+get_chain(struct princ_cache *pc, krb5_const_principal princ,
+          unsigned int flags)
+{
+    unsigned int h = 2166136261U;
+    int i;
+
+    h = hash_bytes(h, (char *)&flags, sizeof(flags));
+    h = hash_bytes(h, princ->realm.data, princ->realm.length);
+    for (i = 0; i < princ->length; i++) {
+        /* Hash a separator so that "a/bc" and "ab/c" differ. */
+        h = hash_bytes(h, "/", 1);
+        h = hash_bytes(h, princ->data[i].data, princ->data[i].length);
+    }
+    return &pc->buckets[h & (pc->nbuckets - 1)];
+}
+
+static void
+discard_entry(krb5_context context, struct princ_cache *pc,
+              struct pc_entry *ent)
+{
+    K5_TAILQ_REMOVE(&pc->lru, ent, lru_links);
+    K5_LIST_REMOVE(ent, hash_links);
+    krb5_free_principal(context, ent->princ);
+    krb5_db_free_principal(context, ent->entry);
+    free(ent);
+    pc->num_entries--;
+}
+
+static void
+discard_all(krb5_context context, struct princ_cache *pc)
+{
+    while (!K5_TAILQ_EMPTY(&pc->lru))
+        discard_entry(context, pc, K5_TAILQ_FIRST(&pc->lru));
+}
+
+/* Unmap the update log header, if it is mapped. */
+static void
+unmap_ulog(struct princ_cache *pc)
+{
+    if (pc->ulog != NULL)
+        (void)munmap(pc->ulog, pc->ulog_maplen);
+    pc->ulog = NULL;
+}
+
+/* Try to map the update log header read-only.  Failure is not an error; the
+ * log may not have been created yet. */
+static void
+map_ulog(struct princ_cache *pc, time_t now)
+{
+    int fd;
+    struct stat st;
+    void *map;
+
+    if (pc->ulog_path == NULL || now < pc->next_map_attempt)
+        return;
+    pc->next_map_attempt = now + pc->ttl;
+
+    fd = open(pc->ulog_path, O_RDONLY);
+    if (fd == -1)
+        return;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(kdb_hlog_t)) {
+        close(fd);
+        return;
+    }
+    map = mmap(NULL, sizeof(kdb_hlog_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return;
+    pc->ulog = map;
+    pc->ulog_maplen = sizeof(kdb_hlog_t);
+    if (pc->ulog->kdb_hmagic != KDB_ULOG_HDR_MAGIC) {
+        unmap_ulog(pc);
+        return;
+    }
+    pc->last_sno = pc->ulog->kdb_last_sno;
+    pc->last_time = pc->ulog->kdb_last_time;
+}
+
+/* Discard all entries if the update log shows that the database has changed
+ * since we last looked. */
+static void
+check_ulog(krb5_context context, struct princ_cache *pc, time_t now)
+{
+    kdb_hlog_t *ulog;
+
+    if (pc->ulog == NULL) {
+        map_ulog(pc, now);
+        if (pc->ulog != NULL)
+            discard_all(context, pc);
+        return;
+    }
+
+    ulog = pc->ulog;
+    if (ulog->kdb_last_sno == pc->last_sno &&
+        ulog->kdb_last_time.seconds == pc->last_time.seconds &&
+        ulog->kdb_last_time.useconds == pc->last_time.useconds)
+        return;
+    discard_all(context, pc);
+    pc->last_sno = ulog->kdb_last_sno;
+    pc->last_time = ulog->kdb_last_time;
+}
+
+static struct pc_entry *
+find_entry(krb5_context context, struct pc_chain *chain,
+           krb5_const_principal princ, unsigned int flags)
+{
+    struct pc_entry *ent;
+
+    K5_LIST_FOREACH(ent, chain, hash_links) {
+        if (ent->flags == flags &&
+            krb5_principal_compare(context, ent->princ, princ))
+            return ent;
+    }
+    return NULL;
+}
+
+/* Add a result to the cache, taking ownership of entry (which may be NULL for
+ * a negative result) on success. */
+static krb5_error_code
+add_entry(krb5_context context, struct princ_cache *pc,
+          struct pc_chain *chain, krb5_const_principal princ,
+          unsigned int flags, krb5_db_entry *entry, time_t now)
+{
+    krb5_error_code ret;
+    struct pc_entry *ent;
+
+    ent = k5alloc(sizeof(*ent), &ret);
+    if (ent == NULL)
+        return ret;
+    ret = krb5_copy_principal(context, princ, &ent->princ);
+    if (ret) {
+        free(ent);
+        return ret;
+    }
+    ent->flags = flags;
+    ent->expires = now + pc->ttl;
+    ent->entry = entry;
+
+    if (pc->num_entries >= pc->max_entries)
+        discard_entry(context, pc, K5_TAILQ_FIRST(&pc->lru));
+    K5_TAILQ_INSERT_TAIL(&pc->lru, ent, lru_links);
+    K5_LIST_INSERT_HEAD(chain, ent, hash_links);
+    pc->num_entries++;
+    return 0;
+}
+
+krb5_error_code
+kdc_init_principal_cache(krb5_context context, const char *realm,
+                         krb5_deltat ttl, krb5_int32 size,
+                         krb5_boolean negative, struct princ_cache **pc_out)
+{
+    krb5_error_code ret;
+    struct princ_cache *pc;
+    kadm5_config_params params;
+    unsigned int i;
+
+    *pc_out = NULL;
+    if (ttl <= 0)
+        return 0;
+
+    pc = k5alloc(sizeof(*pc), &ret);
+    if (pc == NULL)
+        return ret;
+    pc->ttl = ttl;
+    pc->negative = negative;
+    pc->max_entries = (size > 0) ? size : DEFAULT_CACHE_SIZE;
+    pc->nbuckets = 16;
+    while (pc->nbuckets < pc->max_entries)
+        pc->nbuckets *= 2;
+    pc->buckets = k5calloc(pc->nbuckets, sizeof(*pc->buckets), &ret);
+    if (pc->buckets == NULL) {
+        free(pc);
+        return ret;
+    }
+    for (i = 0; i < pc->nbuckets; i++)
+        K5_LIST_INIT(&pc->buckets[i]);
+    K5_TAILQ_INIT(&pc->lru);
+
+    /* Find the update log if iprop is enabled for the realm.  If we can't
+     * read the configuration, rely on expiry alone. */
+    memset(&params, 0, sizeof(params));
+    params.mask = KADM5_CONFIG_REALM;
+    params.realm = (char *)realm;
+    if (kadm5_get_config_params(context, 1, &params, &params) == 0) {
+        if (params.iprop_enabled && params.iprop_logfile != NULL) {
+            pc->ulog_path = strdup(params.iprop_logfile);
+            if (pc->ulog_path == NULL)
+                ret = ENOMEM;
+        }
+        kadm5_free_config_params(context, &params);
+    }
+    if (ret) {
+        kdc_free_principal_cache(context, pc);
+        return ret;
+    }
+    map_ulog(pc, time(NULL));
+
+    *pc_out = pc;
+    return 0;
+}
+
+void
+kdc_flush_principal_cache(krb5_context context, struct princ_cache *pc)
+{
+    if (pc == NULL)
+        return;
+    discard_all(context, pc);
+
+    /* Remap the update log in case it has been replaced. */
+    unmap_ulog(pc);
+    pc->next_map_attempt = 0;
+    map_ulog(pc, time(NULL));
+}
+
+void
+kdc_free_principal_cache(krb5_context context, struct princ_cache *pc)
+{
+    if (pc == NULL)
+        return;
+    discard_all(context, pc);
+    unmap_ulog(pc);
+    free(pc->ulog_path);
+    free(pc->buckets);
+    free(pc);
+}
+
+krb5_error_code
+kdc_get_principal(kdc_realm_t *realm, krb5_const_principal princ,
+                  unsigned int flags, krb5_db_entry **entry_out)
+{
+    krb5_error_code ret;
+    krb5_context context = realm->realm_context;
+    struct princ_cache *pc = realm->realm_princ_cache;
+    struct pc_chain *chain;
+    struct pc_entry *ent;
+    krb5_db_entry *entry, *copy;
+    time_t now;
+    uint64_t start;
+
+    *entry_out = NULL;
+    if (pc == NULL) {
+        start = kdc_metrics_now();
+        ret = krb5_db_get_principal(context, princ, flags, entry_out);
+        kdc_metrics_latency(KDC_HIST_DB_LOOKUP, start);
+        return ret;
+    }
+
+    now = time(NULL);
+    check_ulog(context, pc, now);
+
+    chain = get_chain(pc, princ, flags);
+    ent = find_entry(context, chain, princ, flags);
+    if (ent != NULL && now < ent->expires) {
+        K5_TAILQ_REMOVE(&pc->lru, ent, lru_links);
+        K5_TAILQ_INSERT_TAIL(&pc->lru, ent, lru_links);
+        if (ent->entry == NULL)
+            return KRB5_KDB_NOENTRY;
+        return krb5_db_copy_principal(context, ent->entry, entry_out);
+    }
+    if (ent != NULL)
+        discard_entry(context, pc, ent);
+
+    start = kdc_metrics_now();
+    ret = krb5_db_get_principal(context, princ, flags, &entry);
+    kdc_metrics_latency(KDC_HIST_DB_LOOKUP, start);
+    if (ret == KRB5_KDB_NOENTRY && pc->negative)
+        (void)add_entry(context, pc, chain, princ, flags, NULL, now);
+    if (ret)
+        return ret;
+
+    /* Keep the fetched entry and give the caller a copy.  If the entry can't
+     * be copied (or cached), just return it. */
+    if (krb5_db_copy_principal(context, entry, &copy) != 0) {
+        *entry_out = entry;
+        return 0;
+    }
+    if (add_entry(context, pc, chain, princ, flags, entry, now) != 0) {
+        krb5_db_free_principal(context, copy);
+        *entry_out = entry;
+        return 0;
+    }
+    *entry_out = copy;
+    return 0;
+}
@@ -74,6 +74,8 @@ typedef struct __kdc_realm_data {
     krb5_boolean        realm_reject_bad_transit; /* Accept unverifiable transited_realm ? */
     krb5_boolean        realm_restrict_anon;  /* Anon to local TGT only */
     krb5_boolean        realm_assume_des_crc_sess;  /* Assume princs support des-cbc-crc for session keys */
+    struct princ_cache  *realm_princ_cache; /* Cached server entries, or NULL */
+    struct key_cache    *realm_key_cache; /* Cached decrypted keys, or NULL */
 } kdc_realm_t;
 
 struct server_handle {
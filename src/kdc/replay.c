@@ -26,11 +26,23 @@
 
 #include "k5-int.h"
 #include "k5-queue.h"
+#include "k5-thread.h"
 #include "kdc_util.h"
 #include "extern.h"
 
 #ifndef NOCACHE
 
+#include <sys/mman.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#if defined(ENABLE_THREADS) && defined(HAVE_PTHREAD) && \
+    defined(_POSIX_THREAD_PROCESS_SHARED) && defined(MAP_ANONYMOUS)
+#define HAVE_SHARED_LOOKASIDE
+#endif
+
 struct entry {
     K5_LIST_ENTRY(entry) bucket_links;
     K5_TAILQ_ENTRY(entry) expire_links;
@@ -43,9 +55,6 @@ struct entry {
 #ifndef LOOKASIDE_HASH_SIZE
 #define LOOKASIDE_HASH_SIZE 16384
 #endif
-#ifndef LOOKASIDE_MAX_SIZE
-#define LOOKASIDE_MAX_SIZE (10 * 1024 * 1024)
-#endif
 
 K5_LIST_HEAD(entry_list, entry);
 K5_TAILQ_HEAD(entry_queue, entry);
@@ -57,7 +66,9 @@ static int hits = 0;
 static int calls = 0;
 static int max_hits_per_entry = 0;
 static int num_entries = 0;
+static unsigned long evictions = 0;
 static size_t total_size = 0;
+static size_t max_size = LOOKASIDE_MAX_SIZE;
 static krb5_ui_4 seed;
 
 #define STALE_TIME      (2*60)            /* two minutes */
@@ -176,17 +187,381 @@ find_entry(krb5_data *req_packet)
     return NULL;
 }
 
-/* Initialize the lookaside cache structures and randomize the hash seed. */
+#ifdef HAVE_SHARED_LOOKASIDE
+
+/*
+ * The shared lookaside cache lives in an anonymous shared mapping created
+ * before worker processes are forked, so that a retransmitted request can be
+ * answered by whichever worker receives it.  The hash table is divided into
+ * stripes, each with its own process-shared lock, hash buckets, statistics,
+ * and a circular arena holding its entries in insertion order.  Each stripe
+ * gets an equal share of the configured size; the oldest entries of a stripe
+ * are evicted when they become stale or when room is needed for a new entry.
+ * Entries are linked by arena offsets rather than pointers.
+ */
+
+#define SHM_STRIPES 64
+#define SHM_BUCKETS (LOOKASIDE_HASH_SIZE / SHM_STRIPES)
+#define SHM_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+#if LOOKASIDE_HASH_SIZE % SHM_STRIPES != 0
+#error LOOKASIDE_HASH_SIZE must be a multiple of SHM_STRIPES
+#endif
+
+struct shm_entry {
+    uint32_t size;              /* Arena bytes used, including this header */
+    uint32_t next;              /* Offset + 1 of next entry in bucket, or 0 */
+    uint32_t bucket;
+    uint32_t live;              /* 0 for removed entries and padding */
+    uint32_t num_hits;
+    krb5_timestamp timein;
+    uint32_t req_len;
+    uint32_t rep_len;
+    /* The request and reply packets follow. */
+};
+
+struct shm_stripe {
+    pthread_mutex_t lock;
+    uint32_t buckets[SHM_BUCKETS];  /* Offset + 1 of first entry, or 0 */
+    size_t head;                /* Offset of the oldest entry */
+    size_t tail;                /* Offset at which to write the next entry */
+    size_t used;                /* Bytes in use from head to tail */
+    unsigned long calls;
+    unsigned long hits;
+    unsigned long evictions;
+    unsigned long num_entries;
+    unsigned int max_hits_per_entry;
+};
+
+struct shm_cache {
+    size_t arena_size;          /* Size of each stripe's arena */
+    struct shm_stripe stripes[SHM_STRIPES];
+    /* The stripe arenas follow, starting at SHM_ALIGN(sizeof(shm_cache)). */
+};
+
+static struct shm_cache *shm;
+static size_t shm_len;
+
+static inline unsigned char *
+shm_arena(int stripe)
+{
+    return (unsigned char *)shm + SHM_ALIGN(sizeof(*shm)) +
+        stripe * shm->arena_size;
+}
+
+static inline struct shm_entry *
+shm_entry_at(unsigned char *arena, size_t off)
+{
+    return (struct shm_entry *)(void *)(arena + off);
+}
+
+static inline krb5_data
+shm_entry_req(struct shm_entry *e)
+{
+    return make_data((unsigned char *)(e + 1), e->req_len);
+}
+
+static inline krb5_data
+shm_entry_rep(struct shm_entry *e)
+{
+    return make_data((unsigned char *)(e + 1) + e->req_len, e->rep_len);
+}
+
+/* Remove e (at offset off in arena) from its hash bucket and mark it dead. */
+static void
+shm_unlink_entry(struct shm_stripe *st, unsigned char *arena, size_t off,
+                 struct shm_entry *e)
+{
+    uint32_t *link = &st->buckets[e->bucket];
+
+    while (*link != 0 && *link != off + 1)
+        link = &shm_entry_at(arena, *link - 1)->next;
+    if (*link != 0)
+        *link = e->next;
+    e->live = 0;
+    st->num_entries--;
+    st->max_hits_per_entry = max(st->max_hits_per_entry, e->num_hits);
+}
+
+/*
+ * Discard the oldest entry (or wrap padding) of a non-empty stripe.  Return
+ * true if a live entry was discarded.
+ */
+static krb5_boolean
+shm_evict_oldest(struct shm_stripe *st, unsigned char *arena)
+{
+    size_t asize = shm->arena_size;
+    struct shm_entry *e;
+    krb5_boolean live = FALSE;
+
+    /* Space at the end of the arena too small for an entry is padding. */
+    if (asize - st->head < sizeof(struct shm_entry)) {
+        st->used -= asize - st->head;
+        st->head = 0;
+    } else {
+        e = shm_entry_at(arena, st->head);
+        live = e->live;
+        if (live)
+            shm_unlink_entry(st, arena, st->head, e);
+        st->used -= e->size;
+        st->head += e->size;
+    }
+    if (st->used == 0)
+        st->head = st->tail = 0;
+    return live;
+}
+
+/* Find the live entry for req in a stripe, or return NULL. */
+static struct shm_entry *
+shm_find_entry(struct shm_stripe *st, unsigned char *arena, int hash,
+               const krb5_data *req)
+{
+    struct shm_entry *e;
+    krb5_data d;
+    uint32_t link;
+
+    for (link = st->buckets[hash / SHM_STRIPES]; link != 0; link = e->next) {
+        e = shm_entry_at(arena, link - 1);
+        d = shm_entry_req(e);
+        if (data_eq(d, *req))
+            return e;
+    }
+    return NULL;
+}
+
+/*
+ * Reserve n contiguous bytes at the tail of a stripe's arena, evicting the
+ * oldest entries as necessary.  Return false if n exceeds the arena size.
+ */
+static krb5_boolean
+shm_reserve(struct shm_stripe *st, unsigned char *arena, size_t n,
+            size_t *off_out)
+{
+    size_t asize = shm->arena_size, gap;
+    struct shm_entry *pad;
+
+    if (n > asize)
+        return FALSE;
+    for (;;) {
+        if (n <= asize - st->tail && n <= asize - st->used) {
+            *off_out = st->tail;
+            st->tail += n;
+            st->used += n;
+            return TRUE;
+        }
+        gap = asize - st->tail;
+        if (st->tail >= st->head && st->used + gap <= asize) {
+            /* Pad out the end of the arena and wrap around. */
+            if (gap >= sizeof(*pad)) {
+                pad = shm_entry_at(arena, st->tail);
+                memset(pad, 0, sizeof(*pad));
+                pad->size = gap;
+            }
+            st->used += gap;
+            st->tail = 0;
+        } else if (shm_evict_oldest(st, arena)) {
+            st->evictions++;
+        }
+    }
+}
+
+static void
+shm_insert(krb5_data *req, krb5_data *rep, krb5_timestamp now)
+{
+    int hash = murmurhash3(req);
+    struct shm_stripe *st = &shm->stripes[hash % SHM_STRIPES];
+    unsigned char *arena = shm_arena(hash % SHM_STRIPES);
+    size_t rep_len = (rep == NULL) ? 0 : rep->length, n, off;
+    struct shm_entry *e;
+
+    n = SHM_ALIGN(sizeof(*e) + req->length + rep_len);
+
+    pthread_mutex_lock(&st->lock);
+
+    /* Purge stale entries and padding from the head of the stripe. */
+    while (st->used > 0) {
+        if (shm->arena_size - st->head >= sizeof(*e)) {
+            e = shm_entry_at(arena, st->head);
+            if (e->live && !STALE(e, now))
+                break;
+        }
+        (void)shm_evict_oldest(st, arena);
+    }
+
+    if (shm_reserve(st, arena, n, &off)) {
+        e = shm_entry_at(arena, off);
+        e->size = n;
+        e->bucket = hash / SHM_STRIPES;
+        e->live = 1;
+        e->num_hits = 0;
+        e->timein = now;
+        e->req_len = req->length;
+        e->rep_len = rep_len;
+        memcpy(e + 1, req->data, req->length);
+        if (rep_len > 0)
+            memcpy((unsigned char *)(e + 1) + req->length, rep->data, rep_len);
+        e->next = st->buckets[e->bucket];
+        st->buckets[e->bucket] = off + 1;
+        st->num_entries++;
+    }
+
+    pthread_mutex_unlock(&st->lock);
+}
+
+static krb5_boolean
+shm_check(krb5_context context, krb5_data *req, krb5_data **reply_out)
+{
+    int hash = murmurhash3(req);
+    struct shm_stripe *st = &shm->stripes[hash % SHM_STRIPES];
+    struct shm_entry *e;
+    krb5_data rep;
+    krb5_boolean found = FALSE;
+
+    pthread_mutex_lock(&st->lock);
+    st->calls++;
+    e = shm_find_entry(st, shm_arena(hash % SHM_STRIPES), hash, req);
+    if (e != NULL) {
+        e->num_hits++;
+        st->hits++;
+        found = TRUE;
+        /* Leave *reply_out as NULL for an in-progress entry. */
+        rep = shm_entry_rep(e);
+        if (rep.length > 0)
+            found = (krb5_copy_data(context, &rep, reply_out) == 0);
+    }
+    pthread_mutex_unlock(&st->lock);
+    return found;
+}
+
+static void
+shm_remove(krb5_data *req)
+{
+    int hash = murmurhash3(req);
+    struct shm_stripe *st = &shm->stripes[hash % SHM_STRIPES];
+    unsigned char *arena = shm_arena(hash % SHM_STRIPES);
+    struct shm_entry *e;
+
+    pthread_mutex_lock(&st->lock);
+    e = shm_find_entry(st, arena, hash, req);
+    if (e != NULL)
+        shm_unlink_entry(st, arena, (unsigned char *)e - arena, e);
+    pthread_mutex_unlock(&st->lock);
+}
+
+static krb5_error_code
+shm_init(size_t size)
+{
+    pthread_mutexattr_t attr;
+    size_t asize;
+    void *addr;
+    int i, ret;
+
+    /* Entry offsets are 32-bit. */
+    asize = SHM_ALIGN(size / SHM_STRIPES);
+    if (asize < 1024)
+        asize = 1024;
+    if (asize > UINT32_MAX - 8)
+        asize = UINT32_MAX - 8;
+    shm_len = SHM_ALIGN(sizeof(*shm)) + asize * SHM_STRIPES;
+
+    addr = mmap(NULL, shm_len, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+        return errno;
+    shm = addr;
+    shm->arena_size = asize;
+
+    ret = pthread_mutexattr_init(&attr);
+    if (ret)
+        goto fail;
+    ret = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    for (i = 0; i < SHM_STRIPES && !ret; i++)
+        ret = pthread_mutex_init(&shm->stripes[i].lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (ret) {
+        while (--i > 0)
+            pthread_mutex_destroy(&shm->stripes[i - 1].lock);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    munmap(shm, shm_len);
+    shm = NULL;
+    return ret;
+}
+
+static void
+shm_free(void)
+{
+    munmap(shm, shm_len);
+    shm = NULL;
+}
+
+#else /* HAVE_SHARED_LOOKASIDE */
+
+#define shm NULL
+#define shm_insert(req, rep, now)
+#define shm_check(context, req, reply_out) FALSE
+#define shm_remove(req)
+#define shm_init(size) ENOTSUP
+#define shm_free()
+
+#endif /* HAVE_SHARED_LOOKASIDE */
+
+/*
+ * Initialize the lookaside cache structures and randomize the hash seed.
+ * Limit the cache to approximately size bytes.  If shared is true, place the
+ * cache in memory shared with processes forked after this call.
+ */
 krb5_error_code
-kdc_init_lookaside(krb5_context context)
+kdc_init_lookaside(krb5_context context, size_t size, krb5_boolean shared)
 {
     krb5_data d = make_data(&seed, sizeof(seed));
+    krb5_error_code ret;
     int i;
 
     for (i = 0; i < LOOKASIDE_HASH_SIZE; i++)
         K5_LIST_INIT(&hash_table[i]);
     K5_TAILQ_INIT(&expiration_queue);
-    return krb5_c_random_make_octets(context, &d);
+    max_size = size;
+    ret = krb5_c_random_make_octets(context, &d);
+    if (ret)
+        return ret;
+    return shared ? shm_init(size) : 0;
+}
+
+/* Report cache statistics.  For a shared cache, they cover all processes. */
+void
+kdc_get_lookaside_stats(struct lookaside_stats *stats)
+{
+#ifdef HAVE_SHARED_LOOKASIDE
+    struct shm_stripe *st;
+    int i;
+#endif
+
+    memset(stats, 0, sizeof(*stats));
+    if (shm == NULL) {
+        stats->calls = calls;
+        stats->hits = hits;
+        stats->evictions = evictions;
+        stats->entries = num_entries;
+        stats->max_hits_per_entry = max_hits_per_entry;
+        return;
+    }
+#ifdef HAVE_SHARED_LOOKASIDE
+    for (i = 0; i < SHM_STRIPES; i++) {
+        st = &shm->stripes[i];
+        pthread_mutex_lock(&st->lock);
+        stats->calls += st->calls;
+        stats->hits += st->hits;
+        stats->evictions += st->evictions;
+        stats->entries += st->num_entries;
+        stats->max_hits_per_entry = max(stats->max_hits_per_entry,
+                                        st->max_hits_per_entry);
+        pthread_mutex_unlock(&st->lock);
+    }
+#endif
 }
 
 /* Remove the lookaside cache entry for a packet. */
@@ -195,6 +570,11 @@ kdc_remove_lookaside(krb5_context kcontext, krb5_data *req_packet)
 {
     struct entry *e;
 
+    if (shm != NULL) {
+        shm_remove(req_packet);
+        return;
+    }
+
     e = find_entry(req_packet);
     if (e != NULL)
         discard_entry(kcontext, e);
@@ -215,6 +595,8 @@ kdc_check_lookaside(krb5_context kcontext, krb5_data *req_packet,
     struct entry *e;
 
     *reply_packet_out = NULL;
+    if (shm != NULL)
+        return shm_check(kcontext, req_packet, reply_packet_out);
     calls++;
 
     e = find_entry(req_packet);
@@ -250,11 +632,18 @@ kdc_insert_lookaside(krb5_context kcontext, krb5_data *req_packet,
     if (krb5_timeofday(kcontext, &timenow))
         return;
 
+    if (shm != NULL) {
+        shm_insert(req_packet, reply_packet, timenow);
+        return;
+    }
+
     /* Purge stale entries and limit the total size of the entries. */
     K5_TAILQ_FOREACH_SAFE(e, &expiration_queue, expire_links, next) {
-        if (!STALE(e, timenow) && total_size + esize <= LOOKASIDE_MAX_SIZE)
+        if (!STALE(e, timenow) && total_size + esize <= max_size)
             break;
         max_hits_per_entry = max(max_hits_per_entry, e->num_hits);
+        if (!STALE(e, timenow))
+            evictions++;
         discard_entry(kcontext, e);
     }
 
@@ -271,6 +660,8 @@ kdc_free_lookaside(krb5_context kcontext)
     K5_TAILQ_FOREACH_SAFE(e, &expiration_queue, expire_links, next) {
         discard_entry(kcontext, e);
     }
+    if (shm != NULL)
+        shm_free();
 }
 
 #endif /* NOCACHE */
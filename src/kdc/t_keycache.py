@@ -0,0 +1,25 @@
+#!/usr/bin/python
+from k5test import *
+
+conf = {'realms': {'$realm': {'key_cache_size': '4'}}}
+realm = K5Realm(create_host=False, kdc_conf=conf)
+realm.addprinc('svc')
+realm.addprinc('svc2')
+realm.extract_keytab('svc', realm.keytab)
+realm.run([kvno, '-k', realm.keytab, 'svc'], expected_msg='kvno = 1')
+
+# Recreate the principal so that its new key has the same kvno as the
+# cached one, and make sure the KDC uses the new key.
+realm.run([kadminl, 'delprinc', 'svc'])
+realm.addprinc('svc')
+realm.run([kadminl, 'ktremove', 'svc', 'all'])
+realm.extract_keytab('svc', realm.keytab)
+realm.kinit(realm.user_princ, password('user'))
+realm.run([kvno, '-k', realm.keytab, 'svc'], expected_msg='kvno = 1')
+
+# Use more keys than the cache holds.
+for i in range(2):
+    realm.kinit(realm.user_princ, password('user'))
+    realm.run([kvno, 'svc', 'svc2', realm.admin_princ])
+
+success('KDC key cache')
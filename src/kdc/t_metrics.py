@@ -0,0 +1,142 @@
+#!/usr/bin/python
+from k5test import *
+import signal
+import socket
+import struct
+
+# Read the metrics file and return the number of slots and a dictionary of
+# counter values summed over the slots, and the values for each slot.
+def read_metrics(path):
+    f = open(path, 'rb')
+    data = f.read()
+    f.close()
+    if data[:8] != 'KDCMETR\0':
+        fail('Bad metrics file magic')
+    (version, name_len, ncounters, nslots, per_process, names_offset,
+     slots_offset, slot_size) = struct.unpack('=8I', data[8:40])
+    if version != 1:
+        fail('Bad metrics file version')
+    names = []
+    for i in range(ncounters):
+        start = names_offset + i * name_len
+        names.append(data[start:start + name_len].rstrip('\0'))
+    totals = dict((name, 0) for name in names)
+    slots = []
+    for s in range(nslots):
+        start = slots_offset + s * slot_size
+        vals = struct.unpack('=%dQ' % ncounters,
+                             data[start:start + 8 * ncounters])
+        slots.append(dict(zip(names, vals)))
+        for name, val in zip(names, vals):
+            totals[name] += val
+    return nslots, totals, slots
+
+def check(cond, msg):
+    if not cond:
+        fail(msg)
+
+# Return the sum of the counters whose names start with prefix.
+def sum_prefix(totals, prefix):
+    return sum(v for k, v in totals.items() if k.startswith(prefix))
+
+conf = {'libdefaults': {'udp_preference_limit': '1'}}
+realm = K5Realm(start_kdc=False, create_host=False)
+metrics = os.path.join(realm.testdir, 'metrics')
+kdc_conf = {'kdcdefaults': {'kdc_metrics_file': metrics}}
+metrics_env = realm.special_env('metrics', True, kdc_conf=kdc_conf)
+tcp_env = realm.special_env('tcp', False, krb5_conf=conf)
+realm.addprinc('service/1')
+realm.run([kadminl, 'modprinc', '+requires_preauth', realm.user_princ])
+
+# Exercise preauth, success, and failure paths over UDP and TCP, and read
+# the metrics while the KDC is running.
+def make_requests():
+    realm.kinit(realm.user_princ, password('user'))
+    realm.run([kvno, 'service/1'])
+    realm.kinit(realm.user_princ, password('user'), env=tcp_env)
+    realm.kinit(realm.user_princ, 'wrong', expected_code=1)
+    realm.run([kvno, 'nonexistent'], expected_code=1)
+
+def check_metrics(expected_slots):
+    nslots, t, slots = read_metrics(metrics)
+    check(nslots == expected_slots, 'Wrong number of metrics slots')
+    nreqs = t['udp_requests'] + t['tcp_requests']
+    check(t['tcp_requests'] >= 2, 'TCP requests not counted')
+    check(t['as_requests'] >= 6 and t['tgs_requests'] >= 2,
+          'Requests not counted')
+    check(t['as_requests'] + t['tgs_requests'] == nreqs,
+          'Request types do not match transports')
+    check(t['lookaside_misses'] == nreqs, 'Lookaside misses not counted')
+    check(t['net_udp_packets'] >= t['udp_requests'],
+          'UDP packets not counted')
+    check(t['net_accepts'] >= t['tcp_requests'], 'Accepts not counted')
+    check(t['as_result_0'] >= 2 and t['as_result_25'] >= 3 and
+          t['as_result_24'] >= 1, 'AS results not counted')
+    check(t['tgs_result_0'] >= 1 and t['tgs_result_7'] >= 1,
+          'TGS results not counted')
+    check(sum_prefix(t, 'as_result_') == t['as_requests'],
+          'AS results do not match requests')
+    check(t['as_padata_2'] >= 3 and t['as_padata_149'] >= 1,
+          'AS padata types not counted')
+    for h, n in (('dispatch', nreqs), ('as_req', t['as_requests']),
+                 ('tgs_req', t['tgs_requests'])):
+        check(t[h + '_count'] == n, 'Wrong %s histogram count' % h)
+        check(sum_prefix(t, h + '_usec_lt_') == n,
+              'Wrong %s histogram buckets' % h)
+    check(t['db_lookup_count'] >= t['as_requests'], 'DB lookups not timed')
+    return slots
+
+realm.start_kdc(env=metrics_env)
+make_requests()
+check_metrics(1)
+realm.stop_kdc()
+
+# With request threads, requests are counted in the threads' slots and
+# network events in the main thread's slot.
+realm.start_kdc(['-t', '2'], env=metrics_env)
+make_requests()
+slots = check_metrics(3)
+check(slots[0]['as_requests'] == 0 and slots[0]['net_udp_packets'] > 0,
+      'Wrong slot for main thread counters')
+realm.stop_kdc()
+
+realm.start_kdc(['-w', '2'], env=metrics_env)
+make_requests()
+check_metrics(2)
+realm.stop_kdc()
+
+# With last_success buffering, the db2 module's count of DB writes avoided
+# is exported.  The first of three successes is buffered, and the other two
+# are merged into it.
+buf_conf = {'kdcdefaults': {'kdc_metrics_file': metrics},
+            'dbmodules': {'db': {'last_success_interval': '1h'}}}
+buf_env = realm.special_env('buffered', True, kdc_conf=buf_conf)
+realm.run([kadminl, 'modprinc', '-unlock', realm.user_princ])
+realm.start_kdc(env=buf_env)
+check(read_metrics(metrics)[1]['db_writes_avoided'] == 0,
+      'DB writes avoided counted too early')
+for i in range(3):
+    realm.kinit(realm.user_princ, password('user'))
+check(read_metrics(metrics)[1]['db_writes_avoided'] == 2,
+      'DB writes avoided not counted')
+realm.stop_kdc()
+
+# Packets which the kernel drops because a UDP listener's receive queue is
+# full are counted per socket and exported through the net-server event
+# hook.  Fill the queue while the KDC is stopped; the count reaches the KDC
+# with the first packet queued after the drops.
+if sys.platform.startswith('linux'):
+    kdc = realm.start_server([krb5kdc, '-n'], 'starting...', env=metrics_env)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    os.kill(kdc.pid, signal.SIGSTOP)
+    for i in range(5000):
+        sock.sendto('x' * 100, ('127.0.0.1', realm.portbase))
+    os.kill(kdc.pid, signal.SIGCONT)
+    sock.sendto('x' * 100, ('127.0.0.1', realm.portbase))
+    realm.kinit(realm.user_princ, password('user'))
+    check(read_metrics(metrics)[1]['net_udp_rxq_drops'] > 0,
+          'UDP receive queue drops not counted')
+    stop_daemon(kdc)
+    sock.close()
+
+success('KDC metrics')
@@ -0,0 +1,46 @@
+#!/usr/bin/python
+from k5test import *
+
+# Without an update log, cached server entries are only refreshed when
+# they expire, so a key change is not seen until the KDC restarts.
+conf = {'realms': {'$realm': {'principal_cache_ttl': '1h'}}}
+realm = K5Realm(create_host=False, kdc_conf=conf)
+realm.addprinc('svc', password('svc'))
+realm.kinit(realm.user_princ, password('user'))
+realm.run([kvno, 'svc'], expected_msg='kvno = 1')
+realm.run([kadminl, 'cpw', '-randkey', 'svc'])
+realm.kinit(realm.user_princ, password('user'))
+realm.run([kvno, 'svc'], expected_msg='kvno = 1')
+realm.stop_kdc()
+realm.start_kdc()
+realm.kinit(realm.user_princ, password('user'))
+realm.run([kvno, 'svc'], expected_msg='kvno = 2')
+realm.stop()
+
+# With iprop enabled, the cache is emptied whenever the update log
+# changes, including for negative entries.
+conf = {'realms': {'$realm': {'principal_cache_ttl': '1h',
+                              'principal_cache_negative': 'true',
+                              'principal_cache_size': '2',
+                              'iprop_enable': 'true',
+                              'iprop_logfile': '$testdir/db.ulog'}}}
+realm = K5Realm(create_host=False, kdc_conf=conf)
+realm.addprinc('svc', password('svc'))
+realm.kinit(realm.user_princ, password('user'))
+realm.run([kvno, 'svc'], expected_msg='kvno = 1')
+realm.run([kadminl, 'cpw', '-randkey', 'svc'])
+realm.kinit(realm.user_princ, password('user'))
+realm.run([kvno, 'svc'], expected_msg='kvno = 2')
+
+realm.run([kvno, 'newsvc'], expected_code=1,
+          expected_msg='not found in Kerberos database')
+realm.addprinc('newsvc', password('newsvc'))
+realm.run([kvno, 'newsvc'], expected_msg='kvno = 1')
+
+# Look up more principals than the cache holds.
+realm.addprinc('svc2', password('svc2'))
+for i in range(2):
+    realm.kinit(realm.user_princ, password('user'))
+    realm.run([kvno, 'svc', 'svc2', 'newsvc'])
+
+success('KDC principal cache')
@@ -41,6 +41,7 @@
 /* For wrapping functions */
 #include "k5-int.h"
 #include "krb5.h"
+#include <sys/wait.h>
 
 /*
  * Wrapper functions
@@ -110,7 +111,7 @@ setup_lookaside(void **state)
     krb5_error_code ret;
     krb5_context context = *state;
 
-    ret = kdc_init_lookaside(context);
+    ret = kdc_init_lookaside(context, LOOKASIDE_MAX_SIZE, FALSE);
     if (ret)
         return ret;
 
@@ -132,6 +133,30 @@ destroy_lookaside(void **state)
     return 0;
 }
 
+#ifdef HAVE_SHARED_LOOKASIDE
+
+/* Give each stripe of the shared cache a 1024-byte arena. */
+#define SHM_TEST_SIZE (SHM_STRIPES * 1024)
+
+#define shared_unit_test(fn)                                            \
+    cmocka_unit_test_setup_teardown(fn, setup_shared_lookaside,         \
+                                    destroy_lookaside)
+
+static int
+setup_shared_lookaside(void **state)
+{
+    krb5_error_code ret;
+    krb5_context context = *state;
+
+    ret = kdc_init_lookaside(context, SHM_TEST_SIZE, TRUE);
+    if (ret)
+        return ret;
+    seed = SEED;
+    return 0;
+}
+
+#endif /* HAVE_SHARED_LOOKASIDE */
+
 /*
  * rotl32 tests
  */
@@ -923,6 +948,198 @@ test_kdc_insert_lookaside_cache_expire(void **state)
     assert_int_equal(total_size, e2_size);
 }
 
+#ifdef HAVE_SHARED_LOOKASIDE
+
+/*
+ * Shared lookaside cache tests
+ */
+
+static void
+test_shared_insert_check(void **state)
+{
+    krb5_boolean result;
+    krb5_data *result_data;
+    krb5_context context = *state;
+    krb5_data req = string2data("I'm a test request");
+    krb5_data rep = string2data("I'm a test response");
+    struct lookaside_stats stats;
+
+    time_return(0, 0);
+    kdc_insert_lookaside(context, &req, &rep);
+
+    result = kdc_check_lookaside(context, &req, &result_data);
+    assert_true(result);
+    assert_true(data_eq(rep, *result_data));
+    krb5_free_data(context, result_data);
+
+    kdc_get_lookaside_stats(&stats);
+    assert_int_equal(stats.calls, 1);
+    assert_int_equal(stats.hits, 1);
+    assert_int_equal(stats.entries, 1);
+    assert_int_equal(stats.max_hits_per_entry, 0);
+}
+
+static void
+test_shared_no_response(void **state)
+{
+    krb5_boolean result;
+    krb5_data *result_data;
+    krb5_context context = *state;
+    krb5_data req = string2data("I'm a test request");
+    krb5_data req2 = string2data("I'm a different test request");
+
+    time_return(0, 0);
+    kdc_insert_lookaside(context, &req, NULL);
+
+    /* Set result_data so we can verify that it is reset to NULL. */
+    result_data = &req;
+    result = kdc_check_lookaside(context, &req, &result_data);
+    assert_true(result);
+    assert_null(result_data);
+
+    result = kdc_check_lookaside(context, &req2, &result_data);
+    assert_false(result);
+    assert_null(result_data);
+}
+
+static void
+test_shared_remove(void **state)
+{
+    krb5_boolean result;
+    krb5_data *result_data;
+    krb5_context context = *state;
+    krb5_data req1 = make_data(hc_data1, sizeof(hc_data1));
+    krb5_data req2 = make_data(hc_data2, sizeof(hc_data2));
+    krb5_data rep = string2data("I'm a test response");
+    struct lookaside_stats stats;
+
+    time_return(0, 0);
+    kdc_insert_lookaside(context, &req1, &rep);
+    time_return(0, 0);
+    kdc_insert_lookaside(context, &req2, NULL);
+
+    kdc_remove_lookaside(context, &req2);
+    result = kdc_check_lookaside(context, &req2, &result_data);
+    assert_false(result);
+    result = kdc_check_lookaside(context, &req1, &result_data);
+    assert_true(result);
+    assert_true(data_eq(rep, *result_data));
+    krb5_free_data(context, result_data);
+
+    kdc_remove_lookaside(context, &req1);
+    result = kdc_check_lookaside(context, &req1, &result_data);
+    assert_false(result);
+
+    kdc_get_lookaside_stats(&stats);
+    assert_int_equal(stats.entries, 0);
+}
+
+static void
+test_shared_expire(void **state)
+{
+    krb5_boolean result;
+    krb5_data *result_data;
+    krb5_context context = *state;
+    krb5_data req1 = make_data(hc_data1, sizeof(hc_data1));
+    krb5_data req2 = make_data(hc_data2, sizeof(hc_data2));
+    krb5_data rep = string2data("I'm a test response");
+    struct lookaside_stats stats;
+
+    time_return(0, 0);
+    kdc_insert_lookaside(context, &req1, &rep);
+
+    /* req2 hashes to the same stripe, so inserting it purges req1. */
+    time_return(STALE_TIME, 0);
+    kdc_insert_lookaside(context, &req2, NULL);
+
+    result = kdc_check_lookaside(context, &req1, &result_data);
+    assert_false(result);
+    result = kdc_check_lookaside(context, &req2, &result_data);
+    assert_true(result);
+
+    /* Stale entries are not counted as evictions. */
+    kdc_get_lookaside_stats(&stats);
+    assert_int_equal(stats.entries, 1);
+    assert_int_equal(stats.evictions, 0);
+}
+
+static void
+test_shared_size_limit(void **state)
+{
+    krb5_boolean result;
+    krb5_data *result_data;
+    krb5_context context = *state;
+    char reqbuf[300], repbuf[300];
+    krb5_data req = make_data(reqbuf, sizeof(reqbuf));
+    krb5_data rep = make_data(repbuf, sizeof(repbuf));
+    struct lookaside_stats stats;
+    int i;
+
+    /* Each entry uses more than half of a stripe's arena. */
+    memset(reqbuf, 'q', sizeof(reqbuf));
+    memset(repbuf, 'r', sizeof(repbuf));
+    for (i = 0; i < 1000; i++) {
+        store_32_be(i, reqbuf);
+        time_return(0, 0);
+        kdc_insert_lookaside(context, &req, &rep);
+    }
+
+    kdc_get_lookaside_stats(&stats);
+    assert_true(stats.entries <= SHM_STRIPES);
+    assert_int_equal(stats.entries + stats.evictions, 1000);
+
+    /* The most recent entry must still be present. */
+    result = kdc_check_lookaside(context, &req, &result_data);
+    assert_true(result);
+    assert_true(data_eq(rep, *result_data));
+    krb5_free_data(context, result_data);
+
+    /* An entry too large for a stripe is not cached. */
+    rep.length = 2000;
+    rep.data = calloc(1, rep.length);
+    assert_non_null(rep.data);
+    store_32_be(i, reqbuf);
+    time_return(0, 0);
+    kdc_insert_lookaside(context, &req, &rep);
+    result = kdc_check_lookaside(context, &req, &result_data);
+    assert_false(result);
+    free(rep.data);
+}
+
+static void
+test_shared_across_fork(void **state)
+{
+    krb5_boolean result;
+    krb5_data *result_data;
+    krb5_context context = *state;
+    krb5_data req = string2data("I'm a test request");
+    krb5_data rep = string2data("I'm a test response");
+    krb5_timestamp now;
+    pid_t pid;
+    int status;
+
+    /* An entry inserted by a child process is visible to the parent. */
+    time_return(0, 0);
+    pid = fork();
+    assert_true(pid >= 0);
+    if (pid == 0) {
+        kdc_insert_lookaside(context, &req, &rep);
+        _exit(0);
+    }
+    assert_int_equal(waitpid(pid, &status, 0), pid);
+    assert_true(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    result = kdc_check_lookaside(context, &req, &result_data);
+    assert_true(result);
+    assert_true(data_eq(rep, *result_data));
+    krb5_free_data(context, result_data);
+
+    /* Consume the mock return values used by the child. */
+    (void)__wrap_krb5_timeofday(context, &now);
+}
+
+#endif /* HAVE_SHARED_LOOKASIDE */
+
 int main()
 {
     int ret;
@@ -975,7 +1192,16 @@ int main()
         replay_unit_test(test_kdc_insert_lookaside_no_reply),
         replay_unit_test(test_kdc_insert_lookaside_multiple),
         replay_unit_test(test_kdc_insert_lookaside_hash_collision),
-        replay_unit_test(test_kdc_insert_lookaside_cache_expire)
+        replay_unit_test(test_kdc_insert_lookaside_cache_expire),
+#ifdef HAVE_SHARED_LOOKASIDE
+        /* shared lookaside tests */
+        shared_unit_test(test_shared_insert_check),
+        shared_unit_test(test_shared_no_response),
+        shared_unit_test(test_shared_remove),
+        shared_unit_test(test_shared_expire),
+        shared_unit_test(test_shared_size_limit),
+        shared_unit_test(test_shared_across_fork),
+#endif
     };
 
     ret = cmocka_run_group_tests_name("replay_lookaside", replay_tests,
@@ -0,0 +1,27 @@
+#!/usr/bin/python
+from k5test import *
+
+# Use TCP for some requests, to exercise both listener types.
+conf = {'libdefaults': {'udp_preference_limit': '1'}}
+realm = K5Realm(start_kdc=False, create_host=False)
+realm.addprinc('service/1')
+realm.addprinc('service/2')
+tcp_env = realm.special_env('tcp', False, krb5_conf=conf)
+
+realm.start_kdc(['-t', '4'])
+realm.kinit(realm.user_princ, password('user'))
+realm.run([kvno, 'service/1', 'service/2'])
+realm.klist(realm.user_princ, 'service/2@' + realm.realm)
+realm.kinit(realm.user_princ, password('user'), env=tcp_env)
+realm.run([kvno, 'service/1'], env=tcp_env)
+
+# Wrong passwords and unknown principals must still produce errors.
+realm.kinit(realm.user_princ, 'wrong', expected_code=1)
+realm.run([kvno, 'nonexistent'], expected_code=1,
+          expected_msg='not found in Kerberos database')
+realm.stop_kdc()
+
+# A KDC cannot use both worker processes and threads.
+realm.run([krb5kdc, '-n', '-t', '2', '-w', '2'], expected_code=1)
+
+success('KDC request threads')
@@ -5,4 +5,35 @@ realm = K5Realm(start_kdc=False, create_host=False)
 realm.start_kdc(['-w', '3'])
 realm.kinit(realm.user_princ, password('user'))
 realm.klist(realm.user_princ)
+realm.stop_kdc()
+
+# Test worker processes with per-worker SO_REUSEPORT listener sockets,
+# over both UDP and TCP.
+conf = {'kdcdefaults': {'kdc_reuseport': 'true'}}
+kdc_env = realm.special_env('reuseport', True, kdc_conf=conf)
+realm.start_kdc(['-w', '3'], env=kdc_env)
+realm.kinit(realm.user_princ, password('user'))
+realm.klist(realm.user_princ)
+tcp_env = realm.special_env('tcp', False,
+                            krb5_conf={'libdefaults':
+                                       {'udp_preference_limit': '1'}})
+realm.kinit(realm.user_princ, password('user'), env=tcp_env)
+realm.run([kvno, realm.krbtgt_princ], env=tcp_env)
+realm.stop_kdc()
+
+# Test worker processes with a lookaside cache in shared memory.  The
+# supervisor doesn't log the cache statistics; each worker does at
+# shutdown.
+conf = {'kdcdefaults': {'kdc_shared_lookaside': 'true',
+                        'kdc_lookaside_size': '1048576'}}
+kdc_env = realm.special_env('shared', True, kdc_conf=conf)
+realm.start_kdc(['-w', '2'], env=kdc_env)
+realm.kinit(realm.user_princ, password('user'))
+realm.run([kvno, realm.krbtgt_princ])
+realm.stop_kdc()
+with open(os.path.join(realm.testdir, 'kdc.log')) as f:
+    stats = [l for l in f if 'lookaside cache:' in l]
+if len(stats) < 2:
+    fail('Expected lookaside cache statistics from each worker')
+
 success('KDC worker processes')
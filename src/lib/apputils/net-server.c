@@ -70,12 +70,26 @@
 static int tcp_or_rpc_data_counter;
 static int max_tcp_or_rpc_data_connections = 45;
 
+/* If set, listener sockets are created with SO_REUSEPORT. */
+static int use_reuseport;
+
+/* Minimum interval between log messages about UDP receive queue drops. */
+#define UDP_DROP_LOG_INTERVAL 60
+
 static int
 setreuseaddr(int sock, int value)
 {
     return setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value));
 }
 
+#ifdef SO_REUSEPORT
+static int
+setreuseport(int sock, int value)
+{
+    return setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &value, sizeof(value));
+}
+#endif
+
 #if defined(IPV6_V6ONLY)
 static int
 setv6only(int sock, int value)
@@ -150,6 +164,12 @@ struct connection {
     /* Crude denial-of-service avoidance support (TCP or RPC) */
     time_t start_time;
 
+    /* Receive queue drop accounting (UDP) */
+    uint32_t rxq_drops_seen;    /* last kernel counter value */
+    uint64_t rxq_drops_total;   /* drops counted since the socket opened */
+    uint64_t rxq_drops_unlogged;
+    time_t rxq_drops_logged;
+
     /* RPC-specific fields */
     SVCXPRT *transp;
     int rpc_force_close;
@@ -205,6 +225,14 @@ struct bind_address {
 
 static SET(verto_ev *) events;
 static SET(struct bind_address) bind_addresses;
+static loop_event_fn event_hook;
+
+static inline void
+count_event(enum loop_event event, unsigned int count)
+{
+    if (event_hook != NULL)
+        event_hook(event, count);
+}
 
 verto_ctx *
 loop_init(verto_ev_type types)
@@ -480,10 +508,18 @@ free_socket(verto_ctx *ctx, verto_ev *ev)
     fd = verto_get_fd(ev);
     conn = verto_get_private(ev);
 
-    /* Close the file descriptor. */
+    /* Close the file descriptor.  The RPC transport owns the descriptor of an
+     * RPC connection and closes it when destroyed; to force it closed, shut
+     * the connection down so that the transport sees EOF.  (Closing the
+     * descriptor here would leave the transport to close it a second time,
+     * after another thread might have reused the number.) */
     krb5_klog_syslog(LOG_INFO, _("closing down fd %d"), fd);
-    if (fd >= 0 && (!conn || conn->type != CONN_RPC || conn->rpc_force_close))
+    if (fd >= 0 && conn != NULL && conn->type == CONN_RPC) {
+        if (conn->rpc_force_close)
+            (void)shutdown(fd, SHUT_RDWR);
+    } else if (fd >= 0) {
         close(fd);
+    }
 
     /* Free the connection struct. */
     if (conn) {
@@ -574,8 +610,9 @@ static void process_rpc_connection(verto_ctx *ctx, verto_ev *ev);
 
 /*
  * Create a socket and bind it to addr.  Ensure the socket will work with
- * select().  Set the socket cloexec, reuseaddr, and if applicable v6-only.
- * Does not call listen().  On failure, log an error and return an error code.
+ * select().  Set the socket cloexec, reuseaddr, reuseport if requested, and if
+ * applicable v6-only.  Does not call listen().  On failure, log an error and
+ * return an error code.
  */
 static krb5_error_code
 create_server_socket(struct sockaddr *addr, int type, const char *prog,
@@ -606,6 +643,15 @@ create_server_socket(struct sockaddr *addr, int type, const char *prog,
     if (setreuseaddr(sock, 1) < 0)
         com_err(prog, errno, _("Cannot enable SO_REUSEADDR on fd %d"), sock);
 
+#ifdef SO_REUSEPORT
+    if (use_reuseport && setreuseport(sock, 1) < 0) {
+        e = errno;
+        com_err(prog, e, _("Cannot enable SO_REUSEPORT on fd %d"), sock);
+        close(sock);
+        return e;
+    }
+#endif
+
     if (addr->sa_family == AF_INET6) {
 #ifdef IPV6_V6ONLY
         if (setv6only(sock, 1)) {
@@ -742,6 +788,12 @@ setup_socket(struct bind_address *ba, struct sockaddr *sock_address,
         }
     }
 
+    /* Ask for receive queue drop counts on UDP sockets, where supported. */
+    if (ba->type == UDP && set_rxq_ovfl(sock) != 0) {
+        krb5_klog_syslog(LOG_DEBUG, _("Cannot track receive queue drops on "
+                                      "UDP socket %s"), paddr(sock_address));
+    }
+
     /* Add the socket to the event loop. */
     flags = VERTO_EV_FLAG_IO_READ | VERTO_EV_FLAG_PERSIST |
         VERTO_EV_FLAG_REINITIABLE;
@@ -883,6 +935,23 @@ cleanup:
     return ret;
 }
 
+krb5_error_code
+loop_set_reuseport(int enable)
+{
+#ifdef SO_REUSEPORT
+    use_reuseport = enable;
+    return 0;
+#else
+    return enable ? ENOTSUP : 0;
+#endif
+}
+
+void
+loop_set_event_hook(loop_event_fn fn)
+{
+    event_hook = fn;
+}
+
 krb5_error_code
 loop_setup_network(verto_ctx *ctx, void *handle, const char *prog,
                    int tcp_listen_backlog)
@@ -947,6 +1016,9 @@ init_addr(krb5_fulladdr *faddr, struct sockaddr *sa)
     }
 }
 
+/* The most datagrams read from a UDP socket per wakeup. */
+#define UDP_BATCH_SIZE 16
+
 struct udp_dispatch_state {
     void *handle;
     const char *prog;
@@ -959,13 +1031,57 @@ struct udp_dispatch_state {
     struct sockaddr_storage daddr;
     aux_addressing_info auxaddr;
     krb5_data request;
-    char pktbuf[MAX_DGRAM_SIZE];
+    /* The request data follows the structure. */
 };
 
+/*
+ * Replies produced while process_packet() is dispatching a batch of requests
+ * are queued here and sent together once the batch has been dispatched.
+ * Replies which complete later are sent individually.
+ */
+struct udp_reply_batch {
+    int port_fd;
+    int n;
+    struct udp_dispatch_state *states[UDP_BATCH_SIZE];
+    krb5_data *responses[UDP_BATCH_SIZE];
+};
+
+static struct udp_reply_batch *reply_batch;
+
+/* Receive buffers for process_packet(), allocated on first use. */
+static char *udp_recv_bufs;
+
+static void
+log_udp_send_error(struct udp_dispatch_state *state, int e)
+{
+    /* Note that the local address (daddr*) has no port number
+     * info associated with it. */
+    char saddrbuf[NI_MAXHOST], sportbuf[NI_MAXSERV];
+    char daddrbuf[NI_MAXHOST];
+
+    count_event(LOOP_EVENT_UDP_SEND_ERROR, 1);
+    if (getnameinfo((struct sockaddr *)&state->daddr, state->daddr_len,
+                    daddrbuf, sizeof(daddrbuf), 0, 0,
+                    NI_NUMERICHOST) != 0) {
+        strlcpy(daddrbuf, "?", sizeof(daddrbuf));
+    }
+
+    if (getnameinfo((struct sockaddr *)&state->saddr, state->saddr_len,
+                    saddrbuf, sizeof(saddrbuf), sportbuf, sizeof(sportbuf),
+                    NI_NUMERICHOST|NI_NUMERICSERV) != 0) {
+        strlcpy(saddrbuf, "?", sizeof(saddrbuf));
+        strlcpy(sportbuf, "?", sizeof(sportbuf));
+    }
+
+    com_err(state->prog, e, _("while sending reply to %s/%s from %s"),
+            saddrbuf, sportbuf, daddrbuf);
+}
+
 static void
 process_packet_response(void *arg, krb5_error_code code, krb5_data *response)
 {
     struct udp_dispatch_state *state = arg;
+    struct udp_reply_batch *batch = reply_batch;
     int cc;
 
     if (code)
@@ -974,33 +1090,22 @@ process_packet_response(void *arg, krb5_error_code code, krb5_data *response)
     if (code || response == NULL)
         goto out;
 
+    /* Queue the reply if a batch for this socket is being dispatched. */
+    if (batch != NULL && batch->port_fd == state->port_fd &&
+        batch->n < UDP_BATCH_SIZE) {
+        batch->states[batch->n] = state;
+        batch->responses[batch->n] = response;
+        batch->n++;
+        return;
+    }
+
     cc = send_to_from(state->port_fd, response->data,
                       (socklen_t) response->length, 0,
                       (struct sockaddr *)&state->saddr, state->saddr_len,
                       (struct sockaddr *)&state->daddr, state->daddr_len,
                       &state->auxaddr);
     if (cc == -1) {
-        /* Note that the local address (daddr*) has no port number
-         * info associated with it. */
-        char saddrbuf[NI_MAXHOST], sportbuf[NI_MAXSERV];
-        char daddrbuf[NI_MAXHOST];
-        int e = errno;
-
-        if (getnameinfo((struct sockaddr *)&state->daddr, state->daddr_len,
-                        daddrbuf, sizeof(daddrbuf), 0, 0,
-                        NI_NUMERICHOST) != 0) {
-            strlcpy(daddrbuf, "?", sizeof(daddrbuf));
-        }
-
-        if (getnameinfo((struct sockaddr *)&state->saddr, state->saddr_len,
-                        saddrbuf, sizeof(saddrbuf), sportbuf, sizeof(sportbuf),
-                        NI_NUMERICHOST|NI_NUMERICSERV) != 0) {
-            strlcpy(saddrbuf, "?", sizeof(saddrbuf));
-            strlcpy(sportbuf, "?", sizeof(sportbuf));
-        }
-
-        com_err(state->prog, e, _("while sending reply to %s/%s from %s"),
-                saddrbuf, sportbuf, daddrbuf);
+        log_udp_send_error(state, errno);
         goto out;
     }
     if ((size_t)cc != response->length) {
@@ -1013,34 +1118,125 @@ out:
     free(state);
 }
 
+/* Send the replies queued in batch with as few system calls as possible. */
+static void
+flush_udp_replies(struct udp_reply_batch *batch)
+{
+    struct udp_msg msgs[UDP_BATCH_SIZE];
+    struct udp_dispatch_state *state;
+    int i, n, sent;
+
+    for (i = 0; i < batch->n; i++) {
+        state = batch->states[i];
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].buf = batch->responses[i]->data;
+        msgs[i].len = batch->responses[i]->length;
+        msgs[i].remote = state->saddr;
+        msgs[i].remote_len = state->saddr_len;
+        msgs[i].local = state->daddr;
+        msgs[i].local_len = state->daddr_len;
+        msgs[i].auxaddr = state->auxaddr;
+    }
+
+    i = 0;
+    while (i < batch->n) {
+        sent = send_to_from_multi(batch->port_fd, &msgs[i], batch->n - i, 0);
+        if (sent < 0) {
+            /* Report and skip the reply that failed. */
+            log_udp_send_error(batch->states[i], errno);
+            i++;
+            continue;
+        }
+        for (n = i + sent; i < n; i++) {
+            if (msgs[i].len != batch->responses[i]->length) {
+                com_err(batch->states[i]->prog, 0,
+                        _("short reply write %d vs %d\n"),
+                        batch->responses[i]->length, (int)msgs[i].len);
+            }
+        }
+    }
+
+    for (i = 0; i < batch->n; i++) {
+        state = batch->states[i];
+        krb5_free_data(get_context(state->handle), batch->responses[i]);
+        free(state);
+    }
+    batch->n = 0;
+}
+
+/*
+ * Account for packets which the kernel reports were dropped because the
+ * receive queue of conn's UDP socket was full.  Add them to the socket's
+ * total, report them to the event hook, and log a warning.  Warnings are
+ * rate-limited to one per socket per UDP_DROP_LOG_INTERVAL seconds; drops are
+ * summed over the interval.
+ */
+static void
+check_udp_drops(struct connection *conn, int fd, uint32_t drops)
+{
+    struct sockaddr_storage ss;
+    socklen_t sslen = sizeof(ss);
+    uint32_t delta;
+    time_t now;
+
+    /* The kernel's counter is cumulative and may wrap.  A packet which
+     * carries no count reports zero; ignore it rather than treating it as a
+     * wrap. */
+    if (drops == 0 || drops == conn->rxq_drops_seen)
+        return;
+    delta = drops - conn->rxq_drops_seen;
+    conn->rxq_drops_seen = drops;
+    conn->rxq_drops_total += delta;
+    conn->rxq_drops_unlogged += delta;
+    count_event(LOOP_EVENT_UDP_RXQ_DROP, delta);
+
+    now = time(NULL);
+    if (conn->rxq_drops_logged != 0 &&
+        now - conn->rxq_drops_logged < UDP_DROP_LOG_INTERVAL)
+        return;
+
+    if (getsockname(fd, ss2sa(&ss), &sslen) != 0)
+        ss.ss_family = AF_UNSPEC;
+    krb5_klog_syslog(LOG_WARNING, _("UDP socket %s dropped %llu packets "
+                                    "(%llu total) because its receive queue "
+                                    "was full"),
+                     (ss.ss_family == AF_UNSPEC) ? "?" : paddr(ss2sa(&ss)),
+                     (unsigned long long)conn->rxq_drops_unlogged,
+                     (unsigned long long)conn->rxq_drops_total);
+    conn->rxq_drops_unlogged = 0;
+    conn->rxq_drops_logged = now;
+}
+
 static void
 process_packet(verto_ctx *ctx, verto_ev *ev)
 {
-    int cc;
+    int i, n, fd;
     struct connection *conn;
     struct udp_dispatch_state *state;
+    struct udp_msg msgs[UDP_BATCH_SIZE];
+    struct udp_reply_batch batch;
+    struct sockaddr_storage bound_addr;
+    socklen_t bound_addr_len = 0;
 
     conn = verto_get_private(ev);
+    fd = verto_get_fd(ev);
+    assert(fd >= 0);
 
-    state = malloc(sizeof(*state));
-    if (!state) {
-        com_err(conn->prog, ENOMEM, _("while dispatching (udp)"));
-        return;
+    if (udp_recv_bufs == NULL) {
+        udp_recv_bufs = malloc(UDP_BATCH_SIZE * MAX_DGRAM_SIZE);
+        if (udp_recv_bufs == NULL) {
+            com_err(conn->prog, ENOMEM, _("while dispatching (udp)"));
+            return;
+        }
+    }
+    for (i = 0; i < UDP_BATCH_SIZE; i++) {
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].buf = udp_recv_bufs + i * MAX_DGRAM_SIZE;
+        msgs[i].len = MAX_DGRAM_SIZE;
     }
 
-    state->handle = conn->handle;
-    state->prog = conn->prog;
-    state->port_fd = verto_get_fd(ev);
-    assert(state->port_fd >= 0);
-
-    state->saddr_len = sizeof(state->saddr);
-    state->daddr_len = sizeof(state->daddr);
-    memset(&state->auxaddr, 0, sizeof(state->auxaddr));
-    cc = recv_from_to(state->port_fd, state->pktbuf, sizeof(state->pktbuf), 0,
-                      (struct sockaddr *)&state->saddr, &state->saddr_len,
-                      (struct sockaddr *)&state->daddr, &state->daddr_len,
-                      &state->auxaddr);
-    if (cc == -1) {
+    n = recv_from_to_multi(fd, msgs, UDP_BATCH_SIZE, 0);
+    if (n == -1) {
         if (errno != EINTR && errno != EAGAIN
             /*
              * This is how Linux indicates that a previous transmission was
@@ -1050,45 +1246,61 @@ process_packet(verto_ctx *ctx, verto_ev *ev)
             && errno != ECONNREFUSED
         )
             com_err(conn->prog, errno, _("while receiving from network"));
-        free(state);
-        return;
-    }
-    if (!cc) { /* zero-length packet? */
-        free(state);
         return;
     }
+    count_event(LOOP_EVENT_UDP_RECV, n);
+
+    batch.port_fd = fd;
+    batch.n = 0;
+    reply_batch = &batch;
+    for (i = 0; i < n; i++) {
+        check_udp_drops(conn, fd, msgs[i].auxaddr.rxq_drops);
+        if (msgs[i].len == 0) /* zero-length packet? */
+            continue;
 
-#if 0
-    if (state->daddr_len > 0) {
-        char addrbuf[100];
-        if (getnameinfo(ss2sa(&state->daddr), state->daddr_len,
-                        addrbuf, sizeof(addrbuf),
-                        0, 0, NI_NUMERICHOST))
-            strlcpy(addrbuf, "?", sizeof(addrbuf));
-        com_err(conn->prog, 0, _("pktinfo says local addr is %s"), addrbuf);
-    }
-#endif
+        state = malloc(sizeof(*state) + msgs[i].len);
+        if (state == NULL) {
+            com_err(conn->prog, ENOMEM, _("while dispatching (udp)"));
+            continue;
+        }
+        state->handle = conn->handle;
+        state->prog = conn->prog;
+        state->port_fd = fd;
+        state->saddr = msgs[i].remote;
+        state->saddr_len = msgs[i].remote_len;
+        state->daddr = msgs[i].local;
+        state->daddr_len = msgs[i].local_len;
+        state->auxaddr = msgs[i].auxaddr;
+
+        if (state->daddr_len == 0 && conn->type == CONN_UDP) {
+            /*
+             * An address couldn't be obtained, so the PKTINFO option probably
+             * isn't available.  If the socket is bound to a specific address,
+             * then try to get the address here (once per batch).
+             */
+            if (bound_addr_len == 0) {
+                bound_addr_len = sizeof(bound_addr);
+                if (getsockname(fd, ss2sa(&bound_addr), &bound_addr_len) != 0)
+                    bound_addr_len = (socklen_t)-1;
+            }
+            /* On failure, keep going anyways. */
+            if (bound_addr_len != (socklen_t)-1) {
+                state->daddr = bound_addr;
+                state->daddr_len = bound_addr_len;
+            }
+        }
 
-    if (state->daddr_len == 0 && conn->type == CONN_UDP) {
-        /*
-         * An address couldn't be obtained, so the PKTINFO option probably
-         * isn't available.  If the socket is bound to a specific address, then
-         * try to get the address here.
-         */
-        state->daddr_len = sizeof(state->daddr);
-        if (getsockname(state->port_fd, (struct sockaddr *)&state->daddr,
-                        &state->daddr_len) != 0)
-            state->daddr_len = 0;
-        /* On failure, keep going anyways. */
+        state->request.length = msgs[i].len;
+        state->request.data = (char *)(state + 1);
+        memcpy(state->request.data, msgs[i].buf, msgs[i].len);
+        state->faddr.address = &state->addr;
+        init_addr(&state->faddr, ss2sa(&state->saddr));
+        /* This address is in net order. */
+        dispatch(state->handle, ss2sa(&state->daddr), &state->faddr,
+                 &state->request, 0, ctx, process_packet_response, state);
     }
-
-    state->request.length = cc;
-    state->request.data = state->pktbuf;
-    state->faddr.address = &state->addr;
-    init_addr(&state->faddr, ss2sa(&state->saddr));
-    /* This address is in net order. */
-    dispatch(state->handle, ss2sa(&state->daddr), &state->faddr,
-             &state->request, 0, ctx, process_packet_response, state);
+    reply_batch = NULL;
+    flush_udp_replies(&batch);
 }
 
 static int
@@ -1121,6 +1333,7 @@ kill_lru_tcp_or_rpc_connection(void *handle, verto_ev *newev)
         }
     }
     if (oldest_c != NULL) {
+        count_event(LOOP_EVENT_CONN_DROP, 1);
         krb5_klog_syslog(LOG_INFO, _("dropping %s fd %d from %s"),
                          c->type == CONN_RPC ? "rpc" : "tcp",
                          verto_get_fd(oldest_ev), oldest_c->addrbuf);
@@ -1189,6 +1402,7 @@ accept_tcp_connection(verto_ctx *ctx, verto_ev *ev)
     newconn->bufsiz = 1024 * 1024;
     newconn->buffer = malloc(newconn->bufsiz);
     newconn->start_time = time(0);
+    count_event(LOOP_EVENT_ACCEPT, 1);
 
     if (++tcp_or_rpc_data_counter > max_tcp_or_rpc_data_connections)
         kill_lru_tcp_or_rpc_connection(conn->handle, newev);
@@ -1304,6 +1518,7 @@ process_tcp_connection_read(verto_ctx *ctx, verto_ev *ev)
             if (conn->msglen > conn->bufsiz - 4) {
                 krb5_error_code err;
                 /* Message too big. */
+                count_event(LOOP_EVENT_TCP_TOOLONG, 1);
                 krb5_klog_syslog(LOG_ERR, _("TCP client %s wants %lu bytes, "
                                             "cap is %lu"), conn->addrbuf,
                                  (unsigned long) conn->msglen,
@@ -1499,6 +1714,7 @@ accept_rpc_connection(verto_ctx *ctx, verto_ev *ev)
         newconn->addr_s = addr_s;
         newconn->addrlen = addrlen;
         newconn->start_time = time(0);
+        count_event(LOOP_EVENT_ACCEPT, 1);
 
         if (++tcp_or_rpc_data_counter > max_tcp_or_rpc_data_connections)
             kill_lru_tcp_or_rpc_connection(newconn->handle, newev);
@@ -41,6 +41,16 @@
 #define HAVE_PKTINFO_SUPPORT
 #endif
 
+/* The batched interfaces need the msghdr-based code below. */
+#if defined(HAVE_PKTINFO_SUPPORT) && defined(CMSG_SPACE)
+#ifdef HAVE_RECVMMSG
+#define USE_RECVMMSG
+#endif
+#ifdef HAVE_SENDMMSG
+#define USE_SENDMMSG
+#endif
+#endif
+
 /* Use RFC 3542 API below, but fall back from IPV6_RECVPKTINFO to IPV6_PKTINFO
  * for RFC 2292 implementations. */
 #if !defined(IPV6_RECVPKTINFO) && defined(IPV6_PKTINFO)
@@ -129,6 +139,25 @@ set_pktinfo(int sock, int family)
     }
 }
 
+/*
+ * Ask the kernel to report the number of packets dropped from a datagram
+ * socket's receive queue along with each received message.
+ *
+ * Returns 0 on success, EINVAL if the system does not support it.
+ */
+krb5_error_code
+set_rxq_ovfl(int sock)
+{
+#if defined(SO_RXQ_OVFL) && defined(HAVE_PKTINFO_SUPPORT) && \
+    defined(CMSG_SPACE)
+    int sockopt = 1;
+    return setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &sockopt,
+                      sizeof(sockopt));
+#else
+    return EINVAL;
+#endif
+}
+
 #if defined(HAVE_PKTINFO_SUPPORT) && defined(CMSG_SPACE)
 
 /*
@@ -256,6 +285,79 @@ check_cmsg_pktinfo(struct cmsghdr *cmsgptr, struct sockaddr *to,
            check_cmsg_v6_pktinfo(cmsgptr, to, tolen, auxaddr);
 }
 
+#ifdef SO_RXQ_OVFL
+#define RXQ_OVFL_SPACE CMSG_SPACE(sizeof(uint32_t))
+
+static int
+check_cmsg_rxq_ovfl(struct cmsghdr *cmsgptr, aux_addressing_info *auxaddr)
+{
+    if (cmsgptr->cmsg_level == SOL_SOCKET &&
+        cmsgptr->cmsg_type == SO_RXQ_OVFL &&
+        cmsgptr->cmsg_len >= CMSG_LEN(sizeof(uint32_t))) {
+        memcpy(&auxaddr->rxq_drops, CMSG_DATA(cmsgptr), sizeof(uint32_t));
+        return 1;
+    }
+    return 0;
+}
+#else /* SO_RXQ_OVFL */
+#define RXQ_OVFL_SPACE 0
+#define check_cmsg_rxq_ovfl(c, a) 0
+#endif /* SO_RXQ_OVFL */
+
+#define RECV_CBUF_SIZE (CMSG_SPACE(sizeof(union pktinfo)) + RXQ_OVFL_SPACE)
+
+/* Initialize msg to receive a message into buf, with the sender address in
+ * from and control data in cbuf. */
+static void
+init_recv_msg(struct msghdr *msg, struct iovec *iov, void *buf, size_t len,
+              struct sockaddr *from, socklen_t fromlen, void *cbuf,
+              size_t cbuflen)
+{
+    iov->iov_base = buf;
+    iov->iov_len = len;
+    memset(msg, 0, sizeof(*msg));
+    msg->msg_name = from;
+    msg->msg_namelen = fromlen;
+    msg->msg_iov = iov;
+    msg->msg_iovlen = 1;
+    msg->msg_control = cbuf;
+    msg->msg_controllen = cbuflen;
+}
+
+/*
+ * Extract the destination address (if use_pktinfo is set) and the receive
+ * queue drop count from the control data of a received message.  Set *tolen
+ * to 0 if no destination address is available.
+ */
+static void
+parse_recv_msg(struct msghdr *msg, int use_pktinfo, struct sockaddr *to,
+               socklen_t *tolen, aux_addressing_info *auxaddr)
+{
+    struct cmsghdr *cmsgptr;
+    int have_to = 0;
+
+    /*
+     * On Darwin (and presumably all *BSD with KAME stacks), CMSG_FIRSTHDR
+     * doesn't check for a non-zero controllen.  RFC 3542 recommends making
+     * this check, even though the (new) spec for CMSG_FIRSTHDR says it's
+     * supposed to do the check.
+     */
+    if (msg->msg_controllen) {
+        cmsgptr = CMSG_FIRSTHDR(msg);
+        while (cmsgptr) {
+            if (use_pktinfo && !have_to &&
+                check_cmsg_pktinfo(cmsgptr, to, tolen, auxaddr))
+                have_to = 1;
+            else
+                (void)check_cmsg_rxq_ovfl(cmsgptr, auxaddr);
+            cmsgptr = CMSG_NXTHDR(msg, cmsgptr);
+        }
+    }
+    /* No info about destination addr was available.  */
+    if (tolen != NULL && !have_to)
+        *tolen = 0;
+}
+
 /*
  * Receive a message from a socket.
  *
@@ -268,9 +370,10 @@ check_cmsg_pktinfo(struct cmsghdr *cmsgptr, struct sockaddr *to,
  *  fromlen
  *  to      - Set to the address that the message was sent to if possible.
  *            May not be set in certain cases such as if pktinfo support is
- *            missing. May be NULL.
+ *            missing, in which case *tolen is set to 0.  May be NULL.
  *  tolen
- *  auxaddr - Miscellaneous address information.
+ *  auxaddr - Miscellaneous address information.  rxq_drops is updated if
+ *            the system reported a receive queue drop count.
  *
  * Returns 0 on success, otherwise an error code.
  */
@@ -281,55 +384,35 @@ recv_from_to(int sock, void *buf, size_t len, int flags,
              aux_addressing_info *auxaddr)
 
 {
-    int r;
+    int r, use_pktinfo;
     struct iovec iov;
-    char cmsg[CMSG_SPACE(sizeof(union pktinfo))];
-    struct cmsghdr *cmsgptr;
+    char cmsg[RECV_CBUF_SIZE];
     struct msghdr msg;
 
     /* Don't use pktinfo if the socket isn't bound to a wildcard address. */
     r = is_socket_bound_to_wildcard(sock);
     if (r < 0)
         return errno;
-
-    if (!to || !tolen || !r)
-        return recvfrom(sock, buf, len, flags, from, fromlen);
+    use_pktinfo = (to != NULL && tolen != NULL && r);
 
     /* Clobber with something recognizeable in case we can't extract the
      * address but try to use it anyways. */
-    memset(to, 0x40, *tolen);
-
-    iov.iov_base = buf;
-    iov.iov_len = len;
-    memset(&msg, 0, sizeof(msg));
-    msg.msg_name = from;
-    msg.msg_namelen = *fromlen;
-    msg.msg_iov = &iov;
-    msg.msg_iovlen = 1;
-    msg.msg_control = cmsg;
-    msg.msg_controllen = sizeof(cmsg);
+    if (to != NULL && tolen != NULL) {
+        memset(to, 0x40, *tolen);
+        if (!use_pktinfo)
+            *tolen = 0;
+    }
+
+    /* We still need recvmsg() for the drop count if the system has one. */
+    if (!use_pktinfo && RXQ_OVFL_SPACE == 0)
+        return recvfrom(sock, buf, len, flags, from, fromlen);
 
+    init_recv_msg(&msg, &iov, buf, len, from, *fromlen, cmsg, sizeof(cmsg));
     r = recvmsg(sock, &msg, flags);
     if (r < 0)
         return r;
     *fromlen = msg.msg_namelen;
-
-    /*
-     * On Darwin (and presumably all *BSD with KAME stacks), CMSG_FIRSTHDR
-     * doesn't check for a non-zero controllen.  RFC 3542 recommends making
-     * this check, even though the (new) spec for CMSG_FIRSTHDR says it's
-     * supposed to do the check.
-     */
-    if (msg.msg_controllen) {
-        cmsgptr = CMSG_FIRSTHDR(&msg);
-        while (cmsgptr) {
-            if (check_cmsg_pktinfo(cmsgptr, to, tolen, auxaddr))
-                return r;
-            cmsgptr = CMSG_NXTHDR(&msg, cmsgptr);
-        }
-    }
-    /* No info about destination addr was available.  */
-    *tolen = 0;
+    parse_recv_msg(&msg, use_pktinfo, to, tolen, auxaddr);
     return r;
 }
 
@@ -432,6 +515,49 @@ set_msg_from(int family, struct msghdr *msg, struct cmsghdr *cmsgptr,
     return EINVAL;
 }
 
+#define SEND_CBUF_SIZE CMSG_SPACE(sizeof(union pktinfo))
+
+/*
+ * Initialize msg to send buf to the address to.  If use_pktinfo is set and
+ * from is a usable source address, also add control data in cbuf to send the
+ * message from that address.  On return, msg->msg_controllen is 0 if no
+ * source address was set.
+ */
+static void
+init_send_msg(struct msghdr *msg, struct iovec *iov, void *buf, size_t len,
+              const struct sockaddr *to, socklen_t tolen,
+              struct sockaddr *from, socklen_t fromlen,
+              aux_addressing_info *auxaddr, int use_pktinfo, void *cbuf,
+              size_t cbuflen)
+{
+    struct cmsghdr *cmsgptr;
+
+    iov->iov_base = buf;
+    iov->iov_len = len;
+    memset(msg, 0, sizeof(*msg));
+    msg->msg_name = (void *)to;
+    msg->msg_namelen = tolen;
+    msg->msg_iov = iov;
+    msg->msg_iovlen = 1;
+
+    if (!use_pktinfo || from == NULL || fromlen == 0 ||
+        from->sa_family != to->sa_family)
+        return;
+
+    memset(cbuf, 0, cbuflen);
+    msg->msg_control = cbuf;
+    /* CMSG_FIRSTHDR needs a non-zero controllen, or it'll return NULL on
+     * Linux. */
+    msg->msg_controllen = cbuflen;
+    cmsgptr = CMSG_FIRSTHDR(msg);
+    msg->msg_controllen = 0;
+
+    if (set_msg_from(from->sa_family, msg, cmsgptr, from, fromlen, auxaddr)) {
+        msg->msg_control = NULL;
+        msg->msg_controllen = 0;
+    }
+}
+
 /*
  * Send a message to an address.
  *
@@ -456,43 +582,112 @@ send_to_from(int sock, void *buf, size_t len, int flags,
     int r;
     struct iovec iov;
     struct msghdr msg;
-    struct cmsghdr *cmsgptr;
-    char cbuf[CMSG_SPACE(sizeof(union pktinfo))];
+    char cbuf[SEND_CBUF_SIZE];
 
     /* Don't use pktinfo if the socket isn't bound to a wildcard address. */
     r = is_socket_bound_to_wildcard(sock);
     if (r < 0)
         return errno;
 
-    if (from == NULL || fromlen == 0 || from->sa_family != to->sa_family || !r)
-        goto use_sendto;
-
-    iov.iov_base = buf;
-    iov.iov_len = len;
+    init_send_msg(&msg, &iov, buf, len, to, tolen, from, fromlen, auxaddr, r,
+                  cbuf, sizeof(cbuf));
     /* Truncation?  */
     if (iov.iov_len != len)
         return EINVAL;
-    memset(cbuf, 0, sizeof(cbuf));
-    memset(&msg, 0, sizeof(msg));
-    msg.msg_name = (void *)to;
-    msg.msg_namelen = tolen;
-    msg.msg_iov = &iov;
-    msg.msg_iovlen = 1;
-    msg.msg_control = cbuf;
-    /* CMSG_FIRSTHDR needs a non-zero controllen, or it'll return NULL on
-     * Linux. */
-    msg.msg_controllen = sizeof(cbuf);
-    cmsgptr = CMSG_FIRSTHDR(&msg);
-    msg.msg_controllen = 0;
-
-    if (set_msg_from(from->sa_family, &msg, cmsgptr, from, fromlen, auxaddr))
-        goto use_sendto;
+    if (msg.msg_controllen == 0)
+        return sendto(sock, buf, len, flags, to, tolen);
     return sendmsg(sock, &msg, flags);
+}
 
-use_sendto:
-    return sendto(sock, buf, len, flags, to, tolen);
+#ifdef USE_RECVMMSG
+
+/*
+ * Receive up to nmsgs messages from a socket with one system call.  See
+ * udppktinfo.h for the use of the udp_msg fields.  Returns the number of
+ * messages received, or -1 with errno set on error.
+ */
+int
+recv_from_to_multi(int sock, struct udp_msg *msgs, int nmsgs, int flags)
+{
+    struct mmsghdr mmsgs[UDP_MULTI_MAX];
+    struct iovec iovs[UDP_MULTI_MAX];
+    char cbufs[UDP_MULTI_MAX][RECV_CBUF_SIZE];
+    int i, n, use_pktinfo;
+
+    /* Don't use pktinfo if the socket isn't bound to a wildcard address. */
+    use_pktinfo = is_socket_bound_to_wildcard(sock);
+    if (use_pktinfo < 0)
+        return -1;
+
+    if (nmsgs > UDP_MULTI_MAX)
+        nmsgs = UDP_MULTI_MAX;
+    for (i = 0; i < nmsgs; i++) {
+        memset(&msgs[i].local, 0x40, sizeof(msgs[i].local));
+        init_recv_msg(&mmsgs[i].msg_hdr, &iovs[i], msgs[i].buf, msgs[i].len,
+                      ss2sa(&msgs[i].remote), sizeof(msgs[i].remote),
+                      cbufs[i], sizeof(cbufs[i]));
+        mmsgs[i].msg_len = 0;
+    }
+
+    n = recvmmsg(sock, mmsgs, nmsgs, flags, NULL);
+    if (n < 0)
+        return -1;
+
+    for (i = 0; i < n; i++) {
+        msgs[i].len = mmsgs[i].msg_len;
+        msgs[i].remote_len = mmsgs[i].msg_hdr.msg_namelen;
+        msgs[i].local_len = sizeof(msgs[i].local);
+        parse_recv_msg(&mmsgs[i].msg_hdr, use_pktinfo, ss2sa(&msgs[i].local),
+                       &msgs[i].local_len, &msgs[i].auxaddr);
+    }
+    return n;
+}
+
+#endif /* USE_RECVMMSG */
+
+#ifdef USE_SENDMMSG
+
+/*
+ * Send up to nmsgs messages on a socket with one system call.  See
+ * udppktinfo.h for the use of the udp_msg fields.  Returns the number of
+ * messages sent, or -1 with errno set if the first message could not be sent.
+ */
+int
+send_to_from_multi(int sock, struct udp_msg *msgs, int nmsgs, int flags)
+{
+    struct mmsghdr mmsgs[UDP_MULTI_MAX];
+    struct iovec iovs[UDP_MULTI_MAX];
+    char cbufs[UDP_MULTI_MAX][SEND_CBUF_SIZE];
+    struct sockaddr *from;
+    int i, n, use_pktinfo;
+
+    /* Don't use pktinfo if the socket isn't bound to a wildcard address. */
+    use_pktinfo = is_socket_bound_to_wildcard(sock);
+    if (use_pktinfo < 0)
+        return -1;
+
+    if (nmsgs > UDP_MULTI_MAX)
+        nmsgs = UDP_MULTI_MAX;
+    for (i = 0; i < nmsgs; i++) {
+        from = (msgs[i].local_len > 0) ? ss2sa(&msgs[i].local) : NULL;
+        init_send_msg(&mmsgs[i].msg_hdr, &iovs[i], msgs[i].buf, msgs[i].len,
+                      ss2sa(&msgs[i].remote), msgs[i].remote_len, from,
+                      msgs[i].local_len, &msgs[i].auxaddr, use_pktinfo,
+                      cbufs[i], sizeof(cbufs[i]));
+        mmsgs[i].msg_len = 0;
+    }
+
+    n = sendmmsg(sock, mmsgs, nmsgs, flags);
+    if (n < 0)
+        return -1;
+
+    for (i = 0; i < n; i++)
+        msgs[i].len = mmsgs[i].msg_len;
+    return n;
 }
 
+#endif /* USE_SENDMMSG */
+
 #else /* HAVE_PKTINFO_SUPPORT && CMSG_SPACE */
 
 krb5_error_code
@@ -521,3 +716,50 @@ send_to_from(int sock, void *buf, size_t len, int flags,
 }
 
 #endif /* HAVE_PKTINFO_SUPPORT && CMSG_SPACE */
+
+#ifndef USE_RECVMMSG
+
+/* Receive one message with recv_from_to(). */
+int
+recv_from_to_multi(int sock, struct udp_msg *msgs, int nmsgs, int flags)
+{
+    int r;
+
+    if (nmsgs < 1)
+        return 0;
+    msgs[0].remote_len = sizeof(msgs[0].remote);
+    msgs[0].local_len = sizeof(msgs[0].local);
+    r = recv_from_to(sock, msgs[0].buf, msgs[0].len, flags,
+                     ss2sa(&msgs[0].remote), &msgs[0].remote_len,
+                     ss2sa(&msgs[0].local), &msgs[0].local_len,
+                     &msgs[0].auxaddr);
+    if (r < 0)
+        return -1;
+    msgs[0].len = r;
+    return 1;
+}
+
+#endif /* USE_RECVMMSG */
+
+#ifndef USE_SENDMMSG
+
+/* Send the messages one at a time with send_to_from(). */
+int
+send_to_from_multi(int sock, struct udp_msg *msgs, int nmsgs, int flags)
+{
+    struct sockaddr *from;
+    int i, r;
+
+    for (i = 0; i < nmsgs; i++) {
+        from = (msgs[i].local_len > 0) ? ss2sa(&msgs[i].local) : NULL;
+        r = send_to_from(sock, msgs[i].buf, msgs[i].len, flags,
+                         ss2sa(&msgs[i].remote), msgs[i].remote_len, from,
+                         msgs[i].local_len, &msgs[i].auxaddr);
+        if (r < 0)
+            return (i > 0) ? i : -1;
+        msgs[i].len = r;
+    }
+    return nmsgs;
+}
+
+#endif /* USE_SENDMMSG */
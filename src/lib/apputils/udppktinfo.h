@@ -32,18 +32,46 @@
  * This holds whatever additional information might be needed to
  * properly send back to the client from the correct local address.
  *
- * In this case, we only need one datum so far: On Mac OS X, the
- * kernel doesn't seem to like sending from link-local addresses
- * unless we specify the correct interface.
+ * On Mac OS X, the kernel doesn't seem to like sending from link-local
+ * addresses unless we specify the correct interface.  recv_from_to() also
+ * reports here the socket's running count of packets dropped because its
+ * receive queue was full, if set_rxq_ovfl() succeeded on the socket.
  */
-typedef union aux_addressing_info
+typedef struct aux_addressing_info
 {
     int ipv6_ifindex;
+    uint32_t rxq_drops;
 } aux_addressing_info;
 
+/*
+ * A datagram for recv_from_to_multi() or send_to_from_multi().  For receiving,
+ * buf and len must be set to the receive buffer; on return len is set to the
+ * message length, remote to the sender address, and local to the destination
+ * address (or local_len to 0 if it is not known), as with recv_from_to().  For
+ * sending, buf and len are the message, remote is the destination address,
+ * and local is the source address if local_len is not 0.  On return, len is
+ * set to the number of bytes sent.
+ */
+struct udp_msg {
+    void *buf;
+    size_t len;
+    struct sockaddr_storage remote;
+    socklen_t remote_len;
+    struct sockaddr_storage local;
+    socklen_t local_len;
+    aux_addressing_info auxaddr;
+};
+
+/* The most messages transferred by one recv_from_to_multi() or
+ * send_to_from_multi() call. */
+#define UDP_MULTI_MAX 32
+
 krb5_error_code
 set_pktinfo(int sock, int family);
 
+krb5_error_code
+set_rxq_ovfl(int sock);
+
 krb5_error_code
 recv_from_to(int sock, void *buf, size_t len, int flags,
              struct sockaddr *from, socklen_t *fromlen,
@@ -55,4 +83,10 @@ send_to_from(int sock, void *buf, size_t len, int flags,
              const struct sockaddr *to, socklen_t tolen, struct sockaddr *from,
              socklen_t fromlen, aux_addressing_info *auxaddr);
 
+int
+recv_from_to_multi(int sock, struct udp_msg *msgs, int nmsgs, int flags);
+
+int
+send_to_from_multi(int sock, struct udp_msg *msgs, int nmsgs, int flags);
+
 #endif /* UDPPKTINFO_H */
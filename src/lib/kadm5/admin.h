@@ -454,6 +454,18 @@ kadm5_ret_t    kadm5_get_principals(void *server_handle,
                                     char *exp, char ***princs,
                                     int *count);
 
+/*
+ * Retrieve up to max principal names matching exp, in ascending order,
+ * beginning after the name start (or at the first match if start is NULL).
+ * Set *more to true if further matches remain; pass the last name returned as
+ * start to get the next page.  Free the result with kadm5_free_name_list.  If
+ * the server does not support paging, all matches are returned at once.
+ */
+kadm5_ret_t    kadm5_get_principals_page(void *server_handle,
+                                         char *exp, char *start, int max,
+                                         char ***princs, int *count,
+                                         krb5_boolean *more);
+
 kadm5_ret_t    kadm5_get_policies(void *server_handle,
                                   char *exp, char ***pols,
                                   int *count);
@@ -206,6 +206,46 @@ kadm5_get_principals(void *server_handle,
     return r.code;
 }
 
+kadm5_ret_t
+kadm5_get_principals_page(void *server_handle, char *exp, char *start,
+                          int max, char ***princs, int *count,
+                          krb5_boolean *more)
+{
+    gprincs_page_arg arg;
+    gprincs_page_ret r;
+    enum clnt_stat st;
+    kadm5_server_handle_t handle = server_handle;
+
+    CHECK_HANDLE(server_handle);
+
+    if (princs == NULL || count == NULL || more == NULL)
+        return EINVAL;
+    *princs = NULL;
+    *count = 0;
+    *more = FALSE;
+    arg.exp = exp;
+    arg.start = start;
+    arg.max = max;
+    arg.api_version = handle->api_version;
+    memset(&r, 0, sizeof(gprincs_page_ret));
+    st = get_princs_page_2(&arg, &r, handle->clnt);
+    if (st == RPC_PROCUNAVAIL) {
+        /* Older servers can only return the whole list. */
+        if (start != NULL)
+            return 0;
+        return kadm5_get_principals(server_handle, exp, princs, count);
+    }
+    if (st != RPC_SUCCESS)
+        eret();
+    if (r.code == 0) {
+        *count = r.count;
+        *princs = r.princs;
+        *more = r.more;
+    }
+
+    return r.code;
+}
+
 kadm5_ret_t
 kadm5_rename_principal(void *server_handle,
                        krb5_principal source, krb5_principal dest)
@@ -65,6 +65,23 @@ struct gprincs_ret {
 };
 typedef struct gprincs_ret gprincs_ret;
 
+struct gprincs_page_arg {
+	krb5_ui_4 api_version;
+	char *exp;
+	char *start;
+	int max;
+};
+typedef struct gprincs_page_arg gprincs_page_arg;
+
+struct gprincs_page_ret {
+	krb5_ui_4 api_version;
+	kadm5_ret_t code;
+	char **princs;
+	int count;
+	bool_t more;
+};
+typedef struct gprincs_page_ret gprincs_page_ret;
+
 struct chpass_arg {
 	krb5_ui_4 api_version;
 	krb5_principal princ;
@@ -369,6 +386,11 @@ extern enum clnt_stat get_principal_keys_2(getpkeys_arg *, getpkeys_ret *,
 					   CLIENT *);
 extern  bool_t get_principal_keys_2_svc(getpkeys_arg *, getpkeys_ret *,
 					struct svc_req *);
+#define GET_PRINCS_PAGE 27
+extern  enum clnt_stat get_princs_page_2(gprincs_page_arg *,
+					 gprincs_page_ret *, CLIENT *);
+extern  bool_t get_princs_page_2_svc(gprincs_page_arg *, gprincs_page_ret *,
+				     struct svc_req *);
 
 extern bool_t xdr_cprinc_arg ();
 extern bool_t xdr_cprinc3_arg ();
@@ -414,5 +436,7 @@ extern bool_t xdr_krb5_string_attr ();
 extern bool_t xdr_kadm5_key_data ();
 extern bool_t xdr_getpkeys_arg ();
 extern bool_t xdr_getpkeys_ret ();
+extern bool_t xdr_gprincs_page_arg ();
+extern bool_t xdr_gprincs_page_ret ();
 
 #endif /* __KADM_RPC_H__ */
@@ -1226,3 +1226,43 @@ xdr_getpkeys_ret(XDR *xdrs, getpkeys_ret *objp)
 	}
 	return TRUE;
 }
+
+bool_t
+xdr_gprincs_page_arg(XDR *xdrs, gprincs_page_arg *objp)
+{
+	if (!xdr_ui_4(xdrs, &objp->api_version)) {
+		return FALSE;
+	}
+	if (!xdr_nullstring(xdrs, &objp->exp)) {
+		return FALSE;
+	}
+	if (!xdr_nullstring(xdrs, &objp->start)) {
+		return FALSE;
+	}
+	if (!xdr_int(xdrs, &objp->max)) {
+		return FALSE;
+	}
+	return TRUE;
+}
+
+bool_t
+xdr_gprincs_page_ret(XDR *xdrs, gprincs_page_ret *objp)
+{
+	if (!xdr_ui_4(xdrs, &objp->api_version)) {
+		return FALSE;
+	}
+	if (!xdr_kadm5_ret_t(xdrs, &objp->code)) {
+		return FALSE;
+	}
+	if (objp->code == KADM5_OK) {
+		if (!xdr_array(xdrs, (caddr_t *) &objp->princs,
+			       (unsigned int *) &objp->count, ~0,
+			       sizeof(char *), xdr_nullstring)) {
+			return FALSE;
+		}
+		if (!xdr_bool(xdrs, &objp->more)) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
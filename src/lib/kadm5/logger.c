@@ -138,6 +138,9 @@ struct log_control {
     char                *log_hostname;
     krb5_boolean        log_opened;
     krb5_boolean        log_debug;
+    krb5_boolean        log_async;
+    size_t              log_async_bufsize;
+    krb5_boolean        log_async_drop;
 };
 
 static struct log_control log_control = {
@@ -149,6 +152,15 @@ static struct log_control log_control = {
 };
 static struct log_entry def_log_entry;
 
+/* Default per-thread buffer size for asynchronous logging. */
+#define DEFAULT_ASYNC_BUFSIZE   65536
+
+/* Serializes output to the log entries against krb5_klog_reopen(), for
+ * servers which log from more than one thread. */
+static k5_mutex_t log_lock = K5_MUTEX_PARTIAL_INITIALIZER;
+
+static void async_stop(void);
+
 /*
  * These macros define any special processing that needs to happen for
  * devices.  For unix, of course, this is hardly anything.
@@ -311,6 +323,35 @@ klog_com_err_proc(const char *whoami, long int code, const char *format, va_list
     }
 }
 
+/* Read the [logging] settings for asynchronous logging. */
+static void
+read_async_config(krb5_context kcontext)
+{
+    int async, bufsize;
+    char *overflow = NULL;
+
+    log_control.log_async = FALSE;
+    log_control.log_async_bufsize = DEFAULT_ASYNC_BUFSIZE;
+    log_control.log_async_drop = FALSE;
+    if (!profile_get_boolean(kcontext->profile, KRB5_CONF_LOGGING,
+                             KRB5_CONF_ASYNC, NULL, 0, &async))
+        log_control.log_async = async;
+    if (!profile_get_integer(kcontext->profile, KRB5_CONF_LOGGING,
+                             KRB5_CONF_ASYNC_BUFFER_SIZE, NULL,
+                             DEFAULT_ASYNC_BUFSIZE, &bufsize) && bufsize > 0)
+        log_control.log_async_bufsize = bufsize;
+    if (!profile_get_string(kcontext->profile, KRB5_CONF_LOGGING,
+                            KRB5_CONF_ASYNC_OVERFLOW, NULL, "block",
+                            &overflow)) {
+        if (strcasecmp(overflow, "drop") == 0)
+            log_control.log_async_drop = TRUE;
+        else if (strcasecmp(overflow, "block") != 0)
+            fprintf(stderr, _("Unknown %s value \"%s\"; using \"block\"\n"),
+                    KRB5_CONF_ASYNC_OVERFLOW, overflow);
+        profile_release_string(overflow);
+    }
+}
+
 /*
  * krb5_klog_init()     - Initialize logging.
  *
@@ -350,6 +391,9 @@ krb5_klog_init(krb5_context kcontext, char *ename, char *whoami, krb5_boolean do
     log_facility = 0;
 
     err_context = kcontext;
+    error = k5_mutex_finish_init(&log_lock);
+    if (error)
+        return error;
 
     /* Look up [logging]->debug in the profile to see if we should include
      * debug messages for types other than syslog.  Default to false. */
@@ -357,6 +401,10 @@ krb5_klog_init(krb5_context kcontext, char *ename, char *whoami, krb5_boolean do
                              KRB5_CONF_DEBUG, NULL, 0, &debug))
         log_control.log_debug = debug;
 
+    /* Look up the asynchronous logging settings, which take effect when the
+     * daemon calls krb5_klog_start_async(). */
+    read_async_config(kcontext);
+
     /*
      * Look up [logging]-><ename> in the profile.  If that doesn't
      * succeed, then look for [logging]->default.
@@ -670,6 +718,7 @@ krb5_klog_close(krb5_context kcontext)
 {
     int lindex;
     (void) reset_com_err_hook();
+    async_stop();
     for (lindex = 0; lindex < log_control.log_nentries; lindex++) {
         switch (log_control.log_entries[lindex].log_type) {
         case K_LOG_FILE:
@@ -751,6 +800,473 @@ severity2string(int severity)
     return(ss);
 }
 
+/*
+ * Write a formatted message to each logging specification.  outbuf contains
+ * the message with its header, and syslogp points into outbuf just past the
+ * header.  If flush is false, leave buffered file output unflushed.  The
+ * caller must hold log_lock.
+ */
+static void
+write_entries(int priority, const char *outbuf, const char *syslogp,
+              krb5_boolean flush)
+{
+    int lindex;
+
+    for (lindex = 0; lindex < log_control.log_nentries; lindex++) {
+        /* Omit LOG_DEBUG messages for non-syslog outputs unless we are
+         * configured to include them. */
+        if (priority == LOG_DEBUG && !log_control.log_debug &&
+            log_control.log_entries[lindex].log_type != K_LOG_SYSLOG)
+            continue;
+
+        switch (log_control.log_entries[lindex].log_type) {
+        case K_LOG_FILE:
+        case K_LOG_STDERR:
+            /*
+             * Files/standard error.
+             */
+            if (fprintf(log_control.log_entries[lindex].lfu_filep, "%s\n",
+                        outbuf) < 0) {
+                /* Attempt to report error */
+                fprintf(stderr, log_file_err, log_control.log_whoami,
+                        log_control.log_entries[lindex].lfu_fname);
+            }
+            else if (flush) {
+                fflush(log_control.log_entries[lindex].lfu_filep);
+            }
+            break;
+        case K_LOG_CONSOLE:
+        case K_LOG_DEVICE:
+            /*
+             * Devices (may need special handling)
+             */
+            if (DEVICE_PRINT(log_control.log_entries[lindex].ldu_filep,
+                             outbuf) < 0) {
+                /* Attempt to report error */
+                fprintf(stderr, log_device_err, log_control.log_whoami,
+                        log_control.log_entries[lindex].ldu_devname);
+            }
+            break;
+        case K_LOG_SYSLOG:
+            /*
+             * System log.
+             */
+
+            /* Log the message with our header trimmed off */
+            syslog(priority, "%s", syslogp);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+#ifdef ENABLE_THREADS
+
+/*
+ * Asynchronous logging.  If [logging] async is set and the daemon calls
+ * krb5_klog_start_async(), krb5_klog_syslog() formats each message into a
+ * buffer belonging to the calling thread instead of writing it out.  A flusher
+ * thread wakes up when a buffer becomes half full, or once a second, swaps
+ * each thread's buffer for an empty one, and writes out the messages, so that
+ * a slow log file or syslog daemon does not hold up request processing.  A
+ * buffer's mutex is contended only by the flusher, for the length of the swap.
+ *
+ * If a message does not fit in the thread's buffer, it is either dropped and
+ * counted (async_overflow = drop) or the thread waits for the flusher to empty
+ * the buffer (async_overflow = block, the default).
+ */
+
+#include <signal.h>
+
+/* Each buffered message is a record header followed by the formatted message
+ * and its terminating null. */
+struct log_record {
+    int priority;
+    size_t len;
+    size_t msgoff;
+};
+
+struct log_buffer {
+    struct log_buffer *next;
+    pthread_mutex_t lock;
+    pthread_cond_t drained;
+    char *data;
+    size_t len;
+    unsigned long dropped;
+};
+
+static struct {
+    krb5_boolean running;
+    krb5_boolean stop;
+    krb5_boolean wakeup;
+    pid_t pid;
+    pthread_t thread;
+    pthread_key_t key;
+    /* Protects buffers, stop, and wakeup.  Buffers are unlinked only while
+     * log_lock is also held, so a holder of log_lock may walk the list. */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct log_buffer *buffers;
+    /* Messages dropped by threads which have exited; protected by log_lock. */
+    unsigned long dropped;
+    /* Owned by the flusher thread. */
+    char *spare;
+    /* Set if the fork handlers locked lock. */
+    krb5_boolean fork_locked;
+} async;
+
+/* Ask the flusher thread to run now. */
+static void
+async_wakeup(void)
+{
+    pthread_mutex_lock(&async.lock);
+    async.wakeup = TRUE;
+    pthread_cond_signal(&async.cond);
+    pthread_mutex_unlock(&async.lock);
+}
+
+/* Return the calling thread's log buffer, creating it if necessary. */
+static struct log_buffer *
+get_buffer(void)
+{
+    struct log_buffer *buf;
+
+    buf = pthread_getspecific(async.key);
+    if (buf != NULL)
+        return buf;
+    buf = calloc(1, sizeof(*buf));
+    if (buf == NULL)
+        return NULL;
+    buf->data = malloc(log_control.log_async_bufsize);
+    if (buf->data == NULL) {
+        free(buf);
+        return NULL;
+    }
+    pthread_mutex_init(&buf->lock, NULL);
+    pthread_cond_init(&buf->drained, NULL);
+    if (pthread_setspecific(async.key, buf) != 0) {
+        pthread_cond_destroy(&buf->drained);
+        pthread_mutex_destroy(&buf->lock);
+        free(buf->data);
+        free(buf);
+        return NULL;
+    }
+    pthread_mutex_lock(&async.lock);
+    buf->next = async.buffers;
+    async.buffers = buf;
+    pthread_mutex_unlock(&async.lock);
+    return buf;
+}
+
+/*
+ * Append a formatted message to the calling thread's buffer.  Return true if
+ * the message was buffered or dropped, or false if the caller should write it
+ * out directly.
+ */
+static krb5_boolean
+async_log(int priority, const char *outbuf, const char *syslogp)
+{
+    struct log_buffer *buf;
+    struct log_record rec;
+    size_t need, bufsize = log_control.log_async_bufsize;
+    krb5_boolean wake;
+
+    /* The flusher writes its own messages directly, as does a child process
+     * (which has no flusher thread). */
+    if (!async.running || pthread_equal(pthread_self(), async.thread) ||
+        getpid() != async.pid)
+        return FALSE;
+    buf = get_buffer();
+    if (buf == NULL)
+        return FALSE;
+
+    rec.priority = priority;
+    rec.len = strlen(outbuf) + 1;
+    rec.msgoff = syslogp - outbuf;
+    need = sizeof(rec) + rec.len;
+
+    pthread_mutex_lock(&buf->lock);
+    if (need > bufsize) {
+        /* This message can never fit in the buffer. */
+        if (!log_control.log_async_drop) {
+            pthread_mutex_unlock(&buf->lock);
+            return FALSE;
+        }
+        buf->dropped++;
+        pthread_mutex_unlock(&buf->lock);
+        return TRUE;
+    }
+    if (buf->len + need > bufsize) {
+        if (log_control.log_async_drop) {
+            buf->dropped++;
+            pthread_mutex_unlock(&buf->lock);
+            return TRUE;
+        }
+        pthread_mutex_unlock(&buf->lock);
+        async_wakeup();
+        pthread_mutex_lock(&buf->lock);
+        while (buf->len + need > bufsize)
+            pthread_cond_wait(&buf->drained, &buf->lock);
+    }
+    memcpy(buf->data + buf->len, &rec, sizeof(rec));
+    memcpy(buf->data + buf->len + sizeof(rec), outbuf, rec.len);
+    wake = (buf->len < bufsize / 2 && buf->len + need >= bufsize / 2);
+    buf->len += need;
+    pthread_mutex_unlock(&buf->lock);
+
+    if (wake)
+        async_wakeup();
+    return TRUE;
+}
+
+/* Write out len bytes of buffered records from data.  The caller must hold
+ * log_lock. */
+static void
+write_records(const char *data, size_t len)
+{
+    struct log_record rec;
+    size_t off;
+
+    for (off = 0; off < len; off += sizeof(rec) + rec.len) {
+        memcpy(&rec, data + off, sizeof(rec));
+        write_entries(rec.priority, data + off + sizeof(rec),
+                      data + off + sizeof(rec) + rec.msgoff, FALSE);
+    }
+}
+
+/* Flush the output streams of file log entries.  The caller must hold
+ * log_lock. */
+static void
+flush_files(void)
+{
+    int lindex;
+
+    for (lindex = 0; lindex < log_control.log_nentries; lindex++) {
+        if (log_control.log_entries[lindex].log_type == K_LOG_FILE ||
+            log_control.log_entries[lindex].log_type == K_LOG_STDERR)
+            fflush(log_control.log_entries[lindex].lfu_filep);
+    }
+}
+
+/* Write out and empty each thread's buffer. */
+static void
+flush_buffers(void)
+{
+    struct log_buffer *head, *buf;
+    char *data;
+    size_t len;
+    unsigned long dropped;
+
+    k5_mutex_lock(&log_lock);
+    pthread_mutex_lock(&async.lock);
+    head = async.buffers;
+    pthread_mutex_unlock(&async.lock);
+    dropped = async.dropped;
+    async.dropped = 0;
+    for (buf = head; buf != NULL; buf = buf->next) {
+        pthread_mutex_lock(&buf->lock);
+        data = buf->data;
+        len = buf->len;
+        buf->data = async.spare;
+        buf->len = 0;
+        dropped += buf->dropped;
+        buf->dropped = 0;
+        pthread_cond_broadcast(&buf->drained);
+        pthread_mutex_unlock(&buf->lock);
+
+        write_records(data, len);
+        async.spare = data;
+    }
+    flush_files();
+    k5_mutex_unlock(&log_lock);
+
+    if (dropped > 0) {
+        krb5_klog_syslog(LOG_WARNING, _("%lu log messages were dropped "
+                                        "because the log buffer was full"),
+                         dropped);
+    }
+}
+
+/*
+ * Destructor for async.key: write out and free the buffer of an exiting
+ * thread.  In a forked child the buffer holds the parent's messages, so it is
+ * left alone.
+ */
+static void
+free_buffer(void *ptr)
+{
+    struct log_buffer *buf = ptr, **bp;
+
+    if (getpid() != async.pid)
+        return;
+    k5_mutex_lock(&log_lock);
+    pthread_mutex_lock(&async.lock);
+    for (bp = &async.buffers; *bp != NULL; bp = &(*bp)->next) {
+        if (*bp == buf) {
+            *bp = buf->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&async.lock);
+    write_records(buf->data, buf->len);
+    flush_files();
+    async.dropped += buf->dropped;
+    k5_mutex_unlock(&log_lock);
+
+    pthread_cond_destroy(&buf->drained);
+    pthread_mutex_destroy(&buf->lock);
+    free(buf->data);
+    free(buf);
+}
+
+/*
+ * Fork handlers.  Hold log_lock and the buffer list lock across fork() so
+ * that the child (such as kadmind's full resync child) does not inherit them
+ * locked by the flusher or another thread.  The forking thread owns both locks
+ * in the parent and in the child, so both release them.
+ */
+static void
+fork_prepare(void)
+{
+    k5_mutex_lock(&log_lock);
+    async.fork_locked = async.running;
+    if (async.fork_locked)
+        pthread_mutex_lock(&async.lock);
+}
+
+static void
+fork_release(void)
+{
+    if (async.fork_locked)
+        pthread_mutex_unlock(&async.lock);
+    async.fork_locked = FALSE;
+    k5_mutex_unlock(&log_lock);
+}
+
+static void *
+flusher_main(void *arg)
+{
+    struct timespec deadline;
+    krb5_boolean stop = FALSE;
+
+    while (!stop) {
+        pthread_mutex_lock(&async.lock);
+        if (!async.wakeup && !async.stop) {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec++;
+            pthread_cond_timedwait(&async.cond, &async.lock, &deadline);
+        }
+        async.wakeup = FALSE;
+        stop = async.stop;
+        pthread_mutex_unlock(&async.lock);
+
+        flush_buffers();
+    }
+    return NULL;
+}
+
+/* Stop the flusher thread, writing out any buffered messages. */
+static void
+async_stop(void)
+{
+    struct log_buffer *buf, *next;
+
+    if (!async.running || getpid() != async.pid)
+        return;
+    pthread_mutex_lock(&async.lock);
+    async.stop = TRUE;
+    pthread_cond_signal(&async.cond);
+    pthread_mutex_unlock(&async.lock);
+    pthread_join(async.thread, NULL);
+    async.running = FALSE;
+
+    /* Delete the key first so that no exiting thread's destructor runs on a
+     * buffer freed here. */
+    pthread_key_delete(async.key);
+    for (buf = async.buffers; buf != NULL; buf = next) {
+        next = buf->next;
+        pthread_cond_destroy(&buf->drained);
+        pthread_mutex_destroy(&buf->lock);
+        free(buf->data);
+        free(buf);
+    }
+    async.buffers = NULL;
+    free(async.spare);
+    async.spare = NULL;
+    pthread_cond_destroy(&async.cond);
+    pthread_mutex_destroy(&async.lock);
+}
+
+krb5_error_code
+krb5_klog_start_async(krb5_context kcontext)
+{
+    static krb5_boolean atfork_registered;
+    sigset_t all, old;
+    int ret;
+
+    if (!log_control.log_async || async.running)
+        return 0;
+
+    if (!atfork_registered) {
+        ret = pthread_atfork(fork_prepare, fork_release, fork_release);
+        if (ret)
+            return ret;
+        atfork_registered = TRUE;
+    }
+
+    async.spare = malloc(log_control.log_async_bufsize);
+    if (async.spare == NULL)
+        return ENOMEM;
+    ret = pthread_key_create(&async.key, free_buffer);
+    if (ret) {
+        free(async.spare);
+        async.spare = NULL;
+        return ret;
+    }
+    pthread_mutex_init(&async.lock, NULL);
+    pthread_cond_init(&async.cond, NULL);
+    async.stop = async.wakeup = FALSE;
+    async.pid = getpid();
+
+    /* Leave signal handling to the daemon's main thread. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    ret = pthread_create(&async.thread, NULL, flusher_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret) {
+        pthread_cond_destroy(&async.cond);
+        pthread_mutex_destroy(&async.lock);
+        pthread_key_delete(async.key);
+        free(async.spare);
+        async.spare = NULL;
+        return ret;
+    }
+    async.running = TRUE;
+    return 0;
+}
+
+#else /* !ENABLE_THREADS */
+
+static krb5_boolean
+async_log(int priority, const char *outbuf, const char *syslogp)
+{
+    return FALSE;
+}
+
+static void
+async_stop(void)
+{
+}
+
+krb5_error_code
+krb5_klog_start_async(krb5_context kcontext)
+{
+    return log_control.log_async ? ENOTSUP : 0;
+}
+
+#endif /* !ENABLE_THREADS */
+
 /*
  * krb5_klog_syslog()   - Simulate the calling sequence of syslog(3), while
  *                        also performing the logging redirection as specified
@@ -767,12 +1283,12 @@ static int
 klog_vsyslog(int priority, const char *format, va_list arglist)
 {
     char        outbuf[KRB5_KLOG_MAX_ERRMSG_SIZE];
-    int         lindex;
     char        *syslogp;
     char        *cp;
     time_t      now;
 #ifdef  HAVE_STRFTIME
     size_t      soff;
+    struct tm   tmbuf, *tm;
 #endif  /* HAVE_STRFTIME */
 
     /*
@@ -790,7 +1306,12 @@ klog_vsyslog(int priority, const char *format, va_list arglist)
     /*
      * Format the date: mon dd hh:mm:ss
      */
-    soff = strftime(outbuf, sizeof(outbuf), "%b %d %H:%M:%S", localtime(&now));
+#ifdef HAVE_LOCALTIME_R
+    tm = localtime_r(&now, &tmbuf);
+#else
+    tm = localtime(&now);
+#endif
+    soff = strftime(outbuf, sizeof(outbuf), "%b %d %H:%M:%S", tm);
     if (soff > 0)
         cp += soff;
     else
@@ -828,57 +1349,17 @@ klog_vsyslog(int priority, const char *format, va_list arglist)
         syslog(priority, "%s", syslogp);
     }
 
+    /* Hand the message to the flusher thread if buffering is active. */
+    if (async_log(priority, outbuf, syslogp))
+        return(0);
+
     /*
      * Now that we have the message formatted, perform the output to each
      * logging specification.
      */
-    for (lindex = 0; lindex < log_control.log_nentries; lindex++) {
-        /* Omit LOG_DEBUG messages for non-syslog outputs unless we are
-         * configured to include them. */
-        if (priority == LOG_DEBUG && !log_control.log_debug &&
-            log_control.log_entries[lindex].log_type != K_LOG_SYSLOG)
-            continue;
-
-        switch (log_control.log_entries[lindex].log_type) {
-        case K_LOG_FILE:
-        case K_LOG_STDERR:
-            /*
-             * Files/standard error.
-             */
-            if (fprintf(log_control.log_entries[lindex].lfu_filep, "%s\n",
-                        outbuf) < 0) {
-                /* Attempt to report error */
-                fprintf(stderr, log_file_err, log_control.log_whoami,
-                        log_control.log_entries[lindex].lfu_fname);
-            }
-            else {
-                fflush(log_control.log_entries[lindex].lfu_filep);
-            }
-            break;
-        case K_LOG_CONSOLE:
-        case K_LOG_DEVICE:
-            /*
-             * Devices (may need special handling)
-             */
-            if (DEVICE_PRINT(log_control.log_entries[lindex].ldu_filep,
-                             outbuf) < 0) {
-                /* Attempt to report error */
-                fprintf(stderr, log_device_err, log_control.log_whoami,
-                        log_control.log_entries[lindex].ldu_devname);
-            }
-            break;
-        case K_LOG_SYSLOG:
-            /*
-             * System log.
-             */
-
-            /* Log the message with our header trimmed off */
-            syslog(priority, "%s", syslogp);
-            break;
-        default:
-            break;
-        }
-    }
+    k5_mutex_lock(&log_lock);
+    write_entries(priority, outbuf, syslogp, TRUE);
+    k5_mutex_unlock(&log_lock);
     return(0);
 }
 
@@ -911,6 +1392,7 @@ krb5_klog_reopen(krb5_context kcontext)
      * Only logs which are actually files need to be closed
      * and reopened in response to a SIGHUP
      */
+    k5_mutex_lock(&log_lock);
     for (lindex = 0; lindex < log_control.log_nentries; lindex++) {
         if (log_control.log_entries[lindex].log_type == K_LOG_FILE) {
             fclose(log_control.log_entries[lindex].lfu_filep);
@@ -929,4 +1411,5 @@ krb5_klog_reopen(krb5_context kcontext)
             }
         }
     }
+    k5_mutex_unlock(&log_lock);
 }
@@ -588,6 +588,35 @@ kadm5int_acl_match_data(const krb5_data *e1, const krb5_data *e2,
     return(retval);
 }
 
+/*
+ * kadm5int_acl_parse_names()   - Parse the principal and target names of all
+ *                                entries, so that lookups (which may happen
+ *                                on several threads at once) do not modify
+ *                                the list.
+ */
+static void
+kadm5int_acl_parse_names(krb5_context kcontext)
+{
+    aent_t              *entry;
+
+    for (entry = acl_list_head; entry; entry = entry->ae_next) {
+        if (strcmp(entry->ae_name, "*") &&
+            krb5_parse_name(kcontext, entry->ae_name, &entry->ae_principal)) {
+            DPRINT(DEBUG_ACL, acl_debug_level,
+                   ("Bad ACL entry %s\n", entry->ae_name));
+            entry->ae_name_bad = 1;
+        }
+        if (entry->ae_target && strcmp(entry->ae_target, "*") &&
+            krb5_parse_name(kcontext, entry->ae_target,
+                            &entry->ae_target_princ)) {
+            DPRINT(DEBUG_ACL, acl_debug_level,
+                   ("Bad target in ACL entry for %s\n", entry->ae_name));
+            entry->ae_target_bad = 1;
+            entry->ae_name_bad = 1;
+        }
+    }
+}
+
 /*
  * kadm5int_acl_find_entry()    - Find a matching entry.
  */
@@ -596,7 +625,6 @@ kadm5int_acl_find_entry(krb5_context kcontext, krb5_const_principal principal,
                         krb5_const_principal dest_princ)
 {
     aent_t              *entry;
-    krb5_error_code     kret;
     int                 i;
     int                 matchgood;
     wildstate_t         state;
@@ -611,18 +639,6 @@ kadm5int_acl_find_entry(krb5_context kcontext, krb5_const_principal principal,
             matchgood = 1;
         }
         else {
-            if (!entry->ae_principal && !entry->ae_name_bad) {
-                kret = krb5_parse_name(kcontext,
-                                       entry->ae_name,
-                                       &entry->ae_principal);
-                if (kret)
-                    entry->ae_name_bad = 1;
-            }
-            if (entry->ae_name_bad) {
-                DPRINT(DEBUG_ACL, acl_debug_level,
-                       ("Bad ACL entry %s\n", entry->ae_name));
-                continue;
-            }
             matchgood = 0;
             if (kadm5int_acl_match_data(&entry->ae_principal->realm,
                                         &principal->realm, 0, (wildstate_t *)0) &&
@@ -642,18 +658,6 @@ kadm5int_acl_find_entry(krb5_context kcontext, krb5_const_principal principal,
 
         /* We've matched the principal.  If we have a target, then try it */
         if (entry->ae_target && strcmp(entry->ae_target, "*")) {
-            if (!entry->ae_target_princ && !entry->ae_target_bad) {
-                kret = krb5_parse_name(kcontext, entry->ae_target,
-                                       &entry->ae_target_princ);
-                if (kret)
-                    entry->ae_target_bad = 1;
-            }
-            if (entry->ae_target_bad) {
-                DPRINT(DEBUG_ACL, acl_debug_level,
-                       ("Bad target in ACL entry for %s\n", entry->ae_name));
-                entry->ae_name_bad = 1;
-                continue;
-            }
             if (!dest_princ)
                 matchgood = 0;
             else if (entry->ae_target_princ && dest_princ) {
@@ -712,6 +716,7 @@ kadm5int_acl_init(kcontext, debug_level, acl_file)
             ((acl_file) ? acl_file : "(null)")));
     acl_acl_file = (acl_file) ? acl_file : (char *) KRB5_DEFAULT_ADMIN_ACL;
     acl_inited = kadm5int_acl_load_acl_file();
+    kadm5int_acl_parse_names(kcontext);
 
     DPRINT(DEBUG_CALLS, acl_debug_level, ("X kadm5int_acl_init() = %d\n", kret));
     return(kret);
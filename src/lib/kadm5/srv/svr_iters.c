@@ -26,6 +26,7 @@
 #include        <regex.h>
 #endif
 #include <stdlib.h>
+#include <limits.h>
 
 #include        "server_internal.h"
 
@@ -127,19 +128,61 @@ static kadm5_ret_t glob_to_regexp(char *glob, char *realm, char **regexp)
     return KADM5_OK;
 }
 
-static void get_either_iter(struct iter_data *data, char *name)
+/* Compile the regexp form of the glob exp into data. */
+static kadm5_ret_t compile_exp(struct iter_data *data, char *exp, char *realm)
 {
-    int match;
+#ifdef BSD_REGEXPS
+    char *msg;
+#endif
+    char *regexp = NULL;
+    kadm5_ret_t ret;
+
+    if ((ret = glob_to_regexp(exp, realm, &regexp)) != KADM5_OK)
+        return ret;
+
+    if (
 #ifdef SOLARIS_REGEXPS
-    match = (step(name, data->expbuf) != 0);
+        ((data->expbuf = compile(regexp, NULL, NULL)) == NULL)
 #endif
 #ifdef POSIX_REGEXPS
-    match = (regexec(&data->preg, name, 0, NULL, 0) == 0);
+        ((regcomp(&data->preg, regexp, REG_NOSUB)) != 0)
 #endif
 #ifdef BSD_REGEXPS
-    match = (re_exec(name) != 0);
+        ((msg = (char *) re_comp(regexp)) != NULL)
 #endif
-    if (match) {
+    )
+    {
+        /* XXX syslog msg or regerr(regerrno) */
+        free(regexp);
+        return EINVAL;
+    }
+    free(regexp);
+    return KADM5_OK;
+}
+
+static void free_exp(struct iter_data *data)
+{
+#ifdef POSIX_REGEXPS
+    regfree(&data->preg);
+#endif
+}
+
+static int match_exp(struct iter_data *data, const char *name)
+{
+#ifdef SOLARIS_REGEXPS
+    return (step((char *)name, data->expbuf) != 0);
+#endif
+#ifdef POSIX_REGEXPS
+    return (regexec(&data->preg, name, 0, NULL, 0) == 0);
+#endif
+#ifdef BSD_REGEXPS
+    return (re_exec((char *)name) != 0);
+#endif
+}
+
+static void get_either_iter(struct iter_data *data, char *name)
+{
+    if (match_exp(data, name)) {
         if (data->n_names == data->sz_names) {
             int new_sz = data->sz_names * 2;
             char **new_names = realloc(data->names,
@@ -184,10 +227,6 @@ static kadm5_ret_t kadm5_get_either(int princ,
                                     int *count)
 {
     struct iter_data data;
-#ifdef BSD_REGEXPS
-    char *msg;
-#endif
-    char *regexp = NULL;
     int i, ret;
     kadm5_server_handle_t handle = server_handle;
 
@@ -198,33 +237,16 @@ static kadm5_ret_t kadm5_get_either(int princ,
 
     CHECK_HANDLE(server_handle);
 
-    if ((ret = glob_to_regexp(exp, princ ? handle->params.realm : NULL,
-                              &regexp)) != KADM5_OK)
+    ret = compile_exp(&data, exp, princ ? handle->params.realm : NULL);
+    if (ret)
         return ret;
 
-    if (
-#ifdef SOLARIS_REGEXPS
-        ((data.expbuf = compile(regexp, NULL, NULL)) == NULL)
-#endif
-#ifdef POSIX_REGEXPS
-        ((regcomp(&data.preg, regexp, REG_NOSUB)) != 0)
-#endif
-#ifdef BSD_REGEXPS
-        ((msg = (char *) re_comp(regexp)) != NULL)
-#endif
-    )
-    {
-        /* XXX syslog msg or regerr(regerrno) */
-        free(regexp);
-        return EINVAL;
-    }
-
     data.n_names = 0;
     data.sz_names = 10;
     data.malloc_failed = 0;
     data.names = malloc(sizeof(char *) * data.sz_names);
     if (data.names == NULL) {
-        free(regexp);
+        free_exp(&data);
         return ENOMEM;
     }
 
@@ -235,10 +257,7 @@ static kadm5_ret_t kadm5_get_either(int princ,
         ret = krb5_db_iter_policy(handle->context, exp, get_pols_iter, (void *)&data);
     }
 
-    free(regexp);
-#ifdef POSIX_REGEXPS
-    regfree(&data.preg);
-#endif
+    free_exp(&data);
     if ( !ret && data.malloc_failed)
         ret = ENOMEM;
     if ( ret ) {
@@ -268,3 +287,170 @@ kadm5_ret_t kadm5_get_policies(void *server_handle,
 {
     return kadm5_get_either(0, server_handle, exp, pols, count);
 }
+
+/* State for kadm5_get_principals_page().  id.names is kept sorted and holds
+ * at most limit names; one more than the page size is collected so that the
+ * caller can be told whether further names remain. */
+struct page_data {
+    struct iter_data id;
+    char *start;
+    char *prefix;
+    size_t prefixlen;
+    int limit;
+    krb5_boolean ordered;
+};
+
+/* Callback return value used to end an ordered walk early. */
+#define PAGE_DONE (-1)
+
+static krb5_error_code get_page_iter(krb5_pointer ptr, krb5_db_entry *entry)
+{
+    struct page_data *pd = ptr;
+    struct iter_data *id = &pd->id;
+    krb5_error_code ret;
+    char *name, **new_names;
+    int lo, hi, mid, new_sz;
+
+    ret = krb5_unparse_name(id->context, entry->princ, &name);
+    if (ret)
+        return ret;
+
+    if (pd->start != NULL && strcmp(name, pd->start) <= 0) {
+        free(name);
+        return 0;
+    }
+
+    /* An ordered walk begins at or after the literal prefix of the glob, so
+     * the first name without that prefix follows every name with it. */
+    if (strncmp(name, pd->prefix, pd->prefixlen) != 0) {
+        free(name);
+        return pd->ordered ? PAGE_DONE : 0;
+    }
+
+    if (!match_exp(id, name)) {
+        free(name);
+        return 0;
+    }
+
+    /* Find the insertion point; for an ordered walk this is the end. */
+    lo = 0;
+    hi = id->n_names;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (strcmp(id->names[mid], name) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (id->n_names == pd->limit) {
+        /* Keep only the limit smallest names seen so far. */
+        if (lo == pd->limit) {
+            free(name);
+            return 0;
+        }
+        free(id->names[--id->n_names]);
+    } else if (id->n_names == id->sz_names) {
+        new_sz = (id->sz_names > pd->limit / 2) ? pd->limit :
+            id->sz_names * 2;
+        new_names = realloc(id->names, new_sz * sizeof(char *));
+        if (new_names == NULL) {
+            free(name);
+            return ENOMEM;
+        }
+        id->names = new_names;
+        id->sz_names = new_sz;
+    }
+
+    memmove(&id->names[lo + 1], &id->names[lo],
+            (id->n_names - lo) * sizeof(char *));
+    id->names[lo] = name;
+    id->n_names++;
+
+    return (pd->ordered && id->n_names == pd->limit) ? PAGE_DONE : 0;
+}
+
+kadm5_ret_t kadm5_get_principals_page(void *server_handle,
+                                      char *exp,
+                                      char *start,
+                                      int max,
+                                      char ***princs,
+                                      int *count,
+                                      krb5_boolean *more)
+{
+    struct page_data pd;
+    char *from = NULL;
+    int i, ret;
+    kadm5_server_handle_t handle = server_handle;
+
+    *princs = NULL;
+    *count = 0;
+    *more = FALSE;
+    if (exp == NULL)
+        exp = "*";
+
+    CHECK_HANDLE(server_handle);
+
+    if (max <= 0)
+        return EINVAL;
+
+    memset(&pd, 0, sizeof(pd));
+    pd.start = start;
+    pd.prefix = exp;
+    pd.prefixlen = strcspn(exp, "?*[\\");
+    pd.limit = (max < INT_MAX) ? max + 1 : max;
+    pd.ordered = TRUE;
+    pd.id.context = handle->context;
+    pd.id.sz_names = (pd.limit < 64) ? pd.limit : 64;
+    pd.id.names = malloc(sizeof(char *) * pd.id.sz_names);
+    if (pd.id.names == NULL)
+        return ENOMEM;
+
+    /* Begin the walk at the literal prefix of the glob if it sorts after the
+     * resume point. */
+    if (pd.prefixlen > 0 &&
+        (start == NULL || strncmp(start, exp, pd.prefixlen) < 0)) {
+        from = malloc(pd.prefixlen + 1);
+        if (from == NULL) {
+            free(pd.id.names);
+            return ENOMEM;
+        }
+        memcpy(from, exp, pd.prefixlen);
+        from[pd.prefixlen] = '\0';
+    }
+
+    ret = compile_exp(&pd.id, exp, handle->params.realm);
+    if (ret) {
+        free(from);
+        free(pd.id.names);
+        return ret;
+    }
+
+    ret = krb5_db_iterate_from(handle->context, from != NULL ? from : start,
+                               get_page_iter, &pd);
+    if (ret == KRB5_PLUGIN_OP_NOTSUPP) {
+        /* The module cannot walk in order, so look at every principal and
+         * keep the smallest matching names. */
+        pd.ordered = FALSE;
+        ret = krb5_db_iterate(handle->context, exp, get_page_iter, &pd, 0);
+    }
+    if (ret == PAGE_DONE)
+        ret = 0;
+
+    free_exp(&pd.id);
+    free(from);
+    if (ret) {
+        for (i = 0; i < pd.id.n_names; i++)
+            free(pd.id.names[i]);
+        free(pd.id.names);
+        return ret;
+    }
+
+    if (pd.id.n_names > max) {
+        free(pd.id.names[--pd.id.n_names]);
+        *more = TRUE;
+    }
+    *princs = pd.id.names;
+    *count = pd.id.n_names;
+    return KADM5_OK;
+}
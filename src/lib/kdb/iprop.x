@@ -239,5 +239,13 @@ program KRB5_IPROP_PROG {
 		 */
 		kdb_fullresync_result_t
 		IPROP_FULL_RESYNC_EXT(uint32_t) = 3;
+
+		/*
+		 * Like IPROP_GET_UPDATES, but if the caller is up to date,
+		 * wait until there are updates (or until a timeout passes,
+		 * returning UPDATE_NIL) before replying.
+		 */
+		kdb_incr_result_t
+		IPROP_GET_UPDATES_WAIT(kdb_last_t) = 4;
 	} = 1;
 } = 100423;
@@ -329,6 +329,21 @@ copy_vtable(const kdb_vftabl *in, kdb_vftabl *out)
     if (in->min_ver >= 1)
         out->free_principal_e_data = in->free_principal_e_data;
 
+    /* Copy fields for minor version 2 (major version 6). */
+    out->iterate_from = NULL;
+    if (in->min_ver >= 2)
+        out->iterate_from = in->iterate_from;
+
+    /* Copy fields for minor version 3 (major version 6). */
+    out->get_stat = NULL;
+    if (in->min_ver >= 3)
+        out->get_stat = in->get_stat;
+
+    /* Copy fields for minor version 4 (major version 6). */
+    out->flush_buffered = NULL;
+    if (in->min_ver >= 4)
+        out->flush_buffered = in->flush_buffered;
+
     /* Set defaults for optional fields. */
     if (out->fetch_master_key == NULL)
         out->fetch_master_key = krb5_db_def_fetch_mkey;
@@ -845,6 +860,92 @@ krb5_db_free_principal(krb5_context kcontext, krb5_db_entry *entry)
     free(entry);
 }
 
+/* Make a deep copy of a DB entry, including its e_data if the module leaves
+ * that as a flat buffer. */
+krb5_error_code
+krb5_db_copy_principal(krb5_context kcontext, const krb5_db_entry *in,
+                       krb5_db_entry **out)
+{
+    krb5_error_code ret;
+    kdb_vftabl *v;
+    krb5_db_entry *entry;
+    krb5_tl_data *tl, **tlp;
+    krb5_key_data *kd;
+    int i, j;
+
+    *out = NULL;
+
+    /* We don't know how to copy module-specific e_data structures. */
+    if (in->e_data != NULL && get_vftabl(kcontext, &v) == 0 &&
+        v->free_principal_e_data != NULL)
+        return KRB5_PLUGIN_OP_NOTSUPP;
+
+    entry = k5alloc(sizeof(*entry), &ret);
+    if (entry == NULL)
+        return ret;
+    *entry = *in;
+    entry->e_data = NULL;
+    entry->princ = NULL;
+    entry->tl_data = NULL;
+    entry->key_data = NULL;
+    entry->n_key_data = 0;
+
+    if (in->e_data != NULL) {
+        entry->e_data = k5memdup(in->e_data, in->e_length, &ret);
+        if (entry->e_data == NULL)
+            goto cleanup;
+    }
+
+    ret = krb5_copy_principal(kcontext, in->princ, &entry->princ);
+    if (ret)
+        goto cleanup;
+
+    tlp = &entry->tl_data;
+    for (tl = in->tl_data; tl != NULL; tl = tl->tl_data_next) {
+        *tlp = k5alloc(sizeof(**tlp), &ret);
+        if (*tlp == NULL)
+            goto cleanup;
+        (*tlp)->tl_data_type = tl->tl_data_type;
+        (*tlp)->tl_data_length = tl->tl_data_length;
+        if (tl->tl_data_length > 0) {
+            (*tlp)->tl_data_contents = k5memdup(tl->tl_data_contents,
+                                                tl->tl_data_length, &ret);
+            if ((*tlp)->tl_data_contents == NULL)
+                goto cleanup;
+        }
+        tlp = &(*tlp)->tl_data_next;
+    }
+
+    if (in->n_key_data > 0) {
+        entry->key_data = k5calloc(in->n_key_data, sizeof(*entry->key_data),
+                                   &ret);
+        if (entry->key_data == NULL)
+            goto cleanup;
+        for (i = 0; i < in->n_key_data; i++) {
+            kd = &entry->key_data[i];
+            *kd = in->key_data[i];
+            kd->key_data_contents[0] = kd->key_data_contents[1] = NULL;
+            entry->n_key_data++;
+            for (j = 0; j < (kd->key_data_ver == 1 ? 1 : 2); j++) {
+                if (in->key_data[i].key_data_contents[j] == NULL)
+                    continue;
+                kd->key_data_contents[j] =
+                    k5memdup(in->key_data[i].key_data_contents[j],
+                             kd->key_data_length[j], &ret);
+                if (kd->key_data_contents[j] == NULL)
+                    goto cleanup;
+            }
+        }
+    }
+
+    *out = entry;
+    entry = NULL;
+
+cleanup:
+    krb5_db_free_principal(kcontext, entry);
+    return ret;
+}
+
 static void
 free_db_args(char **db_args)
 {
@@ -1092,6 +1193,56 @@ krb5_db_iterate(krb5_context kcontext, char *match_entry,
                       &proxy_args, iterflags);
 }
 
+krb5_error_code
+krb5_db_iterate_from(krb5_context kcontext, const char *start,
+                     int (*func)(krb5_pointer, krb5_db_entry *),
+                     krb5_pointer func_arg)
+{
+    krb5_error_code status = 0;
+    kdb_vftabl *v;
+    struct callback_proxy_args proxy_args;
+
+    status = get_vftabl(kcontext, &v);
+    if (status)
+        return status;
+    if (v->iterate_from == NULL)
+        return KRB5_PLUGIN_OP_NOTSUPP;
+
+    proxy_args.func = func;
+    proxy_args.func_arg = func_arg;
+    return v->iterate_from(kcontext, start, sort_entry_callback_proxy,
+                           &proxy_args);
+}
+
+krb5_error_code
+krb5_db_get_stat(krb5_context kcontext, const char *name, uint64_t *value_out)
+{
+    krb5_error_code status = 0;
+    kdb_vftabl *v;
+
+    *value_out = 0;
+    status = get_vftabl(kcontext, &v);
+    if (status)
+        return status;
+    if (v->get_stat == NULL)
+        return KRB5_PLUGIN_OP_NOTSUPP;
+    return v->get_stat(kcontext, name, value_out);
+}
+
+krb5_error_code
+krb5_db_flush_buffered(krb5_context kcontext)
+{
+    krb5_error_code status = 0;
+    kdb_vftabl *v;
+
+    status = get_vftabl(kcontext, &v);
+    if (status)
+        return status;
+    if (v->flush_buffered == NULL)
+        return KRB5_PLUGIN_OP_NOTSUPP;
+    return v->flush_buffered(kcontext);
+}
+
 /* Return a read only pointer alias to mkey list.  Do not free this! */
 krb5_keylist_node *
 krb5_db_mkey_list_alias(krb5_context kcontext)
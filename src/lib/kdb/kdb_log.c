@@ -86,6 +86,59 @@ sync_header(kdb_hlog_t *ulog)
     }
 }
 
+/* Sync every update entry to disk.  Used to commit a group of updates, which
+ * may have been written anywhere in the circular log. */
+static void
+sync_all_updates(kdb_log_context *log_ctx)
+{
+    kdb_hlog_t *ulog = log_ctx->ulog;
+    unsigned long start, end;
+
+    if (!pagesize)
+        pagesize = getpagesize();
+
+    start = (unsigned long)INDEX(ulog, 0) & ~(pagesize - 1);
+    end = ((unsigned long)INDEX(ulog, log_ctx->ulogentries) +
+           (pagesize - 1)) & ~(pagesize - 1);
+    if (msync((caddr_t)start, end - start, MS_SYNC)) {
+        /* Couldn't sync to disk, let's panic. */
+        syslog(LOG_ERR, _("could not sync ulog update to disk"));
+        abort();
+    }
+}
+
+/* Return the number of milliseconds elapsed since t, or 0 if t is in the
+ * future. */
+static unsigned long
+ms_since(const kdbe_time_t *t)
+{
+    kdbe_time_t now;
+    long ms;
+
+    time_current(&now);
+    ms = ((long)now.seconds - (long)t->seconds) * 1000 +
+        ((long)now.useconds - (long)t->useconds) / 1000;
+    return (ms > 0) ? ms : 0;
+}
+
+/*
+ * Make the updates of a pending group commit durable.  The header stays
+ * marked unstable on disk while a group is pending, so a crash before this
+ * point causes the ulog to be reset rather than used with missing entries.
+ */
+static void
+commit_pending(kdb_log_context *log_ctx)
+{
+    kdb_hlog_t *ulog = log_ctx->ulog;
+
+    if (log_ctx->npending == 0)
+        return;
+    sync_all_updates(log_ctx);
+    ulog->kdb_state = KDB_STABLE;
+    sync_header(ulog);
+    log_ctx->npending = 0;
+}
+
 /* Return true if the ulog entry for sno matches sno and timestamp. */
 static krb5_boolean
 check_sno(kdb_log_context *log_ctx, kdb_sno_t sno,
@@ -230,6 +283,7 @@ reset_ulog(kdb_log_context *log_ctx)
     ulog->kdb_hmagic = KDB_ULOG_HDR_MAGIC;
     ulog->db_version_num = KDB_VERSION;
     ulog->kdb_block = ULOG_BLOCK;
+    log_ctx->npending = 0;
 
     /* Create a dummy entry to remember the timestamp for downstreams. */
     time_current(&kdb_time);
@@ -238,6 +292,20 @@ reset_ulog(kdb_log_context *log_ctx)
     sync_header(ulog);
 }
 
+/*
+ * If the header is unstable but this context has no group commit pending, an
+ * update or group commit by some process never completed (typically kadmind
+ * died with a group pending), and entries up to kdb_last_sno may not be on
+ * disk.  Reinitialize the ulog rather than reuse their serial numbers;
+ * downstreams will do a full resync.  The caller must hold the ulog lock.
+ */
+static void
+reset_if_abandoned(kdb_log_context *log_ctx)
+{
+    if (log_ctx->ulog->kdb_state != KDB_STABLE && log_ctx->npending == 0)
+        reset_ulog(log_ctx);
+}
+
 /*
  * If any database operations will be invoked while the ulog lock is held, the
  * caller must explicitly lock the database before locking the ulog, or
@@ -281,12 +349,22 @@ store_update(kdb_log_context *log_ctx, kdb_incr_update_t *upd)
     recsize = sizeof(kdb_ent_header_t) + upd_size;
 
     if (recsize > ulog->kdb_block) {
+        /* Resizing discards all entries, including any pending ones. */
+        log_ctx->npending = 0;
         retval = resize(ulog, ulogentries, log_ctx->ulogfd, recsize);
         if (retval)
             return retval;
     }
 
+    /* The header can only already be unstable here if this context has a
+     * group pending; callers reset an abandoned unstable ulog first. */
     ulog->kdb_state = KDB_UNSTABLE;
+    if (log_ctx->commit_delay > 0 && log_ctx->npending == 0) {
+        /* Start a new group.  Get the unstable state onto disk before any of
+         * the group's entries. */
+        sync_header(ulog);
+        time_current(&log_ctx->pending_since);
+    }
 
     i = (upd->kdb_entry_sno - 1) % ulogentries;
     indx_log = INDEX(ulog, i);
@@ -304,7 +382,8 @@ store_update(kdb_log_context *log_ctx, kdb_incr_update_t *upd)
         return KRB5_LOG_CONV;
 
     indx_log->kdb_commit = TRUE;
-    sync_update(ulog, indx_log);
+    if (log_ctx->commit_delay == 0)
+        sync_update(ulog, indx_log);
 
     /* Modify the ulog header to reflect the new update. */
     ulog->kdb_last_sno = upd->kdb_entry_sno;
@@ -324,6 +403,16 @@ store_update(kdb_log_context *log_ctx, kdb_incr_update_t *upd)
         ulog->kdb_first_time = indx_log->kdb_time;
     }
 
+    if (log_ctx->commit_delay > 0) {
+        /* Leave the header unstable until the group is committed, either
+         * here once the delay has passed or by ulog_sync(). */
+        log_ctx->npending++;
+        if (log_ctx->npending >= ulogentries ||
+            ms_since(&log_ctx->pending_since) >= log_ctx->commit_delay)
+            commit_pending(log_ctx);
+        return 0;
+    }
+
     ulog->kdb_state = KDB_STABLE;
     sync_header(ulog);
     return 0;
@@ -346,6 +435,7 @@ ulog_add_update(krb5_context context, kdb_incr_update_t *upd)
      * ulog and start over.  Slaves will do a full resync. */
     if (ulog->kdb_last_sno == (kdb_sno_t)-1)
         reset_ulog(log_ctx);
+    reset_if_abandoned(log_ctx);
 
     upd->kdb_entry_sno = ulog->kdb_last_sno + 1;
     time_current(&upd->kdb_time);
@@ -395,6 +485,7 @@ ulog_replay(krb5_context context, kdb_incr_result_t *incr_ret, char **db_args)
          * stored, discard any previous ulog state. */
         if (ulog->kdb_num != 0 && upd->kdb_entry_sno != ulog->kdb_last_sno + 1)
             reset_ulog(log_ctx);
+        reset_if_abandoned(log_ctx);
 
         if (upd->kdb_deleted) {
             dbprincstr = k5memdup0(upd->kdb_princ_name.utf8str_t_val,
@@ -564,10 +655,12 @@ ulog_get_entries(krb5_context context, const kdb_last_t *last,
     if (retval)
         return retval;
 
+    /* Never hand out updates which are not yet durable. */
+    commit_pending(log_ctx);
+
     /* If another process terminated mid-update, reset the ulog and force full
      * resyncs. */
-    if (ulog->kdb_state != KDB_STABLE)
-        reset_ulog(log_ctx);
+    reset_if_abandoned(log_ctx);
 
     ulog_handle->ret = get_sno_status(log_ctx, last);
     if (ulog_handle->ret != UPDATE_OK)
@@ -668,11 +761,49 @@ ulog_set_last(krb5_context context, const kdb_last_t *last)
         return ret;
 
     set_dummy(log_ctx, last->last_sno, &last->last_time);
+    log_ctx->npending = 0;
+    ulog->kdb_state = KDB_STABLE;
     sync_header(ulog);
     unlock_ulog(context);
     return 0;
 }
 
+/*
+ * Set the group commit delay in milliseconds.  If delay_ms is nonzero,
+ * updates are not synced to disk individually; they are committed as a group
+ * once delay_ms has passed since the first of them, or when ulog_sync() is
+ * called.  The caller must call ulog_sync() at least every delay_ms
+ * milliseconds while updates may be pending.
+ */
+void
+ulog_set_commit_delay(krb5_context context, unsigned int delay_ms)
+{
+    kdb_log_context *log_ctx = context->kdblog_context;
+
+    if (log_ctx == NULL)
+        return;
+    if (delay_ms == 0)
+        (void)ulog_sync(context);
+    log_ctx->commit_delay = delay_ms;
+}
+
+/* Commit any pending group of updates to disk. */
+krb5_error_code
+ulog_sync(krb5_context context)
+{
+    krb5_error_code ret;
+    kdb_log_context *log_ctx = context->kdblog_context;
+
+    if (log_ctx == NULL || log_ctx->ulog == NULL || log_ctx->npending == 0)
+        return 0;
+    ret = lock_ulog(context, KRB5_LOCKMODE_EXCLUSIVE);
+    if (ret)
+        return ret;
+    commit_pending(log_ctx);
+    unlock_ulog(context);
+    return 0;
+}
+
 void
 ulog_fini(krb5_context context)
 {
@@ -680,6 +811,7 @@ ulog_fini(krb5_context context)
 
     if (log_ctx == NULL)
         return;
+    (void)ulog_sync(context);
     if (log_ctx->ulog != NULL)
         munmap(log_ctx->ulog, MAXLOGLEN);
     free(log_ctx);
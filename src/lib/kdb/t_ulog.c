@@ -32,24 +32,61 @@
 
 /*
  * This program performs unit tests for the update log functions in kdb_log.c.
- * Right now it contains only a test for issue #7839, checking that
- * ulog_add_update behaves appropriately when the last serial number is
- * reached.
+ * It checks that ulog_add_update behaves appropriately when the last serial
+ * number is reached (issue #7839), that a group commit leaves the header
+ * unstable until ulog_sync() is called, and that a ulog left unstable by a
+ * process which died with a group pending is reinitialized.
  *
  * The test program accepts one argument, which it unlinks and then maps with
  * ulog_map().  This lets us test all of the update log functions except for
  * ulog_replay(), which needs to open and modify a Kerberos database.
  * ulog_replay is adequately exercised by the functional tests in t_iprop.py.
+ *
+ * With the -b count option, the program instead measures how many updates per
+ * second ulog_add_update() can store, with each update synced individually
+ * and with a group commit delay of delay_ms (10 by default).
  */
 
 #include "k5-int.h"
 #include "kdb_log.h"
+#include <sys/mman.h>
 
 /* Use a zeroed context structure to avoid reading the profile.  This works
  * fine for the ulog functions. */
 static struct _krb5_context context_st;
 static krb5_context context = &context_st;
 
+/* Store count empty updates in a fresh ulog at filename using the given group
+ * commit delay, and display the rate. */
+static void
+bench(const char *filename, int count, unsigned int delay_ms)
+{
+    kdb_incr_update_t upd;
+    struct timeval start, end;
+    double secs;
+    int i;
+
+    unlink(filename);
+    if (ulog_map(context, filename, DEF_ULOGENTRIES) != 0)
+        abort();
+    ulog_set_commit_delay(context, delay_ms);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < count; i++) {
+        memset(&upd, 0, sizeof(kdb_incr_update_t));
+        if (ulog_add_update(context, &upd) != 0)
+            abort();
+    }
+    if (ulog_sync(context) != 0)
+        abort();
+    gettimeofday(&end, NULL);
+    ulog_fini(context);
+
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+    printf("commit delay %4ums: %d updates in %.3fs (%.0f updates/sec)\n",
+           delay_ms, count, secs, count / secs);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -58,8 +95,15 @@ main(int argc, char **argv)
     kdb_incr_update_t upd;
     const char *filename;
 
+    if (argc >= 4 && strcmp(argv[1], "-b") == 0) {
+        filename = argv[argc - 1];
+        bench(filename, atoi(argv[2]), 0);
+        bench(filename, atoi(argv[2]), (argc > 4) ? atoi(argv[3]) : 10);
+        return 0;
+    }
     if (argc != 2) {
-        fprintf(stderr, "Usage: %s filename\n", argv[0]);
+        fprintf(stderr, "Usage: %s [-b count [delay_ms]] filename\n",
+                argv[0]);
         exit(1);
     }
     filename = argv[1];
@@ -84,5 +128,52 @@ main(int argc, char **argv)
     assert(ulog->kdb_num == 2);
     assert(ulog->kdb_first_sno == 1);
     assert(ulog->kdb_last_sno == 2);
+    assert(ulog->kdb_state == KDB_STABLE);
+
+    /* With a long group commit delay, an update should be visible in the
+     * header but leave it unstable until the group is committed. */
+    ulog_set_commit_delay(context, 3600 * 1000);
+    memset(&upd, 0, sizeof(kdb_incr_update_t));
+    if (ulog_add_update(context, &upd) != 0)
+        abort();
+    memset(&upd, 0, sizeof(kdb_incr_update_t));
+    if (ulog_add_update(context, &upd) != 0)
+        abort();
+    assert(ulog->kdb_num == 4);
+    assert(ulog->kdb_last_sno == 4);
+    assert(ulog->kdb_state == KDB_UNSTABLE);
+    assert(lctx->npending == 2);
+    if (ulog_sync(context) != 0)
+        abort();
+    assert(ulog->kdb_state == KDB_STABLE);
+    assert(lctx->npending == 0);
+
+    /* Simulate a crash with a group pending: unmap the ulog without syncing
+     * and map it again with a fresh log context. */
+    memset(&upd, 0, sizeof(kdb_incr_update_t));
+    if (ulog_add_update(context, &upd) != 0)
+        abort();
+    assert(ulog->kdb_state == KDB_UNSTABLE);
+    munmap(ulog, MAXLOGLEN);
+    close(lctx->ulogfd);
+    free(lctx);
+    context->kdblog_context = NULL;
+    if (ulog_map(context, filename, 10) != 0)
+        abort();
+    lctx = context->kdblog_context;
+    ulog = lctx->ulog;
+    assert(ulog->kdb_state == KDB_UNSTABLE);
+    assert(ulog->kdb_last_sno == 5);
+
+    /* The next update should reinitialize the ulog instead of reusing serial
+     * numbers from the abandoned group. */
+    memset(&upd, 0, sizeof(kdb_incr_update_t));
+    if (ulog_add_update(context, &upd) != 0)
+        abort();
+    assert(ulog->kdb_num == 2);
+    assert(ulog->kdb_first_sno == 1);
+    assert(ulog->kdb_last_sno == 2);
+    assert(ulog->kdb_state == KDB_STABLE);
+    ulog_fini(context);
     return 0;
 }
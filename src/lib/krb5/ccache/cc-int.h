@@ -45,6 +45,18 @@ k5_cc_retrieve_cred_default(krb5_context, krb5_ccache, krb5_flags,
 krb5_boolean
 krb5int_cc_creds_match_request(krb5_context, krb5_flags whichfields, krb5_creds *mcreds, krb5_creds *creds);
 
+/* Return the next candidate credential for k5_cc_retrieve_cred_list(), or
+ * NULL if there are no more. */
+typedef krb5_creds *(*k5_cc_next_cred_fn)(void *arg);
+
+krb5_error_code
+k5_cc_retrieve_cred_list(krb5_context context, krb5_flags flags,
+                         krb5_creds *mcreds, k5_cc_next_cred_fn next,
+                         void *arg, krb5_creds *creds_out);
+
+unsigned int
+k5_cc_creds_hash(const krb5_creds *creds);
+
 int
 krb5int_cc_initialize(void);
 
@@ -103,6 +115,7 @@ void
 k5_cc_mutex_unlock(krb5_context context, k5_cc_mutex *m);
 
 extern k5_cc_mutex krb5int_mcc_mutex;
+extern k5_rwlock_t krb5int_mcc_table_lock;
 extern k5_cc_mutex krb5int_krcc_mutex;
 extern k5_cc_mutex krb5int_cc_file_mutex;
 
@@ -94,9 +94,31 @@ static krb5_error_code interpret_errno(krb5_context, int);
 #endif
 #endif
 
+/* One credential in a decoded view of a cache file. */
+struct fcc_view_ent {
+    krb5_creds creds;
+    unsigned int hash;          /* k5_cc_creds_hash() of creds */
+    long next;                  /* Next entry in bucket, or -1 */
+};
+
+/* The decoded credentials of a cache file, indexed by hash, and the file
+ * attributes used to tell when they are out of date. */
+struct fcc_view {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    unsigned long mtime_frac;
+    struct fcc_view_ent *ents;
+    size_t nents;
+    long *buckets;
+    size_t nbuckets;            /* Always a power of two */
+};
+
 typedef struct fcc_data_st {
     k5_cc_mutex lock;
     char *filename;
+    struct fcc_view *view;      /* Contents as of the last fcc_retrieve() */
 } fcc_data;
 
 /* Iterator over file caches.  */
@@ -439,6 +461,30 @@ read_header(krb5_context context, FILE *fp, int *version_out)
     return 0;
 }
 
+/* Release a decoded view of a cache file.  Do nothing if view is NULL. */
+static void
+free_view(krb5_context context, struct fcc_view *view)
+{
+    size_t i;
+
+    if (view == NULL)
+        return;
+    for (i = 0; i < view->nents; i++)
+        krb5_free_cred_contents(context, &view->ents[i].creds);
+    free(view->ents);
+    free(view->buckets);
+    free(view);
+}
+
+/* Discard the decoded view of data's cache file, if there is one.  Call with
+ * data->lock held. */
+static void
+invalidate_view(krb5_context context, fcc_data *data)
+{
+    free_view(context, data->view);
+    data->view = NULL;
+}
+
 /* Create or overwrite the cache file with a header and default principal. */
 static krb5_error_code KRB5_CALLCONV
 fcc_initialize(krb5_context context, krb5_ccache id, krb5_principal princ)
@@ -454,6 +500,7 @@ fcc_initialize(krb5_context context, krb5_ccache id, krb5_principal princ)
     krb5_boolean file_locked = FALSE;
 
     k5_cc_mutex_lock(context, &data->lock);
+    invalidate_view(context, data);
 
     unlink(data->filename);
     flags = O_CREAT | O_EXCL | O_RDWR | O_BINARY | O_CLOEXEC;
@@ -533,6 +580,7 @@ static void
 free_fccdata(krb5_context context, fcc_data *data)
 {
     k5_cc_mutex_assert_unlocked(context, &data->lock);
+    free_view(context, data->view);
     free(data->filename);
     k5_cc_mutex_destroy(&data->lock);
     free(data);
@@ -673,6 +721,7 @@ fcc_resolve(krb5_context context, krb5_ccache *id, const char *residual)
         free(data);
         return KRB5_CC_NOMEM;
     }
+    data->view = NULL;
     ret = k5_cc_mutex_init(&data->lock);
     if (ret) {
         free(data->filename);
@@ -832,6 +881,7 @@ krb5int_fcc_new_unique(krb5_context context, char *template, krb5_ccache *id)
         unlink(template);
         return KRB5_CC_NOMEM;
     }
+    data->view = NULL;
 
     ret = k5_cc_mutex_init(&data->lock);
     if (ret) {
@@ -949,15 +999,187 @@ cleanup:
     return set_errmsg_filename(context, ret, data->filename);
 }
 
-/* Search for a credential within the cache file. */
+/* Return the sub-second part of a file's modification time, if known. */
+static unsigned long
+mtime_frac(const struct stat *sb)
+{
+#if defined HAVE_STRUCT_STAT_ST_MTIMENSEC
+    return sb->st_mtimensec;
+#elif defined HAVE_STRUCT_STAT_ST_MTIMESPEC_TV_NSEC
+    return sb->st_mtimespec.tv_nsec;
+#elif defined HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+    return sb->st_mtim.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+/* Return true if view was read from the file described by sb. */
+static krb5_boolean
+view_current(const struct fcc_view *view, const struct stat *sb)
+{
+    return view->dev == sb->st_dev && view->ino == sb->st_ino &&
+        view->size == sb->st_size && view->mtime == sb->st_mtime &&
+        view->mtime_frac == mtime_frac(sb);
+}
+
+/* Read and decode all of the credentials in filename, and index them by
+ * k5_cc_creds_hash(). */
+static krb5_error_code
+load_view(krb5_context context, const char *filename,
+          struct fcc_view **view_out)
+{
+    krb5_error_code ret;
+    struct fcc_view *view;
+    struct fcc_view_ent *ents, *ent;
+    struct k5buf buf;
+    struct stat sb;
+    krb5_principal princ = NULL;
+    FILE *fp = NULL;
+    size_t maxsize, nalloc = 0, i, b;
+    int version;
+
+    *view_out = NULL;
+    view = k5alloc(sizeof(*view), &ret);
+    if (view == NULL)
+        return ret;
+
+    ret = open_cache_file(context, filename, FALSE, &fp);
+    if (ret)
+        goto cleanup;
+    if (fstat(fileno(fp), &sb) == -1) {
+        ret = interpret_errno(context, errno);
+        goto cleanup;
+    }
+    ret = read_header(context, fp, &version);
+    if (ret)
+        goto cleanup;
+    ret = read_principal(context, fp, version, &princ);
+    if (ret)
+        goto cleanup;
+    ret = get_size(context, fp, &maxsize);
+    if (ret)
+        goto cleanup;
+
+    /* Decode credentials until we reach the end of the file. */
+    for (;;) {
+        if (view->nents == nalloc) {
+            nalloc = (nalloc == 0) ? 16 : nalloc * 2;
+            ents = realloc(view->ents, nalloc * sizeof(*ents));
+            if (ents == NULL) {
+                ret = ENOMEM;
+                goto cleanup;
+            }
+            view->ents = ents;
+        }
+        ent = &view->ents[view->nents];
+        memset(&ent->creds, 0, sizeof(ent->creds));
+
+        k5_buf_init_dynamic(&buf);
+        ret = load_cred(context, fp, version, maxsize, &buf);
+        if (!ret)
+            ret = k5_buf_status(&buf);
+        if (!ret)
+            ret = k5_unmarshal_cred(buf.data, buf.len, version, &ent->creds);
+        k5_buf_free(&buf);
+        if (ret)
+            break;
+        ent->hash = k5_cc_creds_hash(&ent->creds);
+        view->nents++;
+    }
+    if (ret != KRB5_CC_END)
+        goto cleanup;
+
+    view->nbuckets = 16;
+    while (view->nbuckets < view->nents)
+        view->nbuckets *= 2;
+    view->buckets = k5calloc(view->nbuckets, sizeof(*view->buckets), &ret);
+    if (view->buckets == NULL)
+        goto cleanup;
+    for (b = 0; b < view->nbuckets; b++)
+        view->buckets[b] = -1;
+    /* Insert entries in reverse so that each chain is in file order. */
+    for (i = view->nents; i > 0; i--) {
+        b = view->ents[i - 1].hash & (view->nbuckets - 1);
+        view->ents[i - 1].next = view->buckets[b];
+        view->buckets[b] = i - 1;
+    }
+
+    view->dev = sb.st_dev;
+    view->ino = sb.st_ino;
+    view->size = sb.st_size;
+    view->mtime = sb.st_mtime;
+    view->mtime_frac = mtime_frac(&sb);
+    *view_out = view;
+    view = NULL;
+    ret = 0;
+
+cleanup:
+    (void)close_cache_file(context, fp);
+    krb5_free_principal(context, princ);
+    free_view(context, view);
+    return ret;
+}
+
+/* Iteration state over the credentials in one bucket of a view. */
+struct fcc_chain {
+    struct fcc_view *view;
+    long i;
+    unsigned int hash;
+};
+
+/* Return the next credential in the bucket with the wanted hash. */
+static krb5_creds *
+next_in_chain(void *arg)
+{
+    struct fcc_chain *chain = arg;
+    struct fcc_view_ent *ent;
+
+    while (chain->i != -1) {
+        ent = &chain->view->ents[chain->i];
+        chain->i = ent->next;
+        if (ent->hash == chain->hash)
+            return &ent->creds;
+    }
+    return NULL;
+}
+
+/*
+ * Search for a credential within the cache file.  Keep a decoded, indexed
+ * copy of the file's credentials between calls, so that a lookup costs a
+ * stat() and a hash probe unless the file has changed.
+ */
 static krb5_error_code KRB5_CALLCONV
 fcc_retrieve(krb5_context context, krb5_ccache id, krb5_flags whichfields,
              krb5_creds *mcreds, krb5_creds *creds)
 {
     krb5_error_code ret;
+    fcc_data *data = id->data;
+    struct fcc_chain chain;
+    struct stat sb;
 
+    k5_cc_mutex_lock(context, &data->lock);
+    if (data->view != NULL &&
+        (stat(data->filename, &sb) == -1 || !view_current(data->view, &sb)))
+        invalidate_view(context, data);
+    if (data->view == NULL)
+        (void)load_view(context, data->filename, &data->view);
+    if (data->view != NULL) {
+        chain.view = data->view;
+        chain.hash = k5_cc_creds_hash(mcreds);
+        chain.i = data->view->buckets[chain.hash &
+                                      (data->view->nbuckets - 1)];
+        ret = k5_cc_retrieve_cred_list(context, whichfields, mcreds,
+                                       next_in_chain, &chain, creds);
+        k5_cc_mutex_unlock(context, &data->lock);
+        return set_errmsg_filename(context, ret, data->filename);
+    }
+    k5_cc_mutex_unlock(context, &data->lock);
+
+    /* Fall back to a sequential search, which reports any errors reading the
+     * file. */
     ret = k5_cc_retrieve_cred_default(context, id, whichfields, mcreds, creds);
-    return set_errmsg_filename(context, ret, ((fcc_data *)id->data)->filename);
+    return set_errmsg_filename(context, ret, data->filename);
 }
 
 /* Store a credential in the cache file. */
@@ -972,6 +1194,7 @@ fcc_store(krb5_context context, krb5_ccache id, krb5_creds *creds)
     ssize_t nwritten;
 
     k5_cc_mutex_lock(context, &data->lock);
+    invalidate_view(context, data);
 
     /* Open the cache file for O_APPEND writing. */
     ret = open_cache_file(context, data->filename, TRUE, &fp);
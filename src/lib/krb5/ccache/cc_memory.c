@@ -102,14 +102,45 @@ extern krb5_error_code krb5_change_cache (void);
 typedef struct _krb5_mcc_link {
     struct _krb5_mcc_link *next;
     krb5_creds *creds;
-} krb5_mcc_link, *krb5_mcc_cursor;
+    struct _krb5_mcc_link *hnext; /* Next in index bucket, in list order */
+    unsigned int hash;            /* k5_cc_creds_hash() of creds */
+} krb5_mcc_link;
 
-/* Per-cache data header.  */
+/*
+ * The credentials of one incarnation of a cache.  New links are only ever
+ * prepended, and a link's next pointer and creds never change once it is
+ * reachable, so a cursor holding a reference can walk the list without
+ * locking.  Initializing the cache replaces the generation instead of
+ * freeing it in place; the last reference frees it.
+ */
+typedef struct _krb5_mcc_gen {
+    k5_mutex_t lock;            /* Protects refcount */
+    unsigned int refcount;
+    krb5_mcc_link *link;
+    krb5_mcc_link **buckets;    /* Index of link by hash, or NULL */
+    size_t nbuckets;            /* Always zero or a power of two */
+    size_t ncreds;
+} krb5_mcc_gen;
+
+/* Sequential cursor state.  */
+typedef struct _krb5_mcc_cursor {
+    krb5_mcc_gen *gen;
+    krb5_mcc_link *next;
+} *krb5_mcc_cursor;
+
+/*
+ * Per-cache data header.  Readers (retrieve, get_principal, start_seq_get,
+ * last_change_time) hold rwlock for reading only, so they run concurrently
+ * with each other.  Writers hold lock, which also serializes them against
+ * krb5_cc_lock(), and then hold rwlock for writing while they modify the
+ * fields below it.
+ */
 typedef struct _krb5_mcc_data {
     char *name;
     k5_cc_mutex lock;
+    k5_rwlock_t rwlock;
     krb5_principal prin;
-    krb5_mcc_cursor link;
+    krb5_mcc_gen *gen;
     krb5_timestamp changetime;
     /* Time offsets for clock-skewed clients.  */
     krb5_int32 time_offset;
@@ -119,6 +150,7 @@ typedef struct _krb5_mcc_data {
 /* List of memory caches.  */
 typedef struct krb5_mcc_list_node {
     struct krb5_mcc_list_node *next;
+    struct krb5_mcc_list_node *hnext; /* Next in name table bucket */
     krb5_mcc_data *cache;
 } krb5_mcc_list_node;
 
@@ -127,12 +159,131 @@ struct krb5_mcc_ptcursor_data {
     struct krb5_mcc_list_node *cur;
 };
 
+/*
+ * krb5int_mcc_mutex serializes changes to the set of memory caches.  The
+ * caches are also indexed by name in a hash table, which is modified only
+ * while holding both krb5int_mcc_mutex and krb5int_mcc_table_lock for
+ * writing, so that resolving an existing cache needs only a read lock.
+ */
 k5_cc_mutex krb5int_mcc_mutex = K5_CC_MUTEX_PARTIAL_INITIALIZER;
+k5_rwlock_t krb5int_mcc_table_lock;
 static krb5_mcc_list_node *mcc_head = 0;
+static krb5_mcc_list_node **mcc_buckets = NULL;
+static size_t mcc_nbuckets = 0;     /* Always zero or a power of two */
+static size_t mcc_ncaches = 0;
 
 static void update_mcc_change_time(krb5_mcc_data *);
 
-static void krb5_mcc_free (krb5_context context, krb5_ccache id);
+/* Return an FNV-1a hash of a cache name. */
+static unsigned int
+mcc_name_hash(const char *name)
+{
+    unsigned int h = 2166136261U;
+
+    for (; *name != '\0'; name++) {
+        h ^= (unsigned char)*name;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+/* Look up a cache by name.  Call with krb5int_mcc_table_lock held. */
+static krb5_mcc_data *
+find_mcc_data(const char *name)
+{
+    krb5_mcc_list_node *n;
+
+    if (mcc_buckets == NULL)
+        return NULL;
+    n = mcc_buckets[mcc_name_hash(name) & (mcc_nbuckets - 1)];
+    for (; n != NULL; n = n->hnext) {
+        if (strcmp(n->cache->name, name) == 0)
+            return n->cache;
+    }
+    return NULL;
+}
+
+/* Double the size of the name table (creating it if necessary).  Call with
+ * krb5int_mcc_table_lock held for writing. */
+static krb5_error_code
+grow_mcc_table(void)
+{
+    krb5_mcc_list_node **buckets, *n;
+    size_t nbuckets, b;
+
+    nbuckets = (mcc_nbuckets == 0) ? 16 : mcc_nbuckets * 2;
+    buckets = calloc(nbuckets, sizeof(*buckets));
+    if (buckets == NULL)
+        return ENOMEM;
+    for (n = mcc_head; n != NULL; n = n->next) {
+        b = mcc_name_hash(n->cache->name) & (nbuckets - 1);
+        n->hnext = buckets[b];
+        buckets[b] = n;
+    }
+    free(mcc_buckets);
+    mcc_buckets = buckets;
+    mcc_nbuckets = nbuckets;
+    return 0;
+}
+
+/* Create an empty generation with one reference. */
+static krb5_error_code
+new_mcc_gen(krb5_mcc_gen **gen_out)
+{
+    krb5_error_code err;
+    krb5_mcc_gen *gen;
+
+    *gen_out = NULL;
+    gen = malloc(sizeof(*gen));
+    if (gen == NULL)
+        return KRB5_CC_NOMEM;
+    err = k5_mutex_init(&gen->lock);
+    if (err) {
+        free(gen);
+        return err;
+    }
+    gen->refcount = 1;
+    gen->link = NULL;
+    gen->buckets = NULL;
+    gen->nbuckets = 0;
+    gen->ncreds = 0;
+    *gen_out = gen;
+    return 0;
+}
+
+/* Add a reference to gen.  Call with the owning cache's rwlock held. */
+static void
+hold_mcc_gen(krb5_mcc_gen *gen)
+{
+    k5_mutex_lock(&gen->lock);
+    gen->refcount++;
+    k5_mutex_unlock(&gen->lock);
+}
+
+/* Release a reference to gen, freeing it if it was the last one. */
+static void
+release_mcc_gen(krb5_context context, krb5_mcc_gen *gen)
+{
+    krb5_mcc_link *curr, *next;
+    unsigned int refcount;
+
+    if (gen == NULL)
+        return;
+    k5_mutex_lock(&gen->lock);
+    refcount = --gen->refcount;
+    k5_mutex_unlock(&gen->lock);
+    if (refcount > 0)
+        return;
+
+    for (curr = gen->link; curr != NULL; curr = next) {
+        next = curr->next;
+        krb5_free_creds(context, curr->creds);
+        free(curr);
+    }
+    free(gen->buckets);
+    k5_mutex_destroy(&gen->lock);
+    free(gen);
+}
 
 /*
  * Modifies:
@@ -151,13 +302,20 @@ krb5_mcc_initialize(krb5_context context, krb5_ccache id, krb5_principal princ)
     krb5_os_context os_ctx = &context->os_context;
     krb5_error_code ret;
     krb5_mcc_data *d;
+    krb5_mcc_gen *gen, *old_gen;
+
+    ret = new_mcc_gen(&gen);
+    if (ret)
+        return ret;
 
     d = (krb5_mcc_data *)id->data;
     k5_cc_mutex_lock(context, &d->lock);
+    k5_rwlock_wrlock(&d->rwlock);
 
-    krb5_mcc_free(context, id);
-
-    d = (krb5_mcc_data *)id->data;
+    /* Cursors still walking the old contents keep them alive. */
+    old_gen = d->gen;
+    d->gen = gen;
+    krb5_free_principal(context, d->prin);
     ret = krb5_copy_principal(context, princ,
                               &d->prin);
     update_mcc_change_time(d);
@@ -168,7 +326,9 @@ krb5_mcc_initialize(krb5_context context, krb5_ccache id, krb5_principal princ)
         d->usec_offset = os_ctx->usec_offset;
     }
 
+    k5_rwlock_unlock(&d->rwlock);
     k5_cc_mutex_unlock(context, &d->lock);
+    release_mcc_gen(context, old_gen);
     if (ret == KRB5_OK)
         krb5_change_cache();
     return ret;
@@ -189,23 +349,6 @@ krb5_mcc_close(krb5_context context, krb5_ccache id)
     return KRB5_OK;
 }
 
-static void
-krb5_mcc_free(krb5_context context, krb5_ccache id)
-{
-    krb5_mcc_cursor curr,next;
-    krb5_mcc_data *d;
-
-    d = (krb5_mcc_data *) id->data;
-    for (curr = d->link; curr;) {
-        krb5_free_creds(context, curr->creds);
-        next = curr->next;
-        free(curr);
-        curr = next;
-    }
-    d->link = NULL;
-    krb5_free_principal(context, d->prin);
-}
-
 /*
  * Effects:
  * Destroys the contents of id. id is invalid after call.
@@ -220,23 +363,40 @@ krb5_mcc_destroy(krb5_context context, krb5_ccache id)
     krb5_mcc_data *d;
 
     k5_cc_mutex_lock(context, &krb5int_mcc_mutex);
+    k5_rwlock_wrlock(&krb5int_mcc_table_lock);
 
     d = (krb5_mcc_data *)id->data;
     for (curr = &mcc_head; *curr; curr = &(*curr)->next) {
         if ((*curr)->cache == d) {
             node = *curr;
             *curr = node->next;
-            free(node);
             break;
         }
     }
+    if (mcc_buckets != NULL) {
+        curr = &mcc_buckets[mcc_name_hash(d->name) & (mcc_nbuckets - 1)];
+        for (; *curr; curr = &(*curr)->hnext) {
+            if ((*curr)->cache == d) {
+                node = *curr;
+                *curr = node->hnext;
+                free(node);
+                mcc_ncaches--;
+                break;
+            }
+        }
+    }
+    k5_rwlock_unlock(&krb5int_mcc_table_lock);
     k5_cc_mutex_unlock(context, &krb5int_mcc_mutex);
 
     k5_cc_mutex_lock(context, &d->lock);
+    k5_rwlock_wrlock(&d->rwlock);
 
-    krb5_mcc_free(context, id);
+    release_mcc_gen(context, d->gen);
+    krb5_free_principal(context, d->prin);
     free(d->name);
+    k5_rwlock_unlock(&d->rwlock);
     k5_cc_mutex_unlock(context, &d->lock);
+    k5_rwlock_destroy(&d->rwlock);
     k5_cc_mutex_destroy(&d->lock);
     free(d);
     free(id);
@@ -271,24 +431,25 @@ krb5_mcc_resolve (krb5_context context, krb5_ccache *id, const char *residual)
 {
     krb5_os_context os_ctx = &context->os_context;
     krb5_ccache lid;
-    krb5_mcc_list_node *ptr;
     krb5_error_code err;
     krb5_mcc_data *d;
 
-    k5_cc_mutex_lock(context, &krb5int_mcc_mutex);
-    for (ptr = mcc_head; ptr; ptr=ptr->next)
-        if (!strcmp(ptr->cache->name, residual))
-            break;
-    if (ptr)
-        d = ptr->cache;
-    else {
-        err = new_mcc_data(residual, &d);
-        if (err) {
-            k5_cc_mutex_unlock(context, &krb5int_mcc_mutex);
+    /* Most resolves name an existing cache; look for it without excluding
+     * other readers. */
+    k5_rwlock_rdlock(&krb5int_mcc_table_lock);
+    d = find_mcc_data(residual);
+    k5_rwlock_unlock(&krb5int_mcc_table_lock);
+
+    if (d == NULL) {
+        k5_cc_mutex_lock(context, &krb5int_mcc_mutex);
+        k5_rwlock_wrlock(&krb5int_mcc_table_lock);
+        d = find_mcc_data(residual);
+        err = (d == NULL) ? new_mcc_data(residual, &d) : 0;
+        k5_rwlock_unlock(&krb5int_mcc_table_lock);
+        k5_cc_mutex_unlock(context, &krb5int_mcc_mutex);
+        if (err)
             return err;
-        }
     }
-    k5_cc_mutex_unlock(context, &krb5int_mcc_mutex);
 
     lid = (krb5_ccache) malloc(sizeof(struct _krb5_ccache));
     if (lid == NULL)
@@ -297,8 +458,10 @@ krb5_mcc_resolve (krb5_context context, krb5_ccache *id, const char *residual)
     if ((context->library_options & KRB5_LIBOPT_SYNC_KDCTIME) &&
         !(os_ctx->os_flags & KRB5_OS_TOFFSET_VALID)) {
         /* Use the time offset from the cache entry */
+        k5_rwlock_rdlock(&d->rwlock);
         os_ctx->time_offset = d->time_offset;
         os_ctx->usec_offset = d->usec_offset;
+        k5_rwlock_unlock(&d->rwlock);
         os_ctx->os_flags = ((os_ctx->os_flags & ~KRB5_OS_TOFFSET_TIME) |
                             KRB5_OS_TOFFSET_VALID);
     }
@@ -315,8 +478,9 @@ krb5_mcc_resolve (krb5_context context, krb5_ccache *id, const char *residual)
  * Returns a krb5_cc_cursor to be used with krb5_mcc_next_cred and
  * krb5_mcc_end_seq_get.
  *
- * If the cache is modified between the time of this call and the time
- * of the final krb5_mcc_end_seq_get, the results are undefined.
+ * The cursor sees the credentials present at the time of this call.
+ * Credentials stored afterwards are not returned, and reinitializing
+ * the cache does not affect the cursor.
  *
  * Errors:
  * KRB5_CC_NOMEM
@@ -329,10 +493,15 @@ krb5_mcc_start_seq_get(krb5_context context, krb5_ccache id,
     krb5_mcc_cursor mcursor;
     krb5_mcc_data *d;
 
+    mcursor = malloc(sizeof(*mcursor));
+    if (mcursor == NULL)
+        return KRB5_CC_NOMEM;
     d = id->data;
-    k5_cc_mutex_lock(context, &d->lock);
-    mcursor = d->link;
-    k5_cc_mutex_unlock(context, &d->lock);
+    k5_rwlock_rdlock(&d->rwlock);
+    hold_mcc_gen(d->gen);
+    mcursor->gen = d->gen;
+    mcursor->next = d->gen->link;
+    k5_rwlock_unlock(&d->rwlock);
     *cursor = (krb5_cc_cursor) mcursor;
     return KRB5_OK;
 }
@@ -362,21 +531,24 @@ krb5_mcc_next_cred(krb5_context context, krb5_ccache id,
                    krb5_cc_cursor *cursor, krb5_creds *creds)
 {
     krb5_mcc_cursor mcursor;
+    krb5_mcc_link *link;
     krb5_error_code retval;
 
     /* Once the node in the linked list is created, it's never
-       modified, so we don't need to worry about locking here.  (Note
-       that we don't support _remove_cred.)  */
+       modified, and the cursor's reference keeps it alive, so we don't
+       need to worry about locking here.  (Note that we don't support
+       _remove_cred.)  */
     mcursor = (krb5_mcc_cursor) *cursor;
-    if (mcursor == NULL)
+    link = mcursor->next;
+    if (link == NULL)
         return KRB5_CC_END;
     memset(creds, 0, sizeof(krb5_creds));
-    if (mcursor->creds) {
-        retval = k5_copy_creds_contents(context, mcursor->creds, creds);
+    if (link->creds) {
+        retval = k5_copy_creds_contents(context, link->creds, creds);
         if (retval)
             return retval;
     }
-    *cursor = (krb5_cc_cursor)mcursor->next;
+    mcursor->next = link->next;
     return KRB5_OK;
 }
 
@@ -396,20 +568,35 @@ krb5_mcc_next_cred(krb5_context context, krb5_ccache id,
 krb5_error_code KRB5_CALLCONV
 krb5_mcc_end_seq_get(krb5_context context, krb5_ccache id, krb5_cc_cursor *cursor)
 {
+    krb5_mcc_cursor mcursor = (krb5_mcc_cursor) *cursor;
+
+    if (mcursor != NULL) {
+        release_mcc_gen(context, mcursor->gen);
+        free(mcursor);
+    }
     *cursor = 0L;
     return KRB5_OK;
 }
 
 /* Utility routine: Creates the back-end data for a memory cache, and
-   threads it into the global linked list.
+   threads it into the global linked list and name table.
 
-   Call with the global list lock held.  */
+   Call with krb5int_mcc_mutex held and krb5int_mcc_table_lock held for
+   writing.  */
 static krb5_error_code
 new_mcc_data (const char *name, krb5_mcc_data **dataptr)
 {
     krb5_error_code err;
     krb5_mcc_data *d;
     krb5_mcc_list_node *n;
+    size_t b;
+
+    if (mcc_ncaches >= mcc_nbuckets) {
+        /* If the table exists but can't grow, let its chains lengthen. */
+        err = grow_mcc_table();
+        if (err && mcc_buckets == NULL)
+            return KRB5_CC_NOMEM;
+    }
 
     d = malloc(sizeof(krb5_mcc_data));
     if (d == NULL)
@@ -421,13 +608,23 @@ new_mcc_data (const char *name, krb5_mcc_data **dataptr)
         return err;
     }
 
-    d->name = strdup(name);
-    if (d->name == NULL) {
+    err = k5_rwlock_init(&d->rwlock);
+    if (err) {
         k5_cc_mutex_destroy(&d->lock);
         free(d);
-        return KRB5_CC_NOMEM;
+        return err;
+    }
+
+    d->gen = NULL;
+    err = new_mcc_gen(&d->gen);
+    if (err)
+        goto cleanup;
+
+    d->name = strdup(name);
+    if (d->name == NULL) {
+        err = KRB5_CC_NOMEM;
+        goto cleanup;
     }
-    d->link = NULL;
     d->prin = NULL;
     d->changetime = 0;
     d->time_offset = 0;
@@ -437,17 +634,27 @@ new_mcc_data (const char *name, krb5_mcc_data **dataptr)
     n = malloc(sizeof(krb5_mcc_list_node));
     if (n == NULL) {
         free(d->name);
-        k5_cc_mutex_destroy(&d->lock);
-        free(d);
-        return KRB5_CC_NOMEM;
+        err = KRB5_CC_NOMEM;
+        goto cleanup;
     }
 
     n->cache = d;
     n->next = mcc_head;
     mcc_head = n;
+    b = mcc_name_hash(name) & (mcc_nbuckets - 1);
+    n->hnext = mcc_buckets[b];
+    mcc_buckets[b] = n;
+    mcc_ncaches++;
 
     *dataptr = d;
     return 0;
+
+cleanup:
+    release_mcc_gen(NULL, d->gen);
+    k5_rwlock_destroy(&d->rwlock);
+    k5_cc_mutex_destroy(&d->lock);
+    free(d);
+    return err;
 }
 
 /*
@@ -480,28 +687,25 @@ krb5_mcc_generate_new (krb5_context context, krb5_ccache *id)
     lid->ops = &krb5_mcc_ops;
 
     k5_cc_mutex_lock(context, &krb5int_mcc_mutex);
+    k5_rwlock_wrlock(&krb5int_mcc_table_lock);
 
     /* Check for uniqueness with mutex locked to avoid race conditions */
     while (1) {
-        krb5_mcc_list_node *ptr;
-
         err = krb5int_random_string (context, uniquename, sizeof (uniquename));
         if (err) {
+            k5_rwlock_unlock(&krb5int_mcc_table_lock);
             k5_cc_mutex_unlock(context, &krb5int_mcc_mutex);
             free(lid);
             return err;
         }
 
-        for (ptr = mcc_head; ptr; ptr=ptr->next) {
-            if (!strcmp(ptr->cache->name, uniquename)) {
-                break;  /* got a match, loop again */
-            }
-        }
-        if (!ptr) break; /* got to the end without finding a match */
+        if (find_mcc_data(uniquename) == NULL)
+            break;
     }
 
     err = new_mcc_data(uniquename, &d);
 
+    k5_rwlock_unlock(&krb5int_mcc_table_lock);
     k5_cc_mutex_unlock(context, &krb5int_mcc_mutex);
     if (err) {
         free(lid);
@@ -542,20 +746,62 @@ krb5_mcc_get_name (krb5_context context, krb5_ccache id)
 krb5_error_code KRB5_CALLCONV
 krb5_mcc_get_principal(krb5_context context, krb5_ccache id, krb5_principal *princ)
 {
+    krb5_error_code ret;
     krb5_mcc_data *ptr = (krb5_mcc_data *)id->data;
-    if (!ptr->prin) {
-        *princ = 0L;
-        return KRB5_FCC_NOFILE;
+
+    *princ = 0L;
+    k5_rwlock_rdlock(&ptr->rwlock);
+    if (!ptr->prin)
+        ret = KRB5_FCC_NOFILE;
+    else
+        ret = krb5_copy_principal(context, ptr->prin, princ);
+    k5_rwlock_unlock(&ptr->rwlock);
+    return ret;
+}
+
+/* Iteration state over the credentials in one index bucket. */
+struct mcc_chain {
+    krb5_mcc_link *link;
+    unsigned int hash;
+};
+
+/* Return the next credential in the bucket with the wanted hash. */
+static krb5_creds *
+next_in_chain(void *arg)
+{
+    struct mcc_chain *chain = arg;
+    krb5_mcc_link *l;
+
+    while ((l = chain->link) != NULL) {
+        chain->link = l->hnext;
+        if (l->hash == chain->hash)
+            return l->creds;
     }
-    return krb5_copy_principal(context, ptr->prin, princ);
+    return NULL;
 }
 
+/* Search only the credentials whose client and server hash like mcreds.
+ * Buckets are kept in list order, so this finds the same credential as a
+ * sequential search.  Retrievals hold the cache lock only for reading, so
+ * they do not wait for each other. */
 krb5_error_code KRB5_CALLCONV
 krb5_mcc_retrieve(krb5_context context, krb5_ccache id, krb5_flags whichfields,
                   krb5_creds *mcreds, krb5_creds *creds)
 {
-    return k5_cc_retrieve_cred_default(context, id, whichfields, mcreds,
-                                       creds);
+    krb5_error_code ret;
+    krb5_mcc_data *d = id->data;
+    krb5_mcc_gen *gen;
+    struct mcc_chain chain;
+
+    chain.hash = k5_cc_creds_hash(mcreds);
+    k5_rwlock_rdlock(&d->rwlock);
+    gen = d->gen;
+    chain.link = (gen->buckets == NULL) ? NULL :
+        gen->buckets[chain.hash & (gen->nbuckets - 1)];
+    ret = k5_cc_retrieve_cred_list(context, whichfields, mcreds,
+                                   next_in_chain, &chain, creds);
+    k5_rwlock_unlock(&d->rwlock);
+    return ret;
 }
 
 /*
@@ -596,6 +842,42 @@ krb5_mcc_get_flags(krb5_context context, krb5_ccache id, krb5_flags *flags)
     return KRB5_OK;
 }
 
+/* Double the size of gen's index (creating it if necessary) and rehash the
+ * credential list into it.  Call with the cache's rwlock held for
+ * writing. */
+static krb5_error_code
+grow_mcc_index(krb5_mcc_gen *gen)
+{
+    krb5_mcc_link **buckets, **tails, *l;
+    size_t nbuckets, b;
+
+    nbuckets = (gen->nbuckets == 0) ? 16 : gen->nbuckets * 2;
+    buckets = calloc(nbuckets, sizeof(*buckets));
+    tails = calloc(nbuckets, sizeof(*tails));
+    if (buckets == NULL || tails == NULL) {
+        free(buckets);
+        free(tails);
+        return ENOMEM;
+    }
+
+    /* Append each link to its bucket, keeping the buckets in list order. */
+    for (l = gen->link; l != NULL; l = l->next) {
+        b = l->hash & (nbuckets - 1);
+        l->hnext = NULL;
+        if (tails[b] != NULL)
+            tails[b]->hnext = l;
+        else
+            buckets[b] = l;
+        tails[b] = l;
+    }
+
+    free(tails);
+    free(gen->buckets);
+    gen->buckets = buckets;
+    gen->nbuckets = nbuckets;
+    return 0;
+}
+
 /*
  * Modifies:
  * the memory cache
@@ -613,6 +895,8 @@ krb5_mcc_store(krb5_context ctx, krb5_ccache id, krb5_creds *creds)
     krb5_error_code err;
     krb5_mcc_link *new_node;
     krb5_mcc_data *mptr = (krb5_mcc_data *)id->data;
+    krb5_mcc_gen *gen;
+    size_t b;
 
     new_node = malloc(sizeof(krb5_mcc_link));
     if (new_node == NULL)
@@ -620,10 +904,28 @@ krb5_mcc_store(krb5_context ctx, krb5_ccache id, krb5_creds *creds)
     err = krb5_copy_creds(ctx, creds, &new_node->creds);
     if (err)
         goto cleanup;
+    new_node->hash = k5_cc_creds_hash(new_node->creds);
     k5_cc_mutex_lock(ctx, &mptr->lock);
-    new_node->next = mptr->link;
-    mptr->link = new_node;
+    k5_rwlock_wrlock(&mptr->rwlock);
+    gen = mptr->gen;
+    if (gen->ncreds >= gen->nbuckets) {
+        /* If an index exists but can't grow, let its chains lengthen. */
+        err = grow_mcc_index(gen);
+        if (err && gen->buckets == NULL) {
+            k5_rwlock_unlock(&mptr->rwlock);
+            k5_cc_mutex_unlock(ctx, &mptr->lock);
+            krb5_free_creds(ctx, new_node->creds);
+            goto cleanup;
+        }
+    }
+    new_node->next = gen->link;
+    gen->link = new_node;
+    b = new_node->hash & (gen->nbuckets - 1);
+    new_node->hnext = gen->buckets[b];
+    gen->buckets[b] = new_node;
+    gen->ncreds++;
     update_mcc_change_time(mptr);
+    k5_rwlock_unlock(&mptr->rwlock);
     k5_cc_mutex_unlock(ctx, &mptr->lock);
     return 0;
 cleanup:
@@ -705,9 +1007,9 @@ krb5_mcc_last_change_time(
 {
     krb5_mcc_data *data = (krb5_mcc_data *) id->data;
 
-    k5_cc_mutex_lock(context, &data->lock);
+    k5_rwlock_rdlock(&data->rwlock);
     *change_time = data->changetime;
-    k5_cc_mutex_unlock(context, &data->lock);
+    k5_rwlock_unlock(&data->rwlock);
     return 0;
 }
 
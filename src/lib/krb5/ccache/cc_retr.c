@@ -254,6 +254,97 @@ krb5_cc_retrieve_cred_seq (krb5_context context, krb5_ccache id,
         return nomatch_err;
 }
 
+/*
+ * Search the candidate credentials returned by next(arg), in order, for one
+ * matching mcreds, with the same selection rules as
+ * krb5_cc_retrieve_cred_seq().  Copy the chosen credential into creds_out.
+ * This is used by cache types which keep an index of credentials in memory
+ * and can supply only the candidates sharing k5_cc_creds_hash(mcreds).
+ */
+krb5_error_code
+k5_cc_retrieve_cred_list(krb5_context context, krb5_flags flags,
+                         krb5_creds *mcreds, k5_cc_next_cred_fn next,
+                         void *arg, krb5_creds *creds_out)
+{
+    krb5_error_code ret, nomatch_err = KRB5_CC_NOTFOUND;
+    krb5_enctype *ktypes = NULL;
+    krb5_creds *cand, *best = NULL;
+    int nktypes = 0, cand_pref, best_pref = 0;
+
+    if (flags & KRB5_TC_SUPPORTED_KTYPES) {
+        ret = krb5_get_tgs_ktypes(context, mcreds->server, &ktypes);
+        if (ret)
+            return ret;
+        nktypes = k5_count_etypes(ktypes);
+    }
+
+    while ((cand = next(arg)) != NULL) {
+        if (!krb5int_cc_creds_match_request(context, flags, mcreds, cand))
+            continue;
+        if (ktypes == NULL) {
+            best = cand;
+            break;
+        }
+        cand_pref = pref(cand->keyblock.enctype, nktypes, ktypes);
+        if (cand_pref < 0) {
+            nomatch_err = KRB5_CC_NOT_KTYPE;
+        } else if (best == NULL || cand_pref < best_pref) {
+            best = cand;
+            best_pref = cand_pref;
+        }
+    }
+    free(ktypes);
+
+    if (best == NULL)
+        return nomatch_err;
+    return k5_copy_creds_contents(context, best, creds_out);
+}
+
+/* Mix a counted string into an FNV-1a hash. */
+static unsigned int
+hash_counted(unsigned int h, const void *data, unsigned int len)
+{
+    const unsigned char *p = data;
+    unsigned char lenbuf[4];
+    unsigned int i;
+
+    store_32_be(len, lenbuf);
+    for (i = 0; i < 4; i++)
+        h = (h ^ lenbuf[i]) * 16777619U;
+    for (i = 0; i < len; i++)
+        h = (h ^ p[i]) * 16777619U;
+    return h & 0xFFFFFFFFU;
+}
+
+/*
+ * Return a hash of the client principal and the server principal's name
+ * components.  The server realm is left out because
+ * KRB5_TC_MATCH_SRV_NAMEONLY ignores it, so any credential which can match
+ * mcreds has the same hash as mcreds.
+ */
+unsigned int
+k5_cc_creds_hash(const krb5_creds *creds)
+{
+    unsigned int h = 2166136261U;
+    krb5_int32 i;
+
+    if (creds->client != NULL) {
+        h = hash_counted(h, creds->client->realm.data,
+                         creds->client->realm.length);
+        for (i = 0; i < creds->client->length; i++) {
+            h = hash_counted(h, creds->client->data[i].data,
+                             creds->client->data[i].length);
+        }
+    }
+    if (creds->server != NULL) {
+        for (i = 0; i < creds->server->length; i++) {
+            h = hash_counted(h, creds->server->data[i].data,
+                             creds->server->data[i].length);
+        }
+    }
+    return h;
+}
+
 krb5_error_code
 k5_cc_retrieve_cred_default(krb5_context context, krb5_ccache id,
                             krb5_flags flags, krb5_creds *mcreds,
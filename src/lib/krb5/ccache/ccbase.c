@@ -107,6 +107,9 @@ krb5int_cc_initialize(void)
     if (err)
         return err;
     err = k5_cc_mutex_finish_init(&krb5int_mcc_mutex);
+    if (err)
+        return err;
+    err = k5_rwlock_init(&krb5int_mcc_table_lock);
     if (err)
         return err;
     err = k5_mutex_finish_init(&cc_typelist_lock);
@@ -136,6 +139,7 @@ krb5int_cc_finalize(void)
     k5_cc_mutex_destroy(&krb5int_cc_file_mutex);
 #endif
     k5_cc_mutex_destroy(&krb5int_mcc_mutex);
+    k5_rwlock_destroy(&krb5int_mcc_table_lock);
 #ifdef USE_KEYRING_CCACHE
     k5_cc_mutex_destroy(&krb5int_krcc_mutex);
 #endif
@@ -316,6 +316,108 @@ cc_test(krb5_context context, const char *name, krb5_flags flags)
 
 }
 
+/* Set *princ_out to a principal for service number i in realm. */
+static void
+make_server(krb5_context context, const char *realm, int i,
+            krb5_principal *princ_out)
+{
+    krb5_error_code kret;
+    char comp[32];
+
+    snprintf(comp, sizeof(comp), "svc%d", i);
+    kret = krb5_build_principal(context, princ_out, strlen(realm), realm,
+                                comp, "host", NULL);
+    CHECK(kret, "build_principal");
+}
+
+/* Retrieve the credential for service i, expecting the result experr. */
+static void
+check_retrieve(krb5_context context, krb5_ccache id, krb5_flags flags,
+               const char *realm, int i, krb5_enctype enctype,
+               krb5_error_code experr)
+{
+    krb5_error_code kret;
+    krb5_creds mcreds, creds;
+
+    memset(&mcreds, 0, sizeof(mcreds));
+    mcreds.client = test_creds.client;
+    make_server(context, realm, i, &mcreds.server);
+    mcreds.keyblock.enctype = enctype;
+    kret = krb5_cc_retrieve_cred(context, id, flags, &mcreds, &creds);
+    CHECK_FAIL(experr, kret, "retrieve_cred");
+    if (kret == 0) {
+        CHECK_BOOL(!krb5_principal_compare_any_realm(context, mcreds.server,
+                                                     creds.server),
+                   "wrong server", "retrieve_cred");
+        CHECK_BOOL(enctype && creds.keyblock.enctype != enctype,
+                   "wrong enctype", "retrieve_cred");
+        krb5_free_cred_contents(context, &creds);
+    }
+    krb5_free_principal(context, mcreds.server);
+}
+
+/*
+ * Store credentials for many services and check that each can be retrieved,
+ * including one stored through a second handle after the first handle has
+ * searched the cache.
+ */
+static void
+retrieve_test(krb5_context context, const char *name)
+{
+    krb5_error_code kret;
+    krb5_ccache id, id2;
+    krb5_principal server;
+    int i;
+
+    kret = init_test_cred(context);
+    CHECK(kret, "init_creds");
+    server = test_creds.server;
+
+    kret = krb5_cc_resolve(context, name, &id);
+    CHECK(kret, "resolve");
+    kret = krb5_cc_initialize(context, id, test_creds.client);
+    CHECK(kret, "initialize");
+    for (i = 0; i < 100; i++) {
+        make_server(context, REALM, i, &test_creds.server);
+        kret = krb5_cc_store_cred(context, id, &test_creds);
+        CHECK(kret, "store");
+        krb5_free_principal(context, test_creds.server);
+    }
+
+    /* Add a second credential for one service with a different enctype. */
+    make_server(context, REALM, 7, &test_creds.server);
+    test_creds.keyblock.enctype = 2;
+    kret = krb5_cc_store_cred(context, id, &test_creds);
+    CHECK(kret, "store");
+    test_creds.keyblock.enctype = 1;
+    krb5_free_principal(context, test_creds.server);
+
+    for (i = 0; i < 100; i++)
+        check_retrieve(context, id, 0, REALM, i, 0, 0);
+    check_retrieve(context, id, KRB5_TC_MATCH_KTYPE, REALM, 7, 2, 0);
+    check_retrieve(context, id, KRB5_TC_MATCH_KTYPE, REALM, 8, 2,
+                   KRB5_CC_NOTFOUND);
+    check_retrieve(context, id, KRB5_TC_MATCH_SRV_NAMEONLY, "OTHER", 5, 0, 0);
+    check_retrieve(context, id, 0, "OTHER", 5, 0, KRB5_CC_NOTFOUND);
+    check_retrieve(context, id, 0, REALM, 100, 0, KRB5_CC_NOTFOUND);
+
+    kret = krb5_cc_resolve(context, name, &id2);
+    CHECK(kret, "resolve2");
+    make_server(context, REALM, 100, &test_creds.server);
+    kret = krb5_cc_store_cred(context, id2, &test_creds);
+    CHECK(kret, "store2");
+    krb5_free_principal(context, test_creds.server);
+    check_retrieve(context, id, 0, REALM, 100, 0, 0);
+
+    kret = krb5_cc_close(context, id2);
+    CHECK(kret, "close2");
+    kret = krb5_cc_destroy(context, id);
+    CHECK(kret, "destroy");
+
+    test_creds.server = server;
+    free_test_cred(context);
+}
+
 /*
  * Checks if a credential type is registered with the library
  */
@@ -356,6 +458,7 @@ do_test(krb5_context context, const char *prefix)
     printf("Starting test on %s\n", name);
     cc_test (context, name, 0);
     cc_test (context, name, !0);
+    retrieve_test(context, name);
     printf("Test on %s passed\n", name);
 }
 
@@ -0,0 +1,215 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* lib/krb5/ccache/t_mccbench.c - Threaded benchmark for MEMORY ccaches */
+/*
+ * Copyright (C) 2026 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Usage: t_mccbench [nthreads [iterations [ncreds]]]
+ *
+ * Populates a MEMORY cache with ncreds service tickets, then starts nthreads
+ * threads which each perform iterations operations against it by name, as a
+ * multi-threaded service would.  Most operations resolve the cache and
+ * retrieve a random ticket, checking that the right one came back; a few
+ * store new tickets or iterate over the whole cache, so that readers run
+ * concurrently with writers.  Prints the aggregate operation rate.
+ */
+
+#include "k5-int.h"
+#include <pthread.h>
+#include <sys/time.h>
+
+#define CACHE_NAME "MEMORY:t_mccbench"
+#define REALM "KRBTEST.COM"
+
+/* One in STORE_RATE operations stores, and one in ITER_RATE iterates. */
+#define STORE_RATE 64
+#define ITER_RATE 1024
+
+static int nthreads = 4, iterations = 100000, ncreds = 1000;
+static krb5_principal client;
+
+static void
+check(krb5_error_code code, krb5_context ctx, const char *what)
+{
+    const char *msg;
+
+    if (code) {
+        msg = krb5_get_error_message(ctx, code);
+        fprintf(stderr, "%s: %s\n", what, msg);
+        krb5_free_error_message(ctx, msg);
+        exit(1);
+    }
+}
+
+static void
+store_ticket(krb5_context ctx, krb5_ccache cc, const char *sname)
+{
+    krb5_creds creds;
+
+    memset(&creds, 0, sizeof(creds));
+    creds.client = client;
+    check(krb5_parse_name(ctx, sname, &creds.server), ctx, "parse_name");
+    creds.times.authtime = creds.times.starttime = time(NULL);
+    creds.times.endtime = creds.times.authtime + 3600;
+    /* Use the server name as the ticket so retrievals can be checked. */
+    creds.ticket = string2data((char *)sname);
+    check(krb5_cc_store_cred(ctx, cc, &creds), ctx, "store_cred");
+    krb5_free_principal(ctx, creds.server);
+}
+
+static void
+retrieve_ticket(krb5_context ctx, krb5_ccache cc, const char *sname)
+{
+    krb5_creds mcreds, creds;
+
+    memset(&mcreds, 0, sizeof(mcreds));
+    mcreds.client = client;
+    check(krb5_parse_name(ctx, sname, &mcreds.server), ctx, "parse_name");
+    check(krb5_cc_retrieve_cred(ctx, cc, 0, &mcreds, &creds), ctx,
+          "retrieve_cred");
+    if (!data_eq_string(creds.ticket, sname)) {
+        fprintf(stderr, "retrieved wrong ticket for %s\n", sname);
+        exit(1);
+    }
+    krb5_free_cred_contents(ctx, &creds);
+    krb5_free_principal(ctx, mcreds.server);
+}
+
+/* Iterate over the whole cache and check that it holds at least the initial
+ * tickets. */
+static void
+iterate_cache(krb5_context ctx, krb5_ccache cc)
+{
+    krb5_cc_cursor cursor;
+    krb5_creds creds;
+    krb5_error_code ret;
+    int count = 0;
+
+    check(krb5_cc_start_seq_get(ctx, cc, &cursor), ctx, "start_seq_get");
+    while ((ret = krb5_cc_next_cred(ctx, cc, &cursor, &creds)) == 0) {
+        krb5_free_cred_contents(ctx, &creds);
+        count++;
+    }
+    if (ret != KRB5_CC_END)
+        check(ret, ctx, "next_cred");
+    check(krb5_cc_end_seq_get(ctx, cc, &cursor), ctx, "end_seq_get");
+    if (count < ncreds) {
+        fprintf(stderr, "iteration saw %d of %d tickets\n", count, ncreds);
+        exit(1);
+    }
+}
+
+static void *
+run_thread(void *arg)
+{
+    int id = *(int *)arg, i;
+    unsigned int seed = id;
+    krb5_context ctx;
+    krb5_ccache cc;
+    char sname[64];
+
+    check(krb5_init_context(&ctx), NULL, "init_context");
+    for (i = 0; i < iterations; i++) {
+        check(krb5_cc_resolve(ctx, CACHE_NAME, &cc), ctx, "cc_resolve");
+        if (i % STORE_RATE == STORE_RATE - 1) {
+            snprintf(sname, sizeof(sname), "extra/t%d.%d@" REALM, id, i);
+            store_ticket(ctx, cc, sname);
+        } else if (i % ITER_RATE == ITER_RATE / 2) {
+            iterate_cache(ctx, cc);
+        } else {
+            snprintf(sname, sizeof(sname), "host/h%d@" REALM,
+                     rand_r(&seed) % ncreds);
+            retrieve_ticket(ctx, cc, sname);
+        }
+        krb5_cc_close(ctx, cc);
+    }
+    krb5_free_context(ctx);
+    return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+    krb5_context ctx;
+    krb5_ccache cc;
+    pthread_t *threads;
+    struct timeval start, end;
+    double elapsed;
+    char sname[64];
+    int i, *ids;
+
+    if (argc > 1)
+        nthreads = atoi(argv[1]);
+    if (argc > 2)
+        iterations = atoi(argv[2]);
+    if (argc > 3)
+        ncreds = atoi(argv[3]);
+    if (argc > 4 || nthreads <= 0 || iterations <= 0 || ncreds <= 0) {
+        fprintf(stderr, "Usage: %s [nthreads [iterations [ncreds]]]\n",
+                argv[0]);
+        return 1;
+    }
+
+    check(krb5_init_context(&ctx), NULL, "init_context");
+    check(krb5_parse_name(ctx, "user@" REALM, &client), ctx, "parse_name");
+    check(krb5_cc_resolve(ctx, CACHE_NAME, &cc), ctx, "cc_resolve");
+    check(krb5_cc_initialize(ctx, cc, client), ctx, "cc_initialize");
+    for (i = 0; i < ncreds; i++) {
+        snprintf(sname, sizeof(sname), "host/h%d@" REALM, i);
+        store_ticket(ctx, cc, sname);
+    }
+
+    threads = calloc(nthreads, sizeof(*threads));
+    ids = calloc(nthreads, sizeof(*ids));
+    if (threads == NULL || ids == NULL)
+        abort();
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nthreads; i++) {
+        ids[i] = i;
+        if (pthread_create(&threads[i], NULL, run_thread, &ids[i]) != 0)
+            abort();
+    }
+    for (i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    gettimeofday(&end, NULL);
+
+    elapsed = (end.tv_sec - start.tv_sec) +
+        (end.tv_usec - start.tv_usec) / 1000000.0;
+    printf("%d threads, %d operations in %.3f s (%.0f ops/s)\n",
+           nthreads, nthreads * iterations, elapsed,
+           nthreads * iterations / (elapsed > 0 ? elapsed : 1e-6));
+
+    check(krb5_cc_destroy(ctx, cc), ctx, "cc_destroy");
+    krb5_free_principal(ctx, client);
+    krb5_free_context(ctx);
+    free(threads);
+    free(ids);
+    return 0;
+}
@@ -56,6 +56,9 @@
 #include "k5-int.h"
 #include "../os/os-proto.h"
 #include <stdio.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 /*
  * Information needed by internal routines of the file-based ticket
@@ -75,6 +78,37 @@
 /*
  * Types
  */
+
+/* An index entry for one active record of a memory-mapped keytab. */
+struct kt_index_ent {
+    size_t offset;              /* Offset of the record length field */
+    krb5_int32 size;            /* Record length */
+    unsigned int hash;          /* Hash of the principal */
+    krb5_timestamp timestamp;
+    krb5_kvno vno;
+    krb5_enctype enctype;
+    long next;                  /* Next entry in bucket, or -1 */
+};
+
+/*
+ * An immutable index of a mapped keytab file, shared between lookups.  The
+ * refcount is protected by the owning handle's index_lock.
+ */
+struct kt_index {
+    unsigned int refcount;
+    int version;
+    unsigned char *map;
+    size_t maplen;
+    dev_t dev;
+    ino_t ino;
+    time_t mtime;
+    unsigned long mtime_frac;
+    struct kt_index_ent *ents;
+    size_t nents;
+    long *buckets;
+    size_t nbuckets;            /* Always a power of two */
+};
+
 typedef struct _krb5_ktfile_data {
     char *name;                 /* Name of the file */
     FILE *openf;                /* open file, if any. */
@@ -83,6 +117,8 @@ typedef struct _krb5_ktfile_data {
     unsigned int iter_count;    /* Number of active iterators */
     long start_offset;          /* Starting offset after version */
     k5_mutex_t lock;            /* Protect openf, version */
+    struct kt_index *index;     /* MMAP type only: current index, if any */
+    k5_mutex_t index_lock;      /* Protect index and index refcounts */
 } krb5_ktfile_data;
 
 /*
@@ -119,6 +155,7 @@ typedef struct _krb5_ktfile_data {
 
 extern const struct _krb5_kt_ops krb5_ktf_ops;
 extern const struct _krb5_kt_ops krb5_ktf_writable_ops;
+extern const struct _krb5_kt_ops krb5_ktf_mmap_ops;
 
 static krb5_error_code KRB5_CALLCONV
 krb5_ktfile_resolve(krb5_context, const char *, krb5_keytab *);
@@ -179,6 +216,9 @@ static krb5_error_code
 krb5_ktfileint_find_slot(krb5_context, krb5_keytab, krb5_int32 *,
                          krb5_int32 *);
 
+static void
+free_index(struct kt_index *ix);
+
 
 /*
  * This is an implementation specific resolver.  It returns a keytab id
@@ -212,6 +252,12 @@ krb5_ktfile_resolve(krb5_context context, const char *name,
     if (err)
         goto cleanup;
 
+    err = k5_mutex_init(&data->index_lock);
+    if (err) {
+        k5_mutex_destroy(&data->lock);
+        goto cleanup;
+    }
+
     data->openf = 0;
     data->version = 0;
     data->iter_count = 0;
@@ -244,9 +290,11 @@ krb5_ktfile_close(krb5_context context, krb5_keytab id)
  * This routine should undo anything done by krb5_ktfile_resolve().
  */
 {
+    free_index(KTPRIVATE(id)->index);
     free(KTFILENAME(id));
     zap(KTFILEBUFP(id), BUFSIZ);
     k5_mutex_destroy(&((krb5_ktfile_data *)id->data)->lock);
+    k5_mutex_destroy(&((krb5_ktfile_data *)id->data)->index_lock);
     free(id->data);
     id->ops = 0;
     free(id);
@@ -751,7 +799,7 @@ krb5_ktf_keytab_internalize(krb5_context kcontext, krb5_pointer *argp, krb5_octe
     if (kret)
         goto cleanup;
 
-    if (keytab->ops != &krb5_ktf_ops) {
+    if (keytab->ops != &krb5_ktf_ops && keytab->ops != &krb5_ktf_mmap_ops) {
         kret = EINVAL;
         goto cleanup;
     }
@@ -900,6 +948,681 @@ krb5_ktfile_remove(krb5_context context, krb5_keytab id, krb5_keytab_entry *entr
     return kerror;
 }
 
+/*
+ * MMAP keytab type.  This uses the same file format as FILE, but get_entry
+ * maps the file and consults an in-memory hash index of its active records
+ * instead of parsing every record for each lookup.  The index is rebuilt
+ * when the file's identity, size, or modification time changes.  Lookups
+ * hold index_lock only long enough to take a reference to the current
+ * index, so concurrent acceptor threads do not serialize on KTLOCK.  If the
+ * file cannot be mapped, get_entry falls back to the stdio code path, which
+ * also reports any errors.
+ *
+ * Since the mapping is shared with other writers, a keytab should be
+ * replaced by renaming a new file into place rather than by truncating it.
+ */
+
+#define KT_INDEX_MIN_BUCKETS 16
+
+/* The fields of one keytab record, pointing into the mapped file. */
+struct kt_rec {
+    const unsigned char *realm; /* Counted realm, followed by components */
+    int ncomps;
+    krb5_int32 nametype;
+    krb5_timestamp timestamp;
+    krb5_kvno vno;
+    krb5_enctype enctype;
+    const unsigned char *key;
+    unsigned int keylen;
+};
+
+/* Decode 16-bit and 32-bit integers in the byte order for version. */
+static krb5_int16
+get16(int version, const unsigned char *p)
+{
+    krb5_int16 val;
+
+    if (version == KRB5_KT_VNO_1) {
+        memcpy(&val, p, sizeof(val));
+        return val;
+    }
+    return (krb5_int16)load_16_be(p);
+}
+
+static krb5_int32
+get32(int version, const unsigned char *p)
+{
+    krb5_int32 val;
+
+    if (version == KRB5_KT_VNO_1) {
+        memcpy(&val, p, sizeof(val));
+        return val;
+    }
+    return (krb5_int32)load_32_be(p);
+}
+
+/*
+ * Parse the len-byte record at p into rec, applying the same checks as
+ * krb5_ktfileint_internal_read_entry().  Return KRB5_KT_END if the record is
+ * malformed.
+ */
+static krb5_error_code
+parse_record(int version, const unsigned char *p, size_t len,
+             struct kt_rec *rec)
+{
+    const unsigned char *end = p + len;
+    krb5_int16 count, size;
+    int i;
+
+    memset(rec, 0, sizeof(*rec));
+    if (end - p < 2)
+        return KRB5_KT_END;
+    count = get16(version, p);
+    p += 2;
+    if (version == KRB5_KT_VNO_1)
+        count--;                /* V1 includes the realm in the count */
+    if (count <= 0)
+        return KRB5_KT_END;
+    rec->ncomps = count;
+    rec->realm = p;
+
+    /* Skip over the realm and components, checking their lengths. */
+    for (i = 0; i <= count; i++) {
+        if (end - p < 2)
+            return KRB5_KT_END;
+        size = get16(version, p);
+        if (size <= 0 || end - p - 2 < size)
+            return KRB5_KT_END;
+        p += 2 + size;
+    }
+
+    if (version != KRB5_KT_VNO_1) {
+        if (end - p < 4)
+            return KRB5_KT_END;
+        rec->nametype = get32(version, p);
+        p += 4;
+    }
+
+    /* Timestamp, 8-bit kvno, enctype, and key length. */
+    if (end - p < 9)
+        return KRB5_KT_END;
+    rec->timestamp = get32(version, p);
+    rec->vno = p[4];
+    rec->enctype = get16(version, p + 5);
+    size = get16(version, p + 7);
+    p += 9;
+    if (size <= 0 || end - p < size)
+        return KRB5_KT_END;
+    rec->key = p;
+    rec->keylen = size;
+    p += size;
+
+    /* Check for a 32-bit kvno extension if four or more bytes remain.  If
+     * the value is 0, the bytes are just zero-fill. */
+    if (end - p >= 4 && get32(version, p) != 0)
+        rec->vno = (uint32_t)get32(version, p);
+    return 0;
+}
+
+/* Mix a counted string into an FNV-1a hash. */
+static unsigned int
+hash_counted(unsigned int h, const void *data, unsigned int len)
+{
+    const unsigned char *p = data;
+    unsigned char lenbuf[4];
+    unsigned int i;
+
+    store_32_be(len, lenbuf);
+    for (i = 0; i < 4; i++)
+        h = (h ^ lenbuf[i]) * 16777619U;
+    for (i = 0; i < len; i++)
+        h = (h ^ p[i]) * 16777619U;
+    return h & 0xFFFFFFFFU;
+}
+
+/* Hash the realm and components of princ, ignoring the name type as
+ * krb5_principal_compare() does. */
+static unsigned int
+hash_principal(krb5_const_principal princ)
+{
+    unsigned int h = 2166136261U;
+    krb5_int32 i;
+
+    h = hash_counted(h, princ->realm.data, princ->realm.length);
+    for (i = 0; i < princ->length; i++)
+        h = hash_counted(h, princ->data[i].data, princ->data[i].length);
+    return h;
+}
+
+/* Hash the principal of rec, producing the same value as hash_principal(). */
+static unsigned int
+hash_record(int version, const struct kt_rec *rec)
+{
+    const unsigned char *p = rec->realm;
+    unsigned int h = 2166136261U;
+    krb5_int16 size;
+    int i;
+
+    for (i = 0; i <= rec->ncomps; i++) {
+        size = get16(version, p);
+        h = hash_counted(h, p + 2, size);
+        p += 2 + size;
+    }
+    return h;
+}
+
+/* Return true if the principal of rec has the same realm and components as
+ * princ. */
+static krb5_boolean
+record_princ_matches(int version, const struct kt_rec *rec,
+                     krb5_const_principal princ)
+{
+    const unsigned char *p = rec->realm;
+    const krb5_data *d;
+    krb5_int16 size;
+    int i;
+
+    if (rec->ncomps != princ->length)
+        return FALSE;
+    for (i = 0; i <= rec->ncomps; i++) {
+        d = (i == 0) ? &princ->realm : &princ->data[i - 1];
+        size = get16(version, p);
+        if ((unsigned int)size != d->length ||
+            memcmp(p + 2, d->data, size) != 0)
+            return FALSE;
+        p += 2 + size;
+    }
+    return TRUE;
+}
+
+/* Copy rec into a newly allocated keytab entry. */
+static krb5_error_code
+decode_record(krb5_context context, int version, const struct kt_rec *rec,
+              krb5_keytab_entry *entry)
+{
+    krb5_error_code ret;
+    krb5_principal princ;
+    const unsigned char *p = rec->realm;
+    krb5_data *d;
+    krb5_int16 size;
+    int i;
+
+    memset(entry, 0, sizeof(*entry));
+    entry->magic = KV5M_KEYTAB_ENTRY;
+
+    princ = k5alloc(sizeof(*princ), &ret);
+    if (princ == NULL)
+        return ret;
+    princ->magic = KV5M_PRINCIPAL;
+    princ->type = rec->nametype;
+    princ->data = k5calloc(rec->ncomps, sizeof(*princ->data), &ret);
+    if (princ->data == NULL)
+        goto fail;
+    princ->length = rec->ncomps;
+    for (i = 0; i <= rec->ncomps; i++) {
+        d = (i == 0) ? &princ->realm : &princ->data[i - 1];
+        size = get16(version, p);
+        d->magic = KV5M_DATA;
+        d->data = k5memdup0(p + 2, size, &ret);
+        if (d->data == NULL)
+            goto fail;
+        d->length = size;
+        p += 2 + size;
+    }
+
+    entry->key.contents = k5memdup(rec->key, rec->keylen, &ret);
+    if (entry->key.contents == NULL)
+        goto fail;
+    entry->key.magic = KV5M_KEYBLOCK;
+    entry->key.enctype = rec->enctype;
+    entry->key.length = rec->keylen;
+    entry->principal = princ;
+    entry->timestamp = rec->timestamp;
+    entry->vno = rec->vno;
+    return 0;
+
+fail:
+    krb5_free_principal(context, princ);
+    return ret;
+}
+
+static void
+free_index(struct kt_index *ix)
+{
+    if (ix == NULL)
+        return;
+#ifndef _WIN32
+    if (ix->map != NULL)
+        (void)munmap(ix->map, ix->maplen);
+#endif
+    free(ix->ents);
+    free(ix->buckets);
+    free(ix);
+}
+
+/* Return the sub-second part of a file's modification time, if known. */
+static unsigned long
+mtime_frac(const struct stat *st)
+{
+#if defined HAVE_STRUCT_STAT_ST_MTIMENSEC
+    return st->st_mtimensec;
+#elif defined HAVE_STRUCT_STAT_ST_MTIMESPEC_TV_NSEC
+    return st->st_mtimespec.tv_nsec;
+#elif defined HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+    return st->st_mtim.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+/* Return true if ix was built from the file described by st. */
+static krb5_boolean
+index_current(const struct kt_index *ix, const struct stat *st)
+{
+    return ix->dev == st->st_dev && ix->ino == st->st_ino &&
+        (off_t)ix->maplen == st->st_size && ix->mtime == st->st_mtime &&
+        ix->mtime_frac == mtime_frac(st);
+}
+
+/*
+ * Parse the record for ent from the mapped file into rec.  Return false if
+ * the record has been overwritten since the index was built (for example,
+ * by krb5_ktfileint_delete_entry()).
+ */
+static krb5_boolean
+load_index_ent(const struct kt_index *ix, const struct kt_index_ent *ent,
+               struct kt_rec *rec)
+{
+    size_t avail = ix->maplen - ent->offset - 4;
+    size_t len = ((size_t)ent->size < avail) ? (size_t)ent->size : avail;
+
+    if (get32(ix->version, ix->map + ent->offset) != ent->size)
+        return FALSE;
+    if (parse_record(ix->version, ix->map + ent->offset + 4, len, rec) != 0)
+        return FALSE;
+    return rec->vno == ent->vno && rec->enctype == ent->enctype;
+}
+
+/* Append an index entry for the record at offset off. */
+static krb5_error_code
+add_index_ent(struct kt_index *ix, size_t *nalloc, size_t off,
+              krb5_int32 size, const struct kt_rec *rec)
+{
+    struct kt_index_ent *ents, *ent;
+    size_t newalloc;
+
+    if (ix->nents == *nalloc) {
+        newalloc = (*nalloc == 0) ? 64 : *nalloc * 2;
+        ents = realloc(ix->ents, newalloc * sizeof(*ents));
+        if (ents == NULL)
+            return ENOMEM;
+        ix->ents = ents;
+        *nalloc = newalloc;
+    }
+    ent = &ix->ents[ix->nents++];
+    ent->offset = off;
+    ent->size = size;
+    ent->hash = hash_record(ix->version, rec);
+    ent->timestamp = rec->timestamp;
+    ent->vno = rec->vno;
+    ent->enctype = rec->enctype;
+    ent->next = -1;
+    return 0;
+}
+
+/*
+ * Index the records of the mapped file, stopping wherever
+ * krb5_ktfileint_internal_read_entry() would report the end of the table.
+ */
+static krb5_error_code
+scan_index(struct kt_index *ix)
+{
+    krb5_error_code ret;
+    struct kt_rec rec;
+    krb5_int32 size;
+    size_t pos = 2, nalloc = 0, len, hole, i, b;
+
+    while (ix->maplen - pos >= 4) {
+        size = get32(ix->version, ix->map + pos);
+        if (size < 0) {
+            /* Skip over a hole. */
+            hole = (size_t)-(size + 1) + 1;
+            if (hole > ix->maplen - pos - 4)
+                break;
+            pos += 4 + hole;
+            continue;
+        }
+        if (size == 0)
+            break;
+        len = ix->maplen - pos - 4;
+        if ((size_t)size < len)
+            len = size;
+        if (parse_record(ix->version, ix->map + pos + 4, len, &rec) != 0)
+            break;
+        ret = add_index_ent(ix, &nalloc, pos, size, &rec);
+        if (ret)
+            return ret;
+        if ((size_t)size >= ix->maplen - pos - 4)
+            break;
+        pos += 4 + size;
+    }
+
+    ix->nbuckets = KT_INDEX_MIN_BUCKETS;
+    while (ix->nbuckets < ix->nents)
+        ix->nbuckets *= 2;
+    ix->buckets = k5calloc(ix->nbuckets, sizeof(*ix->buckets), &ret);
+    if (ix->buckets == NULL)
+        return ret;
+    for (b = 0; b < ix->nbuckets; b++)
+        ix->buckets[b] = -1;
+
+    /* Insert entries in reverse so that each chain is in file order. */
+    for (i = ix->nents; i > 0; i--) {
+        b = ix->ents[i - 1].hash & (ix->nbuckets - 1);
+        ix->ents[i - 1].next = ix->buckets[b];
+        ix->buckets[b] = i - 1;
+    }
+    return 0;
+}
+
+/* Map the keytab file name and index its records. */
+static krb5_error_code
+build_index(krb5_context context, const char *name, struct kt_index **ix_out)
+{
+#ifdef _WIN32
+    *ix_out = NULL;
+    return EINVAL;
+#else
+    krb5_error_code ret;
+    struct kt_index *ix = NULL;
+    struct stat st;
+    void *map;
+    int fd, locked = 0;
+
+    *ix_out = NULL;
+
+    fd = open(name, O_RDONLY);
+    if (fd == -1)
+        return errno;
+    set_cloexec_fd(fd);
+    ret = krb5_lock_file(context, fd, KRB5_LOCKMODE_SHARED);
+    if (ret)
+        goto cleanup;
+    locked = 1;
+    if (fstat(fd, &st) == -1) {
+        ret = errno;
+        goto cleanup;
+    }
+    if (st.st_size < 2 || (off_t)(size_t)st.st_size != st.st_size) {
+        ret = KRB5_KEYTAB_BADVNO;
+        goto cleanup;
+    }
+
+    ix = k5alloc(sizeof(*ix), &ret);
+    if (ix == NULL)
+        goto cleanup;
+    ix->maplen = st.st_size;
+    ix->dev = st.st_dev;
+    ix->ino = st.st_ino;
+    ix->mtime = st.st_mtime;
+    ix->mtime_frac = mtime_frac(&st);
+    map = mmap(NULL, ix->maplen, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        ret = errno;
+        goto cleanup;
+    }
+    ix->map = map;
+
+    ix->version = load_16_be(ix->map);
+    if (ix->version != KRB5_KT_VNO && ix->version != KRB5_KT_VNO_1) {
+        ret = KRB5_KEYTAB_BADVNO;
+        goto cleanup;
+    }
+    ret = scan_index(ix);
+    if (ret)
+        goto cleanup;
+
+    ix->refcount = 1;
+    *ix_out = ix;
+    ix = NULL;
+
+cleanup:
+    if (locked)
+        (void)krb5_unlock_file(context, fd);
+    close(fd);
+    free_index(ix);
+    return ret;
+#endif
+}
+
+/* Release a reference to ix. */
+static void
+release_index(krb5_keytab id, struct kt_index *ix)
+{
+    krb5_ktfile_data *data = KTPRIVATE(id);
+    krb5_boolean last;
+
+    k5_mutex_lock(&data->index_lock);
+    last = (--ix->refcount == 0);
+    k5_mutex_unlock(&data->index_lock);
+    if (last)
+        free_index(ix);
+}
+
+/* Discard the current index of id, if any, so that it will be rebuilt. */
+static void
+invalidate_index(krb5_keytab id)
+{
+    krb5_ktfile_data *data = KTPRIVATE(id);
+    struct kt_index *ix;
+
+    k5_mutex_lock(&data->index_lock);
+    ix = data->index;
+    data->index = NULL;
+    k5_mutex_unlock(&data->index_lock);
+    if (ix != NULL)
+        release_index(id, ix);
+}
+
+/* Get a reference to an index of id's file, rebuilding it if the file has
+ * changed since it was last indexed. */
+static krb5_error_code
+get_index(krb5_context context, krb5_keytab id, struct kt_index **ix_out)
+{
+    krb5_ktfile_data *data = KTPRIVATE(id);
+    krb5_error_code ret;
+    struct kt_index *ix, *old;
+    struct stat st;
+
+    *ix_out = NULL;
+    if (stat(data->name, &st) == -1)
+        return errno;
+
+    k5_mutex_lock(&data->index_lock);
+    ix = data->index;
+    if (ix != NULL && index_current(ix, &st)) {
+        ix->refcount++;
+        k5_mutex_unlock(&data->index_lock);
+        *ix_out = ix;
+        return 0;
+    }
+    k5_mutex_unlock(&data->index_lock);
+
+    /* Build outside of the lock; if another thread races us, the last index
+     * built wins. */
+    ret = build_index(context, data->name, &ix);
+    if (ret)
+        return ret;
+
+    k5_mutex_lock(&data->index_lock);
+    old = data->index;
+    data->index = ix;
+    ix->refcount++;
+    k5_mutex_unlock(&data->index_lock);
+    if (old != NULL)
+        release_index(id, old);
+    *ix_out = ix;
+    return 0;
+}
+
+/* Return true if e1 is more recent than e2, as more_recent() decides. */
+static krb5_boolean
+index_ent_more_recent(const struct kt_index_ent *e1,
+                      const struct kt_index_ent *e2)
+{
+    krb5_keytab_entry k1, k2;
+
+    k1.timestamp = e1->timestamp;
+    k1.vno = e1->vno;
+    k2.timestamp = e2->timestamp;
+    k2.vno = e2->vno;
+    return more_recent(&k1, &k2);
+}
+
+/*
+ * Look up an entry in ix, choosing among the candidates exactly as
+ * krb5_ktfile_get_entry() does.  Return KRB5_KT_END if nothing matches,
+ * counting entries which matched in all but kvno in *found_wrong_kvno.  Set
+ * *stale if a candidate record changed after the index was built.
+ */
+static krb5_error_code
+index_lookup(krb5_context context, const struct kt_index *ix,
+             krb5_const_principal principal, krb5_kvno kvno,
+             krb5_enctype enctype, krb5_keytab_entry *entry,
+             int *found_wrong_kvno, krb5_boolean *stale)
+{
+    krb5_error_code ret;
+    const struct kt_index_ent *ent, *best = NULL;
+    struct kt_rec rec;
+    krb5_boolean similar;
+    unsigned int h = hash_principal(principal);
+    long i;
+
+    *found_wrong_kvno = 0;
+    *stale = FALSE;
+    for (i = ix->buckets[h & (ix->nbuckets - 1)]; i != -1; i = ent->next) {
+        ent = &ix->ents[i];
+        if (ent->hash != h)
+            continue;
+        if (!load_index_ent(ix, ent, &rec)) {
+            *stale = TRUE;
+            return 0;
+        }
+        if (!record_princ_matches(ix->version, &rec, principal))
+            continue;
+
+        if (enctype != IGNORE_ENCTYPE) {
+            ret = krb5_c_enctype_compare(context, enctype, ent->enctype,
+                                         &similar);
+            if (ret)
+                return ret;
+            if (!similar)
+                continue;
+        }
+
+        if (kvno == IGNORE_VNO) {
+            if (best == NULL || index_ent_more_recent(ent, best))
+                best = ent;
+        } else if (ent->vno == kvno) {
+            best = ent;
+            break;
+        } else if (ent->vno == (kvno & 0xff) && best == NULL) {
+            best = ent;
+        } else {
+            (*found_wrong_kvno)++;
+        }
+    }
+    if (best == NULL)
+        return KRB5_KT_END;
+
+    if (!load_index_ent(ix, best, &rec)) {
+        *stale = TRUE;
+        return 0;
+    }
+    ret = decode_record(context, ix->version, &rec, entry);
+    if (ret)
+        return ret;
+    /* Coerce the enctype of the output keyblock in case we got an inexact
+     * match on the enctype. */
+    if (enctype != IGNORE_ENCTYPE)
+        entry->key.enctype = enctype;
+    return 0;
+}
+
+static krb5_error_code KRB5_CALLCONV
+krb5_ktmmap_resolve(krb5_context context, const char *name,
+                    krb5_keytab *id_out)
+{
+    krb5_error_code ret;
+
+    ret = krb5_ktfile_resolve(context, name, id_out);
+    if (!ret)
+        (*id_out)->ops = &krb5_ktf_mmap_ops;
+    return ret;
+}
+
+static krb5_error_code KRB5_CALLCONV
+krb5_ktmmap_get_entry(krb5_context context, krb5_keytab id,
+                      krb5_const_principal principal, krb5_kvno kvno,
+                      krb5_enctype enctype, krb5_keytab_entry *entry)
+{
+    krb5_error_code ret;
+    struct kt_index *ix;
+    krb5_boolean stale;
+    int tries, found_wrong_kvno;
+    char *princname;
+
+    /* Rebuild the index once if a record changed underneath it. */
+    for (tries = 0; tries < 2; tries++) {
+        if (get_index(context, id, &ix) != 0)
+            break;
+        ret = index_lookup(context, ix, principal, kvno, enctype, entry,
+                           &found_wrong_kvno, &stale);
+        release_index(id, ix);
+        if (stale) {
+            invalidate_index(id);
+            continue;
+        }
+        if (ret != KRB5_KT_END)
+            return ret;
+        if (found_wrong_kvno)
+            return KRB5_KT_KVNONOTFOUND;
+        ret = KRB5_KT_NOTFOUND;
+        if (krb5_unparse_name(context, principal, &princname) == 0) {
+            k5_setmsg(context, ret, _("No key table entry found for %s"),
+                      princname);
+            free(princname);
+        }
+        return ret;
+    }
+
+    /* Use the stdio code path if the file could not be indexed. */
+    return krb5_ktfile_get_entry(context, id, principal, kvno, enctype,
+                                 entry);
+}
+
+static krb5_error_code KRB5_CALLCONV
+krb5_ktmmap_add(krb5_context context, krb5_keytab id,
+                krb5_keytab_entry *entry)
+{
+    krb5_error_code ret;
+
+    ret = krb5_ktfile_add(context, id, entry);
+    invalidate_index(id);
+    return ret;
+}
+
+static krb5_error_code KRB5_CALLCONV
+krb5_ktmmap_remove(krb5_context context, krb5_keytab id,
+                   krb5_keytab_entry *entry)
+{
+    krb5_error_code ret;
+
+    ret = krb5_ktfile_remove(context, id, entry);
+    invalidate_index(id);
+    return ret;
+}
+
 /*
  * krb5_ktf_ops
  */
@@ -959,6 +1682,26 @@ const krb5_kt_ops krb5_kt_dfl_ops = {
     &krb5_ktfile_ser_entry
 };
 
+/*
+ * krb5_ktf_mmap_ops -- the same as krb5_ktf_ops except for the prefix and the
+ * indexed get_entry.
+ */
+
+const struct _krb5_kt_ops krb5_ktf_mmap_ops = {
+    0,
+    "MMAP",     /* Prefix -- this string should not appear anywhere else! */
+    krb5_ktmmap_resolve,
+    krb5_ktfile_get_name,
+    krb5_ktfile_close,
+    krb5_ktmmap_get_entry,
+    krb5_ktfile_start_seq_get,
+    krb5_ktfile_get_next,
+    krb5_ktfile_end_get,
+    krb5_ktmmap_add,
+    krb5_ktmmap_remove,
+    &krb5_ktfile_ser_entry
+};
+
 /* Formerly lib/krb5/keytab/file/ktf_util.c */
 
 /*
@@ -436,6 +436,7 @@ main(void)
     test_misc(context);
     do_test(context, "WRFILE:", FALSE);
     do_test(context, "MEMORY:", TRUE);
+    do_test(context, "MMAP:", TRUE);
 
     krb5_free_context(context);
     return 0;
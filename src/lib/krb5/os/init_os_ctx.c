@@ -513,6 +513,8 @@ k5_os_free_context(krb5_context ctx)
     }
     krb5int_close_plugin_dirs (&ctx->libkrb5_plugins);
 
+    k5_kdc_health_free(ctx);
+
 #ifdef _WIN32
     WSACleanup();
 #endif /* _WIN32 */
@@ -0,0 +1,558 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* lib/krb5/os/kdc_health.c - Track observed KDC latency and failures */
+/*
+ * Copyright (C) 2026 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * k5_sendto() consults a per-context table of KDC health before contacting
+ * any servers.  Each entry records a smoothed round-trip time for the KDC's
+ * answers and, after failures, a time before which the KDC is tried only
+ * after all healthy ones.  If the kdc_health_file relation is set, the table
+ * is also loaded from and merged back into that file, so that short-lived
+ * processes benefit from what earlier ones observed.
+ *
+ * Each line of the file contains, separated by spaces: the transport number,
+ * the hostname or numeric address, the port, the smoothed RTT in milliseconds
+ * (-1 if unknown), the number of consecutive failures, the time until which
+ * the KDC is considered down, and the time the entry was last updated.  When
+ * merging, the entry with the more recent update time wins.
+ *
+ * The file is only rewritten when a KDC is marked down or recovers, or when
+ * its smoothed RTT has moved noticeably from the value last saved, and at most
+ * once every SAVE_INTERVAL seconds (with any remaining changes saved when the
+ * context is freed).  Writers serialize the merge and rename on a lock file
+ * named after the health file with ".lock" appended.
+ */
+
+#include "k5-int.h"
+#include "fake-addrinfo.h"
+#include "os-proto.h"
+
+/* The first failure marks a KDC down for this many seconds, doubling with
+ * each consecutive failure up to the maximum. */
+#define BACKOFF_BASE 10
+#define BACKOFF_MAX 600
+
+/* Forget about KDCs which have not been heard from for a day. */
+#define ENTRY_MAX_AGE (24 * 60 * 60)
+
+/* Save the file at most this often, in seconds. */
+#define SAVE_INTERVAL 5
+
+/* A new RTT estimate is worth saving if it differs from the saved one by more
+ * than a quarter, and by at least this many milliseconds. */
+#define SRTT_SAVE_MIN 10
+
+#define MAX_HOST_LEN 255
+
+struct health_entry {
+    int transport;
+    char *host;
+    int port;
+    int srtt;                   /* Smoothed RTT in ms, or -1 if unknown */
+    int failures;               /* Consecutive failures */
+    time_t down_until;
+    time_t updated;
+    int saved_srtt;             /* srtt as last loaded or saved */
+};
+
+struct k5_kdc_health {
+    struct health_entry *entries;
+    size_t nentries;
+    int race;                   /* Number of KDCs to contact at once */
+    char *path;                 /* Shared file, or NULL */
+    time_t file_mtime;
+    time_t last_save;
+    krb5_boolean dirty;
+};
+
+/* Place the hostname (or numeric address) and port identifying server into
+ * host and *port_out.  Return false if server can't be identified. */
+static krb5_boolean
+server_key(const struct server_entry *server, char *host, size_t hostlen,
+           int *port_out)
+{
+    char portbuf[NI_MAXSERV];
+
+    if (server->hostname != NULL) {
+        if (strlcpy(host, server->hostname, hostlen) >= hostlen)
+            return FALSE;
+        *port_out = server->port;
+        return TRUE;
+    }
+    if (getnameinfo((struct sockaddr *)&server->addr, server->addrlen, host,
+                    hostlen, portbuf, sizeof(portbuf),
+                    NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+        return FALSE;
+    *port_out = atoi(portbuf);
+    return TRUE;
+}
+
+static struct health_entry *
+find_entry(struct k5_kdc_health *h, int transport, const char *host, int port)
+{
+    size_t i;
+    struct health_entry *e;
+
+    for (i = 0; i < h->nentries; i++) {
+        e = &h->entries[i];
+        if (e->transport == transport && e->port == port &&
+            strcmp(e->host, host) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+static struct health_entry *
+add_entry(struct k5_kdc_health *h, int transport, const char *host, int port)
+{
+    struct health_entry *newents, *e;
+    char *hostcopy;
+
+    hostcopy = strdup(host);
+    if (hostcopy == NULL)
+        return NULL;
+    newents = realloc(h->entries, (h->nentries + 1) * sizeof(*h->entries));
+    if (newents == NULL) {
+        free(hostcopy);
+        return NULL;
+    }
+    h->entries = newents;
+    e = &h->entries[h->nentries++];
+    e->transport = transport;
+    e->host = hostcopy;
+    e->port = port;
+    e->srtt = -1;
+    e->failures = 0;
+    e->down_until = 0;
+    e->updated = 0;
+    e->saved_srtt = -1;
+    return e;
+}
+
+/* Merge the contents of the shared file into h, keeping whichever version of
+ * each entry was updated more recently. */
+static void
+load_file(struct k5_kdc_health *h)
+{
+    FILE *fp;
+    struct stat st;
+    struct health_entry *e;
+    char line[512], host[MAX_HOST_LEN + 1];
+    int transport, port, srtt, failures;
+    long down_until, updated;
+    time_t now = time(NULL);
+
+    fp = fopen(h->path, "r");
+    if (fp == NULL)
+        return;
+    set_cloexec_file(fp);
+    if (fstat(fileno(fp), &st) == 0)
+        h->file_mtime = st.st_mtime;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "%d %255s %d %d %d %ld %ld", &transport, host, &port,
+                   &srtt, &failures, &down_until, &updated) != 7)
+            continue;
+        if (updated < now - ENTRY_MAX_AGE)
+            continue;
+        e = find_entry(h, transport, host, port);
+        if (e != NULL && e->updated >= updated)
+            continue;
+        if (e == NULL)
+            e = add_entry(h, transport, host, port);
+        if (e == NULL)
+            break;
+        e->srtt = e->saved_srtt = srtt;
+        e->failures = failures;
+        e->down_until = down_until;
+        e->updated = updated;
+    }
+    fclose(fp);
+}
+
+/* Reload the shared file if another process has replaced it. */
+static void
+refresh(struct k5_kdc_health *h)
+{
+    struct stat st;
+
+    if (h->path == NULL || stat(h->path, &st) != 0)
+        return;
+    if (st.st_mtime != h->file_mtime)
+        load_file(h);
+}
+
+/* Create the health table for context if it doesn't exist yet. */
+static krb5_error_code
+get_health(krb5_context context, struct k5_kdc_health **h_out)
+{
+    krb5_error_code ret;
+    struct k5_kdc_health *h;
+    char *fname = NULL;
+    int race;
+
+    *h_out = NULL;
+    if (context->kdc_health != NULL) {
+        *h_out = context->kdc_health;
+        return 0;
+    }
+
+    h = k5alloc(sizeof(*h), &ret);
+    if (h == NULL)
+        return ret;
+
+    ret = profile_get_integer(context->profile, KRB5_CONF_LIBDEFAULTS,
+                              KRB5_CONF_KDC_RACE_COUNT, NULL, 1, &race);
+    h->race = (ret == 0 && race > 1) ? race : 1;
+
+    ret = profile_get_string(context->profile, KRB5_CONF_LIBDEFAULTS,
+                             KRB5_CONF_KDC_HEALTH_FILE, NULL, NULL, &fname);
+    if (ret == 0 && fname != NULL) {
+        ret = k5_expand_path_tokens(context, fname, &h->path);
+        profile_release_string(fname);
+        if (ret) {
+            free(h);
+            return ret;
+        }
+        load_file(h);
+    }
+
+    context->kdc_health = h;
+    *h_out = h;
+    return 0;
+}
+
+/* Find or create the entry for server. */
+static struct health_entry *
+lookup_server(krb5_context context, const struct server_entry *server)
+{
+    struct k5_kdc_health *h;
+    struct health_entry *e;
+    char host[MAX_HOST_LEN + 1];
+    int port;
+
+    if (get_health(context, &h) != 0)
+        return NULL;
+    if (!server_key(server, host, sizeof(host), &port))
+        return NULL;
+    e = find_entry(h, server->transport, host, port);
+    if (e == NULL)
+        e = add_entry(h, server->transport, host, port);
+    return e;
+}
+
+/* Classify a server for ordering: 0 if it is up and its RTT is known, 1 if it
+ * is up with no measurements, or 2 if it is marked down. */
+static int
+server_class(const struct health_entry *e, time_t now)
+{
+    if (e == NULL)
+        return 1;
+    if (e->down_until > now)
+        return 2;
+    return (e->srtt >= 0) ? 0 : 1;
+}
+
+/* Return true if the server with health entry a should be tried after the
+ * one with entry b. */
+static krb5_boolean
+sorts_after(const struct health_entry *a, const struct health_entry *b,
+            time_t now)
+{
+    int ca = server_class(a, now), cb = server_class(b, now);
+
+    if (ca != cb)
+        return ca > cb;
+    if (ca == 0)
+        return a->srtt > b->srtt;
+    if (ca == 2)
+        return a->down_until > b->down_until;
+    return FALSE;
+}
+
+/*
+ * Compute the order in which k5_sendto() should contact the servers in
+ * servers: healthy KDCs by increasing smoothed RTT, then KDCs without
+ * measurements in their configured order, then KDCs which are marked down by
+ * the time they come back up.  Set *order_out to an allocated permutation of
+ * the server indices and *race_out to the number of servers to contact
+ * without waiting for an answer in between.
+ */
+krb5_error_code
+k5_kdc_health_order(krb5_context context, const struct serverlist *servers,
+                    size_t **order_out, int *race_out)
+{
+    krb5_error_code ret;
+    struct k5_kdc_health *h;
+    struct health_entry **ents = NULL, *e;
+    size_t *order = NULL, i, j, n = servers->nservers, nup;
+    char host[MAX_HOST_LEN + 1];
+    int port;
+    time_t now = time(NULL);
+
+    *order_out = NULL;
+    *race_out = 1;
+
+    ret = get_health(context, &h);
+    if (ret)
+        return ret;
+    refresh(h);
+
+    order = k5calloc(n + 1, sizeof(*order), &ret);
+    if (order == NULL)
+        goto cleanup;
+    ents = k5calloc(n + 1, sizeof(*ents), &ret);
+    if (ents == NULL)
+        goto cleanup;
+
+    /* Insertion-sort the server indices, keeping ties in configured order. */
+    nup = 0;
+    for (i = 0; i < n; i++) {
+        e = NULL;
+        if (server_key(&servers->servers[i], host, sizeof(host), &port))
+            e = find_entry(h, servers->servers[i].transport, host, port);
+        ents[i] = e;
+        if (server_class(e, now) != 2)
+            nup++;
+        for (j = i; j > 0 && sorts_after(ents[order[j - 1]], e, now); j--)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+
+    *race_out = (nup < (size_t)h->race) ? (int)nup : h->race;
+    if (*race_out < 1)
+        *race_out = 1;
+    if (n > 0 && order[0] != 0 && server_key(&servers->servers[order[0]],
+                                             host, sizeof(host), &port)) {
+        e = ents[order[0]];
+        TRACE_KDC_HEALTH_ORDER(context, host, port,
+                               (e != NULL) ? e->srtt : -1, *race_out);
+    }
+
+    *order_out = order;
+    order = NULL;
+
+cleanup:
+    free(order);
+    free(ents);
+    return ret;
+}
+
+/* Return true if e's smoothed RTT has moved far enough from the saved value
+ * to be worth saving. */
+static krb5_boolean
+srtt_moved(const struct health_entry *e)
+{
+    int diff;
+
+    if (e->saved_srtt < 0)
+        return TRUE;
+    diff = abs(e->srtt - e->saved_srtt);
+    return diff >= SRTT_SAVE_MIN && diff > e->saved_srtt / 4;
+}
+
+/* Record that server answered a request after rtt_ms milliseconds. */
+void
+k5_kdc_health_success(krb5_context context, const struct server_entry *server,
+                      long rtt_ms)
+{
+    struct health_entry *e;
+    krb5_boolean recovered;
+
+    e = lookup_server(context, server);
+    if (e == NULL)
+        return;
+    if (rtt_ms < 0)
+        rtt_ms = 0;
+    if (rtt_ms > 60000)
+        rtt_ms = 60000;
+    recovered = (e->failures > 0);
+    e->srtt = (e->srtt < 0) ? rtt_ms : (7 * e->srtt + rtt_ms) / 8;
+    e->failures = 0;
+    e->down_until = 0;
+    e->updated = time(NULL);
+    if (recovered || srtt_moved(e))
+        context->kdc_health->dirty = TRUE;
+    TRACE_KDC_HEALTH_RTT(context, e->host, e->port, rtt_ms, e->srtt);
+}
+
+/* Record that server failed or did not answer in time, and mark it down for
+ * an exponentially increasing period. */
+void
+k5_kdc_health_failure(krb5_context context, const struct server_entry *server)
+{
+    struct health_entry *e;
+    time_t backoff, now;
+    int i;
+
+    e = lookup_server(context, server);
+    if (e == NULL)
+        return;
+    e->failures++;
+    backoff = BACKOFF_BASE;
+    for (i = 1; i < e->failures && backoff < BACKOFF_MAX; i++)
+        backoff *= 2;
+    if (backoff > BACKOFF_MAX)
+        backoff = BACKOFF_MAX;
+    now = time(NULL);
+    /* Other processes need to know if this KDC has just gone down. */
+    if (e->down_until <= now)
+        context->kdc_health->dirty = TRUE;
+    e->updated = now;
+    e->down_until = now + backoff;
+    TRACE_KDC_HEALTH_DOWN(context, e->host, e->port, e->failures, backoff);
+}
+
+/* Merge h into the shared file, holding the lock file while doing so. */
+static void
+save_file(krb5_context context, struct k5_kdc_health *h)
+{
+    struct health_entry *e;
+    struct stat st;
+    char *tmpname = NULL, *lockname = NULL;
+    FILE *fp = NULL;
+    int fd, lockfd = -1, err = 0;
+    size_t i;
+    time_t now = time(NULL);
+
+    h->dirty = FALSE;
+    h->last_save = now;
+
+    if (asprintf(&lockname, "%s.lock", h->path) < 0) {
+        lockname = NULL;
+        err = ENOMEM;
+        goto cleanup;
+    }
+    lockfd = open(lockname, O_RDWR | O_CREAT, 0600);
+    if (lockfd == -1) {
+        err = errno;
+        goto cleanup;
+    }
+    set_cloexec_fd(lockfd);
+    err = krb5_lock_file(context, lockfd, KRB5_LOCKMODE_EXCLUSIVE);
+    if (err)
+        goto cleanup;
+
+    /* Pick up entries written by other processes since we last looked. */
+    load_file(h);
+
+    if (asprintf(&tmpname, "%s.XXXXXX", h->path) < 0) {
+        tmpname = NULL;
+        err = ENOMEM;
+        goto cleanup;
+    }
+    fd = mkstemp(tmpname);
+    if (fd == -1) {
+        err = errno;
+        free(tmpname);
+        tmpname = NULL;
+        goto cleanup;
+    }
+    fp = fdopen(fd, "w");
+    if (fp == NULL) {
+        err = errno;
+        close(fd);
+        goto cleanup;
+    }
+    set_cloexec_file(fp);
+
+    for (i = 0; i < h->nentries; i++) {
+        e = &h->entries[i];
+        if (e->updated < now - ENTRY_MAX_AGE ||
+            strlen(e->host) > MAX_HOST_LEN || strpbrk(e->host, " \t\n"))
+            continue;
+        fprintf(fp, "%d %s %d %d %d %ld %ld\n", e->transport, e->host,
+                e->port, e->srtt, e->failures, (long)e->down_until,
+                (long)e->updated);
+    }
+    err = ferror(fp) ? EIO : 0;
+    if (fclose(fp) != 0 && err == 0)
+        err = errno;
+    fp = NULL;
+    if (err)
+        goto cleanup;
+    if (rename(tmpname, h->path) != 0) {
+        err = errno;
+        goto cleanup;
+    }
+    free(tmpname);
+    tmpname = NULL;
+    if (stat(h->path, &st) == 0)
+        h->file_mtime = st.st_mtime;
+    for (i = 0; i < h->nentries; i++)
+        h->entries[i].saved_srtt = h->entries[i].srtt;
+
+cleanup:
+    if (err)
+        TRACE_KDC_HEALTH_SAVE_ERROR(context, h->path, err);
+    if (tmpname != NULL) {
+        (void)unlink(tmpname);
+        free(tmpname);
+    }
+    if (lockfd != -1) {
+        (void)krb5_lock_file(context, lockfd, KRB5_LOCKMODE_UNLOCK);
+        close(lockfd);
+    }
+    free(lockname);
+}
+
+/* If the table is shared and has changed in a way worth saving, merge it into
+ * the shared file, unless we did so within the last SAVE_INTERVAL seconds. */
+void
+k5_kdc_health_save(krb5_context context)
+{
+    struct k5_kdc_health *h = context->kdc_health;
+
+    if (h == NULL || !h->dirty || h->path == NULL)
+        return;
+    if (time(NULL) - h->last_save < SAVE_INTERVAL)
+        return;
+    save_file(context, h);
+}
+
+void
+k5_kdc_health_free(krb5_context context)
+{
+    struct k5_kdc_health *h = context->kdc_health;
+    size_t i;
+
+    if (h == NULL)
+        return;
+    /* Save any changes held back by the rate limit. */
+    if (h->dirty && h->path != NULL)
+        save_file(context, h);
+    for (i = 0; i < h->nentries; i++)
+        free(h->entries[i].host);
+    free(h->entries);
+    free(h->path);
+    free(h);
+    context->kdc_health = NULL;
+}
@@ -128,6 +128,18 @@ krb5_error_code k5_sendto(krb5_context context, const krb5_data *message,
                                              void *),
                           void *msg_handler_data);
 
+/* kdc_health.c */
+krb5_error_code k5_kdc_health_order(krb5_context context,
+                                    const struct serverlist *servers,
+                                    size_t **order_out, int *race_out);
+void k5_kdc_health_success(krb5_context context,
+                           const struct server_entry *entry,
+                           long rtt_ms);
+void k5_kdc_health_failure(krb5_context context,
+                           const struct server_entry *entry);
+void k5_kdc_health_save(krb5_context context);
+void k5_kdc_health_free(krb5_context context);
+
 krb5_error_code krb5int_get_fq_local_hostname(char *, size_t);
 
 /* The io vector is *not* const here, unlike writev()!  */
@@ -135,7 +135,9 @@ struct conn_state {
     size_t server_index;
     struct conn_state *next;
     time_ms endtime;
+    time_ms sendtime;           /* When we first tried this address */
     krb5_boolean defer;
+    krb5_boolean timed_out;     /* Waited for in full without an answer */
     struct {
         const char *uri_path;
         const char *servername;
@@ -867,6 +869,7 @@ start_connection(krb5_context context, struct conn_state *state,
     static const int one = 1;
     static const struct linger lopt = { 0, 0 };
 
+    (void)get_curtime_ms(&state->sendtime);
     type = socktype_for_transport(state->addr.transport);
     fd = socket(state->addr.family, type, 0);
     if (fd == INVALID_SOCKET)
@@ -1465,8 +1468,54 @@ service_fds(krb5_context context, struct select_state *selstate,
  * There is one exception to the above rules.  Whenever a TCP connection is
  * established, we wait up to ten seconds for it to finish or fail before
  * moving on.  This reduces network traffic significantly in a TCP environment.
+ *
+ * Servers are contacted in the order chosen by k5_kdc_health_order(), and the
+ * first kdc_race_count servers are contacted without waiting in between.
  */
 
+/*
+ * Update the KDC health table with the outcome of an exchange.  The server
+ * which answered gets its RTT recorded.  Any other server we contacted is
+ * marked down if all of its connections failed, if we waited out its full
+ * second before moving on to the next server, or if the exchange ended with
+ * no server answering (unreachable is true).  A server which was raced
+ * against the one which answered is not penalized for being slower.
+ */
+static void
+record_health(krb5_context context, const struct serverlist *servers,
+              struct conn_state *conns, struct conn_state *winner,
+              krb5_boolean unreachable)
+{
+    struct conn_state *state;
+    time_ms now;
+    size_t s;
+    krb5_boolean contacted, all_failed, timed_out;
+
+    if (get_curtime_ms(&now) != 0)
+        return;
+    for (s = 0; s < servers->nservers; s++) {
+        if (winner != NULL && winner->server_index == s) {
+            k5_kdc_health_success(context, &servers->servers[s],
+                                  (long)(now - winner->sendtime));
+            continue;
+        }
+        contacted = timed_out = FALSE;
+        all_failed = TRUE;
+        for (state = conns; state != NULL; state = state->next) {
+            if (state->server_index != s || state->sendtime == 0)
+                continue;
+            contacted = TRUE;
+            if (state->state != FAILED)
+                all_failed = FALSE;
+            if (state->timed_out)
+                timed_out = TRUE;
+        }
+        if (contacted && (unreachable || all_failed || timed_out))
+            k5_kdc_health_failure(context, &servers->servers[s]);
+    }
+    k5_kdc_health_save(context);
+}
+
 krb5_error_code
 k5_sendto(krb5_context context, const krb5_data *message,
           const krb5_data *realm, const struct serverlist *servers,
@@ -1478,11 +1527,12 @@ k5_sendto(krb5_context context, const krb5_data *message,
           int (*msg_handler)(krb5_context, const krb5_data *, void *),
           void *msg_handler_data)
 {
-    int pass;
+    int pass, race;
     time_ms delay;
     krb5_error_code retval;
-    struct conn_state *conns = NULL, *state, **tailptr, *next, *winner;
-    size_t s;
+    struct conn_state *conns = NULL, *state, **tailptr, *next, *winner = NULL;
+    time_ms wait;
+    size_t i, s, *order = NULL;
     struct select_state *sel_state = NULL, *seltemp;
     char *udpbuf = NULL;
     krb5_boolean done = FALSE;
@@ -1499,9 +1549,18 @@ k5_sendto(krb5_context context, const krb5_data *message,
     seltemp = &sel_state[1];
     cm_init_selstate(sel_state);
 
+    retval = k5_kdc_health_order(context, servers, &order, &race);
+    if (retval)
+        goto cleanup;
+    /* Don't race kpasswd requests, which the callback prepares per socket. */
+    if (callback_info != NULL)
+        race = 1;
+
     /* First pass: resolve server hosts, communicate with resulting addresses
-     * of the preferred transport, and wait 1s for an answer from each. */
-    for (s = 0; s < servers->nservers && !done; s++) {
+     * of the preferred transport, and wait 1s for an answer from each (except
+     * the first race - 1 servers, which get no head start). */
+    for (i = 0; i < servers->nservers && !done; i++) {
+        s = order[i];
         /* Find the current tail pointer. */
         for (tailptr = &conns; *tailptr != NULL; tailptr = &(*tailptr)->next);
         retval = resolve_server(context, realm, servers, s, strategy, message,
@@ -1516,8 +1575,11 @@ k5_sendto(krb5_context context, const krb5_data *message,
             if (maybe_send(context, state, message, sel_state, realm,
                            callback_info))
                 continue;
-            done = service_fds(context, sel_state, 1000, conns, seltemp,
+            wait = (i + 1 < (size_t)race) ? 0 : 1000;
+            done = service_fds(context, sel_state, wait, conns, seltemp,
                                realm, msg_handler, msg_handler_data, &winner);
+            if (!done && wait > 0)
+                state->timed_out = TRUE;
         }
     }
 
@@ -1531,6 +1593,8 @@ k5_sendto(krb5_context context, const krb5_data *message,
             continue;
         done = service_fds(context, sel_state, 1000, conns, seltemp,
                            realm, msg_handler, msg_handler_data, &winner);
+        if (!done)
+            state->timed_out = TRUE;
     }
 
     /* Wait for two seconds at the end of the first pass. */
@@ -1548,6 +1612,8 @@ k5_sendto(krb5_context context, const krb5_data *message,
                 continue;
             done = service_fds(context, sel_state, 1000, conns, seltemp,
                                realm, msg_handler, msg_handler_data, &winner);
+            if (!done)
+                state->timed_out = TRUE;
             if (sel_state->nfds == 0)
                 break;
         }
@@ -1576,6 +1642,9 @@ k5_sendto(krb5_context context, const krb5_data *message,
     TRACE_SENDTO_KDC_RESPONSE(context, reply->length, &winner->addr);
 
 cleanup:
+    if (order != NULL)
+        record_health(context, servers, conns, (retval == 0) ? winner : NULL,
+                      retval == KRB5_KDC_UNREACH);
     for (state = conns; state != NULL; state = next) {
         next = state->next;
         if (state->fd != INVALID_SOCKET) {
@@ -1596,5 +1665,6 @@ cleanup:
     if (reply->data != udpbuf)
         free(udpbuf);
     free(sel_state);
+    free(order);
     return retval;
 }
@@ -87,5 +87,8 @@ krb5_error_code krb5_rc_register_type(krb5_context, const krb5_rc_ops *);
 
 extern const krb5_rc_ops krb5_rc_dfl_ops;
 extern const krb5_rc_ops krb5_rc_none_ops;
+#ifndef _WIN32
+extern const krb5_rc_ops krb5_rc_mmap_ops;
+#endif
 
 #endif /* __KRB5_RCACHE_INT_H__ */
@@ -41,10 +41,11 @@
 
 #define UNIQUE getpid() /* hopefully unique number */
 
-#define GETDIR (dir = getdir(), dirlen = strlen(dir) + sizeof(PATH_SEPARATOR) - 1)
+#define GETDIR (dir = krb5_rc_io_getdir(),                      \
+                dirlen = strlen(dir) + sizeof(PATH_SEPARATOR) - 1)
 
-static char *
-getdir(void)
+char *
+krb5_rc_io_getdir(void)
 {
     char *dir;
 
@@ -121,9 +122,9 @@ krb5_rc_io_mkstemp(krb5_context context, krb5_rc_iostuff *d, char *dir)
 static krb5_error_code rc_map_errno (int) __attribute__((cold));
 #endif
 
-static krb5_error_code
-rc_map_errno (krb5_context context, int e, const char *fn,
-              const char *operation)
+krb5_error_code
+krb5_rc_io_map_errno(krb5_context context, int e, const char *fn,
+                     const char *operation)
 {
     switch (e) {
     case EFBIG:
@@ -186,7 +187,7 @@ krb5_rc_io_creat(krb5_context context, krb5_rc_iostuff *d, char **fn)
         }
     }
     if (d->fd == -1) {
-        retval = rc_map_errno(context, errno, d->fn, "create");
+        retval = krb5_rc_io_map_errno(context, errno, d->fn, "create");
         if (retval == KRB5_RC_IO_PERM)
             do_not_unlink = 1;
         goto cleanup;
@@ -226,7 +227,7 @@ krb5_rc_io_open_internal(krb5_context context, krb5_rc_iostuff *d, char *fn,
 #endif
     char *dir;
 
-    dir = getdir();
+    dir = krb5_rc_io_getdir();
     if (full_pathname) {
         if (!(d->fn = strdup(full_pathname)))
             return KRB5_RC_IO_MALLOC;
@@ -238,24 +239,24 @@ krb5_rc_io_open_internal(krb5_context context, krb5_rc_iostuff *d, char *fn,
 #ifdef NO_USERID
     d->fd = THREEPARAMOPEN(d->fn, O_RDWR | O_BINARY, 0600);
     if (d->fd == -1) {
-        retval = rc_map_errno(context, errno, d->fn, "open");
+        retval = krb5_rc_io_map_errno(context, errno, d->fn, "open");
         goto cleanup;
     }
 #else
     d->fd = -1;
     retval = lstat(d->fn, &sb1);
     if (retval != 0) {
-        retval = rc_map_errno(context, errno, d->fn, "lstat");
+        retval = krb5_rc_io_map_errno(context, errno, d->fn, "lstat");
         goto cleanup;
     }
     d->fd = THREEPARAMOPEN(d->fn, O_RDWR | O_BINARY, 0600);
     if (d->fd < 0) {
-        retval = rc_map_errno(context, errno, d->fn, "open");
+        retval = krb5_rc_io_map_errno(context, errno, d->fn, "open");
         goto cleanup;
     }
     retval = fstat(d->fd, &sb2);
     if (retval < 0) {
-        retval = rc_map_errno(context, errno, d->fn, "fstat");
+        retval = krb5_rc_io_map_errno(context, errno, d->fn, "fstat");
         goto cleanup;
     }
     /* check if someone was playing with symlinks */
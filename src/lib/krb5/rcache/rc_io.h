@@ -57,4 +57,12 @@ krb5_rc_io_sync(krb5_context, krb5_rc_iostuff *);
 
 long
 krb5_rc_io_size(krb5_context, krb5_rc_iostuff *);
+
+/* Return the directory in which replay cache files are kept. */
+char *
+krb5_rc_io_getdir(void);
+
+/* Map an errno value from operation on the file fn to an rcache error. */
+krb5_error_code
+krb5_rc_io_map_errno(krb5_context, int, const char *, const char *);
 #endif
@@ -0,0 +1,582 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* lib/krb5/rcache/rc_mmap.c - Memory-mapped hash table replay cache */
+/*
+ * Copyright (C) 2026 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The "mmap" replay cache type keeps a hash table of authenticator tags,
+ * sized when the file is created, in a file which every process using the
+ * cache maps shared.  Opening the cache reads only the header, and a store
+ * examines a single bucket, so neither cost grows with the number of entries.
+ * There is no expunge pass: each slot records the authenticator timestamp,
+ * and a slot whose timestamp has fallen out of the cache lifespan is free to
+ * be reused.
+ *
+ * A store locks only the byte range of its bucket, so processes storing into
+ * different buckets do not wait for each other.  Where the platform has open
+ * file description locks, they are used so that separate handles in one
+ * process also exclude each other.
+ *
+ * The file is written in host byte order and is not shared with the dfl
+ * format; the cache named NAME lives in the replay cache directory as
+ * NAME.mmap.  Stores are not flushed to disk, so entries may be lost if the
+ * host crashes.
+ */
+
+#include "k5-int.h"
+#include "rc_base.h"
+#include "rc_io.h"
+#include "rc-int.h"
+
+#ifndef _WIN32
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MMAP_MAGIC      0x4B35524D      /* "K5RM" */
+#define MMAP_VERSION    1
+#define MMAP_SLOTS      16              /* Slots per bucket */
+#define MMAP_RATE       256             /* Default authenticators/second */
+#define MMAP_DEFAULT_LIFESPAN 300       /* Used if lifespan and clockskew are
+                                         * not positive */
+#define MMAP_MAX_BUCKETS (1U << 18)     /* 64 MiB of buckets */
+#define MMAP_TAG_LEN    12
+#define MMAP_HEADER_LEN 64
+
+struct mmap_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nbuckets;
+    int32_t lifespan;
+};
+
+/* A slot is empty if its timestamp is zero. */
+struct mmap_slot {
+    uint32_t timestamp;
+    unsigned char tag[MMAP_TAG_LEN];
+};
+
+#define MMAP_BUCKET_LEN (MMAP_SLOTS * sizeof(struct mmap_slot))
+
+struct mmap_data {
+    char *name;
+    char *fn;
+    int fd;
+    unsigned char *map;
+    size_t maplen;
+    uint32_t nbuckets;
+    krb5_deltat lifespan;
+};
+
+static size_t
+file_len(uint32_t nbuckets)
+{
+    return MMAP_HEADER_LEN + (size_t)nbuckets * MMAP_BUCKET_LEN;
+}
+
+static struct mmap_slot *
+bucket_slots(struct mmap_data *d, uint32_t b)
+{
+    return (struct mmap_slot *)(d->map + MMAP_HEADER_LEN +
+                                (size_t)b * MMAP_BUCKET_LEN);
+}
+
+/*
+ * Choose the number of buckets for a new cache with the given lifespan.  By
+ * default, size the table to hold MMAP_RATE authenticators per second of
+ * lifespan at half occupancy, since a request is refused when its bucket is
+ * full; a lifespan which is not positive is replaced by the clock skew.  The
+ * rcache_mmap_entries relation overrides the entry count.  Either way the
+ * table is limited to MMAP_MAX_BUCKETS.
+ */
+static uint32_t
+choose_nbuckets(krb5_context context, krb5_deltat lifespan)
+{
+    uint32_t nbuckets;
+    uint64_t entries, want;
+    int n;
+
+    if (profile_get_integer(context->profile, KRB5_CONF_LIBDEFAULTS,
+                            KRB5_CONF_RCACHE_MMAP_ENTRIES, NULL, 0,
+                            &n) == 0 && n > 0) {
+        entries = n;
+    } else {
+        if (lifespan <= 0)
+            lifespan = context->clockskew;
+        if (lifespan <= 0)
+            lifespan = MMAP_DEFAULT_LIFESPAN;
+        entries = (uint64_t)lifespan * MMAP_RATE * 2;
+    }
+    want = (entries + MMAP_SLOTS - 1) / MMAP_SLOTS;
+    nbuckets = 1;
+    while (nbuckets < want && nbuckets < MMAP_MAX_BUCKETS)
+        nbuckets <<= 1;
+    return nbuckets;
+}
+
+/* Lock or unlock (according to type) the byte range of bucket b, or the
+ * whole file if b is -1. */
+static krb5_error_code
+lock_bucket(krb5_context context, struct mmap_data *d, long b, short type)
+{
+    struct flock fl;
+    int st;
+
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = (b < 0) ? 0 : MMAP_HEADER_LEN + b * MMAP_BUCKET_LEN;
+    fl.l_len = (b < 0) ? 0 : MMAP_BUCKET_LEN;
+    do {
+#ifdef F_OFD_SETLKW
+        st = fcntl(d->fd, F_OFD_SETLKW, &fl);
+        if (st == -1 && errno == EINVAL)
+            st = fcntl(d->fd, F_SETLKW, &fl);
+#else
+        st = fcntl(d->fd, F_SETLKW, &fl);
+#endif
+    } while (st == -1 && errno == EINTR);
+    return (st == -1) ? krb5_rc_io_map_errno(context, errno, d->fn, "lock") :
+        0;
+}
+
+/* Unmap and close d's file, leaving d resolved but not open. */
+static void
+close_file(struct mmap_data *d)
+{
+    if (d->map != NULL)
+        munmap(d->map, d->maplen);
+    d->map = NULL;
+    d->maplen = 0;
+    if (d->fd != -1)
+        close(d->fd);
+    d->fd = -1;
+}
+
+/* Open and map d->fn, checking its ownership, permissions, and header.
+ * Return ENOENT if the file does not exist. */
+static krb5_error_code
+open_file(krb5_context context, struct mmap_data *d)
+{
+    krb5_error_code ret;
+    struct mmap_header hdr;
+    struct stat sb1, sb2;
+    void *map;
+
+    /* Let recover_or_init distinguish a missing file from other errors. */
+    if (lstat(d->fn, &sb1) != 0) {
+        return (errno == ENOENT) ? ENOENT :
+            krb5_rc_io_map_errno(context, errno, d->fn, "lstat");
+    }
+    d->fd = open(d->fn, O_RDWR);
+    if (d->fd == -1)
+        return krb5_rc_io_map_errno(context, errno, d->fn, "open");
+    set_cloexec_fd(d->fd);
+    if (fstat(d->fd, &sb2) != 0) {
+        ret = krb5_rc_io_map_errno(context, errno, d->fn, "fstat");
+        goto cleanup;
+    }
+    if (sb1.st_dev != sb2.st_dev || sb1.st_ino != sb2.st_ino ||
+        !S_ISREG(sb2.st_mode)) {
+        ret = KRB5_RC_IO_PERM;
+        k5_setmsg(context, ret, _("rcache not a file %s"), d->fn);
+        goto cleanup;
+    }
+    if (sb2.st_mode & 077) {
+        ret = KRB5_RC_IO_UNKNOWN;
+        k5_setmsg(context, ret,
+                  _("Insecure file mode for replay cache file %s"), d->fn);
+        goto cleanup;
+    }
+    if (sb2.st_uid != geteuid()) {
+        ret = KRB5_RC_IO_PERM;
+        k5_setmsg(context, ret, _("rcache not owned by %d"),
+                  (int)geteuid());
+        goto cleanup;
+    }
+
+    /* Files are created fully formed and renamed into place, so a short or
+     * mismatched header means a different format. */
+    if (pread(d->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        hdr.magic != MMAP_MAGIC || hdr.version != MMAP_VERSION ||
+        hdr.nbuckets == 0 || (hdr.nbuckets & (hdr.nbuckets - 1)) != 0 ||
+        hdr.nbuckets > (SIZE_MAX - MMAP_HEADER_LEN) / MMAP_BUCKET_LEN ||
+        (uintmax_t)sb2.st_size != file_len(hdr.nbuckets)) {
+        ret = KRB5_RCACHE_BADVNO;
+        goto cleanup;
+    }
+
+    map = mmap(NULL, file_len(hdr.nbuckets), PROT_READ | PROT_WRITE,
+               MAP_SHARED, d->fd, 0);
+    if (map == MAP_FAILED) {
+        ret = krb5_rc_io_map_errno(context, errno, d->fn, "map");
+        goto cleanup;
+    }
+    d->map = map;
+    d->maplen = file_len(hdr.nbuckets);
+    d->nbuckets = hdr.nbuckets;
+    d->lifespan = hdr.lifespan;
+    return 0;
+
+cleanup:
+    close_file(d);
+    return ret;
+}
+
+/*
+ * Create an empty cache file with the given lifespan and move it into place
+ * at d->fn.  If replace is false and a file is already there, leave it alone
+ * and return EEXIST.
+ */
+static krb5_error_code
+create_file(krb5_context context, struct mmap_data *d, krb5_deltat lifespan,
+            krb5_boolean replace)
+{
+    krb5_error_code ret;
+    struct mmap_header hdr;
+    char *tmpname;
+    uint32_t nbuckets = choose_nbuckets(context, lifespan);
+    int fd, st;
+
+    if (asprintf(&tmpname, "%s/krb5_RCXXXXXX", krb5_rc_io_getdir()) < 0)
+        return KRB5_RC_IO_MALLOC;
+    fd = mkstemp(tmpname);
+    if (fd == -1) {
+        ret = krb5_rc_io_map_errno(context, errno, tmpname, "create");
+        free(tmpname);
+        return ret;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = MMAP_MAGIC;
+    hdr.version = MMAP_VERSION;
+    hdr.nbuckets = nbuckets;
+    hdr.lifespan = lifespan;
+    /* Extending the file zero-fills the table, leaving every slot empty. */
+    if (fchmod(fd, 0600) != 0 ||
+        write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        ftruncate(fd, file_len(nbuckets)) != 0 || fsync(fd) != 0) {
+        ret = krb5_rc_io_map_errno(context, errno, tmpname, "create");
+        goto cleanup;
+    }
+
+    if (replace) {
+        st = rename(tmpname, d->fn);
+    } else {
+        /* Unlike rename, link fails if another process got there first. */
+        st = link(tmpname, d->fn);
+    }
+    if (st != 0) {
+        ret = (!replace && errno == EEXIST) ? EEXIST :
+            krb5_rc_io_map_errno(context, errno, d->fn, "create");
+        goto cleanup;
+    }
+    ret = 0;
+
+cleanup:
+    close(fd);
+    if (ret || !replace)
+        (void)unlink(tmpname);
+    free(tmpname);
+    return ret;
+}
+
+/* Derive the tag and bucket number of rep.  The tag covers the same fields
+ * which the dfl type compares. */
+static krb5_error_code
+rep_tag(struct mmap_data *d, krb5_donot_replay *rep,
+        unsigned char tag[MMAP_TAG_LEN], uint32_t *bucket_out)
+{
+    krb5_error_code ret;
+    struct k5buf buf;
+    uint8_t cksum[K5_SHA256_HASHLEN];
+    unsigned char tbuf[8];
+    krb5_data data;
+
+    store_32_be(rep->ctime, tbuf);
+    store_32_be(rep->cusec, tbuf + 4);
+    k5_buf_init_dynamic(&buf);
+    k5_buf_add_len(&buf, rep->client, strlen(rep->client) + 1);
+    k5_buf_add_len(&buf, rep->server, strlen(rep->server) + 1);
+    k5_buf_add_len(&buf, tbuf, sizeof(tbuf));
+    if (rep->msghash != NULL)
+        k5_buf_add(&buf, rep->msghash);
+    if (k5_buf_status(&buf) != 0)
+        return KRB5_RC_MALLOC;
+    data = make_data(buf.data, buf.len);
+    ret = k5_sha256(&data, cksum);
+    k5_buf_free(&buf);
+    if (ret)
+        return ret;
+
+    memcpy(tag, cksum, MMAP_TAG_LEN);
+    *bucket_out = load_32_be(cksum + MMAP_TAG_LEN) & (d->nbuckets - 1);
+    return 0;
+}
+
+static krb5_boolean
+slot_live(struct mmap_data *d, struct mmap_slot *slot, krb5_timestamp now)
+{
+    krb5_timestamp ts = slot->timestamp;
+
+    return slot->timestamp != 0 && !(ts + d->lifespan < now);
+}
+
+static krb5_error_code KRB5_CALLCONV
+krb5_rc_mmap_resolve(krb5_context context, krb5_rcache id, char *name)
+{
+    struct mmap_data *d;
+
+    if (name == NULL)
+        return KRB5_RC_PARSE;
+    d = calloc(1, sizeof(*d));
+    if (d == NULL)
+        return KRB5_RC_MALLOC;
+    d->fd = -1;
+    d->name = strdup(name);
+    if (d->name == NULL ||
+        asprintf(&d->fn, "%s/%s.mmap", krb5_rc_io_getdir(), name) < 0) {
+        free(d->name);
+        free(d);
+        return KRB5_RC_MALLOC;
+    }
+    id->data = d;
+    return 0;
+}
+
+static char * KRB5_CALLCONV
+krb5_rc_mmap_get_name(krb5_context context, krb5_rcache id)
+{
+    return ((struct mmap_data *)id->data)->name;
+}
+
+static krb5_error_code KRB5_CALLCONV
+krb5_rc_mmap_get_span(krb5_context context, krb5_rcache id,
+                      krb5_deltat *lifespan)
+{
+    k5_mutex_lock(&id->lock);
+    *lifespan = ((struct mmap_data *)id->data)->lifespan;
+    k5_mutex_unlock(&id->lock);
+    return 0;
+}
+
+/* Replace the cache file with an empty one. */
+static krb5_error_code KRB5_CALLCONV
+krb5_rc_mmap_init(krb5_context context, krb5_rcache id, krb5_deltat lifespan)
+{
+    struct mmap_data *d = id->data;
+    krb5_error_code ret;
+
+    k5_mutex_lock(&id->lock);
+    close_file(d);
+    ret = create_file(context, d, lifespan ? lifespan : context->clockskew,
+                      TRUE);
+    if (!ret)
+        ret = open_file(context, d);
+    k5_mutex_unlock(&id->lock);
+    return ret;
+}
+
+static krb5_error_code KRB5_CALLCONV
+krb5_rc_mmap_recover(krb5_context context, krb5_rcache id)
+{
+    struct mmap_data *d = id->data;
+    krb5_error_code ret;
+
+    k5_mutex_lock(&id->lock);
+    close_file(d);
+    ret = open_file(context, d);
+    if (ret == ENOENT)
+        ret = krb5_rc_io_map_errno(context, ret, d->fn, "open");
+    k5_mutex_unlock(&id->lock);
+    return ret;
+}
+
+/* Open the cache file, creating it if it does not exist or replacing it if it
+ * has an unknown format.  Concurrent creators all end up sharing one file. */
+static krb5_error_code KRB5_CALLCONV
+krb5_rc_mmap_recover_or_init(krb5_context context, krb5_rcache id,
+                             krb5_deltat lifespan)
+{
+    struct mmap_data *d = id->data;
+    krb5_error_code ret;
+
+    if (!lifespan)
+        lifespan = context->clockskew;
+    k5_mutex_lock(&id->lock);
+    close_file(d);
+    ret = open_file(context, d);
+    if (ret == ENOENT || ret == KRB5_RCACHE_BADVNO) {
+        ret = create_file(context, d, lifespan, ret == KRB5_RCACHE_BADVNO);
+        if (ret == EEXIST)
+            ret = 0;
+        if (!ret)
+            ret = open_file(context, d);
+        if (ret == ENOENT)
+            ret = krb5_rc_io_map_errno(context, ret, d->fn, "open");
+    }
+    k5_mutex_unlock(&id->lock);
+    return ret;
+}
+
+static krb5_error_code KRB5_CALLCONV
+krb5_rc_mmap_close(krb5_context context, krb5_rcache id)
+{
+    struct mmap_data *d = id->data;
+
+    close_file(d);
+    free(d->name);
+    free(d->fn);
+    free(d);
+    k5_mutex_destroy(&id->lock);
+    free(id);
+    return 0;
+}
+
+static krb5_error_code KRB5_CALLCONV
+krb5_rc_mmap_destroy(krb5_context context, krb5_rcache id)
+{
+    struct mmap_data *d = id->data;
+
+    if (unlink(d->fn) != 0 && errno != ENOENT)
+        return KRB5_RC_IO;
+    return krb5_rc_mmap_close(context, id);
+}
+
+static krb5_error_code KRB5_CALLCONV
+krb5_rc_mmap_store(krb5_context context, krb5_rcache id,
+                   krb5_donot_replay *rep)
+{
+    struct mmap_data *d = id->data;
+    krb5_error_code ret;
+    struct mmap_slot *slots, *free_slot = NULL;
+    unsigned char tag[MMAP_TAG_LEN];
+    krb5_timestamp now;
+    uint32_t b;
+    int i;
+
+    ret = krb5_timeofday(context, &now);
+    if (ret)
+        return ret;
+
+    k5_mutex_lock(&id->lock);
+    if (d->map == NULL) {
+        ret = KRB5_RC_IO_UNKNOWN;
+        goto cleanup;
+    }
+    ret = rep_tag(d, rep, tag, &b);
+    if (ret)
+        goto cleanup;
+    ret = lock_bucket(context, d, b, F_WRLCK);
+    if (ret)
+        goto cleanup;
+
+    slots = bucket_slots(d, b);
+    for (i = 0; i < MMAP_SLOTS; i++) {
+        if (!slot_live(d, &slots[i], now)) {
+            if (free_slot == NULL)
+                free_slot = &slots[i];
+        } else if (memcmp(slots[i].tag, tag, MMAP_TAG_LEN) == 0) {
+            ret = KRB5KRB_AP_ERR_REPEAT;
+            break;
+        }
+    }
+    if (!ret && free_slot == NULL) {
+        /* Evicting a live entry would let its authenticator be replayed, so
+         * refuse the request instead. */
+        ret = KRB5_RC_IO_SPACE;
+        k5_setmsg(context, ret, _("Replay cache %s is full"), d->fn);
+    }
+    if (!ret) {
+        memcpy(free_slot->tag, tag, MMAP_TAG_LEN);
+        free_slot->timestamp = rep->ctime;
+    }
+
+    (void)lock_bucket(context, d, b, F_UNLCK);
+
+cleanup:
+    k5_mutex_unlock(&id->lock);
+    return ret;
+}
+
+/* Clear expired slots.  Stores reuse them anyway, so this is needed only to
+ * scrub old tags from the file. */
+static krb5_error_code KRB5_CALLCONV
+krb5_rc_mmap_expunge(krb5_context context, krb5_rcache id)
+{
+    struct mmap_data *d = id->data;
+    krb5_error_code ret;
+    struct mmap_slot *slots;
+    krb5_timestamp now;
+    uint32_t b;
+    int i;
+
+    ret = krb5_timeofday(context, &now);
+    if (ret)
+        return ret;
+
+    k5_mutex_lock(&id->lock);
+    if (d->map == NULL) {
+        ret = KRB5_RC_IO_UNKNOWN;
+        goto cleanup;
+    }
+    ret = lock_bucket(context, d, -1, F_WRLCK);
+    if (ret)
+        goto cleanup;
+    for (b = 0; b < d->nbuckets; b++) {
+        slots = bucket_slots(d, b);
+        for (i = 0; i < MMAP_SLOTS; i++) {
+            if (slots[i].timestamp != 0 && !slot_live(d, &slots[i], now))
+                memset(&slots[i], 0, sizeof(slots[i]));
+        }
+    }
+    (void)lock_bucket(context, d, -1, F_UNLCK);
+
+cleanup:
+    k5_mutex_unlock(&id->lock);
+    return ret;
+}
+
+const krb5_rc_ops krb5_rc_mmap_ops = {
+    0,
+    "mmap",
+    krb5_rc_mmap_init,
+    krb5_rc_mmap_recover,
+    krb5_rc_mmap_recover_or_init,
+    krb5_rc_mmap_destroy,
+    krb5_rc_mmap_close,
+    krb5_rc_mmap_store,
+    krb5_rc_mmap_expunge,
+    krb5_rc_mmap_get_span,
+    krb5_rc_mmap_get_name,
+    krb5_rc_mmap_resolve
+};
+
+#endif /* not _WIN32 */
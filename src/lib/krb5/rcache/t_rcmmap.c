@@ -0,0 +1,215 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* lib/krb5/rcache/t_rcmmap.c - Tests for the mmap replay cache type */
+/*
+ * Copyright (C) 2026 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "k5-int.h"
+
+#define RCNAME "mmap:t_rcmmap"
+#define RCFILE "./t_rcmmap.mmap"
+#define CONFFILE "./t_rcmmap.conf"
+#define LIFESPAN 300
+
+static krb5_context ctx;
+
+static void
+check(krb5_error_code code)
+{
+    if (code) {
+        com_err("t_rcmmap", code, "while running test");
+        exit(1);
+    }
+}
+
+static krb5_rcache
+open_rc(void)
+{
+    krb5_rcache rc;
+
+    check(krb5_rc_resolve_full(ctx, &rc, RCNAME));
+    check(krb5_rc_recover_or_initialize(ctx, rc, LIFESPAN));
+    return rc;
+}
+
+/* Store an entry as of the time now and return the result. */
+static krb5_error_code
+store(krb5_rcache rc, const char *client, krb5_timestamp ctime,
+      krb5_int32 cusec, char *msghash, krb5_timestamp now)
+{
+    krb5_donot_replay rep;
+
+    check(krb5_set_debugging_time(ctx, now, 0));
+    rep.client = (char *)client;
+    rep.server = "server@KRBTEST.COM";
+    rep.msghash = msghash;
+    rep.ctime = ctime;
+    rep.cusec = cusec;
+    return krb5_rc_store(ctx, rc, &rep);
+}
+
+/* Return the size of the cache file. */
+static off_t
+rcfile_size(void)
+{
+    struct stat sb;
+
+    if (stat(RCFILE, &sb) != 0)
+        abort();
+    return sb.st_size;
+}
+
+static void
+expect(krb5_error_code got, krb5_error_code want, const char *what)
+{
+    if (got != want) {
+        fprintf(stderr, "%s: got %ld, expected %ld\n", what, (long)got,
+                (long)want);
+        exit(1);
+    }
+}
+
+int
+main(void)
+{
+    krb5_rcache rc1, rc2;
+    krb5_deltat span;
+    krb5_timestamp t = 1000000000;
+    char client[64];
+    FILE *fp;
+    int i;
+
+    check(krb5_init_context(&ctx));
+    setenv("KRB5RCACHEDIR", ".", 1);
+    (void)unlink(RCFILE);
+
+    /* Recovering a cache which does not exist fails. */
+    check(krb5_rc_resolve_full(ctx, &rc1, RCNAME));
+    if (krb5_rc_recover(ctx, rc1) == 0)
+        abort();
+    krb5_rc_close(ctx, rc1);
+
+    rc1 = open_rc();
+    check(krb5_rc_get_lifespan(ctx, rc1, &span));
+    expect(span, LIFESPAN, "lifespan");
+    expect(store(rc1, "a@KRBTEST.COM", t, 1, NULL, t), 0, "first store");
+    expect(store(rc1, "a@KRBTEST.COM", t, 1, NULL, t),
+           KRB5KRB_AP_ERR_REPEAT, "replay");
+    expect(store(rc1, "a@KRBTEST.COM", t, 2, NULL, t), 0, "new usec");
+    expect(store(rc1, "b@KRBTEST.COM", t, 1, NULL, t), 0, "new client");
+
+    /* Entries are distinguished by message hash when present. */
+    expect(store(rc1, "c@KRBTEST.COM", t, 1, "AA", t), 0, "hash AA");
+    expect(store(rc1, "c@KRBTEST.COM", t, 1, "BB", t), 0, "hash BB");
+    expect(store(rc1, "c@KRBTEST.COM", t, 1, "AA", t),
+           KRB5KRB_AP_ERR_REPEAT, "hash AA replay");
+
+    /* A second handle, as in another process, sees the same entries. */
+    rc2 = open_rc();
+    expect(store(rc2, "a@KRBTEST.COM", t, 1, NULL, t),
+           KRB5KRB_AP_ERR_REPEAT, "replay through second handle");
+    expect(store(rc2, "d@KRBTEST.COM", t, 1, NULL, t), 0,
+           "store through second handle");
+    expect(store(rc1, "d@KRBTEST.COM", t, 1, NULL, t),
+           KRB5KRB_AP_ERR_REPEAT, "replay through first handle");
+    krb5_rc_close(ctx, rc2);
+
+    /* Once an entry is older than the lifespan, its slot is reused. */
+    expect(store(rc1, "a@KRBTEST.COM", t, 1, NULL, t + LIFESPAN),
+           KRB5KRB_AP_ERR_REPEAT, "replay at end of lifespan");
+    expect(store(rc1, "a@KRBTEST.COM", t, 1, NULL, t + LIFESPAN + 1), 0,
+           "store after lifespan");
+    check(krb5_rc_expunge(ctx, rc1));
+
+    /* By default the table holds 512 entries per second of lifespan,
+     * rounded up to a power of two 16-slot buckets of 16 bytes each. */
+    expect(rcfile_size(), 64 + 16384 * 16 * 16, "default file size");
+    krb5_rc_close(ctx, rc1);
+
+    /* Shrink new caches to a single bucket and overflow it.  Evicting a live
+     * entry would allow a replay, so the extra store is refused. */
+    fp = fopen(CONFFILE, "w");
+    if (fp == NULL)
+        abort();
+    fputs("[libdefaults]\n\trcache_mmap_entries = 10\n", fp);
+    fclose(fp);
+    setenv("KRB5_CONFIG", CONFFILE, 1);
+    krb5_free_context(ctx);
+    check(krb5_init_context(&ctx));
+    check(krb5_rc_resolve_full(ctx, &rc1, RCNAME));
+    check(krb5_rc_initialize(ctx, rc1, LIFESPAN));
+    expect(rcfile_size(), 64 + 16 * 16, "one-bucket file size");
+    t += 10000;
+    for (i = 0; i < 16; i++) {
+        snprintf(client, sizeof(client), "fill%d@KRBTEST.COM", i);
+        expect(store(rc1, client, t, 0, NULL, t + i), 0, "fill");
+    }
+    expect(store(rc1, "over@KRBTEST.COM", t, 0, NULL, t + 16),
+           KRB5_RC_IO_SPACE, "store into full bucket");
+    expect(store(rc1, "fill0@KRBTEST.COM", t, 0, NULL, t + 16),
+           KRB5KRB_AP_ERR_REPEAT, "replay in full bucket");
+    expect(store(rc1, "over@KRBTEST.COM", t, 0, NULL, t + LIFESPAN + 1), 0,
+           "store into expired bucket");
+    check(krb5_rc_expunge(ctx, rc1));
+
+    /* An existing file keeps its size regardless of configuration. */
+    krb5_rc_close(ctx, rc1);
+    unsetenv("KRB5_CONFIG");
+    krb5_free_context(ctx);
+    check(krb5_init_context(&ctx));
+    rc1 = open_rc();
+    expect(rcfile_size(), 64 + 16 * 16, "size of existing file");
+    krb5_rc_close(ctx, rc1);
+    (void)unlink(CONFFILE);
+
+    /* A negative lifespan sizes the table from the clock skew, and a very
+     * long one is limited to the maximum of 2^18 buckets. */
+    check(krb5_rc_resolve_full(ctx, &rc1, RCNAME));
+    check(krb5_rc_initialize(ctx, rc1, -1));
+    expect(rcfile_size(), 64 + 16384 * 16 * 16, "negative lifespan file size");
+    check(krb5_rc_initialize(ctx, rc1, INT32_MAX));
+    expect(rcfile_size(), 64 + 262144 * 16 * 16, "maximum file size");
+    krb5_rc_close(ctx, rc1);
+
+    /* A file in an unknown format is replaced. */
+    fp = fopen(RCFILE, "w");
+    if (fp == NULL)
+        abort();
+    fputs("not a replay cache", fp);
+    fclose(fp);
+    rc1 = open_rc();
+    expect(store(rc1, "a@KRBTEST.COM", t, 1, NULL, t), 0,
+           "store after replacement");
+    check(krb5_rc_destroy(ctx, rc1));
+    if (access(RCFILE, F_OK) == 0)
+        abort();
+
+    krb5_free_context(ctx);
+    return 0;
+}
@@ -0,0 +1,832 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* plugins/audit/binary/au_binary.c - Batched binary audit plugin */
+/*
+ * Copyright (C) 2026 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * This audit module encodes KDC events as compact binary records, written
+ * directly into a fixed-size batch buffer without building an intermediate
+ * JSON object, and writes whole batches to a file or a Unix stream socket.
+ * Memory use is bounded by the buffer size.
+ *
+ * Where threads are available, a flusher thread swaps out the batch buffer
+ * and writes it when the buffer is half full, when the oldest buffered record
+ * is older than the flush interval, at KDC stop, and when the module is
+ * closed, so that request processing never waits for the output.  A record
+ * which does not fit in the buffer is dropped.  The socket is non-blocking; if
+ * it cannot accept a batch, the batch is dropped rather than delaying the
+ * batches behind it.  Dropped records are counted, and the count is reported
+ * in the next record written.  Without threads, batches are written as events
+ * are recorded.
+ *
+ * Each record begins with a twelve-byte header:
+ *
+ *     4 bytes  length of the rest of the record
+ *     1 byte   format version (AUB_VERSION)
+ *     1 byte   event type (AUB_EV_*)
+ *     1 byte   flags (AUB_FLAG_SUCCESS)
+ *     1 byte   reserved (zero)
+ *     4 bytes  event time in seconds since the epoch
+ *
+ * followed by fields, each a one-byte tag (AUB_T_*), a two-byte length, and
+ * the value.  All integers are big-endian; integer fields are four bytes.
+ * A principal is a four-byte name type and a two-byte component count,
+ * followed by the realm and each component as a two-byte length and the
+ * contents.  An address is a two-byte address type followed by the
+ * contents.  Readers should skip fields with unknown tags.
+ */
+
+#include <k5-int.h>
+#include <krb5/audit_plugin.h>
+#include "k5-thread.h"
+#include <sys/un.h>
+#include <signal.h>
+
+#define AUB_VERSION             1
+#define AUB_FLAG_SUCCESS        0x01
+
+/* Event types. */
+#define AUB_EV_KDC_START        1
+#define AUB_EV_KDC_STOP         2
+#define AUB_EV_AS_REQ           3
+#define AUB_EV_TGS_REQ          4
+#define AUB_EV_S4U2SELF         5
+#define AUB_EV_S4U2PROXY        6
+#define AUB_EV_U2U              7
+
+/* Field tags. */
+#define AUB_T_DROPPED           1  /* records lost before this one */
+#define AUB_T_REQ_ID            2
+#define AUB_T_STAGE             3
+#define AUB_T_KDC_STATUS        4
+#define AUB_T_FROMADDR          5
+#define AUB_T_FROMPORT          6
+#define AUB_T_TKT_IN_ID         7
+#define AUB_T_TKT_OUT_ID        8
+#define AUB_T_EVIDENCE_TKT_ID   9
+#define AUB_T_CREF_REALM        10
+#define AUB_T_VIOLATION         11
+#define AUB_T_REQ_CLIENT        12
+#define AUB_T_REQ_SERVER        13
+#define AUB_T_REQ_KDC_OPTIONS   14
+#define AUB_T_REQ_ETYPES        15 /* list of four-byte enctypes */
+#define AUB_T_REQ_TIMES         16 /* from, till, rtime */
+#define AUB_T_REP_ETYPE         17
+#define AUB_T_TKT_SRV_ETYPE     18
+#define AUB_T_TKT_CLIENT        19
+#define AUB_T_TKT_FLAGS         20
+#define AUB_T_TKT_SESS_ETYPE    21
+#define AUB_T_TKT_TIMES         22 /* authtime, starttime, endtime,
+                                    * renew_till */
+#define AUB_T_S4U2SELF_USER     23
+#define AUB_T_S4U2PROXY_USER    24
+#define AUB_T_U2U_USER          25
+#define AUB_T_U2U_ETYPE         26
+
+#define AUB_HEADER_LEN          12
+#define AUB_MAX_FIELD           0xFFFF
+
+#define DEFAULT_BUFFER_SIZE     65536
+#define MIN_BUFFER_SIZE         1024
+#define DEFAULT_FLUSH_INTERVAL  1
+
+struct krb5_audit_moddata_st {
+    int fd;                     /* owned by the flusher thread */
+    krb5_boolean is_socket;
+    const char *path;
+    size_t bufsize;
+    krb5_deltat flush_interval;
+
+    /* Protected by lock. */
+    unsigned char *buf;
+    size_t used;
+    unsigned int nrecords;      /* records in buf */
+    krb5_ui_4 dropped;          /* records lost since the last one kept */
+    time_t first;               /* time of the oldest record in buf */
+
+#ifdef ENABLE_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    krb5_boolean wakeup;        /* protected by lock */
+    krb5_boolean stop;          /* protected by lock */
+    unsigned char *spare;       /* owned by the flusher thread */
+#endif
+};
+
+/* A cursor into the batch buffer for encoding one record. */
+struct enc {
+    unsigned char *ptr;
+    size_t avail;
+    krb5_boolean overflow;
+};
+
+krb5_error_code
+audit_binary_initvt(krb5_context context, int maj_ver, int min_ver,
+                    krb5_plugin_vtable vtable);
+
+/* The open method has no context, so configuration is read by initvt. */
+static char *cfg_output;
+static int cfg_bufsize = DEFAULT_BUFFER_SIZE;
+static krb5_deltat cfg_interval = DEFAULT_FLUSH_INTERVAL;
+
+static void
+put_bytes(struct enc *e, const void *p, size_t len)
+{
+    if (e->overflow || len > e->avail) {
+        e->overflow = TRUE;
+        return;
+    }
+    if (len > 0)
+        memcpy(e->ptr, p, len);
+    e->ptr += len;
+    e->avail -= len;
+}
+
+static void
+put_u8(struct enc *e, unsigned int val)
+{
+    unsigned char b = val & 0xFF;
+
+    put_bytes(e, &b, 1);
+}
+
+static void
+put_u16(struct enc *e, unsigned int val)
+{
+    unsigned char b[2];
+
+    store_16_be(val, b);
+    put_bytes(e, b, 2);
+}
+
+static void
+put_u32(struct enc *e, krb5_ui_4 val)
+{
+    unsigned char b[4];
+
+    store_32_be(val, b);
+    put_bytes(e, b, 4);
+}
+
+static void
+put_field_header(struct enc *e, int tag, size_t len)
+{
+    put_u8(e, tag);
+    put_u16(e, len);
+}
+
+/* Encode a counted string field, truncating it if necessary. */
+static void
+put_data_field(struct enc *e, int tag, const char *p, size_t len)
+{
+    if (p == NULL)
+        return;
+    if (len > AUB_MAX_FIELD)
+        len = AUB_MAX_FIELD;
+    put_field_header(e, tag, len);
+    put_bytes(e, p, len);
+}
+
+static void
+put_string_field(struct enc *e, int tag, const char *s)
+{
+    if (s != NULL)
+        put_data_field(e, tag, s, strlen(s));
+}
+
+static void
+put_int_field(struct enc *e, int tag, krb5_ui_4 val)
+{
+    put_field_header(e, tag, 4);
+    put_u32(e, val);
+}
+
+/* Encode princ in place of its unparsed form, avoiding an allocation. */
+static void
+put_princ_field(struct enc *e, int tag, krb5_const_principal princ)
+{
+    size_t len;
+    krb5_int32 i;
+
+    if (princ == NULL)
+        return;
+    len = 4 + 2 + 2 + princ->realm.length;
+    for (i = 0; i < princ->length; i++)
+        len += 2 + princ->data[i].length;
+    if (len > AUB_MAX_FIELD)
+        return;
+
+    put_field_header(e, tag, len);
+    put_u32(e, princ->type);
+    put_u16(e, princ->length);
+    put_u16(e, princ->realm.length);
+    put_bytes(e, princ->realm.data, princ->realm.length);
+    for (i = 0; i < princ->length; i++) {
+        put_u16(e, princ->data[i].length);
+        put_bytes(e, princ->data[i].data, princ->data[i].length);
+    }
+}
+
+static void
+put_addr_field(struct enc *e, int tag, const krb5_address *addr)
+{
+    if (addr == NULL || 2 + addr->length > AUB_MAX_FIELD)
+        return;
+    put_field_header(e, tag, 2 + addr->length);
+    put_u16(e, addr->addrtype);
+    put_bytes(e, addr->contents, addr->length);
+}
+
+static void
+put_etypes_field(struct enc *e, int tag, const krb5_enctype *etypes, int n)
+{
+    int i;
+
+    if (etypes == NULL || n <= 0 || (size_t)n * 4 > AUB_MAX_FIELD)
+        return;
+    put_field_header(e, tag, n * 4);
+    for (i = 0; i < n; i++)
+        put_u32(e, etypes[i]);
+}
+
+/* Encode the issued ticket. */
+static void
+put_ticket(struct enc *e, const krb5_ticket *tkt)
+{
+    const krb5_enc_tkt_part *part2;
+
+    if (tkt == NULL)
+        return;
+    if (tkt->enc_part.enctype)
+        put_int_field(e, AUB_T_TKT_SRV_ETYPE, tkt->enc_part.enctype);
+    part2 = tkt->enc_part2;
+    if (part2 == NULL)
+        return;
+    put_princ_field(e, AUB_T_TKT_CLIENT, part2->client);
+    put_int_field(e, AUB_T_TKT_FLAGS, part2->flags);
+    if (part2->session != NULL)
+        put_int_field(e, AUB_T_TKT_SESS_ETYPE, part2->session->enctype);
+    put_field_header(e, AUB_T_TKT_TIMES, 16);
+    put_u32(e, part2->times.authtime);
+    put_u32(e, part2->times.starttime);
+    put_u32(e, part2->times.endtime);
+    put_u32(e, part2->times.renew_till);
+}
+
+/* Return the client of the second ticket in req, if it was decrypted. */
+static krb5_principal
+second_ticket_client(const krb5_kdc_req *req)
+{
+    if (req == NULL || req->second_ticket == NULL ||
+        req->second_ticket[0] == NULL ||
+        req->second_ticket[0]->enc_part2 == NULL)
+        return NULL;
+    return req->second_ticket[0]->enc_part2->client;
+}
+
+/* Encode the fields of a request event. */
+static void
+put_state(struct enc *e, int event, krb5_boolean ev_success,
+          const krb5_audit_state *state)
+{
+    const krb5_kdc_req *req = state->request;
+    const krb5_kdc_rep *rep = state->reply;
+    krb5_principal user;
+
+    put_string_field(e, AUB_T_REQ_ID, state->req_id);
+    put_int_field(e, AUB_T_STAGE, state->stage);
+    put_string_field(e, AUB_T_KDC_STATUS, state->status);
+    put_addr_field(e, AUB_T_FROMADDR, state->cl_addr);
+    put_int_field(e, AUB_T_FROMPORT, state->cl_port);
+    put_string_field(e, AUB_T_TKT_IN_ID, state->tkt_in_id);
+    put_string_field(e, AUB_T_TKT_OUT_ID, state->tkt_out_id);
+    put_string_field(e, AUB_T_EVIDENCE_TKT_ID, state->evid_tkt_id);
+    if (state->cl_realm != NULL) {
+        put_data_field(e, AUB_T_CREF_REALM, state->cl_realm->data,
+                       state->cl_realm->length);
+    }
+    if (state->violation)
+        put_int_field(e, AUB_T_VIOLATION, state->violation);
+
+    if (req != NULL) {
+        put_princ_field(e, AUB_T_REQ_CLIENT, req->client);
+        put_princ_field(e, AUB_T_REQ_SERVER, req->server);
+        put_int_field(e, AUB_T_REQ_KDC_OPTIONS, req->kdc_options);
+        put_etypes_field(e, AUB_T_REQ_ETYPES, req->ktype, req->nktypes);
+        put_field_header(e, AUB_T_REQ_TIMES, 12);
+        put_u32(e, req->from);
+        put_u32(e, req->till);
+        put_u32(e, req->rtime);
+    }
+    if (rep != NULL && ev_success) {
+        put_int_field(e, AUB_T_REP_ETYPE, rep->enc_part.enctype);
+        put_ticket(e, rep->ticket);
+    }
+
+    if (event == AUB_EV_S4U2SELF) {
+        put_princ_field(e, AUB_T_S4U2SELF_USER, state->s4u2self_user);
+    } else if (event == AUB_EV_S4U2PROXY) {
+        put_princ_field(e, AUB_T_S4U2PROXY_USER, second_ticket_client(req));
+    } else if (event == AUB_EV_U2U) {
+        user = second_ticket_client(req);
+        put_princ_field(e, AUB_T_U2U_USER, user);
+        if (user != NULL &&
+            req->second_ticket[0]->enc_part2->session != NULL) {
+            put_int_field(e, AUB_T_U2U_ETYPE,
+                          req->second_ticket[0]->enc_part2->session->enctype);
+        }
+    }
+}
+
+/*
+ * Append a record for an event to the batch buffer.  Return FALSE, leaving
+ * the buffer unchanged, if the record does not fit in the remaining space.
+ */
+static krb5_boolean
+encode_record(krb5_audit_moddata md, int event, krb5_boolean ev_success,
+              const krb5_audit_state *state, time_t now)
+{
+    struct enc e;
+    unsigned char *start = md->buf + md->used;
+
+    e.ptr = start;
+    e.avail = md->bufsize - md->used;
+    e.overflow = FALSE;
+
+    put_u32(&e, 0);
+    put_u8(&e, AUB_VERSION);
+    put_u8(&e, event);
+    put_u8(&e, ev_success ? AUB_FLAG_SUCCESS : 0);
+    put_u8(&e, 0);
+    put_u32(&e, now);
+    if (md->dropped)
+        put_int_field(&e, AUB_T_DROPPED, md->dropped);
+    if (state != NULL)
+        put_state(&e, event, ev_success, state);
+    if (e.overflow)
+        return FALSE;
+
+    store_32_be(e.ptr - start - 4, start);
+    if (md->used == 0)
+        md->first = now;
+    md->used = e.ptr - md->buf;
+    md->nrecords++;
+    md->dropped = 0;
+    return TRUE;
+}
+
+/* Open the configured output file or connect to the output socket. */
+static krb5_error_code
+open_output(krb5_audit_moddata md)
+{
+    struct sockaddr_un sa;
+    int fd;
+
+    if (md->is_socket) {
+        if (strlen(md->path) >= sizeof(sa.sun_path))
+            return ENAMETOOLONG;
+        memset(&sa, 0, sizeof(sa));
+        sa.sun_family = AF_UNIX;
+        strlcpy(sa.sun_path, md->path, sizeof(sa.sun_path));
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1)
+            return errno;
+        if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) == -1 ||
+            fcntl(fd, F_SETFL, O_NONBLOCK) == -1) {
+            close(fd);
+            return errno;
+        }
+    } else {
+        fd = open(md->path, O_WRONLY | O_APPEND | O_CREAT, 0600);
+        if (fd == -1)
+            return errno;
+    }
+    set_cloexec_fd(fd);
+    md->fd = fd;
+    return 0;
+}
+
+/* Return the number of records in the batch data of length len which were
+ * not completely written by the first off bytes. */
+static krb5_ui_4
+count_unsent(const unsigned char *data, size_t len, size_t off)
+{
+    size_t pos, reclen;
+    krb5_ui_4 count = 0;
+
+    for (pos = 0; pos < len; pos += reclen) {
+        reclen = 4 + load_32_be(data + pos);
+        if (pos + reclen > off)
+            count++;
+    }
+    return count;
+}
+
+/*
+ * Write out a batch of nrecords records, with a single write in the common
+ * case, and return the number of records which were not written.  If the
+ * socket cannot accept the batch, drop it but keep the connection.  If the
+ * write fails or stops partway through a record, close a socket connection
+ * so that the reader does not see a broken record stream; it is reopened at
+ * the next batch.
+ */
+static krb5_ui_4
+write_batch(krb5_audit_moddata md, const unsigned char *data, size_t len,
+            unsigned int nrecords)
+{
+    size_t off = 0;
+    ssize_t n;
+
+    if (md->fd == -1 && open_output(md) != 0)
+        return nrecords;
+    while (off < len) {
+        n = write(md->fd, data + off, len - off);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n > 0) {
+            off += n;
+            continue;
+        }
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) && off == 0)
+            return nrecords;
+        break;
+    }
+    if (off == len)
+        return 0;
+    if (md->is_socket) {
+        close(md->fd);
+        md->fd = -1;
+    }
+    return count_unsent(data, len, off);
+}
+
+#ifdef ENABLE_THREADS
+
+/* Return true if the buffered batch should be written out now.  Call with
+ * md->lock held. */
+static krb5_boolean
+flush_due(krb5_audit_moddata md)
+{
+    if (md->stop || md->wakeup)
+        return TRUE;
+    return md->used > 0 && time(NULL) - md->first >= md->flush_interval;
+}
+
+static void *
+flusher_main(void *arg)
+{
+    krb5_audit_moddata md = arg;
+    struct timespec deadline;
+    unsigned char *data;
+    size_t len;
+    unsigned int nrecords;
+    krb5_ui_4 dropped;
+    krb5_boolean stop = FALSE;
+
+    pthread_mutex_lock(&md->lock);
+    while (!stop) {
+        while (!flush_due(md)) {
+            if (md->used > 0) {
+                deadline.tv_sec = md->first + md->flush_interval;
+                deadline.tv_nsec = 0;
+                pthread_cond_timedwait(&md->cond, &md->lock, &deadline);
+            } else {
+                pthread_cond_wait(&md->cond, &md->lock);
+            }
+        }
+        stop = md->stop;
+        md->wakeup = FALSE;
+
+        /* Swap in the empty buffer and write out the batch unlocked. */
+        data = md->buf;
+        len = md->used;
+        nrecords = md->nrecords;
+        md->buf = md->spare;
+        md->used = 0;
+        md->nrecords = 0;
+        pthread_mutex_unlock(&md->lock);
+
+        dropped = (len > 0) ? write_batch(md, data, len, nrecords) : 0;
+        md->spare = data;
+
+        pthread_mutex_lock(&md->lock);
+        md->dropped += dropped;
+    }
+    pthread_mutex_unlock(&md->lock);
+    return NULL;
+}
+
+/* Record an event and wake the flusher thread if the batch should be written
+ * soon. */
+static krb5_error_code
+log_event(krb5_audit_moddata md, int event, krb5_boolean ev_success,
+          const krb5_audit_state *state)
+{
+    time_t now = time(NULL);
+    krb5_boolean wake;
+
+    pthread_mutex_lock(&md->lock);
+    if (!encode_record(md, event, ev_success, state, now)) {
+        md->dropped++;
+        wake = TRUE;
+    } else {
+        wake = (md->used >= md->bufsize / 2 || event == AUB_EV_KDC_STOP ||
+                md->flush_interval == 0);
+    }
+    if (wake)
+        md->wakeup = TRUE;
+    /* Let the flusher set its deadline when the first record arrives. */
+    if (wake || md->nrecords == 1)
+        pthread_cond_signal(&md->cond);
+    pthread_mutex_unlock(&md->lock);
+    return 0;
+}
+
+static krb5_error_code
+start_flusher(krb5_audit_moddata md)
+{
+    sigset_t all, old;
+    int ret;
+
+    md->spare = malloc(md->bufsize);
+    if (md->spare == NULL)
+        return ENOMEM;
+    pthread_mutex_init(&md->lock, NULL);
+    pthread_cond_init(&md->cond, NULL);
+
+    /* Leave signal handling to the KDC's main thread. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    ret = pthread_create(&md->thread, NULL, flusher_main, md);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret) {
+        pthread_cond_destroy(&md->cond);
+        pthread_mutex_destroy(&md->lock);
+        free(md->spare);
+        md->spare = NULL;
+    }
+    return ret;
+}
+
+/* Stop the flusher thread after it writes out any buffered records. */
+static void
+stop_flusher(krb5_audit_moddata md)
+{
+    pthread_mutex_lock(&md->lock);
+    md->stop = TRUE;
+    pthread_cond_signal(&md->cond);
+    pthread_mutex_unlock(&md->lock);
+    pthread_join(md->thread, NULL);
+    pthread_cond_destroy(&md->cond);
+    pthread_mutex_destroy(&md->lock);
+    free(md->spare);
+}
+
+#else /* !ENABLE_THREADS */
+
+/* Write out the buffered batch. */
+static void
+flush_buffer(krb5_audit_moddata md)
+{
+    if (md->used == 0)
+        return;
+    md->dropped += write_batch(md, md->buf, md->used, md->nrecords);
+    md->used = 0;
+    md->nrecords = 0;
+}
+
+/* Record an event, writing out the batch as needed. */
+static krb5_error_code
+log_event(krb5_audit_moddata md, int event, krb5_boolean ev_success,
+          const krb5_audit_state *state)
+{
+    time_t now = time(NULL);
+
+    if (!encode_record(md, event, ev_success, state, now)) {
+        /* Make room and try again; drop the record if it can never fit. */
+        flush_buffer(md);
+        if (!encode_record(md, event, ev_success, state, now))
+            md->dropped++;
+    }
+    if (md->used > 0 && (event == AUB_EV_KDC_STOP ||
+                         now - md->first >= md->flush_interval))
+        flush_buffer(md);
+    return 0;
+}
+
+static krb5_error_code
+start_flusher(krb5_audit_moddata md)
+{
+    return 0;
+}
+
+static void
+stop_flusher(krb5_audit_moddata md)
+{
+    flush_buffer(md);
+}
+
+#endif /* !ENABLE_THREADS */
+
+/* Open the output and allocate the batch buffer.  Returns 0 on success. */
+static krb5_error_code
+open_au(krb5_audit_moddata *auctx)
+{
+    krb5_error_code ret;
+    krb5_audit_moddata md;
+
+    *auctx = NULL;
+    if (cfg_output == NULL)
+        return EINVAL;
+
+    md = k5alloc(sizeof(*md), &ret);
+    if (md == NULL)
+        return ret;
+    md->fd = -1;
+    md->bufsize = cfg_bufsize;
+    md->flush_interval = cfg_interval;
+    if (strncasecmp(cfg_output, "FILE:", 5) == 0) {
+        md->path = cfg_output + 5;
+    } else if (strncasecmp(cfg_output, "SOCKET:", 7) == 0) {
+        md->path = cfg_output + 7;
+        md->is_socket = TRUE;
+    } else {
+        ret = EINVAL;
+        goto error;
+    }
+    md->buf = k5alloc(md->bufsize, &ret);
+    if (md->buf == NULL)
+        goto error;
+    ret = open_output(md);
+    if (ret)
+        goto error;
+    ret = start_flusher(md);
+    if (ret)
+        goto error;
+
+    *auctx = md;
+    return 0;
+
+error:
+    if (md->fd != -1)
+        close(md->fd);
+    free(md->buf);
+    free(md);
+    return ret;
+}
+
+/* Write out any buffered records and close the output.  Returns 0. */
+static krb5_error_code
+close_au(krb5_audit_moddata md)
+{
+    if (md == NULL)
+        return 0;
+    stop_flusher(md);
+    if (md->fd != -1)
+        close(md->fd);
+    free(md->buf);
+    free(md);
+    return 0;
+}
+
+static krb5_error_code
+b_kdc_start(krb5_audit_moddata md, krb5_boolean ev_success)
+{
+    return log_event(md, AUB_EV_KDC_START, ev_success, NULL);
+}
+
+static krb5_error_code
+b_kdc_stop(krb5_audit_moddata md, krb5_boolean ev_success)
+{
+    return log_event(md, AUB_EV_KDC_STOP, ev_success, NULL);
+}
+
+static krb5_error_code
+b_as_req(krb5_audit_moddata md, krb5_boolean ev_success,
+         krb5_audit_state *state)
+{
+    return log_event(md, AUB_EV_AS_REQ, ev_success, state);
+}
+
+static krb5_error_code
+b_tgs_req(krb5_audit_moddata md, krb5_boolean ev_success,
+          krb5_audit_state *state)
+{
+    return log_event(md, AUB_EV_TGS_REQ, ev_success, state);
+}
+
+static krb5_error_code
+b_tgs_s4u2self(krb5_audit_moddata md, krb5_boolean ev_success,
+               krb5_audit_state *state)
+{
+    return log_event(md, AUB_EV_S4U2SELF, ev_success, state);
+}
+
+static krb5_error_code
+b_tgs_s4u2proxy(krb5_audit_moddata md, krb5_boolean ev_success,
+                krb5_audit_state *state)
+{
+    return log_event(md, AUB_EV_S4U2PROXY, ev_success, state);
+}
+
+static krb5_error_code
+b_tgs_u2u(krb5_audit_moddata md, krb5_boolean ev_success,
+          krb5_audit_state *state)
+{
+    return log_event(md, AUB_EV_U2U, ev_success, state);
+}
+
+/* Read the output location, buffer size, and flush interval. */
+static krb5_error_code
+read_config(krb5_context context)
+{
+    krb5_error_code ret;
+    char *str = NULL;
+    int bufsize;
+    krb5_deltat interval = DEFAULT_FLUSH_INTERVAL;
+
+    ret = profile_get_integer(context->profile, KRB5_CONF_KDCDEFAULTS,
+                              KRB5_CONF_AUDIT_BINARY_BUFFER_SIZE, NULL,
+                              DEFAULT_BUFFER_SIZE, &bufsize);
+    if (ret)
+        return ret;
+    ret = profile_get_string(context->profile, KRB5_CONF_KDCDEFAULTS,
+                             KRB5_CONF_AUDIT_BINARY_FLUSH_INTERVAL, NULL,
+                             NULL, &str);
+    if (ret)
+        return ret;
+    if (str != NULL) {
+        ret = krb5_string_to_deltat(str, &interval);
+        profile_release_string(str);
+        if (ret || interval < 0)
+            return EINVAL;
+    }
+    ret = profile_get_string(context->profile, KRB5_CONF_KDCDEFAULTS,
+                             KRB5_CONF_AUDIT_BINARY_OUTPUT, NULL, NULL, &str);
+    if (ret)
+        return ret;
+
+    profile_release_string(cfg_output);
+    cfg_output = str;
+    cfg_bufsize = (bufsize < MIN_BUFFER_SIZE) ? MIN_BUFFER_SIZE : bufsize;
+    cfg_interval = interval;
+    return 0;
+}
+
+krb5_error_code
+audit_binary_initvt(krb5_context context, int maj_ver, int min_ver,
+                    krb5_plugin_vtable vtable)
+{
+    krb5_error_code ret;
+    krb5_audit_vtable vt;
+
+    if (maj_ver != 1)
+        return KRB5_PLUGIN_VER_NOTSUPP;
+
+    ret = read_config(context);
+    if (ret)
+        return ret;
+
+    vt = (krb5_audit_vtable)vtable;
+    vt->name = "binary";
+
+    vt->open = open_au;
+    vt->close = close_au;
+    vt->kdc_start = b_kdc_start;
+    vt->kdc_stop = b_kdc_stop;
+    vt->as_req = b_as_req;
+    vt->tgs_req = b_tgs_req;
+    vt->tgs_s4u2self = b_tgs_s4u2self;
+    vt->tgs_s4u2proxy = b_tgs_s4u2proxy;
+    vt->tgs_u2u = b_tgs_u2u;
+
+    return 0;
+}
@@ -134,6 +134,21 @@ WRAP_K (krb5_db2_iterate,
          krb5_pointer p, krb5_flags flags),
         (ctx, s, f, p, flags));
 
+WRAP_K (krb5_db2_iterate_from,
+        (krb5_context ctx, const char *s,
+         krb5_error_code (*f) (krb5_pointer,
+                               krb5_db_entry *),
+         krb5_pointer p),
+        (ctx, s, f, p));
+
+WRAP_K (krb5_db2_get_stat,
+        (krb5_context ctx, const char *name, uint64_t *value_out),
+        (ctx, name, value_out));
+
+WRAP_K (krb5_db2_lockout_flush_due,
+        (krb5_context ctx),
+        (ctx));
+
 WRAP_K (krb5_db2_create_policy,
         (krb5_context context, osa_policy_ent_t entry),
         (context, entry));
@@ -197,7 +212,7 @@ hack_cleanup (void)
 
 kdb_vftabl PLUGIN_SYMBOL_NAME(krb5_db2, kdb_function_table) = {
     KRB5_KDB_DAL_MAJOR_VERSION,             /* major version number */
-    0,                                      /* minor version number 0 */
+    4,                                      /* minor version number */
     /* init_library */                  hack_init,
     /* fini_library */                  hack_cleanup,
     /* init_module */                   wrap_krb5_db2_open,
@@ -223,5 +238,9 @@ kdb_vftabl PLUGIN_SYMBOL_NAME(krb5_db2, kdb_function_table) = {
     /* check_policy_as */               wrap_krb5_db2_check_policy_as,
     0,
     /* audit_as_req */                  wrap_krb5_db2_audit_as_req,
-    0, 0
+    0, 0,
+    /* free_principal_e_data */         NULL,
+    /* iterate_from */                  wrap_krb5_db2_iterate_from,
+    /* get_stat */                      wrap_krb5_db2_get_stat,
+    /* flush_buffered */                wrap_krb5_db2_lockout_flush_due
 };
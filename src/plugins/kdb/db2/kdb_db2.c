@@ -276,6 +276,24 @@ configure_context(krb5_context context, char *conf_section, char **db_args)
         goto cleanup;
     dbc->disable_lockout = bval;
 
+    status = profile_get_boolean(profile, KDB_MODULE_SECTION, conf_section,
+                                 KRB5_CONF_KEEP_OPEN, FALSE, &bval);
+    if (status != 0)
+        goto cleanup;
+    dbc->keep_open = bval && !dbc->tempdb;
+
+    profile_release_string(pval);
+    pval = NULL;
+    status = profile_get_string(profile, KDB_MODULE_SECTION, conf_section,
+                                KRB5_CONF_LAST_SUCCESS_INTERVAL, NULL, &pval);
+    if (status != 0)
+        goto cleanup;
+    if (pval != NULL && !dbc->tempdb) {
+        status = krb5_string_to_deltat(pval, &dbc->last_success_interval);
+        if (status != 0)
+            goto cleanup;
+    }
+
 cleanup:
     free(opt);
     free(val);
@@ -393,28 +411,100 @@ open_db(krb5_context context, krb5_db2_context *dbc, int flags, int mode,
     return (db == NULL) ? errno : 0;
 }
 
+/*
+ * The lock file holds a counter which is incremented each time an exclusive
+ * lock is released, so that a context which keeps the database open between
+ * locks can tell whether the database may have changed.  A lock file without
+ * a counter reads as generation 0.
+ */
+static uint64_t
+read_generation(krb5_db2_context *dbc)
+{
+    uint64_t gen;
+
+    if (pread(dbc->db_lf_file, &gen, sizeof(gen), 0) != sizeof(gen))
+        return 0;
+    return gen;
+}
+
+static void
+bump_generation(krb5_db2_context *dbc)
+{
+    uint64_t gen = read_generation(dbc) + 1;
+
+    (void)pwrite(dbc->db_lf_file, &gen, sizeof(gen), 0);
+}
+
+/* Record the state of the database file just opened for dbc.  SUFFIX_DB is
+ * empty and keep_open is never set for temporary DBs, so the filename is
+ * db_name. */
+static void
+record_db_state(krb5_db2_context *dbc)
+{
+    dbc->db_generation = read_generation(dbc);
+    if (stat(dbc->db_name, &dbc->db_stat) != 0)
+        memset(&dbc->db_stat, 0, sizeof(dbc->db_stat));
+}
+
+/* Return true if the DB handle kept open in dbc is still usable.  The caller
+ * must hold a lock on the lock file.  Checking the file status as well as the
+ * generation counter catches a database replaced by kdb5_util load, and
+ * writers which don't maintain the counter. */
+static krb5_boolean
+db_unchanged(krb5_db2_context *dbc)
+{
+    struct stat st;
+
+    if (read_generation(dbc) != dbc->db_generation)
+        return FALSE;
+    if (stat(dbc->db_name, &st) != 0)
+        return FALSE;
+    return st.st_dev == dbc->db_stat.st_dev &&
+        st.st_ino == dbc->db_stat.st_ino &&
+        st.st_size == dbc->db_stat.st_size &&
+        st.st_mtime == dbc->db_stat.st_mtime;
+}
+
+/* Release one hold on the principal database lock. */
 static krb5_error_code
-ctx_unlock(krb5_context context, krb5_db2_context *dbc)
+ctx_unlock_db(krb5_context context, krb5_db2_context *dbc)
 {
-    krb5_error_code retval, retval2;
+    krb5_error_code retval;
     DB *db;
 
-    retval = osa_adb_release_lock(dbc->policy_db);
-
     if (!dbc->db_locks_held) /* lock already unlocked */
         return KRB5_KDB_NOTLOCKED;
 
     db = dbc->db;
     if (--(dbc->db_locks_held) == 0) {
-        db->close(db);
-        dbc->db = NULL;
+        /* Keep a read-only handle open if configured to; it will be checked
+         * for freshness when the database is next locked. */
+        if (!dbc->keep_open || dbc->db_lock_mode != KRB5_LOCKMODE_SHARED) {
+            db->close(db);
+            dbc->db = NULL;
+        }
+        if (dbc->db_lock_mode == KRB5_LOCKMODE_EXCLUSIVE)
+            bump_generation(dbc);
         dbc->db_lock_mode = 0;
 
-        retval2 = krb5_lock_file(context, dbc->db_lf_file,
+        retval = krb5_lock_file(context, dbc->db_lf_file,
                                 KRB5_LOCKMODE_UNLOCK);
-        if (retval2)
-            return retval2;
+        if (retval)
+            return retval;
     }
+    return 0;
+}
+
+static krb5_error_code
+ctx_unlock(krb5_context context, krb5_db2_context *dbc)
+{
+    krb5_error_code retval, retval2;
+
+    retval = osa_adb_release_lock(dbc->policy_db);
+
+    retval2 = ctx_unlock_db(context, dbc);
+    if (retval2)
+        return retval2;
 
     /* We may be unlocking because osa_adb_get_lock() failed. */
     if (retval == OSA_ADB_NOTLOCKED)
@@ -422,8 +512,10 @@ ctx_unlock(krb5_context context, krb5_db2_context *dbc)
     return retval;
 }
 
+/* Acquire or upgrade the principal database lock, opening the database if
+ * necessary. */
 static krb5_error_code
-ctx_lock(krb5_context context, krb5_db2_context *dbc, int lockmode)
+ctx_lock_db(krb5_context context, krb5_db2_context *dbc, int lockmode)
 {
     krb5_error_code retval;
     int kmode;
@@ -447,24 +539,43 @@ ctx_lock(krb5_context context, krb5_db2_context *dbc, int lockmode)
         else if (retval)
             return retval;
 
-        /* Open the DB (or re-open it for read/write). */
-        if (dbc->db != NULL)
-            dbc->db->close(dbc->db);
-        retval = open_db(context, dbc,
-                         kmode == KRB5_LOCKMODE_SHARED ? O_RDONLY : O_RDWR,
-                         0600, &dbc->db);
-        if (retval) {
-            dbc->db_locks_held = 0;
-            dbc->db_lock_mode = 0;
-            (void) osa_adb_release_lock(dbc->policy_db);
-            (void) krb5_lock_file(context, dbc->db_lf_file,
-                                  KRB5_LOCKMODE_UNLOCK);
-            return retval;
+        if (dbc->db != NULL && dbc->db_locks_held == 0 &&
+            kmode == KRB5_LOCKMODE_SHARED && db_unchanged(dbc)) {
+            /* The read-only handle we kept open is still good. */
+        } else {
+            /* Open the DB (or re-open it for read/write). */
+            if (dbc->db != NULL)
+                dbc->db->close(dbc->db);
+            dbc->db = NULL;
+            retval = open_db(context, dbc,
+                             kmode == KRB5_LOCKMODE_SHARED ? O_RDONLY : O_RDWR,
+                             0600, &dbc->db);
+            if (retval) {
+                dbc->db_locks_held = 0;
+                dbc->db_lock_mode = 0;
+                (void) osa_adb_release_lock(dbc->policy_db);
+                (void) krb5_lock_file(context, dbc->db_lf_file,
+                                      KRB5_LOCKMODE_UNLOCK);
+                return retval;
+            }
+            if (dbc->keep_open && kmode == KRB5_LOCKMODE_SHARED)
+                record_db_state(dbc);
         }
 
         dbc->db_lock_mode = kmode;
     }
     dbc->db_locks_held++;
+    return 0;
+}
+
+static krb5_error_code
+ctx_lock(krb5_context context, krb5_db2_context *dbc, int lockmode)
+{
+    krb5_error_code retval;
+
+    retval = ctx_lock_db(context, dbc, lockmode);
+    if (retval)
+        return retval;
 
     /* Acquire or upgrade the policy lock. */
     retval = osa_adb_get_lock(dbc->policy_db, lockmode);
@@ -522,6 +633,9 @@ cleanup:
 static void
 ctx_fini(krb5_db2_context *dbc)
 {
+    if (dbc->db != NULL && dbc->db_locks_held == 0)
+        dbc->db->close(dbc->db);
+    krb5_db2_lockout_free_buffer(dbc);
     if (dbc->db_lf_file != -1)
         (void) close(dbc->db_lf_file);
     if (dbc->policy_db)
@@ -534,6 +648,7 @@ krb5_error_code
 krb5_db2_fini(krb5_context context)
 {
     if (context->dal_handle->db_context != NULL) {
+        (void)krb5_db2_lockout_flush(context);
         ctx_fini(context->dal_handle->db_context);
         context->dal_handle->db_context = NULL;
     }
@@ -768,7 +883,12 @@ krb5_db2_get_principal(krb5_context context, krb5_const_principal searchfor,
 
     dbc = context->dal_handle->db_context;
 
-    retval = ctx_lock(context, dbc, KRB5_LOCKMODE_SHARED);
+    /* A single lookup doesn't need the policy lock; skip it when the DB is
+     * being kept open to make lookups cheap. */
+    if (dbc->keep_open)
+        retval = ctx_lock_db(context, dbc, KRB5_LOCKMODE_SHARED);
+    else
+        retval = ctx_lock(context, dbc, KRB5_LOCKMODE_SHARED);
     if (retval)
         return retval;
 
@@ -798,7 +918,11 @@ krb5_db2_get_principal(krb5_context context, krb5_const_principal searchfor,
     }
 
 cleanup:
-    (void) krb5_db2_unlock(context); /* unlock read lock */
+    /* unlock read lock */
+    if (dbc->keep_open)
+        (void) ctx_unlock_db(context, dbc);
+    else
+        (void) krb5_db2_unlock(context);
     return retval;
 }
 
@@ -1008,13 +1132,21 @@ curs_init(iter_curs *curs, krb5_context ctx, krb5_db2_context *dbc,
     return curs_lock(curs);
 }
 
-/* Get initial entry. */
+/* Get initial entry, or the first entry whose key is at or after start if
+ * start is not NULL. */
 static int
-curs_start(iter_curs *curs)
+curs_start(iter_curs *curs, const char *start)
 {
     DB *db = curs->dbc->db;
 
-    return db->seq(db, &curs->key, &curs->data, curs->startflag);
+    if (start == NULL)
+        return db->seq(db, &curs->key, &curs->data, curs->startflag);
+
+    /* Principal keys include the terminating null, so the libdb key order
+     * matches strcmp order of the names. */
+    curs->key.data = (char *)start;
+    curs->key.size = strlen(start) + 1;
+    return db->seq(db, &curs->key, &curs->data, R_CURSOR);
 }
 
 /* Save iteration state so DB can be unlocked/closed. */
@@ -1106,8 +1238,9 @@ curs_fini(iter_curs *curs)
 }
 
 static krb5_error_code
-ctx_iterate(krb5_context context, krb5_db2_context *dbc,
-            ctx_iterate_cb func, krb5_pointer func_arg, krb5_flags iterflags)
+ctx_iterate_from(krb5_context context, krb5_db2_context *dbc,
+                 const char *start, ctx_iterate_cb func,
+                 krb5_pointer func_arg, krb5_flags iterflags)
 {
     krb5_error_code retval;
     int dbret;
@@ -1116,7 +1249,7 @@ ctx_iterate(krb5_context context, krb5_db2_context *dbc,
     retval = curs_init(&curs, context, dbc, iterflags);
     if (retval)
         return retval;
-    dbret = curs_start(&curs);
+    dbret = curs_start(&curs, start);
     while (dbret == 0) {
         retval = curs_run_cb(&curs, func, func_arg);
         if (retval)
@@ -1136,6 +1269,13 @@ cleanup:
     return retval;
 }
 
+static krb5_error_code
+ctx_iterate(krb5_context context, krb5_db2_context *dbc,
+            ctx_iterate_cb func, krb5_pointer func_arg, krb5_flags iterflags)
+{
+    return ctx_iterate_from(context, dbc, NULL, func, func_arg, iterflags);
+}
+
 krb5_error_code
 krb5_db2_iterate(krb5_context context, char *match_expr, ctx_iterate_cb func,
                  krb5_pointer func_arg, krb5_flags iterflags)
@@ -1146,6 +1286,21 @@ krb5_db2_iterate(krb5_context context, char *match_expr, ctx_iterate_cb func,
                        func_arg, iterflags);
 }
 
+krb5_error_code
+krb5_db2_iterate_from(krb5_context context, const char *start,
+                      ctx_iterate_cb func, krb5_pointer func_arg)
+{
+    krb5_db2_context *dbc;
+
+    if (!inited(context))
+        return KRB5_KDB_DBNOTINITED;
+    dbc = context->dal_handle->db_context;
+    /* Hash databases have no useful key order. */
+    if (dbc->hashfirst)
+        return KRB5_PLUGIN_OP_NOTSUPP;
+    return ctx_iterate_from(context, dbc, start, func, func_arg, 0);
+}
+
 krb5_boolean
 krb5_db2_set_lockmode(krb5_context context, krb5_boolean mode)
 {
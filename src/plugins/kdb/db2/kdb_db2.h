@@ -48,6 +48,11 @@ typedef struct _krb5_db2_context {
     krb5_boolean        disable_last_success;
     krb5_boolean        disable_lockout;
     krb5_boolean        unlockiter;
+    krb5_boolean        keep_open;      /* Keep DB open while unlocked  */
+    uint64_t            db_generation;  /* Lock file counter at open    */
+    struct stat         db_stat;        /* DB file status at open       */
+    krb5_deltat         last_success_interval; /* Buffer last_success   */
+    struct lockout_buffer *lockout_buf; /* Pending last_success updates */
 } krb5_db2_context;
 
 krb5_error_code krb5_db2_init(krb5_context);
@@ -61,6 +66,10 @@ krb5_error_code krb5_db2_iterate(krb5_context, char *,
                                  krb5_error_code (*)(krb5_pointer,
                                                      krb5_db_entry *),
                                  krb5_pointer, krb5_flags);
+krb5_error_code krb5_db2_iterate_from(krb5_context, const char *,
+                                      krb5_error_code (*)(krb5_pointer,
+                                                          krb5_db_entry *),
+                                      krb5_pointer);
 krb5_error_code krb5_db2_set_nonblocking(krb5_context, krb5_boolean,
                                          krb5_boolean *);
 krb5_boolean krb5_db2_set_lockmode(krb5_context, krb5_boolean);
@@ -126,6 +135,23 @@ krb5_db2_lockout_audit(krb5_context context,
                        krb5_timestamp stamp,
                        krb5_error_code status);
 
+krb5_error_code
+krb5_db2_lockout_flush(krb5_context context);
+
+krb5_error_code
+krb5_db2_lockout_flush_due(krb5_context context);
+
+void
+krb5_db2_lockout_free_buffer(krb5_db2_context *dbc);
+
+krb5_error_code
+krb5_db2_get_stat(krb5_context context, const char *name,
+                  uint64_t *value_out);
+
+#define TRACE_DB2_LOCKOUT_FLUSH(c, written, avoided)                    \
+    TRACE(c, "Flushed {int} buffered last-success updates; {long} DB "  \
+          "writes avoided so far", written, avoided)
+
 krb5_error_code
 krb5_db2_check_policy_as(krb5_context kcontext, krb5_kdc_req *request,
                          krb5_db_entry *client, krb5_db_entry *server,
@@ -37,6 +37,172 @@
  * principal lockout functionality.
  */
 
+/*
+ * When last_success_interval is set, successful authentications which would
+ * only update last_success are recorded in memory and written out together
+ * once the oldest pending update is last_success_interval seconds old, or the
+ * buffer fills.  The age is checked as each update is recorded and whenever
+ * the KDC calls the flush_buffered method, so that an idle KDC does not hold
+ * updates indefinitely.  Failure counts are still written immediately, so
+ * that every KDC process sees them and lockout thresholds are enforced
+ * exactly.
+ */
+
+#define LOCKOUT_BUFFER_SIZE 256
+
+struct lockout_update {
+    krb5_principal princ;
+    krb5_timestamp stamp;
+};
+
+struct lockout_buffer {
+    struct lockout_update updates[LOCKOUT_BUFFER_SIZE];
+    int count;
+    krb5_timestamp oldest;
+    uint64_t writes_avoided;    /* updates merged or found stale at flush */
+};
+
+/* Return true if dbc's buffered updates should be written out at time now. */
+static krb5_boolean
+flush_due(krb5_db2_context *dbc, krb5_timestamp now)
+{
+    struct lockout_buffer *buf = dbc->lockout_buf;
+
+    if (buf == NULL || buf->count == 0)
+        return FALSE;
+    return buf->count == LOCKOUT_BUFFER_SIZE ||
+        now - buf->oldest >= dbc->last_success_interval;
+}
+
+/* Record a last_success update for entry.  Set *flush_out to true if the
+ * buffer should now be flushed. */
+static krb5_error_code
+buffer_last_success(krb5_context context, krb5_db2_context *dbc,
+                    krb5_db_entry *entry, krb5_timestamp stamp,
+                    krb5_boolean *flush_out)
+{
+    krb5_error_code ret;
+    struct lockout_buffer *buf = dbc->lockout_buf;
+    struct lockout_update *u;
+    int i;
+
+    *flush_out = FALSE;
+    if (buf == NULL) {
+        buf = k5alloc(sizeof(*buf), &ret);
+        if (buf == NULL)
+            return ret;
+        dbc->lockout_buf = buf;
+    }
+
+    for (i = 0; i < buf->count; i++) {
+        u = &buf->updates[i];
+        if (krb5_principal_compare(context, u->princ, entry->princ)) {
+            if (stamp > u->stamp)
+                u->stamp = stamp;
+            buf->writes_avoided++;
+            goto done;
+        }
+    }
+
+    u = &buf->updates[buf->count];
+    ret = krb5_copy_principal(context, entry->princ, &u->princ);
+    if (ret)
+        return ret;
+    u->stamp = stamp;
+    if (buf->count++ == 0)
+        buf->oldest = stamp;
+
+done:
+    *flush_out = flush_due(dbc, stamp);
+    return 0;
+}
+
+/* Write out all buffered last_success updates under a single exclusive
+ * lock. */
+krb5_error_code
+krb5_db2_lockout_flush(krb5_context context)
+{
+    krb5_error_code ret;
+    krb5_db2_context *dbc = context->dal_handle->db_context;
+    struct lockout_buffer *buf = dbc->lockout_buf;
+    struct lockout_update *u;
+    krb5_db_entry *entry;
+    int i, nwritten = 0;
+
+    if (buf == NULL || buf->count == 0)
+        return 0;
+
+    ret = krb5_db2_lock(context, KRB5_DB_LOCKMODE_EXCLUSIVE);
+    if (ret)
+        return ret;
+
+    for (i = 0; i < buf->count; i++) {
+        u = &buf->updates[i];
+        /* Re-read the entry so that we don't overwrite changes made since the
+         * update was buffered.  Skip principals which have been deleted. */
+        if (krb5_db2_get_principal(context, u->princ, 0, &entry) != 0)
+            continue;
+        if (u->stamp > entry->last_success) {
+            entry->last_success = u->stamp;
+            if (krb5_db2_put_principal(context, entry, NULL) == 0)
+                nwritten++;
+        }
+        krb5_db_free_principal(context, entry);
+    }
+    (void)krb5_db2_unlock(context);
+
+    buf->writes_avoided += buf->count - nwritten;
+    TRACE_DB2_LOCKOUT_FLUSH(context, nwritten, (long)buf->writes_avoided);
+    for (i = 0; i < buf->count; i++)
+        krb5_free_principal(context, buf->updates[i].princ);
+    buf->count = 0;
+    return 0;
+}
+
+/* Write out the buffered last_success updates if the oldest of them has been
+ * held for last_success_interval. */
+krb5_error_code
+krb5_db2_lockout_flush_due(krb5_context context)
+{
+    krb5_error_code ret;
+    krb5_db2_context *dbc = context->dal_handle->db_context;
+    krb5_timestamp now;
+
+    if (dbc == NULL || dbc->lockout_buf == NULL)
+        return 0;
+    ret = krb5_timeofday(context, &now);
+    if (ret)
+        return ret;
+    return flush_due(dbc, now) ? krb5_db2_lockout_flush(context) : 0;
+}
+
+krb5_error_code
+krb5_db2_get_stat(krb5_context context, const char *name, uint64_t *value_out)
+{
+    krb5_db2_context *dbc = context->dal_handle->db_context;
+
+    *value_out = 0;
+    if (strcmp(name, KRB5_KDB_STAT_WRITES_AVOIDED) != 0)
+        return KRB5_PLUGIN_OP_NOTSUPP;
+    if (dbc != NULL && dbc->lockout_buf != NULL)
+        *value_out = dbc->lockout_buf->writes_avoided;
+    return 0;
+}
+
+void
+krb5_db2_lockout_free_buffer(krb5_db2_context *dbc)
+{
+    struct lockout_buffer *buf = dbc->lockout_buf;
+    int i;
+
+    if (buf == NULL)
+        return;
+    for (i = 0; i < buf->count; i++)
+        krb5_free_principal(NULL, buf->updates[i].princ);
+    free(buf);
+    dbc->lockout_buf = NULL;
+}
+
 static krb5_error_code
 lookup_lockout_policy(krb5_context context,
                       krb5_db_entry *entry,
@@ -149,7 +315,7 @@ krb5_db2_lockout_audit(krb5_context context,
     krb5_deltat failcnt_interval = 0;
     krb5_deltat lockout_duration = 0;
     krb5_db2_context *db_ctx = context->dal_handle->db_context;
-    krb5_boolean need_update = FALSE;
+    krb5_boolean need_update = FALSE, flush;
     krb5_timestamp unlock_time;
 
     switch (status) {
@@ -192,6 +358,14 @@ krb5_db2_lockout_audit(krb5_context context,
             need_update = TRUE;
         }
         if (!db_ctx->disable_last_success) {
+            /* Defer the write if last_success is all that changed. */
+            if (!need_update && db_ctx->last_success_interval > 0) {
+                code = buffer_last_success(context, db_ctx, entry, stamp,
+                                           &flush);
+                if (code != 0)
+                    return code;
+                return flush ? krb5_db2_lockout_flush(context) : 0;
+            }
             entry->last_success = stamp;
             need_update = TRUE;
         }
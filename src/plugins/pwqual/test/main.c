@@ -33,7 +33,9 @@
 /*
  * This file implements a module named "combo" which tests whether a password
  * matches a pair of words in the dictionary.  It also implements several dummy
- * modules named "dyn1", "dyn2", and "dyn3" which are used for ordering tests.
+ * modules named "dyn1", "dyn2", and "dyn3" which are used for ordering tests,
+ * and a module named "sleep" which takes three seconds to accept passwords
+ * beginning with "sleep", for testing slow quality checks.
  */
 
 #include <k5-platform.h>
@@ -166,6 +168,16 @@ combo_close(krb5_context context, krb5_pwqual_moddata data)
     destroy_dict((combo_moddata)data);
 }
 
+static krb5_error_code
+sleep_check(krb5_context context, krb5_pwqual_moddata data,
+            const char *password, const char *policy_name,
+            krb5_principal princ, const char **languages)
+{
+    if (strncmp(password, "sleep", 5) == 0)
+        sleep(3);
+    return 0;
+}
+
 krb5_error_code
 pwqual_combo_initvt(krb5_context context, int maj_ver, int min_ver,
                     krb5_plugin_vtable vtable);
@@ -178,6 +190,9 @@ pwqual_dyn2_initvt(krb5_context context, int maj_ver, int min_ver,
 krb5_error_code
 pwqual_dyn3_initvt(krb5_context context, int maj_ver, int min_ver,
                    krb5_plugin_vtable vtable);
+krb5_error_code
+pwqual_sleep_initvt(krb5_context context, int maj_ver, int min_ver,
+                    krb5_plugin_vtable vtable);
 
 krb5_error_code
 pwqual_combo_initvt(krb5_context context, int maj_ver, int min_ver,
@@ -218,3 +233,17 @@ pwqual_dyn3_initvt(krb5_context context, int maj_ver, int min_ver,
     ((krb5_pwqual_vtable)vtable)->name = "dyn3";
     return 0;
 }
+
+krb5_error_code
+pwqual_sleep_initvt(krb5_context context, int maj_ver, int min_ver,
+                    krb5_plugin_vtable vtable)
+{
+    krb5_pwqual_vtable vt;
+
+    if (maj_ver != 1)
+        return KRB5_PLUGIN_VER_NOTSUPP;
+    vt = (krb5_pwqual_vtable)vtable;
+    vt->name = "sleep";
+    vt->check = sleep_check;
+    return 0;
+}
@@ -36,6 +36,9 @@
 #include <sys/param.h>
 #include <netdb.h>
 #include <fcntl.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #include "com_err.h"
 #include "fake-addrinfo.h"
@@ -45,8 +48,6 @@
 #define GETSOCKNAME_ARG3_TYPE unsigned int
 #endif
 
-static char *kprop_version = KPROP_PROT_VERSION;
-
 static char *progname = NULL;
 static int debug = 0;
 static char *srvtab = NULL;
@@ -68,14 +69,19 @@ static void parse_args(krb5_context context, int argc, char **argv);
 static void get_tickets(krb5_context context);
 static void usage(void);
 static void open_connection(krb5_context context, char *host, int *fd_out);
-static void kerberos_authenticate(krb5_context context,
-                                  krb5_auth_context *auth_context, int fd,
-                                  krb5_principal me, krb5_creds **new_creds);
+static krb5_error_code kerberos_authenticate(krb5_context context,
+                                             krb5_auth_context *auth_context,
+                                             int fd, char *version,
+                                             krb5_principal me,
+                                             krb5_creds **new_creds);
 static int open_database(krb5_context context, char *data_fn, int *size);
 static void close_database(krb5_context context, int fd);
 static void xmit_database(krb5_context context,
                           krb5_auth_context auth_context, krb5_creds *my_creds,
                           int fd, int database_fd, int in_database_size);
+static void xmit_delta(krb5_context context, krb5_auth_context auth_context,
+                       krb5_creds *my_creds, int fd, int database_fd);
+static void display_remote_error(krb5_context context, krb5_data *inbuf);
 static void send_error(krb5_context context, krb5_creds *my_creds, int fd,
                        char *err_text, krb5_error_code err_code);
 static void update_last_prop_file(char *hostname, char *file_name);
@@ -107,9 +113,31 @@ main(int argc, char **argv)
 
     database_fd = open_database(context, file, &database_size);
     open_connection(context, slave_host, &fd);
-    kerberos_authenticate(context, &auth_context, fd, my_principal, &my_creds);
-    xmit_database(context, auth_context, my_creds, fd, database_fd,
-                  database_size);
+    retval = kerberos_authenticate(context, &auth_context, fd,
+                                   KPROP_DELTA_VERSION, my_principal,
+                                   &my_creds);
+    if (retval == 0) {
+        xmit_delta(context, auth_context, my_creds, fd, database_fd);
+    } else {
+        /* The slave only knows the original protocol; reconnect and use
+         * that. */
+        if (debug)
+            printf(_("Slave does not support delta propagation\n"));
+        krb5_auth_con_free(context, auth_context);
+        close(fd);
+        krb5_free_address(context, sender_addr);
+        krb5_free_address(context, receiver_addr);
+        open_connection(context, slave_host, &fd);
+        retval = kerberos_authenticate(context, &auth_context, fd,
+                                       KPROP_PROT_VERSION, my_principal,
+                                       &my_creds);
+        if (retval) {
+            com_err(progname, retval, _("while authenticating to server"));
+            exit(1);
+        }
+        xmit_database(context, auth_context, my_creds, fd, database_fd,
+                      database_size);
+    }
     update_last_prop_file(slave_host, file);
     printf(_("Database propagation to %s: SUCCEEDED\n"), slave_host);
     krb5_free_cred_contents(context, my_creds);
@@ -303,9 +331,15 @@ open_connection(krb5_context context, char *host, int *fd_out)
     }
 }
 
-static void
+/*
+ * Authenticate to the slave using the protocol version string version.
+ * Return KRB5_SENDAUTH_BADAPPLVERS if the slave does not accept it; exit on
+ * any other error.
+ */
+static krb5_error_code
 kerberos_authenticate(krb5_context context, krb5_auth_context *auth_context,
-                      int fd, krb5_principal me, krb5_creds **new_creds)
+                      int fd, char *version, krb5_principal me,
+                      krb5_creds **new_creds)
 {
     krb5_error_code retval;
     krb5_error *error = NULL;
@@ -325,9 +359,11 @@ kerberos_authenticate(krb5_context context, krb5_auth_context *auth_context,
         exit(1);
     }
 
-    retval = krb5_sendauth(context, auth_context, &fd, kprop_version,
+    retval = krb5_sendauth(context, auth_context, &fd, version,
                            me, creds.server, AP_OPTS_MUTUAL_REQUIRED, NULL,
                            &creds, NULL, &error, &rep_result, new_creds);
+    if (retval == KRB5_SENDAUTH_BADAPPLVERS)
+        return retval;
     if (retval) {
         com_err(progname, retval, _("while authenticating to server"));
         if (error != NULL) {
@@ -350,6 +386,7 @@ kerberos_authenticate(krb5_context context, krb5_auth_context *auth_context,
         exit(1);
     }
     krb5_free_ap_rep_enc_part(context, rep_result);
+    return 0;
 }
 
 /*
@@ -441,7 +478,6 @@ xmit_database(krb5_context context, krb5_auth_context auth_context,
     krb5_data inbuf, outbuf;
     char buf[KPROP_BUFSIZ];
     krb5_error_code retval;
-    krb5_error *error;
     krb5_ui_4 database_size = in_database_size, send_size, sent_size;
 
     /* Send over the size. */
@@ -523,30 +559,8 @@ xmit_database(krb5_context context, krb5_auth_context auth_context,
      * If we got an error response back from the server, display
      * the error message
      */
-    if (krb5_is_krb_error(&inbuf)) {
-        retval = krb5_rd_error(context, &inbuf, &error);
-        if (retval) {
-            com_err(progname, retval,
-                    _("while decoding error response from server"));
-            exit(1);
-        }
-        if (error->error == KRB_ERR_GENERIC) {
-            if (error->text.data) {
-                fprintf(stderr, _("Generic remote error: %s\n"),
-                        error->text.data);
-            }
-        } else if (error->error) {
-            com_err(progname,
-                    (krb5_error_code)error->error + ERROR_TABLE_BASE_krb5,
-                    _("signalled from server"));
-            if (error->text.data) {
-                fprintf(stderr, _("Error text from server: %s\n"),
-                        error->text.data);
-            }
-        }
-        krb5_free_error(context, error);
-        exit(1);
-    }
+    if (krb5_is_krb_error(&inbuf))
+        display_remote_error(context, &inbuf);
 
     retval = krb5_rd_safe(context,auth_context,&inbuf,&outbuf,NULL);
     if (retval) {
@@ -566,6 +580,349 @@ xmit_database(krb5_context context, krb5_auth_context auth_context,
     free(outbuf.data);
 }
 
+/* Display the KRB_ERROR message in inbuf and exit. */
+static void
+display_remote_error(krb5_context context, krb5_data *inbuf)
+{
+    krb5_error_code retval;
+    krb5_error *error;
+
+    retval = krb5_rd_error(context, inbuf, &error);
+    if (retval) {
+        com_err(progname, retval,
+                _("while decoding error response from server"));
+        exit(1);
+    }
+    if (error->error == KRB_ERR_GENERIC) {
+        if (error->text.data) {
+            fprintf(stderr, _("Generic remote error: %s\n"),
+                    error->text.data);
+        }
+    } else if (error->error) {
+        com_err(progname,
+                (krb5_error_code)error->error + ERROR_TABLE_BASE_krb5,
+                _("signalled from server"));
+        if (error->text.data) {
+            fprintf(stderr, _("Error text from server: %s\n"),
+                    error->text.data);
+        }
+    }
+    krb5_free_error(context, error);
+    exit(1);
+}
+
+/* A block of the slave's previous dump, identified by its hash. */
+struct sig_entry {
+    uint8_t hash[K5_SHA256_HASHLEN];
+    uint32_t index;
+};
+
+struct delta_state {
+    krb5_context context;
+    krb5_auth_context auth_context;
+    krb5_creds *my_creds;
+    int fd;
+    struct sig_entry *sig;
+    uint32_t nsig;
+    char buf[KPROP_BUFSIZ];
+    size_t len;
+    uint64_t total;
+    uint64_t literal;
+    uint64_t sent;
+    uint32_t nblocks;
+    uint32_t ncopied;
+#ifdef HAVE_ZLIB
+    krb5_boolean compress;
+    z_stream zs;
+    char zbuf[2 * KPROP_BUFSIZ];
+#endif
+};
+
+/* Read a KRB_PRIV message from the slave into *out. */
+static void
+read_priv(struct delta_state *st, krb5_data *out)
+{
+    krb5_error_code retval;
+    krb5_data inbuf;
+
+    retval = krb5_read_message(st->context, &st->fd, &inbuf);
+    if (retval) {
+        com_err(progname, retval, _("while reading block hashes from server"));
+        exit(1);
+    }
+    if (krb5_is_krb_error(&inbuf))
+        display_remote_error(st->context, &inbuf);
+    retval = krb5_rd_priv(st->context, st->auth_context, &inbuf, out, NULL);
+    krb5_free_data_contents(st->context, &inbuf);
+    if (retval) {
+        com_err(progname, retval,
+                _("while decoding block hashes from server"));
+        send_error(st->context, st->my_creds, st->fd,
+                   "while decoding block hashes", retval);
+        exit(1);
+    }
+}
+
+static int
+sig_entry_cmp(const void *a, const void *b)
+{
+    return memcmp(((const struct sig_entry *)a)->hash,
+                  ((const struct sig_entry *)b)->hash, K5_SHA256_HASHLEN);
+}
+
+/* Receive the slave's flags and the block hashes of its previous dump, sorted
+ * for lookup by hash. */
+static void
+recv_signature(struct delta_state *st, uint32_t *flags_out)
+{
+    krb5_data msg;
+    uint32_t i, count;
+    size_t pos;
+
+    read_priv(st, &msg);
+    if (msg.length != 8) {
+        com_err(progname, KRB5KRB_ERR_GENERIC,
+                _("bad block count from server"));
+        exit(1);
+    }
+    st->nsig = load_32_be(msg.data);
+    *flags_out = load_32_be(msg.data + 4);
+    krb5_free_data_contents(st->context, &msg);
+    st->sig = calloc(st->nsig ? st->nsig : 1, sizeof(*st->sig));
+    if (st->sig == NULL) {
+        com_err(progname, ENOMEM, _("while allocating block hashes"));
+        exit(1);
+    }
+    for (i = 0; i < st->nsig; ) {
+        read_priv(st, &msg);
+        count = msg.length / K5_SHA256_HASHLEN;
+        if (count == 0 || count > st->nsig - i ||
+            msg.length % K5_SHA256_HASHLEN != 0) {
+            com_err(progname, KRB5KRB_ERR_GENERIC,
+                    _("bad block hash message from server"));
+            exit(1);
+        }
+        for (pos = 0; pos < msg.length; pos += K5_SHA256_HASHLEN, i++) {
+            memcpy(st->sig[i].hash, msg.data + pos, K5_SHA256_HASHLEN);
+            st->sig[i].index = i;
+        }
+        krb5_free_data_contents(st->context, &msg);
+    }
+    qsort(st->sig, st->nsig, sizeof(*st->sig), sig_entry_cmp);
+}
+
+#ifdef HAVE_ZLIB
+/* Compress the buffered operations into st->zbuf, flushing the stream so that
+ * the slave can process them as soon as it receives them. */
+static krb5_data
+compress_ops(struct delta_state *st)
+{
+    st->zbuf[0] = KPROP_OP_ZLIB;
+    st->zs.next_in = (unsigned char *)st->buf;
+    st->zs.avail_in = st->len;
+    st->zs.next_out = (unsigned char *)st->zbuf + 1;
+    st->zs.avail_out = sizeof(st->zbuf) - 1;
+    if (deflate(&st->zs, Z_SYNC_FLUSH) != Z_OK || st->zs.avail_in != 0 ||
+        st->zs.avail_out == 0) {
+        com_err(progname, KRB5KRB_ERR_GENERIC,
+                _("while compressing database block"));
+        send_error(st->context, st->my_creds, st->fd,
+                   "while compressing database block", KRB5KRB_ERR_GENERIC);
+        exit(1);
+    }
+    return make_data(st->zbuf, sizeof(st->zbuf) - st->zs.avail_out);
+}
+#endif
+
+/* Send the buffered operations as a KRB_PRIV message. */
+static void
+flush_ops(struct delta_state *st)
+{
+    krb5_error_code retval;
+    krb5_data inbuf, outbuf;
+
+    if (st->len == 0)
+        return;
+    inbuf = make_data(st->buf, st->len);
+#ifdef HAVE_ZLIB
+    if (st->compress)
+        inbuf = compress_ops(st);
+#endif
+    st->sent += inbuf.length;
+    retval = krb5_mk_priv(st->context, st->auth_context, &inbuf, &outbuf,
+                          NULL);
+    if (retval) {
+        com_err(progname, retval, _("while encoding database block"));
+        send_error(st->context, st->my_creds, st->fd,
+                   "while encoding database block", retval);
+        exit(1);
+    }
+    retval = krb5_write_message(st->context, &st->fd, &outbuf);
+    krb5_free_data_contents(st->context, &outbuf);
+    if (retval) {
+        com_err(progname, retval, _("while sending database block"));
+        exit(1);
+    }
+    st->len = 0;
+}
+
+/* Make sure there is room for len more bytes of operations. */
+static void
+reserve_ops(struct delta_state *st, size_t len)
+{
+    if (st->len + len > sizeof(st->buf))
+        flush_ops(st);
+}
+
+/* Send a block of the dump file, as a reference to the slave's copy of it if
+ * it has one. */
+static void
+send_block(void *arg, const char *data, size_t len)
+{
+    struct delta_state *st = arg;
+    struct sig_entry key, *match = NULL;
+    krb5_data d = make_data((char *)data, len);
+    krb5_error_code retval;
+    size_t n;
+
+    st->nblocks++;
+    st->total += len;
+    if (st->nsig > 0) {
+        retval = k5_sha256(&d, key.hash);
+        if (retval) {
+            com_err(progname, retval, _("while hashing database block"));
+            exit(1);
+        }
+        match = bsearch(&key, st->sig, st->nsig, sizeof(*st->sig),
+                        sig_entry_cmp);
+    }
+    if (match != NULL) {
+        reserve_ops(st, 5);
+        st->buf[st->len] = KPROP_OP_COPY;
+        store_32_be(match->index, st->buf + st->len + 1);
+        st->len += 5;
+        st->ncopied++;
+        return;
+    }
+
+    st->literal += len;
+    while (len > 0) {
+        reserve_ops(st, 6);
+        n = sizeof(st->buf) - st->len - 5;
+        if (n > len)
+            n = len;
+        st->buf[st->len] = KPROP_OP_DATA;
+        store_32_be(n, st->buf + st->len + 1);
+        memcpy(st->buf + st->len + 5, data, n);
+        st->len += 5 + n;
+        data += n;
+        len -= n;
+    }
+}
+
+/*
+ * Send the database using the kprop5_02 protocol.  The slave sends the
+ * hashes of the blocks of its previous dump, and we send each block of our
+ * dump either as a reference to one of those or as literal data, compressed
+ * if we both can.  The slave loads the dump as it arrives, and acknowledges
+ * with the total size in a KRB_SAFE message once the load succeeds.
+ */
+static void
+xmit_delta(krb5_context context, krb5_auth_context auth_context,
+           krb5_creds *my_creds, int fd, int database_fd)
+{
+    struct delta_state *st;
+    struct kprop_chunker chunker;
+    krb5_error_code retval;
+    krb5_data inbuf, outbuf;
+    char buf[KPROP_BUFSIZ];
+    ssize_t n;
+    uint32_t flags;
+
+    st = calloc(1, sizeof(*st));
+    if (st == NULL || kprop_chunker_init(&chunker) != 0) {
+        com_err(progname, ENOMEM, _("while allocating delta state"));
+        exit(1);
+    }
+    st->context = context;
+    st->auth_context = auth_context;
+    st->my_creds = my_creds;
+    st->fd = fd;
+
+    retval = krb5_auth_con_initivector(context, auth_context);
+    if (retval) {
+        send_error(context, my_creds, fd,
+                   "failed while initializing i_vector", retval);
+        com_err(progname, retval, _("while allocating i_vector"));
+        exit(1);
+    }
+
+    recv_signature(st, &flags);
+    if (debug)
+        printf(_("Slave has %u blocks of its previous dump\n"), st->nsig);
+#ifdef HAVE_ZLIB
+    if (flags & KPROP_FLAG_ZLIB) {
+        if (deflateInit(&st->zs, Z_DEFAULT_COMPRESSION) != Z_OK) {
+            com_err(progname, ENOMEM, _("while initializing compression"));
+            exit(1);
+        }
+        st->compress = TRUE;
+    }
+#endif
+
+    while ((n = read(database_fd, buf, sizeof(buf))) > 0)
+        kprop_chunker_add(&chunker, buf, n, send_block, st);
+    if (n < 0) {
+        com_err(progname, errno, _("while reading database file"));
+        send_error(context, my_creds, fd, "while reading database file",
+                   KRB5KRB_ERR_GENERIC);
+        exit(1);
+    }
+    kprop_chunker_finish(&chunker, send_block, st);
+    kprop_chunker_free(&chunker);
+
+    reserve_ops(st, 9);
+    st->buf[st->len] = KPROP_OP_END;
+    store_64_be(st->total, st->buf + st->len + 1);
+    st->len += 9;
+    flush_ops(st);
+    if (debug) {
+        printf(_("%llu bytes sent as %u blocks, %u copied from the slave's "
+                 "previous dump (%llu literal bytes, %llu bytes of "
+                 "operations).\n"),
+               (unsigned long long)st->total, st->nblocks, st->ncopied,
+               (unsigned long long)st->literal,
+               (unsigned long long)st->sent);
+    }
+
+    /* Wait for the slave to acknowledge the total size. */
+    retval = krb5_read_message(context, &fd, &inbuf);
+    if (retval) {
+        com_err(progname, retval, _("while reading response from server"));
+        exit(1);
+    }
+    if (krb5_is_krb_error(&inbuf))
+        display_remote_error(context, &inbuf);
+    retval = krb5_rd_safe(context, auth_context, &inbuf, &outbuf, NULL);
+    if (retval) {
+        com_err(progname, retval,
+                "while decoding final size packet from server");
+        exit(1);
+    }
+    if (outbuf.length != 8 || load_64_be(outbuf.data) != st->total) {
+        com_err(progname, 0, _("Kpropd acknowledged the wrong database size"));
+        exit(1);
+    }
+    free(inbuf.data);
+    free(outbuf.data);
+#ifdef HAVE_ZLIB
+    if (st->compress)
+        deflateEnd(&st->zs);
+#endif
+    free(st->sig);
+    free(st);
+}
+
 static void
 send_error(krb5_context context, krb5_creds *my_creds, int fd, char *err_text,
            krb5_error_code err_code)
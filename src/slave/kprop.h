@@ -30,9 +30,45 @@
 #define KPROP_PORT 754
 
 #define KPROP_PROT_VERSION "kprop5_01"
+#define KPROP_DELTA_VERSION "kprop5_02"
 
 #define KPROP_BUFSIZ 32768
 
+/*
+ * In the kprop5_02 protocol, the slave first sends the number of blocks in
+ * its previous dump file and a flags word, then the hashes of those blocks.
+ * The master then sends its dump as a stream of operations, each either
+ * copying a block of the previous dump or supplying literal data, ending with
+ * the total size.  Dump files are divided into blocks at line boundaries
+ * determined by the content of the lines, so that adding or removing a record
+ * changes only the block containing it.
+ *
+ * If the slave sets KPROP_FLAG_ZLIB and the master supports it too, the
+ * master may send messages holding KPROP_OP_ZLIB followed by zlib data.  The
+ * zlib stream runs across all such messages and is flushed at the end of
+ * each, and each message inflates to at most KPROP_BUFSIZ bytes of
+ * operations.
+ */
+#define KPROP_OP_COPY 'C'       /* 4-byte block index */
+#define KPROP_OP_DATA 'D'       /* 4-byte length, then data */
+#define KPROP_OP_END  'E'       /* 8-byte total size */
+#define KPROP_OP_ZLIB 'Z'       /* rest of message is compressed operations */
+
+#define KPROP_FLAG_ZLIB 0x1
+
+/* A block ends after a line whose hash has none of these bits set, or when it
+ * reaches KPROP_BLOCK_MAX bytes. */
+#define KPROP_BLOCK_MASK 0xF
+#define KPROP_BLOCK_MAX 65536
+
+typedef void (*kprop_block_fn)(void *arg, const char *data, size_t len);
+
+struct kprop_chunker {
+    char *buf;
+    size_t len;
+    uint32_t linehash;
+};
+
 /* pathnames are in osconf.h, included via k5-int.h */
 
 int sockaddr2krbaddr(krb5_context context, int family, struct sockaddr *sa,
@@ -41,3 +77,16 @@ int sockaddr2krbaddr(krb5_context context, int family, struct sockaddr *sa,
 krb5_error_code
 sn2princ_realm(krb5_context context, const char *hostname, const char *sname,
                const char *realm, krb5_principal *princ_out);
+
+krb5_error_code
+kprop_chunker_init(struct kprop_chunker *c);
+
+void
+kprop_chunker_add(struct kprop_chunker *c, const char *data, size_t len,
+                  kprop_block_fn fn, void *arg);
+
+void
+kprop_chunker_finish(struct kprop_chunker *c, kprop_block_fn fn, void *arg);
+
+void
+kprop_chunker_free(struct kprop_chunker *c);
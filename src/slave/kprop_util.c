@@ -24,7 +24,7 @@
  * or implied warranty.
  */
 
-/* sockaddr2krbaddr() utility function used by kprop and kpropd */
+/* Utility functions used by kprop and kpropd */
 
 #include "k5-int.h"
 #include "kprop.h"
@@ -96,3 +96,56 @@ sn2princ_realm(krb5_context context, const char *hostname, const char *sname,
         (*princ_out)->type = KRB5_NT_SRV_HST;
     return ret;
 }
+
+krb5_error_code
+kprop_chunker_init(struct kprop_chunker *c)
+{
+    c->buf = malloc(KPROP_BLOCK_MAX);
+    c->len = 0;
+    c->linehash = 2166136261U;
+    return (c->buf == NULL) ? ENOMEM : 0;
+}
+
+/* Divide data into blocks, calling fn for each complete block. */
+void
+kprop_chunker_add(struct kprop_chunker *c, const char *data, size_t len,
+                  kprop_block_fn fn, void *arg)
+{
+    size_t i;
+    unsigned char ch;
+
+    for (i = 0; i < len; i++) {
+        ch = data[i];
+        c->buf[c->len++] = ch;
+        /* FNV-1a hash of the current line. */
+        c->linehash = (c->linehash ^ ch) * 16777619U;
+        if (ch == '\n') {
+            if ((c->linehash & KPROP_BLOCK_MASK) == 0) {
+                fn(arg, c->buf, c->len);
+                c->len = 0;
+            }
+            c->linehash = 2166136261U;
+        }
+        if (c->len == KPROP_BLOCK_MAX) {
+            fn(arg, c->buf, c->len);
+            c->len = 0;
+        }
+    }
+}
+
+/* Call fn for the final partial block, if there is one. */
+void
+kprop_chunker_finish(struct kprop_chunker *c, kprop_block_fn fn, void *arg)
+{
+    if (c->len > 0)
+        fn(arg, c->buf, c->len);
+    c->len = 0;
+    c->linehash = 2166136261U;
+}
+
+void
+kprop_chunker_free(struct kprop_chunker *c)
+{
+    free(c->buf);
+    c->buf = NULL;
+}
@@ -76,6 +76,9 @@
 #include "iprop.h"
 #include <kadm5/admin.h>
 #include <kdb_log.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #ifndef GETSOCKNAME_ARG3_TYPE
 #define GETSOCKNAME_ARG3_TYPE unsigned int
@@ -110,7 +113,8 @@ typedef struct _kadm5_iprop_handle_t {
     struct _kadm5_iprop_handle_t *lhandle;
 } *kadm5_iprop_handle_t;
 
-static char *kprop_version = KPROP_PROT_VERSION;
+static krb5_boolean delta_protocol;  /* kprop5_02 was negotiated */
+static pid_t load_child = (pid_t)-1;
 
 static kadm5_config_params params;
 
@@ -151,8 +155,15 @@ static void kerberos_authenticate(krb5_context context, int fd,
 static krb5_boolean authorized_principal(krb5_context context,
                                          krb5_principal p,
                                          krb5_enctype auth_etype);
+static void recv_delta(krb5_context context, int fd, int database_fd,
+                       int basis_fd, int load_fd, krb5_data *confmsg);
 static void recv_database(krb5_context context, int fd, int database_fd,
                           krb5_data *confmsg);
+static int write_all(int fd, const char *data, size_t len);
+static pid_t start_load(krb5_context context, char *kdb_util,
+                        char *database_file_name, int *pipe_fd_out,
+                        int *commit_fd_out);
+static void finish_load(char *kdb_util, pid_t child_pid);
 static void load_database(krb5_context context, char *kdb_util,
                           char *database_file_name);
 static void send_error(krb5_context context, int fd, krb5_error_code err_code,
@@ -462,7 +473,8 @@ doit(int fd)
     int lock_fd;
     mode_t omask;
     krb5_enctype etype;
-    int database_fd;
+    int database_fd, basis_fd, load_fd, commit_fd;
+    pid_t load_pid;
     char host[INET6_ADDRSTRLEN + 1];
 
     signal_wrapper(SIGALRM, alarm_handler);
@@ -536,19 +548,48 @@ doit(int fd)
                 temp_file_name);
         exit(1);
     }
-    recv_database(kpropd_context, fd, database_fd, &confmsg);
-    if (rename(temp_file_name, file)) {
-        com_err(progname, errno, _("while renaming %s to %s"),
-                temp_file_name, file);
-        exit(1);
-    }
-    retval = krb5_lock_file(kpropd_context, lock_fd, KRB5_LOCKMODE_SHARED);
-    if (retval) {
-        com_err(progname, retval, _("while downgrading lock on '%s'"),
-                temp_file_name);
-        exit(1);
+    if (delta_protocol) {
+        /* Load the dump as it arrives, keeping a copy of it to serve as the
+         * basis of the next transfer.  The previous copy may not exist. */
+        basis_fd = open(file, O_RDONLY);
+        load_pid = start_load(kpropd_context, kdb5_util, NULL, &load_fd,
+                              &commit_fd);
+        recv_delta(kpropd_context, fd, database_fd, basis_fd, load_fd,
+                   &confmsg);
+        /* The whole dump arrived; tell the load process to commit it.  If we
+         * die before this point, it sees the commit pipe close instead and
+         * leaves the database alone. */
+        close(load_fd);
+        if (write_all(commit_fd, "commit\n", 7) != 0) {
+            com_err(progname, errno, _("while committing %s load"),
+                    kdb5_util);
+            exit(1);
+        }
+        close(commit_fd);
+        finish_load(kdb5_util, load_pid);
+        if (basis_fd >= 0)
+            close(basis_fd);
+        if (rename(temp_file_name, file)) {
+            com_err(progname, errno, _("while renaming %s to %s"),
+                    temp_file_name, file);
+            exit(1);
+        }
+    } else {
+        recv_database(kpropd_context, fd, database_fd, &confmsg);
+        if (rename(temp_file_name, file)) {
+            com_err(progname, errno, _("while renaming %s to %s"),
+                    temp_file_name, file);
+            exit(1);
+        }
+        retval = krb5_lock_file(kpropd_context, lock_fd,
+                                KRB5_LOCKMODE_SHARED);
+        if (retval) {
+            com_err(progname, retval, _("while downgrading lock on '%s'"),
+                    temp_file_name);
+            exit(1);
+        }
+        load_database(kpropd_context, kdb5_util, file);
     }
-    load_database(kpropd_context, kdb5_util, file);
     retval = krb5_lock_file(kpropd_context, lock_fd, KRB5_LOCKMODE_UNLOCK);
     if (retval) {
         com_err(progname, retval, _("while unlocking '%s'"), temp_file_name);
@@ -558,7 +599,7 @@ doit(int fd)
 
     /*
      * Send the acknowledgement message generated in
-     * recv_database, then close the socket.
+     * recv_database or recv_delta, then close the socket.
      */
     retval = krb5_write_message(kpropd_context, &fd, &confmsg);
     if (retval) {
@@ -601,6 +642,35 @@ full_resync(CLIENT *clnt)
     return (status == RPC_SUCCESS) ? &clnt_res : NULL;
 }
 
+/*
+ * Ask the master for updates, letting it hold the request until there are
+ * updates to send or IPROP_WAIT_TIME seconds pass.  Set *unsupported if the
+ * master does not implement waiting.
+ */
+static kdb_incr_result_t *
+get_updates_wait(kdb_last_t *last, CLIENT *clnt, krb5_boolean *unsupported)
+{
+    static kdb_incr_result_t clnt_res;
+    struct timeval timeout, saved_timeout;
+    enum clnt_stat status;
+
+    memset(&clnt_res, 0, sizeof(clnt_res));
+
+    /* Allow for the wait, but notice a vanished master well before the
+     * handle's usual one-hour timeout. */
+    timeout.tv_sec = IPROP_WAIT_TIME * 2;
+    timeout.tv_usec = 0;
+    (void)clnt_control(clnt, CLGET_TIMEOUT, &saved_timeout);
+    (void)clnt_control(clnt, CLSET_TIMEOUT, &timeout);
+    status = clnt_call(clnt, IPROP_GET_UPDATES_WAIT, (xdrproc_t)xdr_kdb_last_t,
+                       (caddr_t)last, (xdrproc_t)xdr_kdb_incr_result_t,
+                       (caddr_t)&clnt_res, timeout);
+    (void)clnt_control(clnt, CLSET_TIMEOUT, &saved_timeout);
+
+    *unsupported = (status == RPC_PROCUNAVAIL);
+    return (status == RPC_SUCCESS) ? &clnt_res : NULL;
+}
+
 /*
  * Beg for incrementals from the KDC.
  *
@@ -623,6 +693,8 @@ do_iprop()
     kdb_last_t mylast;
     kdb_fullresync_result_t *full_ret;
     kadm5_iprop_handle_t handle;
+    krb5_boolean can_wait, wait = FALSE, up_to_date, unsupported;
+    int wait_enabled;
 
     if (debug)
         fprintf(stderr, _("Incremental propagation enabled\n"));
@@ -631,6 +703,13 @@ do_iprop()
     if (pollin == 0)
         pollin = 10;
 
+    /* Waiting for updates (instead of polling) is enabled by a realm
+     * relation, since a held request cannot be interrupted by SIGUSR1. */
+    if (profile_get_boolean(kpropd_context->profile, KRB5_CONF_REALMS, realm,
+                            KRB5_CONF_IPROP_SLAVE_WAIT, 0, &wait_enabled) != 0)
+        wait_enabled = 0;
+    can_wait = (wait_enabled != 0);
+
     if (master_svc_princstr == NULL) {
         retval = kadm5_get_kiprop_host_srv_name(kpropd_context, realm,
                                                 &master_svc_princstr);
@@ -729,6 +808,7 @@ reinit:
      * Reset re-initialization count to zero now.
      */
     reinit_cnt = backoff_time = 0;
+    wait = FALSE;
 
     /*
      * Reset the handle to the correct type for the RPC call
@@ -763,7 +843,20 @@ reinit:
                     (unsigned int)mylast.last_time.useconds);
         }
         gettimeofday(&iprop_start, NULL);
-        incr_ret = iprop_get_updates_1(&mylast, handle->clnt);
+        if (wait) {
+            incr_ret = get_updates_wait(&mylast, handle->clnt, &unsupported);
+            if (incr_ret == NULL && unsupported) {
+                if (debug) {
+                    fprintf(stderr, _("Master does not support waiting for "
+                                      "updates; polling instead\n"));
+                }
+                can_wait = FALSE;
+                incr_ret = iprop_get_updates_1(&mylast, handle->clnt);
+            }
+        } else {
+            incr_ret = iprop_get_updates_1(&mylast, handle->clnt);
+        }
+        up_to_date = FALSE;
         if (incr_ret == (kdb_incr_result_t *)NULL) {
             clnt_perror(handle->clnt,
                         _("iprop_get_updates call failed"));
@@ -885,6 +978,7 @@ reinit:
                 break;
             }
 
+            up_to_date = TRUE;
             gettimeofday(&iprop_end, NULL);
             usec = (iprop_end.tv_sec - iprop_start.tv_sec) * 1000000 +
                 iprop_end.tv_usec - iprop_start.tv_usec;
@@ -926,6 +1020,7 @@ reinit:
                 fprintf(stderr, _("KDC is synchronized with master.\n"));
             backoff_cnt = 0;
             frrequested = 0;
+            up_to_date = TRUE;
             break;
 
         default:
@@ -940,11 +1035,17 @@ reinit:
             goto done;
 
         /*
-         * Sleep for the specified poll interval (Default is 2 mts),
-         * or do a binary exponential backoff if we get an
+         * If we are up to date and the master supports it, ask for the next
+         * updates right away and let the master hold the request until there
+         * are some.  Otherwise sleep for the specified poll interval (Default
+         * is 2 mts), or do a binary exponential backoff if we get an
          * UPDATE_BUSY signal
          */
-        if (backoff_cnt > 0) {
+        wait = (up_to_date && can_wait);
+        if (wait) {
+            if (debug)
+                fprintf(stderr, _("Waiting for updates from master\n"));
+        } else if (backoff_cnt > 0) {
             backoff_time = backoff_from_master(&backoff_cnt);
             if (debug) {
                 fprintf(stderr, _("Busy signal received "
@@ -1193,6 +1294,7 @@ kerberos_authenticate(krb5_context context, int fd, krb5_principal *clientp,
     struct sockaddr_storage r_sin;
     GETSOCKNAME_ARG3_TYPE sin_length;
     krb5_keytab keytab = NULL;
+    krb5_data version;
     char *name, etypebuf[100];
 
     /* Set recv_addr and send_addr. */
@@ -1214,8 +1316,7 @@ kerberos_authenticate(krb5_context context, int fd, krb5_principal *clientp,
             com_err(progname, retval, _("while unparsing client name"));
             exit(1);
         }
-        fprintf(stderr, "krb5_recvauth(%d, %s, %s, ...)\n", fd, kprop_version,
-                name);
+        fprintf(stderr, "krb5_recvauth(%d, %s, ...)\n", fd, name);
         free(name);
     }
 
@@ -1251,14 +1352,26 @@ kerberos_authenticate(krb5_context context, int fd, krb5_principal *clientp,
         }
     }
 
-    retval = krb5_recvauth(context, &auth_context, &fd, kprop_version, server,
-                           0, keytab, &ticket);
+    retval = krb5_recvauth_version(context, &auth_context, &fd, server, 0,
+                                   keytab, &ticket, &version);
     if (retval) {
         syslog(LOG_ERR, _("Error in krb5_recvauth: %s"),
                error_message(retval));
         exit(1);
     }
 
+    /* Accept the original protocol or the delta protocol. */
+    if (version.length == sizeof(KPROP_DELTA_VERSION) &&
+        memcmp(version.data, KPROP_DELTA_VERSION, version.length) == 0) {
+        delta_protocol = TRUE;
+    } else if (version.length != sizeof(KPROP_PROT_VERSION) ||
+               memcmp(version.data, KPROP_PROT_VERSION,
+                      version.length) != 0) {
+        syslog(LOG_ERR, _("Unsupported kprop protocol version"));
+        exit(1);
+    }
+    krb5_free_data_contents(context, &version);
+
     retval = krb5_copy_principal(context, ticket->enc_part2->client, clientp);
     if (retval) {
         syslog(LOG_ERR, _("Error in krb5_copy_prinicpal: %s"),
@@ -1456,6 +1569,332 @@ recv_database(krb5_context context, int fd, int database_fd,
     }
 }
 
+/* A block of the previous dump, which the master can refer to. */
+struct basis_block {
+    off_t offset;
+    size_t len;
+    uint8_t hash[K5_SHA256_HASHLEN];
+};
+
+struct basis {
+    struct basis_block *blocks;
+    uint32_t count;
+    uint32_t alloc;
+    off_t offset;
+};
+
+static void
+add_basis_block(void *arg, const char *data, size_t len)
+{
+    struct basis *b = arg;
+    struct basis_block *newblocks;
+    krb5_data d = make_data((char *)data, len);
+    krb5_error_code retval;
+
+    if (b->count == b->alloc) {
+        b->alloc = (b->alloc == 0) ? 1024 : b->alloc * 2;
+        newblocks = realloc(b->blocks, b->alloc * sizeof(*b->blocks));
+        if (newblocks == NULL) {
+            com_err(progname, ENOMEM, _("while hashing previous dump"));
+            exit(1);
+        }
+        b->blocks = newblocks;
+    }
+    retval = k5_sha256(&d, b->blocks[b->count].hash);
+    if (retval) {
+        com_err(progname, retval, _("while hashing previous dump"));
+        exit(1);
+    }
+    b->blocks[b->count].offset = b->offset;
+    b->blocks[b->count].len = len;
+    b->count++;
+    b->offset += len;
+}
+
+/* Divide the previous dump in basis_fd (if there is one) into blocks. */
+static void
+read_basis(int basis_fd, struct basis *b)
+{
+    struct kprop_chunker chunker;
+    char buf[KPROP_BUFSIZ];
+    ssize_t n;
+
+    memset(b, 0, sizeof(*b));
+    if (basis_fd < 0)
+        return;
+    if (kprop_chunker_init(&chunker) != 0) {
+        com_err(progname, ENOMEM, _("while hashing previous dump"));
+        exit(1);
+    }
+    while ((n = read(basis_fd, buf, sizeof(buf))) > 0)
+        kprop_chunker_add(&chunker, buf, n, add_basis_block, b);
+    if (n < 0) {
+        com_err(progname, errno, _("while reading previous dump"));
+        exit(1);
+    }
+    kprop_chunker_finish(&chunker, add_basis_block, b);
+    kprop_chunker_free(&chunker);
+}
+
+/* Send data to the master as a KRB_PRIV message. */
+static void
+send_priv(krb5_context context, int fd, const char *data, size_t len)
+{
+    krb5_error_code retval;
+    krb5_data inbuf = make_data((char *)data, len), outbuf;
+
+    retval = krb5_mk_priv(context, auth_context, &inbuf, &outbuf, NULL);
+    if (retval) {
+        com_err(progname, retval, _("while encoding block hashes"));
+        send_error(context, fd, retval, "while encoding block hashes");
+        exit(1);
+    }
+    retval = krb5_write_message(context, &fd, &outbuf);
+    krb5_free_data_contents(context, &outbuf);
+    if (retval) {
+        com_err(progname, retval, _("while sending block hashes"));
+        exit(1);
+    }
+}
+
+/* Write all of data to fd. */
+static int
+write_all(int fd, const char *data, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        n = write(fd, data, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Write received dump data to the new dump file and to the load process. */
+static void
+write_dump_data(krb5_context context, int fd, int database_fd, int load_fd,
+                const char *data, size_t len)
+{
+    if (write_all(database_fd, data, len) != 0) {
+        com_err(progname, errno, _("while writing database file"));
+        send_error(context, fd, errno, "while writing database file");
+        exit(1);
+    }
+    if (write_all(load_fd, data, len) != 0) {
+        com_err(progname, errno, _("while writing to %s load"), kdb5_util);
+        send_error(context, fd, errno, "while loading database");
+        exit(1);
+    }
+}
+
+/* Read block index i of the previous dump into buf and check its hash. */
+static void
+read_basis_block(krb5_context context, int fd, int basis_fd, struct basis *b,
+                 uint32_t i, char *buf)
+{
+    struct basis_block *blk = &b->blocks[i];
+    uint8_t hash[K5_SHA256_HASHLEN];
+    krb5_data d = make_data(buf, blk->len);
+    size_t pos = 0;
+    ssize_t n;
+
+    if (lseek(basis_fd, blk->offset, SEEK_SET) == (off_t)-1)
+        goto error;
+    while (pos < blk->len) {
+        n = read(basis_fd, buf + pos, blk->len - pos);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            goto error;
+        pos += n;
+    }
+    if (k5_sha256(&d, hash) == 0 &&
+        memcmp(hash, blk->hash, K5_SHA256_HASHLEN) == 0)
+        return;
+
+error:
+    com_err(progname, 0, _("previous dump changed during propagation"));
+    send_error(context, fd, KRB5KRB_ERR_GENERIC,
+               "previous dump changed during propagation");
+    exit(1);
+}
+
+/*
+ * Receive the database using the kprop5_02 protocol, writing it to
+ * database_fd and load_fd.  basis_fd is our previous dump file, or -1 if we
+ * have none.
+ */
+static void
+recv_delta(krb5_context context, int fd, int database_fd, int basis_fd,
+           int load_fd, krb5_data *confmsg)
+{
+    struct basis basis;
+    krb5_data inbuf, outbuf;
+    krb5_error_code retval;
+    char buf[KPROP_BUFSIZ], *blockbuf, *zbuf = NULL;
+    const char *p, *end;
+    uint64_t received_size = 0, wire_size = 0, total;
+    uint32_t i, n, ncopied = 0, flags = 0;
+    krb5_boolean done = FALSE;
+#ifdef HAVE_ZLIB
+    z_stream zs;
+
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) {
+        com_err(progname, ENOMEM, _("while initializing decompression"));
+        exit(1);
+    }
+    zbuf = malloc(KPROP_BUFSIZ);
+    if (zbuf == NULL) {
+        com_err(progname, ENOMEM, _("while allocating block buffer"));
+        exit(1);
+    }
+    flags |= KPROP_FLAG_ZLIB;
+#endif
+
+    retval = krb5_auth_con_initivector(context, auth_context);
+    if (retval) {
+        send_error(context, fd, retval,
+                   "failed while initializing i_vector");
+        com_err(progname, retval, _("while initializing i_vector"));
+        exit(1);
+    }
+
+    /* Send the hashes of the blocks of our previous dump. */
+    read_basis(basis_fd, &basis);
+    store_32_be(basis.count, buf);
+    store_32_be(flags, buf + 4);
+    send_priv(context, fd, buf, 8);
+    for (i = 0; i < basis.count; i += n) {
+        for (n = 0; n < sizeof(buf) / K5_SHA256_HASHLEN &&
+                 i + n < basis.count; n++) {
+            memcpy(buf + n * K5_SHA256_HASHLEN, basis.blocks[i + n].hash,
+                   K5_SHA256_HASHLEN);
+        }
+        send_priv(context, fd, buf, n * K5_SHA256_HASHLEN);
+    }
+
+    blockbuf = malloc(KPROP_BLOCK_MAX);
+    if (blockbuf == NULL) {
+        com_err(progname, ENOMEM, _("while allocating block buffer"));
+        exit(1);
+    }
+
+    if (debug)
+        fprintf(stderr, _("Full propagation transfer started.\n"));
+
+    while (!done) {
+        retval = krb5_read_message(context, &fd, &inbuf);
+        if (retval) {
+            snprintf(buf, sizeof(buf),
+                     "while reading database block starting at offset %llu",
+                     (unsigned long long)received_size);
+            com_err(progname, retval, "%s", buf);
+            send_error(context, fd, retval, buf);
+            exit(1);
+        }
+        if (krb5_is_krb_error(&inbuf))
+            recv_error(context, &inbuf);
+        retval = krb5_rd_priv(context, auth_context, &inbuf, &outbuf, NULL);
+        krb5_free_data_contents(context, &inbuf);
+        if (retval) {
+            snprintf(buf, sizeof(buf),
+                     "while decoding database block starting at offset %llu",
+                     (unsigned long long)received_size);
+            com_err(progname, retval, "%s", buf);
+            send_error(context, fd, retval, buf);
+            exit(1);
+        }
+
+        wire_size += outbuf.length;
+        p = outbuf.data;
+        end = p + outbuf.length;
+#ifdef HAVE_ZLIB
+        if (p < end && *p == KPROP_OP_ZLIB) {
+            zs.next_in = (unsigned char *)p + 1;
+            zs.avail_in = end - p - 1;
+            zs.next_out = (unsigned char *)zbuf;
+            zs.avail_out = KPROP_BUFSIZ;
+            if (inflate(&zs, Z_SYNC_FLUSH) != Z_OK || zs.avail_in != 0) {
+                snprintf(buf, sizeof(buf), "while decompressing database "
+                         "block starting at offset %llu",
+                         (unsigned long long)received_size);
+                com_err(progname, KRB5KRB_ERR_GENERIC, "%s", buf);
+                send_error(context, fd, KRB5KRB_ERR_GENERIC, buf);
+                exit(1);
+            }
+            p = zbuf;
+            end = zbuf + (KPROP_BUFSIZ - zs.avail_out);
+        }
+#endif
+        while (p < end && !done) {
+            if (*p == KPROP_OP_COPY && end - p >= 5) {
+                i = load_32_be(p + 1);
+                if (i >= basis.count)
+                    break;
+                read_basis_block(context, fd, basis_fd, &basis, i, blockbuf);
+                write_dump_data(context, fd, database_fd, load_fd, blockbuf,
+                                basis.blocks[i].len);
+                received_size += basis.blocks[i].len;
+                ncopied++;
+                p += 5;
+            } else if (*p == KPROP_OP_DATA && end - p >= 5 &&
+                       load_32_be(p + 1) <= (size_t)(end - p - 5)) {
+                n = load_32_be(p + 1);
+                write_dump_data(context, fd, database_fd, load_fd, p + 5, n);
+                received_size += n;
+                p += 5 + n;
+            } else if (*p == KPROP_OP_END && end - p == 9) {
+                total = load_64_be(p + 1);
+                if (total != received_size)
+                    break;
+                done = TRUE;
+                p += 9;
+            } else {
+                break;
+            }
+        }
+        krb5_free_data_contents(context, &outbuf);
+        if (p != end) {
+            snprintf(buf, sizeof(buf),
+                     "invalid database block starting at offset %llu",
+                     (unsigned long long)received_size);
+            com_err(progname, KRB5KRB_ERR_GENERIC, "%s", buf);
+            send_error(context, fd, KRB5KRB_ERR_GENERIC, buf);
+            exit(1);
+        }
+    }
+    free(blockbuf);
+    free(zbuf);
+    free(basis.blocks);
+#ifdef HAVE_ZLIB
+    inflateEnd(&zs);
+#endif
+
+    if (debug) {
+        fprintf(stderr, _("Received %llu bytes (%llu on the wire), %u blocks "
+                          "copied from previous dump.\n"),
+                (unsigned long long)received_size,
+                (unsigned long long)wire_size, ncopied);
+        fprintf(stderr, _("Full propagation transfer finished.\n"));
+    }
+
+    /* Create message acknowledging number of bytes received, but
+     * don't send it until kdb5_util returns successfully. */
+    store_64_be(received_size, buf);
+    inbuf = make_data(buf, 8);
+    retval = krb5_mk_safe(context, auth_context, &inbuf, confmsg, NULL);
+    if (retval) {
+        com_err(progname, retval, "while encoding # of received bytes");
+        send_error(context, fd, retval, "while encoding # of received bytes");
+        exit(1);
+    }
+}
 
 static void
 send_error(krb5_context context, int fd, krb5_error_code err_code,
@@ -1521,22 +1960,28 @@ recv_error(krb5_context context, krb5_data *inbuf)
     exit(1);
 }
 
+/* Kill the load process if we exit before the transfer is complete, so that
+ * it does not load a truncated dump. */
 static void
-load_database(krb5_context context, char *kdb_util, char *database_file_name)
+kill_load_child(void)
 {
-    static char *edit_av[10];
-    int error_ret, child_pid, count;
+    if (load_child > 0)
+        kill(load_child, SIGKILL);
+}
 
-    /* <sys/param.h> has been included, so BSD will be defined on
-     * BSD systems. */
-#if BSD > 0 && BSD <= 43
-#ifndef WEXITSTATUS
-#define WEXITSTATUS(w) (w).w_retcode
-#endif
-    union wait waitb;
-#else
-    int waitb;
-#endif
+/*
+ * Start kdb5_util load on database_file_name, or, if it is NULL, on a pipe
+ * whose write end is returned in *pipe_fd_out.  In the latter case, the load
+ * only takes effect once "commit" is written to *commit_fd_out.
+ */
+static pid_t
+start_load(krb5_context context, char *kdb_util, char *database_file_name,
+           int *pipe_fd_out, int *commit_fd_out)
+{
+    static char *edit_av[12];
+    static char commit_fd_str[16];
+    int count, pipe_fds[2], commit_fds[2];
+    pid_t child_pid;
     kdb_log_context *log_ctx;
 
     if (debug)
@@ -1544,6 +1989,12 @@ load_database(krb5_context context, char *kdb_util, char *database_file_name)
 
     log_ctx = context->kdblog_context;
 
+    if (database_file_name == NULL &&
+        (pipe(pipe_fds) != 0 || pipe(commit_fds) != 0)) {
+        com_err(progname, errno, _("while creating pipe for %s"), kdb_util);
+        exit(1);
+    }
+
     edit_av[0] = kdb_util;
     count = 1;
     if (realm) {
@@ -1557,7 +2008,13 @@ load_database(krb5_context context, char *kdb_util, char *database_file_name)
     }
     if (log_ctx && log_ctx->iproprole == IPROP_SLAVE)
         edit_av[count++] = "-i";
-    edit_av[count++] = database_file_name;
+    if (database_file_name == NULL) {
+        snprintf(commit_fd_str, sizeof(commit_fd_str), "%d", commit_fds[0]);
+        edit_av[count++] = "-commit_fd";
+        edit_av[count++] = commit_fd_str;
+    }
+    edit_av[count++] = (database_file_name != NULL) ? database_file_name :
+        "-";
     edit_av[count++] = NULL;
 
     switch (child_pid = fork()) {
@@ -1565,17 +2022,61 @@ load_database(krb5_context context, char *kdb_util, char *database_file_name)
         com_err(progname, errno, _("while trying to fork %s"), kdb_util);
         exit(1);
     case 0:
+        if (database_file_name == NULL) {
+            close(pipe_fds[1]);
+            close(commit_fds[1]);
+            if (dup2(pipe_fds[0], 0) < 0) {
+                com_err(progname, errno, _("while trying to exec %s"),
+                        kdb_util);
+                _exit(1);
+            }
+            close(pipe_fds[0]);
+        }
         execv(kdb_util, edit_av);
         com_err(progname, errno, _("while trying to exec %s"), kdb_util);
         _exit(1);
         /*NOTREACHED*/
     default:
         if (debug)
-            fprintf(stderr, "Load PID is %d\n", child_pid);
-        if (wait(&waitb) < 0) {
-            com_err(progname, errno, _("while waiting for %s"), kdb_util);
-            exit(1);
-        }
+            fprintf(stderr, "Load PID is %d\n", (int)child_pid);
+    }
+
+    if (database_file_name == NULL) {
+        close(pipe_fds[0]);
+        close(commit_fds[0]);
+        *pipe_fd_out = pipe_fds[1];
+        *commit_fd_out = commit_fds[1];
+        load_child = child_pid;
+        atexit(kill_load_child);
+    }
+    return child_pid;
+}
+
+/* Wait for the load process to finish and check its exit status. */
+static void
+finish_load(char *kdb_util, pid_t child_pid)
+{
+    int error_ret;
+    pid_t wait_pid;
+
+    /* <sys/param.h> has been included, so BSD will be defined on
+     * BSD systems. */
+#if BSD > 0 && BSD <= 43
+#ifndef WEXITSTATUS
+#define WEXITSTATUS(w) (w).w_retcode
+#endif
+    union wait waitb;
+#else
+    int waitb;
+#endif
+
+    do {
+        wait_pid = waitpid(child_pid, &waitb, 0);
+    } while (wait_pid == -1 && errno == EINTR);
+    load_child = (pid_t)-1;
+    if (wait_pid < 0) {
+        com_err(progname, errno, _("while waiting for %s"), kdb_util);
+        exit(1);
     }
 
     if (!WIFEXITED(waitb)) {
@@ -1589,7 +2090,14 @@ load_database(krb5_context context, char *kdb_util, char *database_file_name)
                 kdb_util, error_ret);
         exit(1);
     }
-    return;
+}
+
+static void
+load_database(krb5_context context, char *kdb_util, char *database_file_name)
+{
+    finish_load(kdb_util,
+                start_load(context, kdb_util, database_file_name, NULL,
+                           NULL));
 }
 
 /*
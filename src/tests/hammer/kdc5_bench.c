@@ -0,0 +1,509 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* tests/hammer/kdc5_bench.c - Open-loop KDC load generator */
+/*
+ * Copyright (C) 2026 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Usage: kdc5_bench -m mix -r rate -d seconds [-n threads] [options]
+ *
+ * Issue a mix of KDC requests at a fixed rate for a fixed time, and report
+ * latency percentiles and throughput for each request type.  The mix is a
+ * comma-separated list of type[:weight] elements, where type is one of:
+ *
+ *   as         AS request with encrypted timestamp (-p client, -w password)
+ *   as-fast    the same, armored with the TGT in -c
+ *   as-anon    anonymous PKINIT AS request for the realm of -p
+ *   tgs        TGS request for -s using the TGT in -c
+ *   cross      TGS request for -x, a service in another realm
+ *   s4u2self   S4U2Self request for -u using the service TGT in -c
+ *   s4u2proxy  S4U2Proxy request for -u to -t, using the service TGT in -c
+ *              and the service keytab -k to read the evidence ticket
+ *
+ * The load is open-loop: request i is scheduled at start + i/rate whether or
+ * not earlier requests have completed, and its latency is measured from its
+ * scheduled time, so time spent waiting for a free thread counts against the
+ * KDC.  -n bounds the number of requests in flight.  The library's transport
+ * selection applies; set udp_preference_limit = 1 in the profile to use TCP.
+ *
+ * Output has one line per request type, of the form:
+ *
+ *   type=tgs sent=N ok=N errors=N tput=R p50=MS p99=MS p999=MS max=MS
+ */
+
+#include "k5-int.h"
+#include <pthread.h>
+
+enum req_type {
+    REQ_AS, REQ_AS_FAST, REQ_AS_ANON, REQ_TGS, REQ_CROSS, REQ_S4U2SELF,
+    REQ_S4U2PROXY, REQ_NTYPES
+};
+
+static const char *type_names[REQ_NTYPES] = {
+    "as", "as-fast", "as-anon", "tgs", "cross", "s4u2self", "s4u2proxy"
+};
+
+/* Options. */
+static const char *client_name, *password, *ccname, *server_name;
+static const char *cross_name, *user_name, *target_name, *keytab_name;
+static double rate;
+static int duration, nthreads = 32;
+
+/* The schedule: slot i has type slot_types[i % cycle_len]. */
+static enum req_type slot_types[1024];
+static int cycle_len;
+static long nslots;
+static struct timespec start_time;
+
+/* Results, indexed by slot. */
+static double *latency;
+static krb5_error_code *result;
+static int printed_error[REQ_NTYPES];
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static long next_slot;
+
+struct worker {
+    pthread_t tid;
+    krb5_context ctx;
+    krb5_ccache cc;
+    krb5_principal client, ccprinc, server, cross, user, target;
+    krb5_ticket *evidence;
+};
+
+static void
+usage(void)
+{
+    fprintf(stderr, "Usage: kdc5_bench -m mix -r rate -d seconds "
+            "[-n threads] [-p client] [-w password]\n"
+            "       [-c ccache] [-s server] [-x crossserver] [-u user] "
+            "[-t proxytarget] [-k keytab]\n");
+    exit(1);
+}
+
+static void
+check(krb5_context ctx, krb5_error_code code, const char *what)
+{
+    const char *msg;
+
+    if (code == 0)
+        return;
+    msg = krb5_get_error_message(ctx, code);
+    fprintf(stderr, "kdc5_bench: %s: %s\n", what, msg);
+    krb5_free_error_message(ctx, msg);
+    exit(1);
+}
+
+static double
+elapsed_ms(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1000.0 +
+        (to->tv_nsec - from->tv_nsec) / 1000000.0;
+}
+
+/* Parse a mix specification into the slot_types cycle. */
+static void
+parse_mix(char *spec)
+{
+    char *elem, *save = NULL, *colon;
+    int t, weight;
+
+    for (elem = strtok_r(spec, ",", &save); elem != NULL;
+         elem = strtok_r(NULL, ",", &save)) {
+        weight = 1;
+        colon = strchr(elem, ':');
+        if (colon != NULL) {
+            *colon = '\0';
+            weight = atoi(colon + 1);
+        }
+        for (t = 0; t < REQ_NTYPES; t++) {
+            if (strcmp(elem, type_names[t]) == 0)
+                break;
+        }
+        if (t == REQ_NTYPES || weight < 1 ||
+            cycle_len + weight > (int)(sizeof(slot_types) /
+                                       sizeof(*slot_types))) {
+            fprintf(stderr, "kdc5_bench: bad mix element %s\n", elem);
+            exit(1);
+        }
+        while (weight-- > 0)
+            slot_types[cycle_len++] = t;
+    }
+    if (cycle_len == 0)
+        usage();
+}
+
+static krb5_error_code
+do_as(struct worker *w, enum req_type type)
+{
+    krb5_error_code ret;
+    krb5_get_init_creds_opt *opt;
+    krb5_creds creds;
+    krb5_principal anon = NULL;
+
+    ret = krb5_get_init_creds_opt_alloc(w->ctx, &opt);
+    if (ret)
+        return ret;
+    krb5_get_init_creds_opt_set_tkt_life(opt, 3600);
+    if (type == REQ_AS_FAST)
+        ret = krb5_get_init_creds_opt_set_fast_ccache_name(w->ctx, opt,
+                                                           ccname);
+    if (type == REQ_AS_ANON) {
+        krb5_get_init_creds_opt_set_anonymous(opt, 1);
+        ret = krb5_build_principal_ext(w->ctx, &anon,
+                                       w->client->realm.length,
+                                       w->client->realm.data,
+                                       strlen(KRB5_WELLKNOWN_NAMESTR),
+                                       KRB5_WELLKNOWN_NAMESTR,
+                                       strlen(KRB5_ANONYMOUS_PRINCSTR),
+                                       KRB5_ANONYMOUS_PRINCSTR, 0);
+    }
+    if (ret == 0) {
+        ret = krb5_get_init_creds_password(w->ctx, &creds,
+                                           anon ? anon : w->client,
+                                           anon ? NULL : password, NULL,
+                                           NULL, 0, NULL, opt);
+    }
+    if (ret == 0)
+        krb5_free_cred_contents(w->ctx, &creds);
+    krb5_free_principal(w->ctx, anon);
+    krb5_get_init_creds_opt_free(w->ctx, opt);
+    return ret;
+}
+
+static krb5_error_code
+do_tgs(struct worker *w, enum req_type type)
+{
+    krb5_error_code ret;
+    krb5_creds in, *out = NULL;
+    krb5_flags flags = KRB5_GC_NO_STORE;
+
+    memset(&in, 0, sizeof(in));
+    switch (type) {
+    case REQ_TGS:
+        in.client = w->ccprinc;
+        in.server = w->server;
+        ret = krb5_get_credentials(w->ctx, flags, w->cc, &in, &out);
+        break;
+    case REQ_CROSS:
+        in.client = w->ccprinc;
+        in.server = w->cross;
+        ret = krb5_get_credentials(w->ctx, flags, w->cc, &in, &out);
+        break;
+    case REQ_S4U2SELF:
+        in.client = w->user;
+        in.server = w->ccprinc;
+        ret = krb5_get_credentials_for_user(w->ctx, flags, w->cc, &in, NULL,
+                                            &out);
+        break;
+    case REQ_S4U2PROXY:
+        in.client = w->user;
+        in.server = w->target;
+        ret = krb5_get_credentials_for_proxy(w->ctx, flags, w->cc, &in,
+                                             w->evidence, &out);
+        break;
+    default:
+        abort();
+    }
+    krb5_free_creds(w->ctx, out);
+    return ret;
+}
+
+/* Get and decrypt a forwardable S4U2Self ticket to use as evidence. */
+static void
+get_evidence(struct worker *w)
+{
+    krb5_creds in, *out;
+    krb5_keytab kt;
+
+    memset(&in, 0, sizeof(in));
+    in.client = w->user;
+    in.server = w->ccprinc;
+    check(w->ctx, krb5_get_credentials_for_user(w->ctx, KRB5_GC_NO_STORE |
+                                                KRB5_GC_FORWARDABLE, w->cc,
+                                                &in, NULL, &out),
+          "getting S4U2Self evidence ticket");
+    check(w->ctx, krb5_decode_ticket(&out->ticket, &w->evidence),
+          "decoding evidence ticket");
+    check(w->ctx, krb5_kt_resolve(w->ctx, keytab_name, &kt),
+          "resolving keytab");
+    check(w->ctx, krb5_server_decrypt_ticket_keytab(w->ctx, kt, w->evidence),
+          "decrypting evidence ticket");
+    krb5_kt_close(w->ctx, kt);
+    krb5_free_creds(w->ctx, out);
+}
+
+static void
+parse_opt_name(krb5_context ctx, const char *name, krb5_principal *princ)
+{
+    if (name != NULL)
+        check(ctx, krb5_parse_name(ctx, name, princ), name);
+}
+
+static void
+init_worker(struct worker *w, krb5_boolean need_evidence)
+{
+    check(NULL, krb5_init_context(&w->ctx), "initializing context");
+    parse_opt_name(w->ctx, client_name, &w->client);
+    parse_opt_name(w->ctx, server_name, &w->server);
+    parse_opt_name(w->ctx, cross_name, &w->cross);
+    parse_opt_name(w->ctx, user_name, &w->user);
+    parse_opt_name(w->ctx, target_name, &w->target);
+    if (ccname != NULL) {
+        check(w->ctx, krb5_cc_resolve(w->ctx, ccname, &w->cc),
+              "resolving ccache");
+        check(w->ctx, krb5_cc_get_principal(w->ctx, w->cc, &w->ccprinc),
+              "reading ccache principal");
+    }
+    if (need_evidence)
+        get_evidence(w);
+}
+
+static void
+fini_worker(struct worker *w)
+{
+    krb5_free_ticket(w->ctx, w->evidence);
+    krb5_free_principal(w->ctx, w->client);
+    krb5_free_principal(w->ctx, w->ccprinc);
+    krb5_free_principal(w->ctx, w->server);
+    krb5_free_principal(w->ctx, w->cross);
+    krb5_free_principal(w->ctx, w->user);
+    krb5_free_principal(w->ctx, w->target);
+    if (w->cc != NULL)
+        krb5_cc_close(w->ctx, w->cc);
+    krb5_free_context(w->ctx);
+}
+
+static void *
+run_worker(void *arg)
+{
+    struct worker *w = arg;
+    struct timespec sched, now;
+    enum req_type type;
+    krb5_error_code ret;
+    const char *msg;
+    long slot;
+    long long offset_ns;
+
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        slot = next_slot++;
+        pthread_mutex_unlock(&lock);
+        if (slot >= nslots)
+            break;
+
+        /* Wait for this slot's scheduled time. */
+        offset_ns = (long long)(slot * 1e9 / rate);
+        sched = start_time;
+        sched.tv_sec += offset_ns / 1000000000;
+        sched.tv_nsec += offset_ns % 1000000000;
+        if (sched.tv_nsec >= 1000000000) {
+            sched.tv_sec++;
+            sched.tv_nsec -= 1000000000;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &sched,
+                               NULL) == EINTR);
+
+        type = slot_types[slot % cycle_len];
+        if (type == REQ_AS || type == REQ_AS_FAST || type == REQ_AS_ANON)
+            ret = do_as(w, type);
+        else
+            ret = do_tgs(w, type);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        latency[slot] = elapsed_ms(&sched, &now);
+        result[slot] = ret;
+
+        if (ret) {
+            pthread_mutex_lock(&lock);
+            if (!printed_error[type]) {
+                msg = krb5_get_error_message(w->ctx, ret);
+                fprintf(stderr, "kdc5_bench: %s: %s\n", type_names[type],
+                        msg);
+                krb5_free_error_message(w->ctx, msg);
+                printed_error[type] = 1;
+            }
+            pthread_mutex_unlock(&lock);
+        }
+    }
+    return NULL;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Return the q-quantile of the n sorted values in v. */
+static double
+quantile(const double *v, long n, double q)
+{
+    long i = (long)(q * n);
+
+    if (n == 0)
+        return 0;
+    /* Round q * n up, then convert to an index. */
+    if (i < q * n)
+        i++;
+    return v[(i < 1) ? 0 : i - 1];
+}
+
+static void
+report(double elapsed)
+{
+    double *v;
+    long slot, sent, n, errors;
+    int t;
+
+    v = calloc(nslots, sizeof(*v));
+    if (v == NULL)
+        abort();
+    for (t = 0; t < REQ_NTYPES; t++) {
+        sent = n = errors = 0;
+        for (slot = 0; slot < nslots; slot++) {
+            if (slot_types[slot % cycle_len] != (enum req_type)t)
+                continue;
+            sent++;
+            if (result[slot] == 0)
+                v[n++] = latency[slot];
+            else
+                errors++;
+        }
+        if (sent == 0)
+            continue;
+        qsort(v, n, sizeof(*v), cmp_double);
+        printf("type=%s sent=%ld ok=%ld errors=%ld tput=%.1f p50=%.3f "
+               "p99=%.3f p999=%.3f max=%.3f\n", type_names[t], sent, n,
+               errors, n / elapsed, quantile(v, n, 0.5), quantile(v, n, 0.99),
+               quantile(v, n, 0.999), quantile(v, n, 1.0));
+    }
+    free(v);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct worker *workers;
+    struct timespec end_time;
+    krb5_boolean need_evidence = FALSE;
+    char *mix = NULL;
+    int c, i;
+
+    while ((c = getopt(argc, argv, "m:r:d:n:p:w:c:s:x:u:t:k:")) != -1) {
+        switch (c) {
+        case 'm': mix = optarg; break;
+        case 'r': rate = atof(optarg); break;
+        case 'd': duration = atoi(optarg); break;
+        case 'n': nthreads = atoi(optarg); break;
+        case 'p': client_name = optarg; break;
+        case 'w': password = optarg; break;
+        case 'c': ccname = optarg; break;
+        case 's': server_name = optarg; break;
+        case 'x': cross_name = optarg; break;
+        case 'u': user_name = optarg; break;
+        case 't': target_name = optarg; break;
+        case 'k': keytab_name = optarg; break;
+        default: usage();
+        }
+    }
+    if (mix == NULL || rate <= 0 || duration <= 0 || nthreads <= 0 ||
+        optind != argc)
+        usage();
+    parse_mix(mix);
+
+    /* Make sure each type in the mix has what it needs. */
+    for (i = 0; i < cycle_len; i++) {
+        switch (slot_types[i]) {
+        case REQ_AS:
+            if (client_name == NULL || password == NULL)
+                usage();
+            break;
+        case REQ_AS_FAST:
+            if (client_name == NULL || password == NULL || ccname == NULL)
+                usage();
+            break;
+        case REQ_AS_ANON:
+            if (client_name == NULL)
+                usage();
+            break;
+        case REQ_TGS:
+            if (ccname == NULL || server_name == NULL)
+                usage();
+            break;
+        case REQ_CROSS:
+            if (ccname == NULL || cross_name == NULL)
+                usage();
+            break;
+        case REQ_S4U2SELF:
+            if (ccname == NULL || user_name == NULL)
+                usage();
+            break;
+        case REQ_S4U2PROXY:
+            if (ccname == NULL || user_name == NULL || target_name == NULL ||
+                keytab_name == NULL)
+                usage();
+            need_evidence = TRUE;
+            break;
+        default:
+            abort();
+        }
+    }
+
+    nslots = (long)(rate * duration);
+    latency = calloc(nslots, sizeof(*latency));
+    result = calloc(nslots, sizeof(*result));
+    workers = calloc(nthreads, sizeof(*workers));
+    if (latency == NULL || result == NULL || workers == NULL)
+        abort();
+
+    /* Set up all of the threads before starting the clock. */
+    for (i = 0; i < nthreads; i++)
+        init_worker(&workers[i], need_evidence);
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(&workers[i].tid, NULL, run_worker,
+                           &workers[i]) != 0)
+            abort();
+    }
+    for (i = 0; i < nthreads; i++)
+        pthread_join(workers[i].tid, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+
+    report(elapsed_ms(&start_time, &end_time) / 1000.0);
+
+    for (i = 0; i < nthreads; i++)
+        fini_worker(&workers[i]);
+    free(workers);
+    free(latency);
+    free(result);
+    return 0;
+}
@@ -0,0 +1,53 @@
+#!/usr/bin/python
+from k5test import *
+import time
+
+# Measure KDC request throughput with worker processes (-w) and with
+# request threads (-t).  This script is not run by "make check"; run it
+# with "make bench" in this directory.  Each kdc5_hammer client makes
+# one AS request and one TGS request per principal per round.
+
+nprincs = 100
+rounds = 5
+nclients = 4
+nworkers = 4
+
+hammer = os.path.join(buildtop, 'tests', 'hammer', 'kdc5_hammer')
+
+realm = K5Realm(create_host=False, start_kdc=False)
+
+# kdc5_hammer uses each principal's full name as its password.
+cmds = []
+for n in range(1, nprincs + 1):
+    name = 'hammer%d-DEPTH-1' % n
+    cmds.append('addprinc -pw %s@%s %s' % (name, realm.realm, name))
+realm.run([kadminl], input='\n'.join(cmds) + '\n')
+
+def bench(kdc_args, label):
+    realm.start_kdc(kdc_args)
+    devnull = open(os.devnull, 'w')
+    procs = []
+    start = time.time()
+    for i in range(nclients):
+        env = realm.env.copy()
+        env['KRB5CCNAME'] = os.path.join(realm.testdir, 'hammer_ccache%d' % i)
+        args = [hammer, '-p', 'hammer', '-n', str(nprincs), '-R', str(rounds),
+                '-b']
+        procs.append(subprocess.Popen(args, env=env, stdout=devnull,
+                                      stderr=devnull))
+    codes = [p.wait() for p in procs]
+    elapsed = time.time() - start
+    realm.stop_kdc()
+    devnull.close()
+    if any(codes):
+        fail('kdc5_hammer reported errors with KDC options %s' % kdc_args)
+
+    nreqs = nclients * rounds * nprincs
+    sys.stdout.write('%-12s %6d AS + %6d TGS in %7.2fs: %8.1f requests/sec\n' %
+                     (label, nreqs, nreqs, elapsed, 2 * nreqs / elapsed))
+
+bench([], 'single')
+bench(['-w', str(nworkers)], '-w %d' % nworkers)
+bench(['-t', str(nworkers)], '-t %d' % nworkers)
+
+success('KDC throughput benchmark')
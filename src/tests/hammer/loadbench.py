@@ -0,0 +1,121 @@
+#!/usr/bin/python
+from k5test import *
+
+# Measure KDC latency and throughput under fixed offered loads for
+# each kind of request kdc5_bench can issue, over UDP and TCP.  This
+# script is not run by "make check"; run it with "make loadbench" in
+# this directory.  For each transport and request type, the offered
+# rate is stepped through the values in rates, giving a throughput and
+# latency curve; a final run offers an even mix of all request types.
+
+rates = [50, 100, 200, 400]
+duration = 3
+nthreads = 32
+kdc_args = []
+
+bench = os.path.join(buildtop, 'tests', 'hammer', 'kdc5_bench')
+
+have_pkinit = os.path.exists(os.path.join(plugins, 'preauth', 'pkinit.so'))
+certs = os.path.join(srctop, 'tests', 'dejagnu', 'pkinit-certs')
+anchors = 'FILE:%s' % os.path.join(certs, 'ca.pem')
+pkinit_krb5_conf = {'libdefaults': {'pkinit_anchors': anchors}}
+kdc_conf = {'realms': {'$realm': {'default_principal_flags': '+preauth'}}}
+if have_pkinit:
+    kdc_conf['realms']['$realm'].update({
+            'pkinit_anchors': anchors,
+            'pkinit_eku_checking': 'none',
+            'pkinit_identity': 'FILE:%s,%s' % (
+                os.path.join(certs, 'kdc.pem'),
+                os.path.join(certs, 'privkey.pem'))})
+
+# Two DB2 realms with cross-realm TGTs, for everything except
+# S4U2Proxy.  The first realm uses the default realm name so that it
+# matches the KDC certificate.
+args1 = {'realm': 'KRBTEST.COM', 'kdc_conf': kdc_conf,
+         'krb5_conf': pkinit_krb5_conf}
+r1, r2 = cross_realms(2, args=(args1, None), start_kdc=False,
+                      get_creds=False)
+if have_pkinit:
+    r1.addprinc('WELLKNOWN/ANONYMOUS')
+
+# The DB2 module does not permit constrained delegation, so use the
+# test KDB module for S4U2Proxy.
+testprincs = {'krbtgt/KRBTEST3.COM': {'keys': 'aes128-cts'},
+              'user': {'keys': 'aes128-cts'},
+              'service/1': {'flags': '+ok-to-auth-as-delegate',
+                            'keys': 'aes128-cts'},
+              'service/2': {'keys': 'aes128-cts'}}
+conf = {'realms': {'$realm': {'database_module': 'test'}},
+        'dbmodules': {'test': {'db_library': 'test',
+                               'princs': testprincs,
+                               'delegation': {'service/1': 'service/2'}}}}
+r3 = K5Realm(realm='KRBTEST3.COM', testdir=os.path.join('testdir', '3'),
+             portbase=61040, create_kdb=False, kdc_conf=conf,
+             start_kdc=False, get_creds=False)
+service1 = 'service/1@KRBTEST3.COM'
+r3.extract_keytab(service1, r3.keytab)
+
+def tcp_env(realm):
+    return realm.special_env('tcp', False, krb5_conf={
+            'libdefaults': {'udp_preference_limit': '1'}})
+
+# Parse kdc5_bench output into a dictionary of per-type results.
+def run_bench(realm, env, mix, rate, args):
+    cmd = [bench, '-m', mix, '-r', str(rate), '-d', str(duration),
+           '-n', str(nthreads)] + args
+    out = realm.run(cmd, env=env)
+    results = {}
+    for line in out.splitlines():
+        if not line.startswith('type='):
+            continue
+        fields = dict(f.split('=', 1) for f in line.split())
+        results[fields['type']] = fields
+    return results
+
+def show(transport, offered, r):
+    sys.stdout.write('%-4s %-10s %6d %8s %6s %9s %9s %9s\n' %
+                     (transport, r['type'], offered, r['tput'], r['errors'],
+                      r['p50'], r['p99'], r['p999']))
+
+def curves(realm, transport, env, types, args):
+    for t in types:
+        for rate in rates:
+            r = run_bench(realm, env, t, rate, args)[t]
+            show(transport, rate, r)
+    mix = ','.join(types)
+    results = run_bench(realm, env, mix, rates[-1], args)
+    for t in types:
+        show(transport, rates[-1] / len(types), results[t])
+        if results[t]['errors'] != '0':
+            fail('kdc5_bench reported errors for %s' % t)
+
+sys.stdout.write('%-4s %-10s %6s %8s %6s %9s %9s %9s\n' %
+                 ('xprt', 'type', 'offer', 'req/s', 'errs', 'p50 ms',
+                  'p99 ms', 'p999 ms'))
+
+r1.start_kdc(kdc_args)
+r2.start_kdc(kdc_args)
+r1.kinit(r1.user_princ, password('user'))
+svc_ccache = os.path.join(r1.testdir, 'svc_ccache')
+r1.kinit(r1.host_princ, flags=['-k', '-f', '-c', svc_ccache])
+types = ['as', 'as-fast', 'tgs', 'cross']
+if have_pkinit:
+    types.append('as-anon')
+user_args = ['-p', r1.user_princ, '-w', password('user'), '-c', r1.ccache,
+             '-s', r1.host_princ, '-x', r2.host_princ]
+svc_args = ['-c', svc_ccache, '-u', r1.user_princ]
+for transport, env1 in (('udp', r1.env), ('tcp', tcp_env(r1))):
+    curves(r1, transport, env1, types, user_args)
+    curves(r1, transport, env1, ['s4u2self'], svc_args)
+r1.stop_kdc()
+r2.stop_kdc()
+
+r3.start_kdc(kdc_args)
+r3.kinit(service1, flags=['-k', '-f'])
+proxy_args = ['-c', r3.ccache, '-u', 'user@KRBTEST3.COM',
+              '-t', 'service/2@KRBTEST3.COM', '-k', r3.keytab]
+for transport, env3 in (('udp', r3.env), ('tcp', tcp_env(r3))):
+    curves(r3, transport, env3, ['s4u2proxy'], proxy_args)
+r3.stop_kdc()
+
+success('KDC load benchmark')
@@ -1,10 +1,19 @@
 #!/usr/bin/python
 from k5test import *
 
+import struct
+import time
+
 conf = {'plugins': {'audit': {
-            'module': 'test:$plugins/audit/test/k5audit_test.so'}}}
+            'module': ['test:$plugins/audit/test/k5audit_test.so',
+                       'binary:$plugins/audit/binary/k5audit_binary.so']}}}
+# Use a small buffer and a long flush interval so that batches are
+# written when the buffer fills and when the KDC stops.
+kdc_conf = {'kdcdefaults': {'audit_binary_output': 'FILE:$testdir/au.bin',
+                            'audit_binary_buffer_size': '1024',
+                            'audit_binary_flush_interval': '1h'}}
 
-realm = K5Realm(krb5_conf=conf, get_creds=False)
+realm = K5Realm(krb5_conf=conf, kdc_conf=kdc_conf, get_creds=False)
 realm.addprinc('target')
 realm.run([kadminl, 'modprinc', '+ok_to_auth_as_delegate', realm.host_princ])
 
@@ -25,4 +34,67 @@ realm.start_server([uuserver, port_arg], 'Server started')
 realm.run([uuclient, hostname, 'testing message', port_arg],
           expected_msg='Hello')
 
+# Decode the binary audit records written by the binary module.
+def read_records(path):
+    f = open(path, 'rb')
+    data = f.read()
+    f.close()
+    records = []
+    while data:
+        length, = struct.unpack('>I', data[:4])
+        rec, data = data[4:4 + length], data[4 + length:]
+        version, event, flags, reserved, t = struct.unpack('>BBBBI', rec[:8])
+        if version != 1 or len(rec) != length:
+            fail('Malformed binary audit record')
+        fields = {}
+        pos = 8
+        while pos < len(rec):
+            tag, flen = struct.unpack('>BH', rec[pos:pos + 3])
+            fields[tag] = rec[pos + 3:pos + 3 + flen]
+            pos += 3 + flen
+        records.append((event, flags & 1, fields))
+    return records
+
+def princ_name(val):
+    ntype, ncomps, rlen = struct.unpack('>iHH', val[:8])
+    realm, pos = val[8:8 + rlen], 8 + rlen
+    comps = []
+    for i in range(ncomps):
+        clen, = struct.unpack('>H', val[pos:pos + 2])
+        comps.append(val[pos + 2:pos + 2 + clen])
+        pos += 2 + clen
+    return '/'.join(comps) + '@' + realm
+
+# Stop the KDC so that the final batch is written out.
+realm.stop_kdc()
+records = read_records(os.path.join(realm.testdir, 'au.bin'))
+events = [r[0] for r in records]
+if events[0] != 1 or events[-1] != 2:
+    fail('Expected KDC start and stop binary audit records')
+for ev in (3, 4, 5, 6, 7):
+    if ev not in events:
+        fail('Missing binary audit record for event %d' % ev)
+as_reqs = [r for r in records if r[0] == 3 and r[1]]
+if princ_name(as_reqs[0][2][12]) != realm.host_princ:
+    fail('Wrong client principal in binary AS-REQ record')
+proxy = [r for r in records if r[0] == 6][0]
+if proxy[1] or 11 not in proxy[2]:
+    fail('Expected failed S4U2Proxy record with a violation')
+if len(records) < 10:
+    fail('Expected more binary audit records')
+realm.stop()
+
+# With a short flush interval, a partly filled batch is written out by
+# the module's timer while the KDC is still running and idle.
+kdc_conf = {'kdcdefaults': {'audit_binary_output': 'FILE:$testdir/au2.bin',
+                            'audit_binary_flush_interval': '1s'}}
+realm = K5Realm(krb5_conf=conf, kdc_conf=kdc_conf)
+au2 = os.path.join(realm.testdir, 'au2.bin')
+for i in range(50):
+    if os.path.exists(au2) and 3 in [r[0] for r in read_records(au2)]:
+        break
+    time.sleep(0.2)
+else:
+    fail('Binary audit batch was not written by the flush timer')
+
 success('Audit tests')
@@ -96,4 +96,51 @@ realm.run([kadminl, 'getprinc', 'user'], expected_msg='Policy: [none]')
 realm.run([kdb5_util, 'load', '-update', '-ov', srcdump_ov])
 realm.run([kadminl, 'getprinc', 'user'], expected_msg='Policy: testpol')
 
+# Add enough principals to fill several batches, and check that dumps
+# and loads using worker threads match serial ones.
+realm.run([kadminl], input=''.join('addprinc -nokey bulk%d\n' % i
+                                   for i in range(2000)))
+serialdump = os.path.join(realm.testdir, 'dump.serial')
+realm.run([kdb5_util, 'dump', serialdump])
+realm.run([kdb5_util, 'dump', '-threads', '3', dumpfile])
+if not cmp(serialdump, dumpfile, False):
+    fail('Threaded dump output does not match serial dump')
+realm.run([kdb5_util, 'load', '-threads', '3', dumpfile])
+dump_compare(realm, [], serialdump)
+realm.run([kdb5_util, 'load', '-update', '-threads', '3', dumpfile])
+dump_compare(realm, [], serialdump)
+
+# Dump in binary format, load it, and check that nothing changed.
+bindump = os.path.join(realm.testdir, 'dump.bin')
+realm.run([kdb5_util, 'dump', '-binary', bindump])
+realm.run([kdb5_util, 'load', bindump])
+dump_compare(realm, [], serialdump)
+
+# Restore a single principal from the binary dump using its index.
+realm.run([kadminl, 'delprinc', '-force', 'bulk100'])
+realm.run([kdb5_util, 'load', '-update', bindump, 'bulk100'])
+dump_compare(realm, [], serialdump)
+realm.run([kdb5_util, 'load', '-update', bindump, 'nonexistent'],
+          expected_code=1,
+          expected_msg='principal nonexistent@KRBTEST.COM not found')
+
+# Selecting principals without -update would replace the database
+# with only those principals, so it is refused.
+realm.run([kdb5_util, 'load', bindump, 'bulk100'], expected_code=1,
+          expected_msg='principals can only be selected with the -update')
+dump_compare(realm, [], serialdump)
+
+# Flip a byte in the payload of the first data block, which follows
+# the 32-byte header line and the 8-byte block header, and check that
+# the block checksum catches it.
+with open(bindump, 'rb') as f:
+    bindata = bytearray(f.read())
+bindata[32 + 8 + 16] ^= 1
+corruptdump = os.path.join(realm.testdir, 'dump.bin.corrupt')
+with open(corruptdump, 'wb') as f:
+    f.write(bindata)
+realm.run([kdb5_util, 'load', corruptdump], expected_code=1,
+          expected_msg='corrupt block at offset 32 of')
+dump_compare(realm, [], serialdump)
+
 success('Dump/load tests')
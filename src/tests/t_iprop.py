@@ -448,4 +448,41 @@ check_ulog(1, 1, 1, [None], slave1)
 realm.run([kadminl, 'getpol', 'testpol'], env=slave1,
           expected_msg='Minimum number of password character classes: 3')
 
+# Test group commit in kadmind.  With a long commit delay, an update
+# made through kadmind should leave the master ulog header unstable
+# until kadmind commits it before serving it to a slave.
+realm.stop_kadmind()
+commit_conf = {'realms': {'$realm': {'iprop_commit_delay': '3600000'}}}
+realm.start_kadmind(env=realm.special_env('commit', True,
+                                          kdc_conf=commit_conf))
+realm.addprinc(realm.admin_princ, password('admin'))
+realm.prep_kadmin()
+realm.run_kadmin(['modprinc', '-maxlife', '10 minutes', pr1])
+check_ulog(3, 1, 3, [None, realm.admin_princ, pr1])
+realm.run([kproplog, '-h'], expected_msg='Log state : Unstable')
+out = realm.run_kpropd_once(slave1, ['-d'])
+if 'Got incremental updates (sno=3 ' not in out:
+    fail('Expected incremental updates from kpropd -t')
+realm.run([kproplog, '-h'], expected_msg='Log state : Stable')
+realm.run([kadminl, 'getprinc', pr1], env=slave1,
+          expected_msg='Maximum ticket life: 0 days 00:10:00')
+
+# Test a slave which waits for updates instead of polling.  With a
+# long poll interval and no SIGUSR1, a change made through kadmind
+# should still reach the slave promptly.
+realm.stop_kadmind()
+realm.start_kadmind()
+conf_slave1w = {'realms': {'$realm': {'iprop_slave_poll': '600',
+                                      'iprop_slave_wait': 'true',
+                                      'iprop_logfile': '$testdir/ulog.slave1'}},
+                'dbmodules': {'db': {'database_name': '$testdir/db.slave1'}}}
+slave1w = realm.special_env('slave1w', True, kdc_conf=conf_slave1w)
+kpropd1 = realm.start_kpropd(slave1w, ['-d'])
+wait_for_prop(kpropd1, False, 3, 3)
+realm.run_kadmin(['modprinc', '-maxlife', '15 minutes', pr1])
+wait_for_prop(kpropd1, False, 3, 4)
+realm.run([kadminl, 'getprinc', pr1], env=slave1,
+          expected_msg='Maximum ticket life: 0 days 00:15:00')
+stop_daemon(kpropd1)
+
 success('iprop tests')
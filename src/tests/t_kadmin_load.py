@@ -0,0 +1,111 @@
+#!/usr/bin/python
+from k5test import *
+import time
+
+# Load test for kadmind with worker threads: many kadmin clients run
+# at once, each creating, reading, and listing its own principals.
+# Check that every client sees its own writes, that the database ends
+# up with every principal, and that the update log recorded each write
+# exactly once.
+nclients = 16
+nprincs = 10
+
+plugin = os.path.join(buildtop, 'plugins', 'pwqual', 'test', 'pwqual_test.so')
+pconf = {'plugins': {'pwqual': {'module': 'sleep:' + plugin}}}
+conf = {'realms': {'$realm': {'kadmind_threads': '4',
+                              'iprop_enable': 'true',
+                              'iprop_logfile': '$testdir/db.ulog'}}}
+realm = K5Realm(create_host=False, start_kadmind=True, krb5_conf=pconf,
+                kdc_conf=conf)
+realm.prep_kadmin()
+
+def ulog_serials():
+    out = realm.run([kproplog])
+    return [int(l.split(':')[1]) for l in out.splitlines()
+            if l.strip().startswith('Update serial #')]
+
+base = ulog_serials()[-1]
+
+def client_input(c):
+    lines = []
+    for i in range(nprincs):
+        name = 'c%d_p%d' % (c, i)
+        lines.append('addprinc -nokey %s' % name)
+        lines.append('getprinc %s' % name)
+        lines.append('setstr %s client %d' % (name, c))
+        lines.append('getstrs %s' % name)
+        lines.append('listprincs c%d_*' % c)
+        lines.append('getpol nonexistent')
+    return '\n'.join(lines) + '\n'
+
+def check_output(c, out):
+    for i in range(nprincs):
+        name = 'c%d_p%d' % (c, i)
+        if ('Principal: %s@%s' % (name, realm.realm)) not in out:
+            fail('client %d did not read back %s' % (c, name))
+    if out.count('client: %d\n' % c) != nprincs:
+        fail('client %d got wrong string attribute output' % c)
+
+start = time.time()
+procs = []
+for c in range(nclients):
+    args = [kadmin, '-c', realm.kadmin_ccache]
+    procs.append(subprocess.Popen(args, stdin=subprocess.PIPE,
+                                  stdout=subprocess.PIPE,
+                                  stderr=subprocess.STDOUT, env=realm.env))
+for c, proc in enumerate(procs):
+    proc.stdin.write(client_input(c))
+    proc.stdin.close()
+for c, proc in enumerate(procs):
+    out = proc.stdout.read()
+    proc.wait()
+    output('*** kadmin client %d:\n%s' % (c, out))
+    if proc.returncode != 0:
+        fail('kadmin client %d exited with %d' % (c, proc.returncode))
+    check_output(c, out)
+elapsed = time.time() - start
+nrequests = nclients * nprincs * 6
+output('*** %d kadmin requests from %d clients in %.2f seconds\n' %
+       (nrequests, nclients, elapsed))
+
+out = realm.run_kadmin(['listprincs', 'c*_p*'])
+if len(out.splitlines()) != nclients * nprincs:
+    fail('Wrong number of principals after load test')
+
+# Each client made two writes per principal, and the update log should
+# hold one entry for each, in serial number order.
+nwrites = nclients * nprincs * 2
+if ulog_serials() != range(1, base + nwrites + 1):
+    fail('Update log does not record every write in order')
+
+# Clients using the old AUTH_GSSAPI flavor are answered by the main
+# thread, for reads and writes alike.
+oldauth = [kadmin, '-O', '-c', realm.kadmin_ccache]
+realm.run(oldauth + ['addprinc', '-nokey', 'oldauth'])
+realm.run(oldauth + ['getprinc', 'oldauth'],
+          expected_msg='Principal: oldauth@' + realm.realm)
+realm.run(oldauth + ['listprincs', 'old*'], expected_msg='oldauth@')
+
+# A write with a slow password quality check holds up neither reads
+# of other principals nor the main loop.
+start = time.time()
+slow = subprocess.Popen([kadmin, '-c', realm.kadmin_ccache, 'cpw', '-pw',
+                         'sleepy', realm.user_princ], stdout=subprocess.PIPE,
+                        stderr=subprocess.STDOUT, env=realm.env)
+time.sleep(0.5)
+realm.run_kadmin(['getprinc', 'c0_p0'], expected_msg='Principal: c0_p0@')
+realm.run(oldauth + ['getprinc', 'c0_p1'], expected_msg='Principal: c0_p1@')
+fast = time.time() - start
+out = slow.communicate()[0]
+slowtime = time.time() - start
+output('*** slow cpw: %.2f seconds; reads done after %.2f seconds\n' %
+       (slowtime, fast))
+if slow.returncode != 0:
+    fail('cpw with slow password quality check failed')
+if slowtime < 3:
+    fail('Password quality check did not run')
+if fast >= 2.5:
+    fail('Reads waited for slow password quality check')
+realm.kinit(realm.user_princ, 'sleepy')
+
+success('kadmind load test')
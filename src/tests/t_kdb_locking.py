@@ -30,5 +30,22 @@ f.close()
 output = realm.run([kadminl, 'modprinc', '-allow_tix', p])
 if 'Cannot lock database' in output:
     fail('krb5kdc still holds a lock on the principal db')
+realm.stop()
+
+# Test a KDC which keeps the principal DB open between lookups.  It
+# must notice changes made by kadmin and by a DB load.
+conf = {'dbmodules': {'db': {'keep_open': 'true'}}}
+realm = K5Realm(create_host=False, kdc_conf=conf)
+realm.addprinc('svc')
+realm.run([kvno, 'svc'], expected_msg='kvno = 1')
+realm.run([kadminl, 'cpw', '-randkey', 'svc'])
+realm.kinit(realm.user_princ, password('user'))
+realm.run([kvno, 'svc'], expected_msg='kvno = 2')
+dumpfile = os.path.join(realm.testdir, 'dump')
+realm.run([kdb5_util, 'dump', dumpfile])
+realm.run([kadminl, 'cpw', '-randkey', 'svc'])
+realm.run([kdb5_util, 'load', dumpfile])
+realm.kinit(realm.user_princ, password('user'))
+realm.run([kvno, 'svc'], expected_msg='kvno = 2')
 
 success('KDB locking tests')
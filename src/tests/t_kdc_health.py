@@ -0,0 +1,81 @@
+#!/usr/bin/python
+from k5test import *
+import socket
+
+# List a KDC which never answers ahead of the real one.  Bind a UDP
+# socket to its port so that requests to it are silently dropped
+# rather than refused.
+conf = {'realms': {'$realm': {'kdc': ['127.0.0.1:$port9',
+                                      '$hostname:$port0']}},
+        'libdefaults': {'kdc_health_file': '$testdir/kdc_health'}}
+realm = K5Realm(krb5_conf=conf, get_creds=False)
+silent_port = realm.portbase + 9
+silent = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+silent.bind(('127.0.0.1', silent_port))
+
+silent_send = ('Sending initial UDP request to dgram 127.0.0.1:%d' %
+               silent_port)
+marked_down = 'Marking KDC 127.0.0.1:%d down' % silent_port
+real_first = 'Trying KDC %s:%d first' % (hostname, realm.portbase)
+real_answered = 'KDC %s:%d answered in' % (hostname, realm.portbase)
+
+def kinit_trace(env):
+    tracefile = os.path.join(realm.testdir, 'trace')
+    if os.path.exists(tracefile):
+        os.remove(tracefile)
+    env = env.copy()
+    env['KRB5_TRACE'] = tracefile
+    realm.kinit(realm.user_princ, password('user'), env=env)
+    with open(tracefile) as f:
+        return f.read()
+
+def health_fields(path, port):
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if fields[1] == '127.0.0.1' and fields[2] == str(port):
+                return fields
+    fail('No health entry for port %d' % port)
+
+# With kdc_race_count = 2, both KDCs are contacted at once and the
+# real one answers before the silent one is considered to have timed
+# out.
+race_conf = {'libdefaults': {'kdc_race_count': '2',
+                             'kdc_health_file': '$testdir/kdc_health_race'}}
+race_env = realm.special_env('race', False, krb5_conf=race_conf)
+out = kinit_trace(race_env)
+if silent_send not in out or real_answered not in out:
+    fail('Expected both KDCs to be contacted with kdc_race_count = 2')
+if marked_down in out:
+    fail('Raced KDC marked down before its timeout')
+
+# Without racing, the silent KDC gets its full second and is marked
+# down.
+out = kinit_trace(realm.env)
+if silent_send not in out:
+    fail('Expected silent KDC to be contacted first')
+if marked_down + ' for 10 seconds after 1 failure(s)' not in out:
+    fail('Expected silent KDC to be marked down')
+fields = health_fields(os.path.join(realm.testdir, 'kdc_health'),
+                       silent_port)
+if fields[4] != '1':
+    fail('Expected one recorded failure for silent KDC')
+
+# A new process reads the shared file and never contacts the silent
+# KDC.
+out = kinit_trace(realm.env)
+if real_first not in out or real_answered not in out:
+    fail('Expected real KDC to be tried first from shared file')
+if silent_send in out:
+    fail('Silent KDC contacted while marked down')
+
+# An answer which changes neither the KDC's state nor (noticeably) its
+# RTT does not rewrite the shared file.
+health_path = os.path.join(realm.testdir, 'kdc_health')
+ino = os.stat(health_path).st_ino
+kinit_trace(realm.env)
+if os.stat(health_path).st_ino != ino:
+    fail('Health file rewritten without a state change')
+
+silent.close()
+success('KDC health tracking')
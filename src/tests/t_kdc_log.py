@@ -20,4 +20,41 @@ f.close()
 if not found_skew:
     fail('Did not find KDC log line for expired-ticket TGS request')
 
+realm.stop()
+
+def count_log(realm, text):
+    f = open(os.path.join(realm.testdir, 'kdc.log'), 'r')
+    n = len([line for line in f if text in line])
+    f.close()
+    return n
+
+# With asynchronous logging, every request should have been written
+# out by the time the KDC has shut down.  The small buffer makes the
+# request threads wait for the flusher at times.
+conf = {'logging': {'async': 'true', 'async_buffer_size': '1024'}}
+realm = K5Realm(kdc_conf=conf, start_kdc=False, get_creds=False)
+realm.start_kdc(['-t', '4'])
+for i in range(20):
+    realm.kinit(realm.user_princ, password('user'))
+realm.stop_kdc()
+if count_log(realm, 'ISSUE: authtime') != 20:
+    fail('Asynchronous logging lost AS request log lines')
+if count_log(realm, 'shutting down') != 1:
+    fail('Asynchronous logging lost shutdown message')
+realm.stop()
+
+# With a buffer too small to hold any message and the drop policy,
+# request messages are counted and reported instead of written.
+conf = {'logging': {'async': 'true', 'async_buffer_size': '16',
+                    'async_overflow': 'drop'}}
+realm = K5Realm(kdc_conf=conf, start_kdc=False, get_creds=False)
+realm.start_kdc()
+for i in range(5):
+    realm.kinit(realm.user_princ, password('user'))
+realm.stop_kdc()
+if count_log(realm, 'ISSUE: authtime') != 0:
+    fail('Asynchronous logging did not drop messages')
+if count_log(realm, 'log messages were dropped') == 0:
+    fail('Asynchronous logging did not report dropped messages')
+
 success('KDC logging tests')
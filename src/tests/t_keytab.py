@@ -67,6 +67,9 @@ def test_key_rotate(realm, princ, expected_kvno):
     realm.run_kadmin(['ktadd', '-k', realm.keytab, princ])
     realm.run([kadminl, 'ktrem', princ, 'old'])
     realm.kinit(princ, flags=['-k'])
+    # Check that the indexed MMAP keytab type makes the same choices.
+    realm.kinit(princ, flags=['-k', '-t', 'MMAP:' + realm.keytab])
+    realm.run([kvno, '-k', 'MMAP:' + realm.keytab, princ])
     msg = '%d %s' % (expected_kvno, princ)
     out = realm.run([klist, '-k'], expected_msg=msg)
     msg = 'Key: vno %d,' % expected_kvno
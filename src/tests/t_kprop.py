@@ -1,4 +1,8 @@
 #!/usr/bin/python
+import re
+import signal
+import time
+
 from k5test import *
 
 conf_slave = {'dbmodules': {'db': {'database_name': '$testdir/db.slave'}}}
@@ -11,13 +15,16 @@ def setup_acl(realm):
 
 def check_output(kpropd):
     output('*** kpropd output follows\n')
+    lines = []
     while True:
         line = kpropd.stdout.readline()
         if 'Database load process for full propagation completed' in line:
             break
         output('kpropd: ' + line)
+        lines.append(line)
         if 'Rejected connection' in line:
             fail('kpropd rejected connection from kprop')
+    return ''.join(lines)
 
 # kprop/kpropd are the only users of krb5_auth_con_initivector, so run
 # this test over all enctypes to exercise mkpriv cipher state.
@@ -89,4 +96,87 @@ realm.run([kprop, '-f', dumpfile, '-P', str(realm.kprop_port()), hostname])
 check_output(kpropd)
 realm.run([kadminl, 'listprincs'], slave3, expected_msg='wakawaka')
 
+# Test that a second propagation to slave3 reuses the unchanged parts
+# of the dump it received last time.
+realm.run([kadminl], input=''.join('addprinc -nokey user%d\n' % i
+                                   for i in range(200)))
+realm.run([kdb5_util, 'dump', dumpfile])
+realm.run([kprop, '-f', dumpfile, '-P', str(realm.kprop_port()), hostname])
+out = check_output(kpropd)
+# The dump is mostly new to the slave, so it is sent as literal data,
+# which should be compressed if zlib is available.
+m = re.search(r'Received (\d+) bytes \((\d+) on the wire\)', out)
+if m is None:
+    fail('Expected received byte counts in kpropd output')
+if runenv.have_zlib == 'yes' and int(m.group(2)) >= int(m.group(1)):
+    fail('Expected propagation to be compressed')
+realm.addprinc('wakawaka2')
+realm.run([kdb5_util, 'dump', dumpfile])
+realm.run([kprop, '-f', dumpfile, '-P', str(realm.kprop_port()), hostname])
+out = check_output(kpropd)
+m = re.search(r'(\d+) blocks copied from previous dump', out)
+if m is None or int(m.group(1)) == 0:
+    fail('Expected blocks to be copied from previous dump')
+realm.run([kadminl, 'listprincs'], slave3, expected_msg='wakawaka2')
+
+# Test that the load refuses a dump without a commit message, even if
+# the dump ends cleanly at a record boundary.
+truncfile = os.path.join(realm.testdir, 'dump.trunc')
+with open(dumpfile) as f:
+    lines = f.readlines()
+with open(truncfile, 'w') as f:
+    f.writelines(lines[:len(lines) // 2])
+(rfd, wfd) = os.pipe()
+os.close(wfd)
+realm.run([kdb5_util, 'load', '-commit_fd', str(rfd), truncfile], slave3,
+          expected_code=1, expected_msg='no commit message received')
+os.close(rfd)
+realm.run([kadminl, 'getprinc', 'wakawaka2'], slave3)
+
+# Kill kpropd partway through a transfer, with the load process
+# stopped so that it has only read part of the dump when kpropd dies.
+# The load must not commit what it received.
+realm.run([kadminl], input=''.join('addprinc -nokey kill%d\n' % i
+                                   for i in range(2000)))
+realm.run([kdb5_util, 'dump', dumpfile])
+kprop_proc = subprocess.Popen([kprop, '-f', dumpfile, '-P',
+                               str(realm.kprop_port()), hostname],
+                              stdout=subprocess.PIPE,
+                              stderr=subprocess.STDOUT, env=realm.env)
+while True:
+    line = kpropd.stdout.readline()
+    if line == '':
+        fail('kpropd exited during interrupted propagation')
+    output('kpropd: ' + line)
+    m = re.search(r'Load PID is (\d+)', line)
+    if m:
+        break
+load_pid = int(m.group(1))
+os.kill(load_pid, signal.SIGSTOP)
+time.sleep(1)
+doit_pid = int(realm.run(['ps', '-o', 'ppid=', '-p', str(load_pid)]))
+os.kill(doit_pid, signal.SIGKILL)
+os.kill(load_pid, signal.SIGCONT)
+output(kprop_proc.communicate()[0])
+if kprop_proc.returncode == 0:
+    fail('kprop succeeded after kpropd was killed')
+load_failed = doit_reaped = False
+while not load_failed or not doit_reaped:
+    line = kpropd.stdout.readline()
+    if line == '':
+        fail('kpropd exited during interrupted propagation')
+    output('kpropd: ' + line)
+    if 'restore failed' in line or 'no commit message received' in line:
+        load_failed = True
+    if 'Database load process for full propagation completed' in line:
+        doit_reaped = True
+realm.run([kadminl, 'getprinc', 'kill0'], slave3, expected_code=1,
+          expected_msg='Principal does not exist')
+realm.run([kadminl, 'getprinc', 'wakawaka2'], slave3)
+
+# The next propagation succeeds.
+realm.run([kprop, '-f', dumpfile, '-P', str(realm.kprop_port()), hostname])
+check_output(kpropd)
+realm.run([kadminl, 'getprinc', 'kill1999'], slave3)
+
 success('kprop tests')
@@ -0,0 +1,65 @@
+#!/usr/bin/python
+from k5test import *
+import time
+
+# Buffer last_success updates for up to an hour, so that they are only
+# written out when the KDC exits.
+conf = {'dbmodules': {'db': {'last_success_interval': '1h'}}}
+realm = K5Realm(create_host=False, start_kdc=False, get_creds=False,
+                kdc_conf=conf)
+tracefile = os.path.join(realm.testdir, 'kdctrace')
+kdc_env = realm.env.copy()
+kdc_env['KRB5_TRACE'] = tracefile
+
+realm.run([kadminl, 'addpol', '-maxfailure', '2', '-failurecountinterval',
+           '5m', 'lockout'])
+realm.run([kadminl, 'modprinc', '+requires_preauth', '-policy', 'lockout',
+           'user'])
+
+def last_success():
+    out = realm.run([kadminl, 'getprinc', 'user'])
+    for line in out.splitlines():
+        if line.startswith('Last successful authentication:'):
+            return line.split(':', 1)[1].strip()
+    fail('no last success field in getprinc output')
+
+# Successful authentications are not written to the DB right away.
+realm.start_kdc(env=kdc_env)
+realm.kinit(realm.user_princ, password('user'))
+realm.kinit(realm.user_princ, password('user'))
+realm.kinit(realm.user_princ, password('user'))
+if last_success() != '[never]':
+    fail('last_success was written without buffering')
+
+# They are flushed in one write when the KDC shuts down.
+realm.stop_kdc()
+if last_success() == '[never]':
+    fail('buffered last_success was not flushed')
+with open(tracefile) as f:
+    trace = f.read()
+if 'Flushed 1 buffered last-success updates; 2 DB writes avoided' not in trace:
+    fail('expected flush trace message not found')
+
+# Failures are still counted exactly.
+realm.start_kdc()
+realm.run([kinit, realm.user_princ], input='wrong\n', expected_code=1,
+          expected_msg='Password incorrect while getting initial credentials')
+realm.run([kinit, realm.user_princ], input='wrong\n', expected_code=1,
+          expected_msg='Password incorrect while getting initial credentials')
+m = 'Client\'s credentials have been revoked while getting initial credentials'
+realm.run([kinit, realm.user_princ], expected_code=1, expected_msg=m)
+realm.stop()
+
+# With a short interval, an idle KDC writes out buffered updates once
+# the oldest of them is an interval old.
+conf = {'dbmodules': {'db': {'last_success_interval': '2s'}}}
+realm = K5Realm(create_host=False, get_creds=False, kdc_conf=conf)
+realm.run([kadminl, 'modprinc', '+requires_preauth', 'user'])
+realm.kinit(realm.user_princ, password('user'))
+if last_success() != '[never]':
+    fail('last_success was written without buffering')
+time.sleep(4)
+if last_success() == '[never]':
+    fail('buffered last_success was not flushed while the KDC was idle')
+
+success('Buffered last_success updates')
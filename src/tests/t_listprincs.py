@@ -0,0 +1,53 @@
+#!/usr/bin/python
+from k5test import *
+import fnmatch
+
+# Test that listprincs returns complete, ordered results when the
+# names span several pages of the paginated listing interface, both
+# locally and through kadmind.
+realm = K5Realm(create_host=False, start_kadmind=True)
+realm.prep_kadmin()
+
+nprincs = 2500
+cmds = ['addprinc -nokey p%04d' % i for i in range(nprincs)]
+cmds += ['addprinc -nokey q%04d/admin' % i for i in range(10)]
+realm.run([kadminl], input='\n'.join(cmds) + '\n')
+
+allnames = realm.run([kadminl, 'listprincs']).splitlines()
+names = [n.split('@')[0] for n in allnames]
+
+def check(glob, progs=([kadminl], [kadmin, '-c', realm.kadmin_ccache])):
+    expected = [n for n in names if fnmatch.fnmatchcase(n, glob)]
+    for prog in progs:
+        out = realm.run(prog + ['listprincs', glob]).splitlines()
+        got = [n.split('@')[0] for n in out]
+        if got != expected:
+            fail('listprincs %s returned %d names, expected %d' %
+                 (glob, len(got), len(expected)))
+
+if len(names) < nprincs + 10 or allnames != sorted(allnames):
+    fail('listprincs did not return every principal in order')
+check('*')
+check('p*')
+check('p1*')
+check('p?5*')
+check('[pq]000*')
+check('q*/admin')
+check('nonexistent*')
+
+# The glob is matched against the realm too, and a missing realm
+# matches any realm.
+out = realm.run_kadmin(['listprincs', 'p0001@' + realm.realm])
+if out != 'p0001@%s\n' % realm.realm:
+    fail('listprincs with realm')
+
+# A hash database cannot be walked in order, so the server must sort
+# the names itself.
+dumpfile = os.path.join(realm.testdir, 'dump')
+realm.run([kdb5_util, 'dump', dumpfile])
+realm.run([kdb5_util, 'load', '-hash', dumpfile])
+check('*', [[kadminl]])
+check('p1*', [[kadminl]])
+check('p?5*', [[kadminl]])
+
+success('Paginated listprincs')
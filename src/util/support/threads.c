@@ -117,6 +117,11 @@ struct tsd_block {
 # pragma weak pthread_mutex_unlock
 # pragma weak pthread_mutex_destroy
 # pragma weak pthread_mutex_init
+# pragma weak pthread_rwlock_init
+# pragma weak pthread_rwlock_destroy
+# pragma weak pthread_rwlock_rdlock
+# pragma weak pthread_rwlock_wrlock
+# pragma weak pthread_rwlock_unlock
 # pragma weak pthread_self
 # pragma weak pthread_equal
 # pragma weak pthread_getspecific
@@ -561,6 +566,51 @@ k5_os_mutex_unlock(k5_os_mutex *m)
         return 0;
 }
 
+int
+k5_os_rwlock_init(k5_os_rwlock *l)
+{
+    if (krb5int_pthread_loaded())
+        return pthread_rwlock_init(l, 0);
+    else
+        return 0;
+}
+
+int
+k5_os_rwlock_destroy(k5_os_rwlock *l)
+{
+    if (krb5int_pthread_loaded())
+        return pthread_rwlock_destroy(l);
+    else
+        return 0;
+}
+
+int
+k5_os_rwlock_rdlock(k5_os_rwlock *l)
+{
+    if (krb5int_pthread_loaded())
+        return pthread_rwlock_rdlock(l);
+    else
+        return 0;
+}
+
+int
+k5_os_rwlock_wrlock(k5_os_rwlock *l)
+{
+    if (krb5int_pthread_loaded())
+        return pthread_rwlock_wrlock(l);
+    else
+        return 0;
+}
+
+int
+k5_os_rwlock_unlock(k5_os_rwlock *l)
+{
+    if (krb5int_pthread_loaded())
+        return pthread_rwlock_unlock(l);
+    else
+        return 0;
+}
+
 int
 k5_once(k5_once_t *once, void (*fn)(void))
 {
@@ -576,12 +626,22 @@ k5_once(k5_once_t *once, void (*fn)(void))
 #undef k5_os_mutex_destroy
 #undef k5_os_mutex_lock
 #undef k5_os_mutex_unlock
+#undef k5_os_rwlock_init
+#undef k5_os_rwlock_destroy
+#undef k5_os_rwlock_rdlock
+#undef k5_os_rwlock_wrlock
+#undef k5_os_rwlock_unlock
 #undef k5_once
 
 int k5_os_mutex_init(k5_os_mutex *m);
 int k5_os_mutex_destroy(k5_os_mutex *m);
 int k5_os_mutex_lock(k5_os_mutex *m);
 int k5_os_mutex_unlock(k5_os_mutex *m);
+int k5_os_rwlock_init(k5_os_rwlock *l);
+int k5_os_rwlock_destroy(k5_os_rwlock *l);
+int k5_os_rwlock_rdlock(k5_os_rwlock *l);
+int k5_os_rwlock_wrlock(k5_os_rwlock *l);
+int k5_os_rwlock_unlock(k5_os_rwlock *l);
 int k5_once(k5_once_t *once, void (*fn)(void));
 
 /* Stub functions */
@@ -606,6 +666,31 @@ k5_os_mutex_unlock(k5_os_mutex *m)
     return 0;
 }
 int
+k5_os_rwlock_init(k5_os_rwlock *l)
+{
+    return 0;
+}
+int
+k5_os_rwlock_destroy(k5_os_rwlock *l)
+{
+    return 0;
+}
+int
+k5_os_rwlock_rdlock(k5_os_rwlock *l)
+{
+    return 0;
+}
+int
+k5_os_rwlock_wrlock(k5_os_rwlock *l)
+{
+    return 0;
+}
+int
+k5_os_rwlock_unlock(k5_os_rwlock *l)
+{
+    return 0;
+}
+int
 k5_once(k5_once_t *once, void (*fn)(void))
 {
     return 0;